@@ -0,0 +1,73 @@
+// Memory benchmark: resident memory of the NM file index.
+// Loads N files spread over a realistic namespace (1000 folders, 50 owners,
+// 2 storage servers) and reports the RSS growth, the heap the index itself
+// accounts for, and bytes per file. For comparison it also prints what the
+// previous layout (one malloc'd FileEntry of fixed arrays plus three list
+// pointers per file, 1024 fixed buckets) would have needed.
+//
+// Usage: ./bin_bench_index_memory [files]   (default 1000000)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/nm/index.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Resident set size in bytes, from /proc/self/statm
+static size_t rss_bytes(void) {
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long size = 0, resident = 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char **argv) {
+    int file_count = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (file_count <= 0) file_count = 1000000;
+
+    index_init();
+    size_t rss_before = rss_bytes();
+
+    char path[128], owner[32];
+    double t0 = now_sec();
+    for (int i = 0; i < file_count; i++) {
+        snprintf(path, sizeof(path), "/projects/team%d/notes_%07d.txt", i % 1000, i);
+        snprintf(owner, sizeof(owner), "user%d", i % 50);
+        int primary = i & 1;
+        index_add_file(path, owner, primary ? "10.0.0.11" : "10.0.0.12",
+                       primary ? 6001 : 6002, primary ? "ss1" : "ss2", NULL);
+    }
+    double load = now_sec() - t0;
+
+    size_t rss_after = rss_bytes();
+    IndexStats stats;
+    index_get_stats(&stats);
+
+    // Previous layout: FileEntry + next/lru_prev/lru_next, ~16 bytes malloc
+    // overhead per allocation, plus the fixed bucket array
+    size_t legacy = (size_t)file_count * (sizeof(FileEntry) + 3 * sizeof(void *) + 16)
+                    + 1024 * sizeof(void *);
+    size_t rss_delta = rss_after > rss_before ? rss_after - rss_before : 0;
+
+    printf("files=%zu load=%.2fs interned_strings=%zu buckets=%zu\n",
+           stats.files, load, stats.interned_strings, stats.buckets);
+    printf("rss growth:      %10.1f MB  (%6.1f bytes/file)\n",
+           rss_delta / 1048576.0, (double)rss_delta / file_count);
+    printf("index heap:      %10.1f MB  (%6.1f bytes/file)\n",
+           stats.memory_bytes / 1048576.0, (double)stats.memory_bytes / file_count);
+    printf("legacy estimate: %10.1f MB  (%6.1f bytes/file)\n",
+           legacy / 1048576.0, (double)legacy / file_count);
+    if (rss_delta > 0) {
+        printf("reduction vs legacy (rss): %.1fx\n", (double)legacy / rss_delta);
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+// Restart benchmark: NM index cold restore from snapshot + write-ahead log.
+// Builds an index of N files (same namespace shape as bench_index_memory),
+// checkpoints it into a state directory, then journals a tail of extra
+// mutations (creates, metadata updates, deletes) that only exist in the log.
+// It then re-executes itself in a fresh process, which times index_init() +
+// index_wal_open() (mmap the snapshot, replay the log) and checks the file
+// count. For comparison it also reports how long the initial build took,
+// which is the floor for rebuilding the index from SS re-registration.
+//
+// Usage: ./bin_bench_index_restore [files] [log_records] [state_dir]
+//        (default 1000000 10000 /tmp/nm_bench_state)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/common/log.h"
+#include "../src/nm/index.h"
+#include "../src/nm/index_wal.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void file_path(int i, char *buf, size_t len) {
+    snprintf(buf, len, "/projects/team%d/notes_%07d.txt", i % 1000, i);
+}
+
+static void add_file(int i) {
+    char path[128], owner[32];
+    file_path(i, path, sizeof(path));
+    snprintf(owner, sizeof(owner), "user%d", i % 50);
+    int primary = i & 1;
+    index_add_file(path, owner, primary ? "10.0.0.11" : "10.0.0.12",
+                   primary ? 6001 : 6002, primary ? "ss1" : "ss2", NULL);
+}
+
+// Child: cold restore, print "<files> <seconds>"
+static int restore(const char *dir) {
+    double t0 = now_sec();
+    index_init();
+    if (index_wal_open(dir) != 0) return 1;
+    double elapsed = now_sec() - t0;
+
+    IndexStats stats;
+    index_get_stats(&stats);
+    printf("%zu %.6f\n", stats.files, elapsed);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    log_set_file("/dev/null");
+    if (argc > 2 && strcmp(argv[1], "--restore") == 0) return restore(argv[2]);
+
+    int file_count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int log_records = argc > 2 ? atoi(argv[2]) : 10000;
+    const char *dir = argc > 3 ? argv[3] : "/tmp/nm_bench_state";
+    if (file_count <= 0) file_count = 1000000;
+    if (log_records < 0) log_records = 0;
+
+    char path[1024];
+    const char *files[] = {"index.snap", "index.wal", "index.wal.old"};
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+
+    // Build, then persist
+    index_init();
+    double t0 = now_sec();
+    for (int i = 0; i < file_count; i++) add_file(i);
+    double build = now_sec() - t0;
+
+    if (index_wal_open(dir) != 0) {
+        fprintf(stderr, "cannot open state dir %s\n", dir);
+        return 1;
+    }
+    t0 = now_sec();
+    if (index_wal_checkpoint() != 0) {
+        fprintf(stderr, "checkpoint failed\n");
+        return 1;
+    }
+    double checkpoint = now_sec() - t0;
+
+    // Log-only tail: a third each of creates, metadata updates and deletes
+    t0 = now_sec();
+    int expected = file_count;
+    for (int i = 0; i < log_records; i++) {
+        int n = i / 3;
+        if (i % 3 == 0) {
+            add_file(file_count + n);
+            expected++;
+        } else if (i % 3 == 1) {
+            file_path(n, path, sizeof(path));
+            index_update_metadata(path, 0, time(NULL), 1024, 200, 1024);
+        } else if (n < file_count) {
+            file_path(n, path, sizeof(path));
+            if (index_remove_file(path) == 0) expected--;
+        }
+    }
+    double journal = now_sec() - t0;
+
+    snprintf(path, sizeof(path), "%s/index.snap", dir);
+    FILE *fp = fopen(path, "rb");
+    long snap_bytes = 0;
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        snap_bytes = ftell(fp);
+        fclose(fp);
+    }
+
+    // Restore in a fresh process (no checkpoint on exit: the tail stays in the log)
+    fflush(stdout);
+    int pipefd[2];
+    if (pipe(pipefd) != 0) return 1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(pipefd[1], STDOUT_FILENO);
+        close(pipefd[0]);
+        execl("/proc/self/exe", argv[0], "--restore", dir, (char *)NULL);
+        _exit(127);
+    }
+    close(pipefd[1]);
+    FILE *child = fdopen(pipefd[0], "r");
+    size_t restored = 0;
+    double restore_sec = 0;
+    if (!child || fscanf(child, "%zu %lf", &restored, &restore_sec) != 2) {
+        fprintf(stderr, "restore child failed\n");
+        return 1;
+    }
+    fclose(child);
+    waitpid(pid, NULL, 0);
+
+    printf("files=%d log_records=%d snapshot=%.1f MB\n", file_count, log_records,
+           snap_bytes / 1048576.0);
+    printf("build (insert path): %8.3f s\n", build);
+    printf("checkpoint:          %8.3f s\n", checkpoint);
+    printf("journaled tail:      %8.3f s  (%.0f records/s)\n", journal,
+           journal > 0 ? log_records / journal : 0);
+    printf("cold restore:        %8.3f s  (%zu files, expected %d)%s\n", restore_sec,
+           restored, expected, (int)restored == expected ? "" : "  MISMATCH");
+    return (int)restored == expected ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+// Stress benchmark: concurrent NM index lookups under the index rwlock.
+// Preloads the index, then runs N reader threads doing index_get_file() on
+// random preloaded paths while M writer threads churn CREATE/DELETE-style
+// add/remove pairs on their own paths. Reader counts double from 1 up to the
+// number of online CPUs so lookup throughput scaling can be read directly.
+// The preload phase also reports the worst single insert, which bounds the
+// pause an incremental resize can cause.
+//
+// Usage: ./bin_bench_index_rwlock [files] [writers] [seconds]   (default 10000 1 1)
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/nm/index.h"
+
+typedef struct {
+    int id;
+    int file_count;
+    volatile int *stop;
+    unsigned long ops;
+} WorkerArg;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void preload_path(int i, char *buf, size_t len) {
+    snprintf(buf, len, "/dir%d/file%d.txt", i % 64, i);
+}
+
+static void *reader_thread(void *arg) {
+    WorkerArg *w = (WorkerArg*)arg;
+    unsigned int seed = 0x9e3779b9u * (unsigned int)(w->id + 1);
+    char path[128];
+    FileEntry entry;
+    while (!*w->stop) {
+        seed = seed * 1103515245u + 12345u;
+        preload_path((int)((seed >> 8) % (unsigned int)w->file_count), path, sizeof(path));
+        if (!index_get_file(path, &entry)) {
+            fprintf(stderr, "lookup miss: %s\n", path);
+            exit(1);
+        }
+        w->ops++;
+    }
+    return NULL;
+}
+
+static void *writer_thread(void *arg) {
+    WorkerArg *w = (WorkerArg*)arg;
+    char path[128];
+    int n = 0;
+    while (!*w->stop) {
+        snprintf(path, sizeof(path), "/churn/w%d_%d.txt", w->id, n++ % 256);
+        index_add_file(path, "bench", "127.0.0.1", 6001, "ss1", NULL);
+        index_remove_file(path);
+        w->ops++;
+    }
+    return NULL;
+}
+
+static void run(int readers, int writers, int file_count, double seconds,
+                double *base_rate) {
+    volatile int stop = 0;
+    pthread_t tids[readers + writers];
+    WorkerArg args[readers + writers];
+
+    for (int i = 0; i < readers + writers; i++) {
+        args[i] = (WorkerArg){i, file_count, &stop, 0};
+        pthread_create(&tids[i], NULL, i < readers ? reader_thread : writer_thread, &args[i]);
+    }
+
+    double t0 = now_sec();
+    struct timespec ts = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+    stop = 1;
+    for (int i = 0; i < readers + writers; i++) pthread_join(tids[i], NULL);
+    double elapsed = now_sec() - t0;
+
+    unsigned long reads = 0, writes = 0;
+    for (int i = 0; i < readers + writers; i++) {
+        if (i < readers) reads += args[i].ops;
+        else writes += args[i].ops;
+    }
+
+    double rate = reads / elapsed;
+    if (*base_rate == 0) *base_rate = rate;
+    printf("%-8d %-8d %14.0f %10.2fx %14.0f\n", readers, writers, rate,
+           rate / *base_rate, writes / elapsed);
+}
+
+int main(int argc, char **argv) {
+    int file_count = argc > 1 ? atoi(argv[1]) : 10000;
+    int writers = argc > 2 ? atoi(argv[2]) : 1;
+    double seconds = argc > 3 ? atof(argv[3]) : 1.0;
+    if (file_count <= 0) file_count = 10000;
+    if (writers < 0) writers = 0;
+    if (seconds <= 0) seconds = 1.0;
+
+    index_init();
+    char path[128];
+    double worst_insert = 0;
+    double t0 = now_sec();
+    for (int i = 0; i < file_count; i++) {
+        preload_path(i, path, sizeof(path));
+        double t = now_sec();
+        index_add_file(path, "bench", "127.0.0.1", 6001, "ss1", NULL);
+        t = now_sec() - t;
+        if (t > worst_insert) worst_insert = t;
+    }
+    double preload = now_sec() - t0;
+
+    IndexStats stats;
+    index_get_stats(&stats);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+
+    printf("preload: %zu files in %.3f s, worst insert %.1f us, buckets=%zu max_chain=%zu%s\n",
+           stats.files, preload, worst_insert * 1e6, stats.buckets, stats.max_chain,
+           stats.rehashing ? " (resize in progress)" : "");
+    printf("files=%d cpus=%ld seconds=%.1f\n", file_count, cpus, seconds);
+    printf("%-8s %-8s %14s %11s %14s\n", "readers", "writers", "lookups/s", "scaling", "add+remove/s");
+
+    int writer_counts[2] = {0, writers};
+    for (int w = 0; w < (writers > 0 ? 2 : 1); w++) {
+        double base_rate = 0;
+        for (long r = 1; r <= cpus; r *= 2) {
+            run((int)r, writer_counts[w], file_count, seconds, &base_rate);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Microbenchmark: byte-at-a-time recv_line() vs buffered NetReader.
+// A writer thread pushes a multi-MB READ-style response (DATA lines followed
+// by STOP) through a socketpair; the reader side parses it line by line and
+// reports throughput plus the number of recv() syscalls issued.
+//
+// Usage: ./bin_bench_net_reader [megabytes]   (default 8)
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/common/net.h"
+#include "../src/common/protocol.h"
+
+typedef struct {
+    int fd;
+    size_t total_bytes;
+} WriterArg;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Send DATA lines with full 1792-byte payloads until total_bytes, then STOP.
+static void *writer_thread(void *arg) {
+    WriterArg *w = (WriterArg*)arg;
+    Message msg = {0};
+    snprintf(msg.type, sizeof(msg.type), "DATA");
+    snprintf(msg.id, sizeof(msg.id), "42");
+    snprintf(msg.username, sizeof(msg.username), "bench");
+    snprintf(msg.role, sizeof(msg.role), "SS");
+    memset(msg.payload, 'x', sizeof(msg.payload) - 1);
+    msg.payload[sizeof(msg.payload) - 1] = '\0';
+
+    char line[MAX_LINE];
+    proto_format_line(&msg, line, sizeof(line));
+    size_t line_len = strlen(line);
+    size_t sent = 0;
+    while (sent < w->total_bytes) {
+        if (send_all(w->fd, line, line_len) != 0) break;
+        sent += line_len;
+    }
+    const char *stop = "STOP|42|bench|SS|\n";
+    send_all(w->fd, stop, strlen(stop));
+    return NULL;
+}
+
+static void run(const char *label, int use_reader, size_t total_bytes) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    WriterArg w = {sv[1], total_bytes};
+    pthread_t th;
+    pthread_create(&th, NULL, writer_thread, &w);
+
+    NetReader *reader = (NetReader*)malloc(sizeof(NetReader));
+    net_reader_init(reader, sv[0]);
+
+    char line[MAX_LINE];
+    size_t bytes = 0;
+    unsigned long lines = 0;
+    double start = now_sec();
+    while (1) {
+        int n = use_reader ? net_reader_line(reader, line, sizeof(line))
+                           : recv_line(sv[0], line, sizeof(line));
+        if (n <= 0) break;
+        bytes += (size_t)n;
+        lines++;
+        if (strncmp(line, "STOP|", 5) == 0) break;
+    }
+    double elapsed = now_sec() - start;
+    pthread_join(th, NULL);
+
+    // recv_line() issues exactly one recv() per byte
+    unsigned long syscalls = use_reader ? reader->recv_calls : (unsigned long)bytes;
+    printf("%-12s bytes=%zu lines=%lu recv_calls=%lu time=%.3fs throughput=%.1f MB/s\n",
+           label, bytes, lines, syscalls, elapsed,
+           elapsed > 0 ? (bytes / (1024.0 * 1024.0)) / elapsed : 0.0);
+
+    free(reader);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+int main(int argc, char **argv) {
+    size_t mb = (argc > 1) ? (size_t)atoi(argv[1]) : 8;
+    if (mb == 0) mb = 8;
+    size_t total = mb * 1024 * 1024;
+    printf("Transferring %zu MB of DATA lines\n", mb);
+    run("recv_line", 0, total);
+    run("net_reader", 1, total);
+    return 0;
+}
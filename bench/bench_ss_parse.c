@@ -0,0 +1,272 @@
+// Throughput benchmark: sentence parser on a generated document.
+// Times sentence_parse_text() and sentence_parse_text() + render +
+// sentence_collection_free() on an mb-sized text of random words and
+// sentences, next to the previous parser (one malloc per word, one
+// realloc per word and per sentence, one free per word), which is kept
+// here for comparison. The arena parser is run once per text_scan kernel
+// the CPU supports, and word counting (count_file_stats) is timed against
+// the old one-byte-at-a-time loop.
+//
+// Usage: ./bin_bench_ss_parse [mb] [iterations]   (default 1 50)
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/ss/sentence_parser.h"
+#include "../src/ss/text_scan.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ---- Previous parser (per-word allocations) ----
+
+static int legacy_delim(char c) {
+    return c == '.' || c == '!' || c == '?';
+}
+
+static void legacy_free_sentence(SentenceEntry *entry) {
+    for (size_t i = 0; i < entry->word_count; i++) free(entry->words[i].text);
+    free(entry->words);
+    entry->words = NULL;
+    entry->word_count = 0;
+}
+
+static void legacy_free(SentenceCollection *c) {
+    for (size_t i = 0; i < c->count; i++) legacy_free_sentence(&c->sentences[i]);
+    free(c->sentences);
+    c->sentences = NULL;
+    c->count = 0;
+}
+
+static int legacy_append_word(SentenceEntry *entry, const char *start, size_t len) {
+    SentenceWord *words = realloc(entry->words, sizeof(SentenceWord) * (entry->word_count + 1));
+    if (!words) return -1;
+    entry->words = words;
+    char *text = malloc(len + 1);
+    if (!text) return -1;
+    memcpy(text, start, len);
+    text[len] = '\0';
+    entry->words[entry->word_count++].text = text;
+    return 0;
+}
+
+static int legacy_finalize(SentenceCollection *c, SentenceEntry *current) {
+    if (current->word_count == 0) return 0;
+    SentenceEntry *arr = realloc(c->sentences, sizeof(SentenceEntry) * (c->count + 1));
+    if (!arr) return -1;
+    c->sentences = arr;
+    c->sentences[c->count++] = *current;
+    memset(current, 0, sizeof(*current));
+    return 0;
+}
+
+static int legacy_parse(const char *text, SentenceCollection *c) {
+    memset(c, 0, sizeof(*c));
+    SentenceEntry current = {0};
+    const char *p = text;
+    const char *token_start = NULL;
+    while (*p) {
+        if (isspace((unsigned char)*p)) {
+            if (token_start && legacy_append_word(&current, token_start, (size_t)(p - token_start)) != 0) return -1;
+            token_start = NULL;
+        } else if (legacy_delim(*p)) {
+            if (token_start) {
+                if (legacy_append_word(&current, token_start, (size_t)(p - token_start + 1)) != 0) return -1;
+                token_start = NULL;
+            } else if (current.word_count > 0) {
+                SentenceWord *last = &current.words[current.word_count - 1];
+                size_t len = strlen(last->text);
+                char *grown = realloc(last->text, len + 2);
+                if (!grown) return -1;
+                grown[len] = *p;
+                grown[len + 1] = '\0';
+                last->text = grown;
+            }
+            if (legacy_finalize(c, &current) != 0) return -1;
+        } else if (!token_start) {
+            token_start = p;
+        }
+        p++;
+    }
+    if (token_start && legacy_append_word(&current, token_start, (size_t)(p - token_start)) != 0) return -1;
+    return legacy_finalize(c, &current);
+}
+
+// Previous render: capacity check and possible realloc per word
+static int legacy_render(const SentenceCollection *c, char **out, size_t *out_len) {
+    size_t capacity = 1024;
+    char *buffer = malloc(capacity);
+    if (!buffer) return -1;
+    size_t written = 0;
+    for (size_t i = 0; i < c->count; i++) {
+        const SentenceEntry *entry = &c->sentences[i];
+        for (size_t w = 0; w < entry->word_count; w++) {
+            size_t len = strlen(entry->words[w].text);
+            while (written + len + 2 >= capacity) {
+                capacity *= 2;
+                char *grown = realloc(buffer, capacity);
+                if (!grown) {
+                    free(buffer);
+                    return -1;
+                }
+                buffer = grown;
+            }
+            if (written > 0) buffer[written++] = ' ';
+            memcpy(buffer + written, entry->words[w].text, len);
+            written += len;
+        }
+        if (i + 1 < c->count) buffer[written++] = ' ';
+    }
+    buffer[written] = '\0';
+    *out = buffer;
+    *out_len = written;
+    return 0;
+}
+
+// ---- Driver ----
+
+static char *make_document(size_t bytes) {
+    char *text = malloc(bytes + 32);
+    if (!text) return NULL;
+    static const char delims[] = ".!?";
+    unsigned seed = 12345;
+    size_t pos = 0;
+    int words_left = 0;
+    while (pos < bytes) {
+        if (words_left == 0) words_left = 5 + (int)((seed = seed * 1103515245 + 12345) >> 16) % 16;
+        int len = 1 + (int)((seed = seed * 1103515245 + 12345) >> 16) % 10;
+        for (int i = 0; i < len; i++) {
+            text[pos++] = (char)('a' + ((seed = seed * 1103515245 + 12345) >> 16) % 26);
+        }
+        if (--words_left == 0) text[pos++] = delims[(seed >> 16) % 3];
+        text[pos++] = ' ';
+    }
+    text[pos] = '\0';
+    return text;
+}
+
+typedef struct {
+    double parse;
+    double full;
+    size_t words;
+    size_t sentences;
+    size_t rendered;
+} Result;
+
+static Result run(const char *text, int iterations, int legacy) {
+    Result r = {0};
+    double t0 = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        SentenceCollection c;
+        int next = 1;
+        if (legacy ? legacy_parse(text, &c) : sentence_parse_text(text, 1, &c, &next)) {
+            fprintf(stderr, "parse failed\n");
+            exit(1);
+        }
+        if (i == 0) {
+            r.sentences = c.count;
+            for (size_t s = 0; s < c.count; s++) r.words += c.sentences[s].word_count;
+        }
+        if (legacy) legacy_free(&c);
+        else sentence_collection_free(&c);
+    }
+    r.parse = now_sec() - t0;
+
+    t0 = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        SentenceCollection c;
+        int next = 1;
+        char *out = NULL;
+        size_t out_len = 0;
+        if (legacy) {
+            if (legacy_parse(text, &c) != 0 || legacy_render(&c, &out, &out_len) != 0) exit(1);
+            legacy_free(&c);
+        } else {
+            if (sentence_parse_text(text, 1, &c, &next) != 0 ||
+                sentence_render_text(&c, &out, &out_len) != 0) {
+                exit(1);
+            }
+            sentence_collection_free(&c);
+        }
+        r.rendered = out_len;
+        free(out);
+    }
+    r.full = now_sec() - t0;
+    return r;
+}
+
+// Previous count_file_stats() loop
+static size_t legacy_count_words(const char *p) {
+    size_t words = 0;
+    int in_word = 0;
+    for (; *p; p++) {
+        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            in_word = 0;
+        } else if (!in_word) {
+            words++;
+            in_word = 1;
+        }
+    }
+    return words;
+}
+
+int main(int argc, char **argv) {
+    double mb = argc > 1 ? atof(argv[1]) : 1.0;
+    int iterations = argc > 2 ? atoi(argv[2]) : 50;
+    if (mb <= 0) mb = 1.0;
+    if (iterations <= 0) iterations = 50;
+    size_t bytes = (size_t)(mb * 1024 * 1024);
+    char *text = make_document(bytes);
+    if (!text) return 1;
+    size_t len = strlen(text);
+    double total_mb = (double)len * iterations / (1024.0 * 1024.0);
+
+    static const TextScanImpl impls[] = { TEXT_SCAN_SCALAR, TEXT_SCAN_SSE2, TEXT_SCAN_AVX2 };
+    Result old = run(text, iterations, 1);
+    printf("document: %.1f MB, %zu words, %zu sentences, %d iterations\n",
+           len / (1024.0 * 1024.0), old.words, old.sentences, iterations);
+    printf("%-22s %12s %18s\n", "", "parse MB/s", "parse+render MB/s");
+    printf("%-22s %12.1f %18.1f\n", "per-word malloc", total_mb / old.parse, total_mb / old.full);
+    Result best = old;
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (text_scan_select(impls[i]) != 0) continue;
+        Result r = run(text, iterations, 0);
+        char label[32];
+        snprintf(label, sizeof(label), "arena, %s", text_scan_impl_name());
+        printf("%-22s %12.1f %18.1f\n", label, total_mb / r.parse, total_mb / r.full);
+        if (r.words != old.words || r.sentences != old.sentences) {
+            printf("MISMATCH: %s parsed %zu words / %zu sentences\n", label, r.words, r.sentences);
+            return 1;
+        }
+        best = r;
+    }
+    printf("speedup: parse %.2fx, parse+render %.2fx\n",
+           old.parse / best.parse, old.full / best.full);
+
+    double t0 = now_sec();
+    size_t expect = 0;
+    for (int i = 0; i < iterations; i++) expect += legacy_count_words(text);
+    double base = now_sec() - t0;
+    printf("\nword count MB/s: byte loop %.1f", total_mb / base);
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (text_scan_select(impls[i]) != 0) continue;
+        t0 = now_sec();
+        size_t words = 0;
+        for (int it = 0; it < iterations; it++) words += text_scan_words(text, len, NULL, NULL);
+        double d = now_sec() - t0;
+        printf(", %s %.1f", text_scan_impl_name(), total_mb / d);
+        if (words != expect) {
+            printf("\nMISMATCH: %s counted %zu words\n", text_scan_impl_name(), words / iterations);
+            return 1;
+        }
+    }
+    printf("\n");
+    free(text);
+    return 0;
+}
@@ -0,0 +1,134 @@
+// Throughput benchmark: READ of large files from a running SS.
+// For each size from 1 MB up to max_mb (x4 steps: 1, 4, 16, ... MB) it
+// CREATEs a file over the protocol, fills it directly in the SS storage
+// directory, then times a binary-framed READ and checks that every byte
+// arrived. Before streaming reads, anything above 64 KB came back truncated.
+//
+// Usage: ./bin_bench_ss_read [host] [port] [storage_dir] [max_mb] [repeats]
+//        (default 127.0.0.1 6001 ./storage_ss1 1024 3; start bin_ss first,
+//         storage_dir must be the --storage of that SS)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/common/net.h"
+#include "../src/common/protocol.h"
+
+#define BENCH_USER "bench"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int send_msg(int fd, const char *type, const char *id, const char *payload) {
+    Message m = {0};
+    snprintf(m.type, sizeof(m.type), "%s", type);
+    snprintf(m.id, sizeof(m.id), "%s", id);
+    snprintf(m.username, sizeof(m.username), "%s", BENCH_USER);
+    snprintf(m.role, sizeof(m.role), "%s", "CLIENT");
+    snprintf(m.payload, sizeof(m.payload), "%s", payload);
+    char line[MAX_LINE];
+    if (proto_format_line(&m, line, sizeof(line)) != 0) return -1;
+    return send_all(fd, line, strlen(line));
+}
+
+// CREATE name on the SS (owner BENCH_USER; an existing file is fine), then
+// write size bytes of text straight into <storage_dir>/files/name
+static int prepare_file(const char *host, int port, const char *storage_dir,
+                        const char *name, size_t size) {
+    int fd = connect_to_host(host, port);
+    if (fd < 0) return -1;
+    char line[MAX_LINE];
+    int rc = send_msg(fd, "CREATE", "1", name) == 0 && recv_line(fd, line, sizeof(line)) > 0 ? 0 : -1;
+    close(fd);
+    if (rc != 0) return -1;
+
+    char path[1024], tmp[1100];
+    snprintf(path, sizeof(path), "%s/files/%s", storage_dir, name);
+    snprintf(tmp, sizeof(tmp), "%s.bench", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return -1;
+    char block[4096];
+    for (size_t i = 0; i < sizeof(block); i++) block[i] = (i % 64 == 63) ? '\n' : "abcdefgh "[i % 9];
+    size_t left = size;
+    while (left > 0 && rc == 0) {
+        size_t n = left < sizeof(block) ? left : sizeof(block);
+        if (fwrite(block, 1, n, fp) != n) rc = -1;
+        left -= n;
+    }
+    if (fclose(fp) != 0) rc = -1;
+    if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+    return rc;
+}
+
+// One binary READ of name; returns bytes received or -1
+static long long timed_read(const char *host, int port, const char *name, uint32_t seq) {
+    int fd = connect_to_host(host, port);
+    if (fd < 0) return -1;
+    NetReader *r = (NetReader*)malloc(sizeof(NetReader));
+    char *buf = (char*)malloc(PROTO_FRAME_CHUNK);
+    long long total = -1;
+    char id[32];
+    snprintf(id, sizeof(id), "%u", seq);
+    if (r && buf && proto_negotiate_binary(fd, BENCH_USER, "CLIENT") == 1 &&
+        send_msg(fd, "READ", id, name) == 0) {
+        net_reader_init(r, fd);
+        total = 0;
+        for (;;) {
+            FrameHeader hdr;
+            if (proto_reader_frame_header(r, &hdr) != 0 || hdr.type == FRAME_ERROR ||
+                hdr.payload_len > PROTO_FRAME_CHUNK ||
+                net_reader_read(r, buf, hdr.payload_len) != 0) {
+                total = -1;
+                break;
+            }
+            if (hdr.type == FRAME_STOP) break;
+            total += hdr.payload_len;
+        }
+    }
+    free(buf);
+    free(r);
+    close(fd);
+    return total;
+}
+
+int main(int argc, char **argv) {
+    const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 6001;
+    const char *storage_dir = argc > 3 ? argv[3] : "./storage_ss1";
+    long max_mb = argc > 4 ? atol(argv[4]) : 1024;
+    int repeats = argc > 5 ? atoi(argv[5]) : 3;
+    if (max_mb <= 0) max_mb = 1024;
+    if (repeats <= 0) repeats = 3;
+
+    uint32_t seq = 1;
+    printf("%10s %10s %12s\n", "size", "best_s", "MB/s");
+    for (long mb = 1; mb <= max_mb; mb *= 4) {
+        size_t size = (size_t)mb * 1048576;
+        char name[64];
+        snprintf(name, sizeof(name), "bench_read_%ldM.txt", mb);
+        if (prepare_file(host, port, storage_dir, name, size) != 0) {
+            fprintf(stderr, "cannot prepare %s (is bin_ss running with --storage %s?)\n", name, storage_dir);
+            return 1;
+        }
+
+        double best = 0;
+        for (int i = 0; i < repeats; i++) {
+            double t0 = now_sec();
+            long long got = timed_read(host, port, name, seq++);
+            double elapsed = now_sec() - t0;
+            if (got != (long long)size) {
+                fprintf(stderr, "%s: read %lld of %zu bytes\n", name, got, size);
+                return 1;
+            }
+            if (i == 0 || elapsed < best) best = elapsed;
+        }
+        printf("%8ldMB %10.3f %12.1f\n", mb, best, mb / best);
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+// Load benchmark: many concurrent persistent sessions against a running SS.
+// Creates a small file on the SS, opens N sessions and keeps them all open,
+// then runs rounds in which every session sends a READ and every reply is
+// read back (checking each reply carries its request id). All reads of all
+// rounds reuse the same N connections; with one connection per command and
+// a thread per connection this many idle readers would not fit in the SS.
+//
+// Usage: ./bin_bench_ss_sessions [host] [port] [sessions] [rounds]
+//        (default 127.0.0.1 6001 1000 10; start bin_ss first)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/common/net.h"
+#include "../src/common/protocol.h"
+
+#define BENCH_FILE "bench_sessions.txt"
+#define BENCH_USER "bench"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int send_msg(int fd, const char *type, const char *id, const char *payload) {
+    Message m = {0};
+    snprintf(m.type, sizeof(m.type), "%s", type);
+    snprintf(m.id, sizeof(m.id), "%s", id);
+    snprintf(m.username, sizeof(m.username), "%s", BENCH_USER);
+    snprintf(m.role, sizeof(m.role), "%s", "CLIENT");
+    snprintf(m.payload, sizeof(m.payload), "%s", payload);
+    char line[MAX_LINE];
+    if (proto_format_line(&m, line, sizeof(line)) != 0) return -1;
+    return send_all(fd, line, strlen(line));
+}
+
+// Read one reply line into msg. Returns 0 on success.
+static int recv_msg(NetReader *r, Message *msg) {
+    char line[MAX_LINE];
+    if (net_reader_line(r, line, sizeof(line)) <= 0) return -1;
+    return proto_parse_line(line, msg);
+}
+
+// CREATE the bench file (an existing one is fine) and fill it with ~4 KB
+static int prepare_file(const char *host, int port) {
+    int fd = connect_to_host(host, port);
+    if (fd < 0) return -1;
+    NetReader *r = (NetReader*)malloc(sizeof(NetReader));
+    if (!r) {
+        close(fd);
+        return -1;
+    }
+    net_reader_init(r, fd);
+    Message resp;
+    int rc = -1;
+    if (send_msg(fd, "CREATE", "1", BENCH_FILE) == 0 && recv_msg(r, &resp) == 0 &&
+        send_msg(fd, "PUT_FILE_CONTENT", "2", BENCH_FILE) == 0) {
+        char chunk[1024];
+        memset(chunk, 'x', sizeof(chunk) - 1);
+        chunk[sizeof(chunk) - 1] = '\0';
+        rc = 0;
+        for (int i = 0; i < 4 && rc == 0; i++) rc = send_msg(fd, "DATA", "2", chunk);
+        if (rc == 0 && send_msg(fd, "STOP", "2", "") == 0 && recv_msg(r, &resp) == 0) {
+            rc = strcmp(resp.type, "ACK") == 0 ? 0 : -1;
+        } else {
+            rc = -1;
+        }
+    }
+    free(r);
+    close(fd);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 6001;
+    int sessions = argc > 3 ? atoi(argv[3]) : 1000;
+    int rounds = argc > 4 ? atoi(argv[4]) : 10;
+    if (sessions <= 0) sessions = 1000;
+    if (rounds <= 0) rounds = 10;
+
+    net_raise_fd_limit();
+    if (prepare_file(host, port) != 0) {
+        fprintf(stderr, "cannot prepare %s on %s:%d (is bin_ss running?)\n", BENCH_FILE, host, port);
+        return 1;
+    }
+
+    int *fds = (int*)calloc((size_t)sessions, sizeof(int));
+    NetReader **readers = (NetReader**)calloc((size_t)sessions, sizeof(NetReader*));
+    if (!fds || !readers) return 1;
+
+    double t0 = now_sec();
+    for (int i = 0; i < sessions; i++) {
+        fds[i] = connect_to_host(host, port);
+        readers[i] = (NetReader*)malloc(sizeof(NetReader));
+        if (fds[i] < 0 || !readers[i]) {
+            fprintf(stderr, "session %d: connect failed\n", i);
+            return 1;
+        }
+        net_reader_init(readers[i], fds[i]);
+    }
+    double connect_time = now_sec() - t0;
+
+    unsigned long reads = 0, bytes = 0;
+    t0 = now_sec();
+    for (int round = 0; round < rounds; round++) {
+        char id[32];
+        for (int i = 0; i < sessions; i++) {
+            snprintf(id, sizeof(id), "%d", round * sessions + i + 1);
+            if (send_msg(fds[i], "READ", id, BENCH_FILE) != 0) {
+                fprintf(stderr, "session %d: send failed\n", i);
+                return 1;
+            }
+        }
+        for (int i = 0; i < sessions; i++) {
+            snprintf(id, sizeof(id), "%d", round * sessions + i + 1);
+            Message resp;
+            do {
+                if (recv_msg(readers[i], &resp) != 0 || strcmp(resp.type, "ERROR") == 0 ||
+                    strcmp(resp.id, id) != 0) {
+                    fprintf(stderr, "session %d: bad reply in round %d\n", i, round);
+                    return 1;
+                }
+                if (strcmp(resp.type, "DATA") == 0) bytes += strlen(resp.payload);
+            } while (strcmp(resp.type, "STOP") != 0);
+            reads++;
+        }
+    }
+    double elapsed = now_sec() - t0;
+
+    printf("sessions=%d rounds=%d connections=%d connect=%.3fs\n",
+           sessions, rounds, sessions + 1, connect_time);
+    printf("reads=%lu in %.3fs  %.0f reads/s  %.1f MB/s\n",
+           reads, elapsed, reads / elapsed, bytes / elapsed / 1048576.0);
+
+    for (int i = 0; i < sessions; i++) {
+        close(fds[i]);
+        free(readers[i]);
+    }
+    free(fds);
+    free(readers);
+    return 0;
+}
@@ -1,6 +1,7 @@
 // Client: Interactive shell for file operations
 // Phase 2: Supports VIEW, CREATE, READ, DELETE, INFO, LIST commands
 #define _POSIX_C_SOURCE 200809L  // For strdup
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,8 +17,21 @@
 
 // Global: connection to NM (kept open for entire session)
 static int g_nm_fd = -1;
+static NetReader g_nm_reader;   // Buffered reads from g_nm_fd
 static char g_username[64] = {0};
 
+// READ/STREAM reuse one storage server session across commands (see
+// "Sessions" in protocol.h). It is dropped well before the SS idle timeout.
+#define CLIENT_SS_SESSION_IDLE_MS (PROTO_SESSION_IDLE_MS / 2)
+static int g_ss_fd = -1;
+static char g_ss_host[64] = {0};
+static int g_ss_port = 0;
+static int g_ss_binary = 0;           // Framing in effect
+static int g_ss_want_binary = 0;      // Framing requested (a text fallback is not retried)
+static long long g_ss_idle_since_ms = 0;
+static NetReader g_ss_reader;       // Buffered reads from g_ss_fd
+static unsigned long g_request_seq = 0;
+
 // Forward declaration
 static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int ss_port);
 static int perform_write_session(const ParsedCommand *cmd, const char *ss_host, int ss_port);
@@ -25,6 +39,67 @@ static int perform_undo_command(const ParsedCommand *cmd, const char *ss_host, i
 static void print_payload_with_newlines(const char *payload);
 static void print_help_message(void);
 
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void ss_session_close(void) {
+    if (g_ss_fd >= 0) close(g_ss_fd);
+    g_ss_fd = -1;
+}
+
+// Get a session to host:port in the wanted framing mode, reusing the cached
+// one when it is fresh and has nothing unread (readable means the SS closed it).
+// Returns: fd (reads go through g_ss_reader), or -1 if the SS is unreachable
+static int ss_session_acquire(const char *host, int port, int want_binary, int *binary_out) {
+    if (g_ss_fd >= 0) {
+        struct pollfd pfd = {.fd = g_ss_fd, .events = POLLIN};
+        int reusable = g_ss_port == port && strcmp(g_ss_host, host) == 0 &&
+                       g_ss_want_binary == want_binary &&
+                       now_ms() - g_ss_idle_since_ms < CLIENT_SS_SESSION_IDLE_MS &&
+                       poll(&pfd, 1, 0) == 0;
+        if (reusable) {
+            *binary_out = g_ss_binary;
+            return g_ss_fd;
+        }
+        ss_session_close();
+    }
+
+    int fd = connect_to_host(host, port);
+    if (fd < 0) return -1;
+    int binary = 0;
+    if (want_binary) {
+        // An older SS rejects HELLO and drops the connection, so reconnect in text mode
+        binary = proto_negotiate_binary(fd, g_username, "CLIENT");
+        if (binary != 1) {
+            binary = 0;
+            close(fd);
+            fd = connect_to_host(host, port);
+            if (fd < 0) return -1;
+        }
+    }
+    g_ss_fd = fd;
+    (void)snprintf(g_ss_host, sizeof(g_ss_host), "%s", host);
+    g_ss_port = port;
+    g_ss_binary = binary;
+    g_ss_want_binary = want_binary;
+    net_reader_init(&g_ss_reader, fd);
+    *binary_out = binary;
+    return fd;
+}
+
+// Finish a command on the cached session
+// reusable: 1 if the whole reply (final STOP/ERROR) was read; 0 closes it
+static void ss_session_release(int reusable) {
+    if (!reusable || net_reader_buffered(&g_ss_reader) > 0) {
+        ss_session_close();
+        return;
+    }
+    g_ss_idle_since_ms = now_ms();
+}
+
 // Send command to NM and receive response
 // Returns: 0 on success, -1 on error
 static int send_command_and_receive(const ParsedCommand *cmd) {
@@ -46,7 +121,7 @@ static int send_command_and_receive(const ParsedCommand *cmd) {
     
     // Receive response
     char resp_buf[MAX_LINE];
-    int n = recv_line(g_nm_fd, resp_buf, sizeof(resp_buf));
+    int n = net_reader_line(&g_nm_reader, resp_buf, sizeof(resp_buf));
     if (n <= 0) {
         printf("Error: Failed to receive response from NM\n");
         fflush(stdout);
@@ -131,7 +206,7 @@ static int send_command_and_receive(const ParsedCommand *cmd) {
         // READ, VIEWCHECKPOINT, and EXEC commands use DATA streaming
         if (strcmp(cmd->cmd, "EXEC") == 0 || strcmp(cmd->cmd, "VIEWCHECKPOINT") == 0) {
             while (1) {
-                int n = recv_line(g_nm_fd, resp_buf, sizeof(resp_buf));
+                int n = net_reader_line(&g_nm_reader, resp_buf, sizeof(resp_buf));
                 if (n <= 0) break;
                 if (proto_parse_line(resp_buf, &resp) != 0) break;
                 if (strcmp(resp.type, "STOP") == 0) {
@@ -208,7 +283,7 @@ static int send_command_and_receive(const ParsedCommand *cmd) {
 }
 
 // Handle direct SS command (READ, STREAM)
-// Connects to SS, sends command, receives data until STOP
+// Sends the command on the cached SS session, receives data until STOP
 // Returns: 0 on success, -1 on error
 static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int ss_port) {
     if (!cmd || !ss_host || ss_port <= 0) return -1;
@@ -220,13 +295,15 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
         return perform_undo_command(cmd, ss_host, ss_port);
     }
     
-    // Connect to SS
-    int ss_fd = connect_to_host(ss_host, ss_port);
+    // READ prefers binary framing (raw bytes, no 1.8KB lines or escaping)
+    int binary = 0;
+    int ss_fd = ss_session_acquire(ss_host, ss_port, strcmp(cmd->cmd, "READ") == 0, &binary);
     if (ss_fd < 0) {
         printf("Error: Failed to connect to storage server at %s:%d\n", ss_host, ss_port);
         fflush(stdout);
         return -1;
     }
+    NetReader *ss_reader = &g_ss_reader;
     
     // Format command message for SS
     Message ss_cmd = {0};
@@ -235,7 +312,7 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
     memcpy(ss_cmd.type, cmd->cmd, copy_len);
     ss_cmd.type[copy_len] = '\0';
     
-    (void)snprintf(ss_cmd.id, sizeof(ss_cmd.id), "%ld", (long)time(NULL));
+    (void)snprintf(ss_cmd.id, sizeof(ss_cmd.id), "%lu", ++g_request_seq);
     
     size_t username_len = strlen(g_username);
     copy_len = (username_len < sizeof(ss_cmd.username) - 1) ? username_len : sizeof(ss_cmd.username) - 1;
@@ -260,27 +337,79 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
     if (proto_format_line(&ss_cmd, cmd_buf, sizeof(cmd_buf)) != 0) {
         printf("Error: Failed to format command for SS\n");
         fflush(stdout);
-        close(ss_fd);
+        ss_session_release(0);
         return -1;
     }
     
     if (send_all(ss_fd, cmd_buf, strlen(cmd_buf)) != 0) {
         printf("Error: Failed to send command to SS\n");
         fflush(stdout);
-        close(ss_fd);
+        ss_session_release(0);
         return -1;
     }
     
     // Handle response based on command type
-    if (strcmp(cmd->cmd, "READ") == 0) {
+    if (strcmp(cmd->cmd, "READ") == 0 && binary) {
+        // Receive DATA frames until STOP frame
+        while (1) {
+            FrameHeader hdr;
+            if (proto_reader_frame_header(ss_reader, &hdr) != 0) {
+                printf("Error: Connection closed unexpectedly\n");
+                fflush(stdout);
+                ss_session_release(0);
+                return -1;
+            }
+            if (hdr.request_id != proto_frame_request_id(ss_cmd.id)) {
+                printf("Error: Reply for another request\n");
+                fflush(stdout);
+                ss_session_release(0);
+                return -1;
+            }
+            if (hdr.type == FRAME_STOP) {
+                break;
+            }
+            char *payload = (char*)malloc(hdr.payload_len + 1);
+            if (!payload || net_reader_read(ss_reader, payload, hdr.payload_len) != 0) {
+                free(payload);
+                printf("Error: Connection closed unexpectedly\n");
+                fflush(stdout);
+                ss_session_release(0);
+                return -1;
+            }
+            payload[hdr.payload_len] = '\0';
+            if (hdr.type == FRAME_ERROR) {
+                Message err = {0};
+                (void)snprintf(err.payload, sizeof(err.payload), "%s", payload);
+                char error_code[64];
+                char error_msg[256];
+                if (proto_parse_error(&err, error_code, sizeof(error_code),
+                                      error_msg, sizeof(error_msg)) == 0) {
+                    printf("ERROR [%s]: %s\n", error_code, error_msg);
+                } else {
+                    printf("ERROR: %s\n", payload);
+                }
+                fflush(stdout);
+                free(payload);
+                ss_session_release(1);
+                return -1;
+            }
+            if (hdr.type == FRAME_DATA) {
+                fwrite(payload, 1, hdr.payload_len, stdout);
+            }
+            free(payload);
+        }
+        
+        printf("\n");
+        fflush(stdout);
+    } else if (strcmp(cmd->cmd, "READ") == 0) {
         // Receive data until STOP packet
         while (1) {
             char resp_buf[MAX_LINE];
-            int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
+            int n = net_reader_line(ss_reader, resp_buf, sizeof(resp_buf));
             if (n <= 0) {
                 printf("Error: Connection closed unexpectedly\n");
                 fflush(stdout);
-                close(ss_fd);
+                ss_session_release(0);
                 return -1;
             }
             
@@ -289,7 +418,13 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
             if (proto_parse_line(resp_buf, &resp) != 0) {
                 printf("Error: Failed to parse response from SS\n");
                 fflush(stdout);
-                close(ss_fd);
+                ss_session_release(0);
+                return -1;
+            }
+            if (strcmp(resp.id, ss_cmd.id) != 0) {
+                printf("Error: Reply for another request\n");
+                fflush(stdout);
+                ss_session_release(0);
                 return -1;
             }
             
@@ -310,7 +445,7 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
                     printf("ERROR: %s\n", resp.payload);
                 }
                 fflush(stdout);
-                close(ss_fd);
+                ss_session_release(1);
                 return -1;
             }
             
@@ -339,11 +474,11 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
         int first_word = 1;
         while (1) {
             char resp_buf[MAX_LINE];
-            int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
+            int n = net_reader_line(ss_reader, resp_buf, sizeof(resp_buf));
             if (n <= 0) {
                 printf("\nError: Connection closed unexpectedly\n");
                 fflush(stdout);
-                close(ss_fd);
+                ss_session_release(0);
                 return -1;
             }
             
@@ -352,7 +487,13 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
             if (proto_parse_line(resp_buf, &resp) != 0) {
                 printf("\nError: Failed to parse response from SS\n");
                 fflush(stdout);
-                close(ss_fd);
+                ss_session_release(0);
+                return -1;
+            }
+            if (strcmp(resp.id, ss_cmd.id) != 0) {
+                printf("\nError: Reply for another request\n");
+                fflush(stdout);
+                ss_session_release(0);
                 return -1;
             }
             
@@ -375,7 +516,7 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
                     printf("\nERROR: %s\n", resp.payload);
                 }
                 fflush(stdout);
-                close(ss_fd);
+                ss_session_release(1);
                 return -1;
             }
             
@@ -392,7 +533,7 @@ static int handle_ss_command(const ParsedCommand *cmd, const char *ss_host, int
         }
     }
     
-    close(ss_fd);
+    ss_session_release(1);
     return 0;
 }
 
@@ -450,6 +591,8 @@ static int perform_write_session(const ParsedCommand *cmd, const char *ss_host,
         fflush(stdout);
         return -1;
     }
+    NetReader ss_reader;
+    net_reader_init(&ss_reader, ss_fd);
 
     Message write_msg = {0};
     (void)snprintf(write_msg.type, sizeof(write_msg.type), "%s", "WRITE");
@@ -469,7 +612,7 @@ static int perform_write_session(const ParsedCommand *cmd, const char *ss_host,
 
     int ready = 0;
     while (!ready) {
-        int n = recv_line(ss_fd, line_buf, sizeof(line_buf));
+        int n = net_reader_line(&ss_reader, line_buf, sizeof(line_buf));
         if (n <= 0) {
             printf("Error: No response from storage server\n");
             fflush(stdout);
@@ -553,7 +696,7 @@ static int perform_write_session(const ParsedCommand *cmd, const char *ss_host,
                 close(ss_fd);
                 return -1;
             }
-            int n = recv_line(ss_fd, line_buf, sizeof(line_buf));
+            int n = net_reader_line(&ss_reader, line_buf, sizeof(line_buf));
             if (n <= 0) {
                 printf("Error: No response after ETIRW\n");
                 fflush(stdout);
@@ -620,7 +763,7 @@ static int perform_write_session(const ParsedCommand *cmd, const char *ss_host,
             close(ss_fd);
             return -1;
         }
-        int n = recv_line(ss_fd, line_buf, sizeof(line_buf));
+        int n = net_reader_line(&ss_reader, line_buf, sizeof(line_buf));
         if (n <= 0) {
             printf("Error: Connection closed during WRITE\n");
             fflush(stdout);
@@ -667,6 +810,8 @@ static int perform_undo_command(const ParsedCommand *cmd, const char *ss_host, i
         fflush(stdout);
         return -1;
     }
+    NetReader ss_reader;
+    net_reader_init(&ss_reader, ss_fd);
     Message req = {0};
     (void)snprintf(req.type, sizeof(req.type), "%s", "UNDO");
     (void)snprintf(req.id, sizeof(req.id), "%ld", (long)time(NULL));
@@ -683,7 +828,7 @@ static int perform_undo_command(const ParsedCommand *cmd, const char *ss_host, i
         return -1;
     }
 
-    int n = recv_line(ss_fd, line_buf, sizeof(line_buf));
+    int n = net_reader_line(&ss_reader, line_buf, sizeof(line_buf));
     if (n <= 0) {
         printf("Error: No response from storage server\n");
         fflush(stdout);
@@ -847,6 +992,8 @@ int main(int argc, char **argv) {
         return 1;
     }
     
+    net_reader_init(&g_nm_reader, g_nm_fd);
+    
     // Register with NM
     Message reg_msg = {0};
     (void)snprintf(reg_msg.type, sizeof(reg_msg.type), "%s", "CLIENT_REGISTER");
@@ -861,7 +1008,7 @@ int main(int argc, char **argv) {
     
     // Wait for ACK
     char ack_buf[MAX_LINE];
-    if (recv_line(g_nm_fd, ack_buf, sizeof(ack_buf)) > 0) {
+    if (net_reader_line(&g_nm_reader, ack_buf, sizeof(ack_buf)) > 0) {
         Message ack;
         if (proto_parse_line(ack_buf, &ack) == 0) {
             log_info("client_registered", "user=%s", username);
@@ -872,6 +1019,7 @@ int main(int argc, char **argv) {
     command_loop();
     
     // Cleanup
+    ss_session_close();
     close(g_nm_fd);
     return 0;
 }
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // splice()
 #include "net.h"
 
 // Implementation of simple TCP server/client helpers.
@@ -6,8 +7,11 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -28,7 +32,7 @@ int create_server_socket(const char *host, int port) {
         if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) { close(fd); return -1; }
     }
     if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { close(fd); return -1; }
-    if (listen(fd, 128) < 0) { close(fd); return -1; }
+    if (listen(fd, SOMAXCONN) < 0) { close(fd); return -1; }
     return fd;
 }
 
@@ -45,6 +49,15 @@ int connect_to_host(const char *host, int port) {
     return fd;
 }
 
+long net_raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return -1;
+    if (rl.rlim_cur >= rl.rlim_max) return 0;
+    rl.rlim_cur = rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) != 0) return -1;
+    return (long)rl.rlim_cur;
+}
+
 // Receive a single line (ending with '\n') into buf (null-terminated).
 int recv_line(int fd, char *buf, size_t buflen) {
     size_t off = 0;
@@ -64,10 +77,34 @@ int recv_line(int fd, char *buf, size_t buflen) {
 }
 
 // Send the entire buffer contents.
+// Also works on non-blocking sockets (NM event loop): when the socket buffer
+// is full we wait for POLLOUT, up to SEND_WAIT_TIMEOUT_MS per stall.
 int send_all(int fd, const char *buf, size_t len) {
     size_t off = 0;
     while (off < len) {
-        ssize_t n = send(fd, buf + off, len - off, 0);
+        ssize_t n = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                int rc = poll(&pfd, 1, SEND_WAIT_TIMEOUT_MS);
+                if (rc > 0 || (rc < 0 && errno == EINTR)) continue;
+                return -1;
+            }
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    return 0;
+}
+
+// Receive exactly len bytes, retrying short reads.
+int recv_exact(int fd, void *buf, size_t len) {
+    char *p = (char*)buf;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = recv(fd, p + off, len - off, 0);
+        if (n == 0) return -1; // closed mid-frame
         if (n < 0) {
             if (errno == EINTR) continue;
             return -1;
@@ -77,4 +114,188 @@ int send_all(int fd, const char *buf, size_t len) {
     return 0;
 }
 
+// Wait until fd is writable (non-blocking sockets); 0 if it is, -1 on timeout
+static int wait_writable(int fd) {
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int rc = poll(&pfd, 1, SEND_WAIT_TIMEOUT_MS);
+    return (rc > 0 || (rc < 0 && errno == EINTR)) ? 0 : -1;
+}
+
+// pread() + send_all() fallback for send_file_range()
+static int send_file_copy(int sock, int file_fd, off_t offset, size_t len) {
+    char buf[16384];
+    while (len > 0) {
+        size_t want = len < sizeof(buf) ? len : sizeof(buf);
+        ssize_t n = pread(file_fd, buf, want, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        if (send_all(sock, buf, (size_t)n) != 0) return -1;
+        offset += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
 
+int send_file_range(int sock, int file_fd, off_t offset, size_t len) {
+    while (len > 0) {
+        ssize_t n = sendfile(sock, file_fd, &offset, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                if (wait_writable(sock) != 0) return -1;
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS) return send_file_copy(sock, file_fd, offset, len);
+            return -1;
+        }
+        if (n == 0) return -1;  // File shorter than promised
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Buffered fallback for net_splice()
+static int splice_copy(int in_fd, int out_fd, size_t len) {
+    char buf[16384];
+    while (len > 0) {
+        size_t want = len < sizeof(buf) ? len : sizeof(buf);
+        if (recv_exact(in_fd, buf, want) != 0) return -1;
+        if (send_all(out_fd, buf, want) != 0) return -1;
+        len -= want;
+    }
+    return 0;
+}
+
+int net_splice(int in_fd, int out_fd, size_t len, const int pipefd[2]) {
+    if (!pipefd) return splice_copy(in_fd, out_fd, len);
+    size_t in_pipe = 0;
+    while (len > 0 || in_pipe > 0) {
+        if (len > 0) {
+            ssize_t n = splice(in_fd, NULL, pipefd[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                // Nothing moved yet on this call: fall back to copying
+                if ((errno == EINVAL || errno == ENOSYS) && in_pipe == 0) {
+                    return splice_copy(in_fd, out_fd, len);
+                }
+                return -1;
+            }
+            if (n == 0) return -1;  // Peer closed mid-payload
+            len -= (size_t)n;
+            in_pipe += (size_t)n;
+        }
+        while (in_pipe > 0) {
+            ssize_t n = splice(pipefd[0], NULL, out_fd, NULL, in_pipe,
+                               SPLICE_F_MOVE | (len > 0 ? SPLICE_F_MORE : 0));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) {
+                    if (wait_writable(out_fd) != 0) return -1;
+                    continue;
+                }
+                return -1;
+            }
+            in_pipe -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+// ===== Buffered connection reader =====
+
+#define NET_READER_MASK (NET_READER_BUFSZ - 1)
+
+void net_reader_init(NetReader *r, int fd) {
+    r->fd = fd;
+    r->head = 0;
+    r->count = 0;
+    r->recv_calls = 0;
+}
+
+size_t net_reader_buffered(const NetReader *r) {
+    return r->count;
+}
+
+// Refill the ring with a single recv() into its largest contiguous free span.
+// Returns 1 if data was added, 0 if the peer closed, -1 on error.
+static int net_reader_fill(NetReader *r) {
+    if (r->count == 0) r->head = 0;  // Keep the free span contiguous
+    size_t tail = (r->head + r->count) & NET_READER_MASK;
+    size_t space = (tail >= r->head) ? NET_READER_BUFSZ - tail : r->head - tail;
+    if (r->count == NET_READER_BUFSZ || space == 0) return 1;
+    while (1) {
+        ssize_t n = recv(r->fd, r->ring + tail, space, 0);
+        r->recv_calls++;
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        r->count += (size_t)n;
+        return 1;
+    }
+}
+
+int net_reader_line(NetReader *r, char *buf, size_t buflen) {
+    if (!r || !buf || buflen == 0) return -1;
+    size_t off = 0;
+    while (off + 1 < buflen) {
+        if (r->count == 0) {
+            int rc = net_reader_fill(r);
+            if (rc <= 0) return rc;  // closed (0) or error (-1), like recv_line
+        }
+        // Contiguous unread span starting at head
+        size_t seg = r->count;
+        if (seg > NET_READER_BUFSZ - r->head) seg = NET_READER_BUFSZ - r->head;
+        if (seg > buflen - 1 - off) seg = buflen - 1 - off;
+        const char *start = r->ring + r->head;
+        const char *nl = memchr(start, '\n', seg);
+        if (nl) seg = (size_t)(nl - start) + 1;
+        memcpy(buf + off, start, seg);
+        off += seg;
+        r->head = (r->head + seg) & NET_READER_MASK;
+        r->count -= seg;
+        if (nl) break;
+    }
+    buf[off] = '\0';
+    return (int)off;
+}
+
+int net_reader_read(NetReader *r, void *buf, size_t len) {
+    if (!r || (!buf && len > 0)) return -1;
+    char *dst = (char*)buf;
+    size_t off = 0;
+    // Drain what is already buffered
+    while (off < len && r->count > 0) {
+        size_t seg = r->count;
+        if (seg > NET_READER_BUFSZ - r->head) seg = NET_READER_BUFSZ - r->head;
+        if (seg > len - off) seg = len - off;
+        memcpy(dst + off, r->ring + r->head, seg);
+        off += seg;
+        r->head = (r->head + seg) & NET_READER_MASK;
+        r->count -= seg;
+    }
+    // Large remainders go straight into the caller's buffer
+    while (len - off >= NET_READER_BUFSZ) {
+        ssize_t n = recv(r->fd, dst + off, len - off, 0);
+        r->recv_calls++;
+        if (n == 0) return -1;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    // Small remainders refill the ring so following headers come for free
+    while (off < len) {
+        if (r->count == 0 && net_reader_fill(r) <= 0) return -1;
+        size_t seg = r->count;
+        if (seg > NET_READER_BUFSZ - r->head) seg = NET_READER_BUFSZ - r->head;
+        if (seg > len - off) seg = len - off;
+        memcpy(dst + off, r->ring + r->head, seg);
+        off += seg;
+        r->head = (r->head + seg) & NET_READER_MASK;
+        r->count -= seg;
+    }
+    return 0;
+}
@@ -5,11 +5,81 @@
 // and simple line-based send/receive utilities.
 
 #include <stddef.h>
+#include <sys/types.h>
+
+#define SEND_WAIT_TIMEOUT_MS 5000  // Max wait for a full non-blocking socket to drain
 
 int create_server_socket(const char *host, int port);
 int connect_to_host(const char *host, int port);
 int recv_line(int fd, char *buf, size_t buflen);
 int send_all(int fd, const char *buf, size_t len);
+// Receive exactly len bytes (used for binary frames). Returns 0 on success,
+// -1 on error or if the peer closed the connection early.
+int recv_exact(int fd, void *buf, size_t len);
+
+// ===== Zero-copy bulk transfer =====
+// Both helpers can raise SIGPIPE if the peer is gone (there is no
+// MSG_NOSIGNAL for them); servers that use them ignore SIGPIPE.
+
+// Send len bytes of file_fd starting at offset with sendfile(2): file pages
+// go from the page cache to the socket without a userspace copy. Falls back
+// to pread() + send_all() where sendfile does not support the fd pair.
+// Returns 0 on success, -1 on error or if the file ends early.
+//
+// Usage:
+//   if (send_file_range(sock, file_fd, 0, st.st_size) != 0) goto fail;
+int send_file_range(int sock, int file_fd, off_t offset, size_t len);
+
+// Move exactly len bytes from in_fd to out_fd through pipefd with splice(2),
+// so relayed payloads never enter userspace. Pass pipefd == NULL (or a
+// kernel without splice) to get a buffered read/send copy instead.
+// Returns 0 on success, -1 on error or early close.
+//
+// Usage:
+//   int p[2];
+//   if (pipe(p) != 0) ...;
+//   net_splice(src_sock, dst_sock, payload_len, p);
+int net_splice(int in_fd, int out_fd, size_t len, const int pipefd[2]);
+
+// Servers holding thousands of sessions need thousands of fds: lift the
+// soft RLIMIT_NOFILE to the hard limit.
+// Returns the new soft limit if it was raised, 0 if unchanged, -1 on error.
+long net_raise_fd_limit(void);
+
+// ===== Buffered connection reader =====
+// recv_line() issues one recv() per byte. A NetReader owns a ring buffer that
+// is refilled with one large recv() at a time, and hands out complete lines
+// or exact byte counts (frame headers/payloads) from memory.
+//
+// Once a reader is attached to an fd, all reads on that fd must go through
+// it; bytes already buffered would otherwise be skipped.
+//
+// Usage:
+//   NetReader r;
+//   net_reader_init(&r, fd);
+//   while (net_reader_line(&r, line, sizeof(line)) > 0) { ... }
+
+#define NET_READER_BUFSZ 16384  // Must be a power of two
+
+typedef struct NetReader {
+    int fd;
+    size_t head;               // Index of first unread byte in ring
+    size_t count;              // Number of unread bytes
+    unsigned long recv_calls;  // recv() syscalls issued (for diagnostics/benchmarks)
+    char ring[NET_READER_BUFSZ];
+} NetReader;
+
+void net_reader_init(NetReader *r, int fd);
+
+// Same contract as recv_line(): returns bytes stored (including '\n'),
+// 0 if the peer closed, -1 on error. Lines longer than buflen-1 are split.
+int net_reader_line(NetReader *r, char *buf, size_t buflen);
+
+// Same contract as recv_exact(): 0 on success, -1 on error/early close.
+int net_reader_read(NetReader *r, void *buf, size_t len);
+
+// Bytes received but not yet consumed.
+size_t net_reader_buffered(const NetReader *r);
 
 #endif
 
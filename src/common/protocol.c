@@ -3,9 +3,13 @@
 // Parser/formatter for the line-based protocol.
 // We split by '|' for the first four fields and assign the remainder to payload.
 
+#include <arpa/inet.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "net.h"
+
 // Copy helper that always null-terminates.
 static void safe_copy(char *dst, size_t dstsz, const char *src) {
     if (!dst || dstsz == 0) return;
@@ -119,4 +123,118 @@ int proto_parse_error(const Message *msg, char *error_code, size_t code_sz,
     return 0;
 }
 
+// ===== Binary framing =====
+
+void proto_encode_frame_header(const FrameHeader *hdr, unsigned char out[PROTO_FRAME_HEADER_SIZE]) {
+    uint16_t magic = htons(PROTO_FRAME_MAGIC);
+    uint16_t type = htons(hdr->type);
+    uint32_t rid = htonl(hdr->request_id);
+    uint32_t len = htonl(hdr->payload_len);
+    memcpy(out, &magic, 2);
+    memcpy(out + 2, &type, 2);
+    memcpy(out + 4, &rid, 4);
+    memcpy(out + 8, &len, 4);
+}
+
+int proto_decode_frame_header(const unsigned char in[PROTO_FRAME_HEADER_SIZE], FrameHeader *out) {
+    uint16_t magic, type;
+    uint32_t rid, len;
+    memcpy(&magic, in, 2);
+    memcpy(&type, in + 2, 2);
+    memcpy(&rid, in + 4, 4);
+    memcpy(&len, in + 8, 4);
+    if (ntohs(magic) != PROTO_FRAME_MAGIC) return -1;
+    out->type = ntohs(type);
+    out->request_id = ntohl(rid);
+    out->payload_len = ntohl(len);
+    return 0;
+}
+
+uint32_t proto_frame_request_id(const char *id) {
+    if (!id || !*id) return 0;
+    char *end = NULL;
+    unsigned long v = strtoul(id, &end, 10);
+    if (end && *end == '\0') return (uint32_t)v;
+    // djb2 for non-numeric ids
+    uint32_t h = 5381;
+    for (const unsigned char *p = (const unsigned char*)id; *p; p++) {
+        h = ((h << 5) + h) + *p;
+    }
+    return h;
+}
+
+int proto_send_frame(int fd, uint16_t type, uint32_t request_id,
+                     const void *payload, uint32_t payload_len) {
+    FrameHeader hdr = {type, request_id, payload_len};
+    unsigned char raw[PROTO_FRAME_HEADER_SIZE];
+    proto_encode_frame_header(&hdr, raw);
+    if (send_all(fd, (const char*)raw, sizeof(raw)) != 0) return -1;
+    if (payload_len > 0 && send_all(fd, (const char*)payload, payload_len) != 0) return -1;
+    return 0;
+}
+
+int proto_send_file_frames(int sock, uint32_t request_id, int file_fd, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        size_t chunk = len - off;
+        if (chunk > PROTO_FRAME_CHUNK) chunk = PROTO_FRAME_CHUNK;
+        FrameHeader hdr = {FRAME_DATA, request_id, (uint32_t)chunk};
+        unsigned char raw[PROTO_FRAME_HEADER_SIZE];
+        proto_encode_frame_header(&hdr, raw);
+        if (send_all(sock, (const char*)raw, sizeof(raw)) != 0) return -1;
+        if (send_file_range(sock, file_fd, (off_t)off, chunk) != 0) return -1;
+        off += chunk;
+    }
+    return 0;
+}
+
+int proto_send_frame_error(int fd, uint32_t request_id,
+                           const char *error_code, const char *error_msg) {
+    char payload[512];
+    int n = snprintf(payload, sizeof(payload), "%s|%s",
+                     error_code ? error_code : "UNKNOWN",
+                     error_msg ? error_msg : "");
+    if (n < 0) return -1;
+    if ((size_t)n >= sizeof(payload)) n = (int)sizeof(payload) - 1;
+    return proto_send_frame(fd, FRAME_ERROR, request_id, payload, (uint32_t)n);
+}
+
+int proto_recv_frame_header(int fd, FrameHeader *hdr) {
+    if (!hdr) return -1;
+    unsigned char raw[PROTO_FRAME_HEADER_SIZE];
+    if (recv_exact(fd, raw, sizeof(raw)) != 0) return -1;
+    if (proto_decode_frame_header(raw, hdr) != 0) return -1;
+    if (hdr->payload_len > PROTO_FRAME_MAX_PAYLOAD) return -1;
+    return 0;
+}
+
+int proto_reader_frame_header(NetReader *r, FrameHeader *hdr) {
+    if (!r || !hdr) return -1;
+    unsigned char raw[PROTO_FRAME_HEADER_SIZE];
+    if (net_reader_read(r, raw, sizeof(raw)) != 0) return -1;
+    if (proto_decode_frame_header(raw, hdr) != 0) return -1;
+    if (hdr->payload_len > PROTO_FRAME_MAX_PAYLOAD) return -1;
+    return 0;
+}
+
+int proto_negotiate_binary(int fd, const char *username, const char *role) {
+    Message hello = {0};
+    safe_copy(hello.type, sizeof(hello.type), PROTO_HELLO);
+    safe_copy(hello.id, sizeof(hello.id), "0");
+    safe_copy(hello.username, sizeof(hello.username), username);
+    safe_copy(hello.role, sizeof(hello.role), role);
+    safe_copy(hello.payload, sizeof(hello.payload), PROTO_MODE_BINARY);
 
+    char line[MAX_LINE];
+    if (proto_format_line(&hello, line, sizeof(line)) != 0) return -1;
+    if (send_all(fd, line, strlen(line)) != 0) return -1;
+    int n = recv_line(fd, line, sizeof(line));
+    if (n <= 0) return -1;
+
+    Message resp;
+    if (proto_parse_line(line, &resp) != 0) return 0;
+    if (strcmp(resp.type, "ACK") == 0 && strcmp(resp.payload, PROTO_MODE_BINARY) == 0) {
+        return 1;
+    }
+    return 0;
+}
@@ -8,6 +8,7 @@
 // a message safely into fixed-size buffers.
 
 #include <stddef.h>
+#include <stdint.h>
 
 // Message Types:
 //   Registration: SS_REGISTER, CLIENT_REGISTER
@@ -16,6 +17,16 @@
 //   User Operations: VIEW, LIST, ADDACCESS, REMACCESS
 //   Folder Operations: CREATE_FOLDER/CREATEFOLDER, MOVE, VIEWFOLDER/VIEW_FOLDER
 //   Internal: DATA, STOP, GET_FILE, GET_ACL, UPDATE_ACL
+//   Replication: GET_FILE_CONTENT, PUT_FILE_CONTENT,
+//                REPLICATE_TO (NM -> primary SS, payload "file|host|port":
+//                push the file and its .meta to that SS, ACK carries
+//                "bytes|delta" or "bytes|full"),
+//                PUT_FILE_DELTA (primary SS -> replica, payload "file", a
+//                delta image in binary frames; ERROR CONFLICT if the
+//                replica's copy does not match it)
+//   Anti-entropy: MERKLE_NODE (NM -> SS, payload "level|index", ACK carries
+//                the node's child hashes), MERKLE_LEAF (payload "leaf", one
+//                DATA "hash|file" line per file, then STOP)
 
 #define MAX_LINE 2048
 
@@ -43,5 +54,97 @@ int proto_format_error(const char *id, const char *username, const char *role,
 int proto_parse_error(const Message *msg, char *error_code, size_t code_sz, 
                       char *error_msg, size_t msg_sz);
 
+// ===== Sessions =====
+// A connection to an SS is a session: it carries any number of commands,
+// and a peer may pipeline several before reading replies. The SS runs them
+// in arrival order and every reply line or frame carries the id of the
+// request it answers (frames via proto_frame_request_id), so give each
+// request its own id. HELLO may be sent between any two commands. The SS
+// closes a session after PROTO_SESSION_IDLE_MS without a command; peers
+// that keep connections around should drop them before that.
+
+#define PROTO_SESSION_IDLE_MS 5000
+
+// ===== Binary framing mode =====
+// Text lines cap every payload at 1792 bytes and force bulk data to escape
+// '\n' as '\x01'. Peers that understand frames negotiate them per connection:
+//   -> HELLO|ID|USERNAME|ROLE|BINARY
+//   <- ACK|ID|USERNAME|ROLE|BINARY      (server supports frames)
+//   <- ACK|ID|USERNAME|ROLE|TEXT        (server declines, stay in text mode)
+// Old servers answer HELLO with an ERROR line; callers treat that as TEXT.
+//
+// After negotiation, command lines and single-line replies stay text, but bulk
+// streams (the DATA...STOP sequences of READ, GET_FILE, GET_FILE_CONTENT and
+// PUT_FILE_CONTENT) are sent as frames. An error that replaces a stream is sent
+// as a FRAME_ERROR whose payload is "ERROR_CODE|ERROR_MESSAGE".
+//
+// Frame layout (all integers big-endian):
+//   magic(2) | type(2) | request_id(4) | payload_len(4) | payload bytes...
+// Payload bytes are raw; there is no escaping and no per-line size cap.
+// The magic's first byte is non-ASCII so a frame can never be mistaken for a
+// text line.
+
+#define PROTO_HELLO "HELLO"
+#define PROTO_MODE_BINARY "BINARY"
+#define PROTO_MODE_TEXT "TEXT"
+
+#define PROTO_FRAME_MAGIC 0xF5A1
+#define PROTO_FRAME_HEADER_SIZE 12
+#define PROTO_FRAME_CHUNK 65536                      // Preferred DATA frame size
+#define PROTO_FRAME_MAX_PAYLOAD (64u * 1024u * 1024u) // Sanity limit for receivers
+
+typedef enum {
+    FRAME_DATA = 1,   // Raw bulk bytes
+    FRAME_STOP = 2,   // End of a bulk stream (empty payload)
+    FRAME_ERROR = 3,  // Stream aborted, payload is "CODE|MESSAGE"
+    FRAME_ACK = 4     // Generic acknowledgement
+} FrameType;
+
+typedef struct FrameHeader {
+    uint16_t type;         // FrameType
+    uint32_t request_id;   // Numeric form of Message.id (see proto_frame_request_id)
+    uint32_t payload_len;  // Bytes following the header
+} FrameHeader;
+
+// Encode/decode the fixed 12-byte header. Decode returns -1 on bad magic.
+void proto_encode_frame_header(const FrameHeader *hdr, unsigned char out[PROTO_FRAME_HEADER_SIZE]);
+int proto_decode_frame_header(const unsigned char in[PROTO_FRAME_HEADER_SIZE], FrameHeader *out);
+
+// Map a text request id ("42", "repl_1700000000") onto the 32-bit frame id.
+// Non-numeric ids hash to a stable value so replies can still be correlated.
+uint32_t proto_frame_request_id(const char *id);
+
+// Send one frame (header + payload). Returns 0 on success, -1 on error.
+int proto_send_frame(int fd, uint16_t type, uint32_t request_id,
+                     const void *payload, uint32_t payload_len);
+
+// Send the first len bytes of an open file as DATA frames of up to
+// PROTO_FRAME_CHUNK bytes, without a closing STOP. Payloads go out with
+// send_file_range() (sendfile(2)), so file bytes are never copied through
+// userspace. The file must not shrink below len while this runs (writers
+// replace files by rename, so an open fd is stable).
+// Returns 0 on success, -1 on error (the connection is then out of sync).
+int proto_send_file_frames(int sock, uint32_t request_id, int file_fd, size_t len);
+
+// Send a FRAME_ERROR carrying "ERROR_CODE|ERROR_MESSAGE".
+int proto_send_frame_error(int fd, uint32_t request_id,
+                           const char *error_code, const char *error_msg);
+
+// Read a frame header. The caller then reads hdr->payload_len bytes with
+// recv_exact(), which lets large payloads be streamed instead of buffered.
+// Returns 0 on success, -1 on I/O error, bad magic or oversized payload.
+int proto_recv_frame_header(int fd, FrameHeader *hdr);
+
+// Same as proto_recv_frame_header(), reading through a buffered NetReader.
+// Follow up with net_reader_read() for the payload.
+struct NetReader;
+int proto_reader_frame_header(struct NetReader *r, FrameHeader *hdr);
+
+// Ask the peer to switch this connection to binary framing.
+// Returns 1 if the peer accepted, 0 if it stays in text mode, -1 on I/O error.
+// Note: an old peer may close the connection after rejecting HELLO, so callers
+// that get 0 should reconnect before sending their command.
+int proto_negotiate_binary(int fd, const char *username, const char *role);
+
 #endif
 
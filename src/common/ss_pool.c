@@ -0,0 +1,222 @@
+#define _POSIX_C_SOURCE 200809L
+#include "ss_pool.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "net.h"
+#include "protocol.h"
+
+// One pooled connection; lives on either the idle list or the leased list
+typedef struct PoolConn {
+    int fd;
+    char host[64];
+    int port;
+    int binary;
+    long long idle_since_ms;
+    struct PoolConn *next;
+} PoolConn;
+
+static pthread_mutex_t g_pool_mu = PTHREAD_MUTEX_INITIALIZER;
+static PoolConn *g_idle = NULL;     // Most recently released first
+static PoolConn *g_leased = NULL;
+static SsPoolStats g_stats;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int same_target(const PoolConn *c, const char *host, int port, int binary) {
+    return c->port == port && c->binary == binary && strcmp(c->host, host) == 0;
+}
+
+// An idle connection is healthy if it has not outlived the idle timeout and
+// has nothing to read: the SS never sends unsolicited data, so readable
+// means EOF (session closed, SS restarted) or a desynchronized stream.
+static int conn_healthy(const PoolConn *c, long long now) {
+    if (now - c->idle_since_ms >= SS_POOL_IDLE_TIMEOUT_MS) return 0;
+    struct pollfd pfd = {.fd = c->fd, .events = POLLIN};
+    return poll(&pfd, 1, 0) == 0;
+}
+
+// Unlink and close expired idle connections (caller holds g_pool_mu)
+static void prune_idle_locked(long long now) {
+    PoolConn **pp = &g_idle;
+    while (*pp) {
+        PoolConn *c = *pp;
+        if (now - c->idle_since_ms >= SS_POOL_IDLE_TIMEOUT_MS) {
+            *pp = c->next;
+            close(c->fd);
+            free(c);
+            g_stats.idle--;
+            g_stats.discards++;
+        } else {
+            pp = &c->next;
+        }
+    }
+}
+
+// Take a healthy idle connection to host:port, or return NULL
+static PoolConn *take_idle(const char *host, int port, int binary) {
+    long long now = now_ms();
+    pthread_mutex_lock(&g_pool_mu);
+    prune_idle_locked(now);
+    PoolConn **pp = &g_idle;
+    while (*pp) {
+        PoolConn *c = *pp;
+        if (!same_target(c, host, port, binary)) {
+            pp = &c->next;
+            continue;
+        }
+        *pp = c->next;
+        g_stats.idle--;
+        if (!conn_healthy(c, now)) {
+            close(c->fd);
+            free(c);
+            g_stats.discards++;
+            continue;
+        }
+        c->next = g_leased;
+        g_leased = c;
+        g_stats.leased++;
+        g_stats.reuses++;
+        pthread_mutex_unlock(&g_pool_mu);
+        return c;
+    }
+    pthread_mutex_unlock(&g_pool_mu);
+    return NULL;
+}
+
+// Open a new connection and record it as leased
+static int open_leased(const char *host, int port, int binary) {
+    int fd = connect_to_host(host, port);
+    if (fd < 0) return -1;
+    int one = 1;
+    (void)setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    // Requests are pipelined as a command line followed by frames; without
+    // this each small write after the first waits out the peer's delayed ACK
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    PoolConn *c = (PoolConn*)calloc(1, sizeof(PoolConn));
+    if (!c) {
+        close(fd);
+        return -1;
+    }
+    c->fd = fd;
+    (void)snprintf(c->host, sizeof(c->host), "%s", host);
+    c->port = port;
+    c->binary = binary;
+
+    pthread_mutex_lock(&g_pool_mu);
+    c->next = g_leased;
+    g_leased = c;
+    g_stats.leased++;
+    g_stats.connects++;
+    pthread_mutex_unlock(&g_pool_mu);
+    return fd;
+}
+
+// Unlink the lease for fd (caller holds g_pool_mu)
+static PoolConn *unlink_leased_locked(int fd) {
+    for (PoolConn **pp = &g_leased; *pp; pp = &(*pp)->next) {
+        if ((*pp)->fd == fd) {
+            PoolConn *c = *pp;
+            *pp = c->next;
+            g_stats.leased--;
+            return c;
+        }
+    }
+    return NULL;
+}
+
+int ss_pool_acquire(const char *host, int port) {
+    if (!host || !host[0] || port <= 0) return -1;
+    PoolConn *c = take_idle(host, port, 0);
+    if (c) return c->fd;
+    return open_leased(host, port, 0);
+}
+
+int ss_pool_acquire_binary(const char *host, int port, int *binary_out) {
+    if (binary_out) *binary_out = 0;
+    if (!host || !host[0] || port <= 0) return -1;
+    PoolConn *c = take_idle(host, port, 1);
+    if (c) {
+        if (binary_out) *binary_out = 1;
+        return c->fd;
+    }
+
+    int fd = open_leased(host, port, 1);
+    if (fd < 0) return -1;
+    if (proto_negotiate_binary(fd, "NM", "NM") == 1) {
+        if (binary_out) *binary_out = 1;
+        return fd;
+    }
+    // An SS that rejects HELLO may have closed the socket; start over in text
+    ss_pool_release(fd, 0);
+    return ss_pool_acquire(host, port);
+}
+
+void ss_pool_release(int fd, int reusable) {
+    if (fd < 0) return;
+    long long now = now_ms();
+    pthread_mutex_lock(&g_pool_mu);
+    PoolConn *c = unlink_leased_locked(fd);
+    if (!c) {
+        // Not ours; just close it
+        pthread_mutex_unlock(&g_pool_mu);
+        close(fd);
+        return;
+    }
+
+    if (reusable) {
+        prune_idle_locked(now);
+        int same = 0;
+        for (PoolConn *it = g_idle; it; it = it->next) {
+            if (it->port == c->port && strcmp(it->host, c->host) == 0) same++;
+        }
+        reusable = same < SS_POOL_MAX_IDLE_PER_SS;
+    }
+    if (!reusable) {
+        g_stats.discards++;
+        pthread_mutex_unlock(&g_pool_mu);
+        close(c->fd);
+        free(c);
+        return;
+    }
+    c->idle_since_ms = now;
+    c->next = g_idle;
+    g_idle = c;
+    g_stats.idle++;
+    pthread_mutex_unlock(&g_pool_mu);
+}
+
+void ss_pool_drain(void) {
+    pthread_mutex_lock(&g_pool_mu);
+    PoolConn *c = g_idle;
+    g_idle = NULL;
+    g_stats.idle = 0;
+    pthread_mutex_unlock(&g_pool_mu);
+    while (c) {
+        PoolConn *next = c->next;
+        close(c->fd);
+        free(c);
+        c = next;
+    }
+}
+
+void ss_pool_get_stats(SsPoolStats *out) {
+    if (!out) return;
+    pthread_mutex_lock(&g_pool_mu);
+    *out = g_stats;
+    pthread_mutex_unlock(&g_pool_mu);
+}
@@ -0,0 +1,48 @@
+#ifndef SS_POOL_H
+#define SS_POOL_H
+
+#include <stddef.h>
+
+// Pool of persistent connections to storage servers, kept idle per (host,
+// port, framing mode) and health-checked on acquire. Thread-safe.
+// Release a connection as reusable only after reading its complete response
+// (final ACK/ERROR line or STOP) and nothing else.
+
+#define SS_POOL_MAX_IDLE_PER_SS 8
+#define SS_POOL_IDLE_TIMEOUT_MS 2000
+
+typedef struct {
+    unsigned long connects;   // New TCP connections opened
+    unsigned long reuses;     // Acquires served from the idle list
+    unsigned long discards;   // Connections closed instead of pooled (stale, error, overflow)
+    size_t idle;              // Connections currently idle
+    size_t leased;            // Connections currently handed out
+} SsPoolStats;
+
+// Acquire a text-mode connection to the SS at host:port
+// Returns: connected fd, or -1 if the SS is unreachable
+//
+// Usage:
+//   int fd = ss_pool_acquire(host, port);
+//   if (fd < 0) return -1;
+//   ok = send_all(fd, req, len) == 0 && recv_line(fd, resp, sizeof(resp)) > 0;
+//   ss_pool_release(fd, ok);
+int ss_pool_acquire(const char *host, int port);
+
+// Acquire a connection with binary framing negotiated (HELLO) if the SS
+// supports it; falls back to a text-mode connection otherwise.
+// binary_out: Set to 1 for binary framing, 0 for text
+// Returns: connected fd, or -1 if the SS is unreachable
+int ss_pool_acquire_binary(const char *host, int port, int *binary_out);
+
+// Return a connection obtained from ss_pool_acquire*()
+// reusable: 1 if the last response was fully consumed and the connection
+//           may serve another request; 0 closes it
+void ss_pool_release(int fd, int reusable);
+
+// Close all idle connections (shutdown, or after an SS failure)
+void ss_pool_drain(void);
+
+void ss_pool_get_stats(SsPoolStats *out);
+
+#endif
@@ -0,0 +1,265 @@
+#define _POSIX_C_SOURCE 200809L
+#include "acl_cache.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "index.h"
+
+// One cached ACL. Only the used part of the ACL's entry array is stored
+// (a full ACL struct is ~7KB; most files have a handful of grants).
+typedef struct {
+    uint64_t hash;          // index_hash() of path
+    char *path;             // NULL = free slot
+    ACLEntry *entries;      // count entries (NULL if count == 0)
+    int count;
+    char owner[MAX_USERNAME];
+    time_t expires;         // Negative entries: expiry time
+    uint32_t next;          // Bucket chain / free list (slot index + 1; 0 = end)
+    unsigned char negative;
+    unsigned char referenced;  // CLOCK bit, set by readers with relaxed atomics
+} AclSlot;
+
+typedef struct {
+    pthread_rwlock_t lock;
+    AclSlot *slots;
+    uint32_t cap;
+    uint32_t top;           // Slots ever handed out
+    uint32_t used;
+    uint32_t free_list;     // Invalidated slots (index + 1)
+    uint32_t hand;          // CLOCK hand
+    uint32_t *buckets;      // Chain heads (slot index + 1)
+    uint32_t mask;
+    // Counters, updated with relaxed atomics (per shard to avoid sharing)
+    unsigned long hits;
+    unsigned long negative_hits;
+    unsigned long misses;
+    unsigned long evictions;
+} AclShard;
+
+static AclShard g_shards[ACL_CACHE_SHARDS];
+static int g_acl_cache_ready = 0;
+static int g_negative_ttl = ACL_CACHE_NEGATIVE_TTL_SEC;
+
+#define SLOT(shard, ref) (&(shard)->slots[(ref) - 1])
+
+int acl_cache_init(size_t capacity, int negative_ttl_sec) {
+    if (g_acl_cache_ready) return 0;
+    if (capacity == 0) capacity = ACL_CACHE_DEFAULT_CAPACITY;
+    g_negative_ttl = negative_ttl_sec < 0 ? 0 : negative_ttl_sec;
+
+    uint32_t per_shard = (uint32_t)((capacity + ACL_CACHE_SHARDS - 1) / ACL_CACHE_SHARDS);
+    uint32_t buckets = 16;
+    while (buckets < per_shard * 2) buckets *= 2;
+
+    for (int i = 0; i < ACL_CACHE_SHARDS; i++) {
+        AclShard *shard = &g_shards[i];
+        memset(shard, 0, sizeof(*shard));
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->slots = calloc(per_shard, sizeof(AclSlot));
+        shard->buckets = calloc(buckets, sizeof(uint32_t));
+        if (!shard->slots || !shard->buckets) return -1;
+        shard->cap = per_shard;
+        shard->mask = buckets - 1;
+    }
+    g_acl_cache_ready = 1;
+    return 0;
+}
+
+static AclShard *shard_for(uint64_t hash) {
+    // Low bits pick the bucket, high bits pick the shard
+    return &g_shards[(hash >> 56) & (ACL_CACHE_SHARDS - 1)];
+}
+
+// Find the link holding path's slot; caller holds the shard lock
+static uint32_t *find_link(AclShard *shard, uint64_t hash, const char *path) {
+    uint32_t *link = &shard->buckets[hash & shard->mask];
+    while (*link) {
+        AclSlot *slot = SLOT(shard, *link);
+        if (slot->hash == hash && strcmp(slot->path, path) == 0) return link;
+        link = &slot->next;
+    }
+    return NULL;
+}
+
+static void slot_clear(AclSlot *slot) {
+    free(slot->path);
+    free(slot->entries);
+    memset(slot, 0, sizeof(*slot));
+}
+
+// Unlink slot ref from its chain and free its contents; caller holds the
+// shard lock exclusively
+static void slot_evict(AclShard *shard, uint32_t ref) {
+    AclSlot *slot = SLOT(shard, ref);
+    uint32_t *link = &shard->buckets[slot->hash & shard->mask];
+    while (*link && *link != ref) link = &SLOT(shard, *link)->next;
+    if (*link) *link = slot->next;
+    slot_clear(slot);
+    shard->used--;
+}
+
+// Get a free slot, evicting with CLOCK if the shard is full
+// Caller holds the shard lock exclusively
+static uint32_t slot_alloc(AclShard *shard) {
+    if (shard->free_list) {
+        uint32_t ref = shard->free_list;
+        shard->free_list = SLOT(shard, ref)->next;
+        SLOT(shard, ref)->next = 0;
+        return ref;
+    }
+    if (shard->top < shard->cap) return ++shard->top;
+
+    // Second chance: clear referenced bits until an unreferenced slot
+    // comes around (at most two sweeps)
+    for (;;) {
+        uint32_t ref = shard->hand + 1;
+        AclSlot *slot = SLOT(shard, ref);
+        shard->hand = (shard->hand + 1) % shard->cap;
+        if (__atomic_load_n(&slot->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&slot->referenced, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        slot_evict(shard, ref);
+        __atomic_fetch_add(&shard->evictions, 1, __ATOMIC_RELAXED);
+        return ref;
+    }
+}
+
+int acl_cache_get(const char *path, ACL *acl_out) {
+    if (!g_acl_cache_ready || !path || !acl_out) return ACL_CACHE_MISS;
+
+    uint64_t hash = index_hash(path, strlen(path));
+    AclShard *shard = shard_for(hash);
+    int result = ACL_CACHE_MISS;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    uint32_t *link = find_link(shard, hash, path);
+    if (link) {
+        AclSlot *slot = SLOT(shard, *link);
+        if (slot->negative) {
+            // Expired negatives are left for put/evict to replace
+            if (time(NULL) < slot->expires) result = ACL_CACHE_NEGATIVE;
+        } else {
+            memcpy(acl_out->owner, slot->owner, sizeof(acl_out->owner));
+            if (slot->count > 0) {
+                memcpy(acl_out->entries, slot->entries, slot->count * sizeof(ACLEntry));
+            }
+            acl_out->count = slot->count;
+            result = ACL_CACHE_HIT;
+        }
+        if (result != ACL_CACHE_MISS &&
+            !__atomic_load_n(&slot->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&slot->referenced, 1, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    unsigned long *counter = result == ACL_CACHE_HIT ? &shard->hits :
+                             result == ACL_CACHE_NEGATIVE ? &shard->negative_hits :
+                             &shard->misses;
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+    return result;
+}
+
+// Insert or replace path; acl == NULL stores a negative entry
+static void cache_store(const char *path, const ACL *acl) {
+    if (!g_acl_cache_ready || !path) return;
+
+    // Copy out of the lock
+    uint64_t hash = index_hash(path, strlen(path));
+    char *path_copy = strdup(path);
+    ACLEntry *entries = NULL;
+    int count = acl ? acl->count : 0;
+    if (count < 0) count = 0;
+    if (count > MAX_ACL_ENTRIES) count = MAX_ACL_ENTRIES;
+    if (count > 0) {
+        entries = malloc(count * sizeof(ACLEntry));
+        if (entries) memcpy(entries, acl->entries, count * sizeof(ACLEntry));
+    }
+    if (!path_copy || (count > 0 && !entries)) {
+        free(path_copy);
+        free(entries);
+        return;
+    }
+
+    AclShard *shard = shard_for(hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    uint32_t *link = find_link(shard, hash, path);
+    uint32_t ref;
+    if (link) {
+        // Replace in place; the slot keeps its chain position
+        ref = *link;
+        AclSlot *slot = SLOT(shard, ref);
+        uint32_t next = slot->next;
+        slot_clear(slot);
+        slot->next = next;
+    } else {
+        ref = slot_alloc(shard);
+        size_t b = hash & shard->mask;
+        SLOT(shard, ref)->next = shard->buckets[b];
+        shard->buckets[b] = ref;
+        shard->used++;
+    }
+
+    AclSlot *slot = SLOT(shard, ref);
+    slot->hash = hash;
+    slot->path = path_copy;
+    slot->entries = entries;
+    slot->count = count;
+    if (acl) {
+        memcpy(slot->owner, acl->owner, sizeof(slot->owner));
+        slot->owner[sizeof(slot->owner) - 1] = '\0';
+    } else {
+        slot->negative = 1;
+        slot->expires = time(NULL) + g_negative_ttl;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+void acl_cache_put(const char *path, const ACL *acl) {
+    if (acl) cache_store(path, acl);
+}
+
+void acl_cache_put_negative(const char *path) {
+    if (g_negative_ttl > 0) cache_store(path, NULL);
+}
+
+void acl_cache_invalidate(const char *path) {
+    if (!g_acl_cache_ready || !path) return;
+
+    uint64_t hash = index_hash(path, strlen(path));
+    AclShard *shard = shard_for(hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    uint32_t *link = find_link(shard, hash, path);
+    if (link) {
+        uint32_t ref = *link;
+        *link = SLOT(shard, ref)->next;
+        slot_clear(SLOT(shard, ref));
+        SLOT(shard, ref)->next = shard->free_list;
+        shard->free_list = ref;
+        shard->used--;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+void acl_cache_get_stats(AclCacheStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!g_acl_cache_ready) return;
+
+    for (int i = 0; i < ACL_CACHE_SHARDS; i++) {
+        AclShard *shard = &g_shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        out->entries += shard->used;
+        out->capacity += shard->cap;
+        pthread_rwlock_unlock(&shard->lock);
+        out->hits += __atomic_load_n(&shard->hits, __ATOMIC_RELAXED);
+        out->negative_hits += __atomic_load_n(&shard->negative_hits, __ATOMIC_RELAXED);
+        out->misses += __atomic_load_n(&shard->misses, __ATOMIC_RELAXED);
+        out->evictions += __atomic_load_n(&shard->evictions, __ATOMIC_RELAXED);
+    }
+}
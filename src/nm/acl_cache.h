@@ -0,0 +1,69 @@
+#ifndef ACL_CACHE_H
+#define ACL_CACHE_H
+
+#include <stddef.h>
+
+#include "../common/acl.h"
+
+// NM cache of per-file ACLs fetched from storage servers
+//
+// Every READ/STREAM/WRITE/INFO authorization consults this cache before
+// asking the SS with GET_ACL. The cache is split into ACL_CACHE_SHARDS
+// shards by path hash; each shard is a chained hash table over a fixed
+// slot array guarded by its own reader-writer lock, so lookups are O(1)
+// and lookups on different files rarely touch the same lock.
+// - Eviction is CLOCK (second chance): a hit sets the slot's referenced bit
+//   with a relaxed atomic store under the shared lock; the insert path
+//   sweeps the hand and evicts the first unreferenced slot.
+// - Negative entries record that the SS answered GET_ACL with an error, so
+//   a burst of requests for a broken file does not hammer the SS. They
+//   expire after the negative TTL. Connection failures are never cached.
+// - Entries are keyed on the SS-relative path ("dir/file.txt"); callers
+//   invalidate on DELETE, MOVE and ACL changes.
+
+#define ACL_CACHE_SHARDS 16                 // Power of two
+#define ACL_CACHE_DEFAULT_CAPACITY 16384    // Entries across all shards
+#define ACL_CACHE_NEGATIVE_TTL_SEC 5        // Lifetime of negative entries
+
+// Result of a cache lookup
+#define ACL_CACHE_MISS -1
+#define ACL_CACHE_HIT 0
+#define ACL_CACHE_NEGATIVE 1
+
+typedef struct {
+    unsigned long hits;
+    unsigned long negative_hits;
+    unsigned long misses;
+    unsigned long evictions;
+    size_t entries;
+    size_t capacity;
+} AclCacheStats;
+
+// Size the cache (call once at startup, before serving requests)
+// capacity: Total entries (0 = ACL_CACHE_DEFAULT_CAPACITY)
+// negative_ttl_sec: Lifetime of negative entries (0 disables them)
+// Returns: 0 on success, -1 on allocation failure (cache stays disabled)
+//
+// Usage:
+//   acl_cache_init(ACL_CACHE_DEFAULT_CAPACITY, ACL_CACHE_NEGATIVE_TTL_SEC);
+int acl_cache_init(size_t capacity, int negative_ttl_sec);
+
+// Look up the ACL for path (shared shard lock)
+// acl_out: Receives a copy on ACL_CACHE_HIT
+// Returns: ACL_CACHE_HIT, ACL_CACHE_NEGATIVE (SS recently refused), or
+//          ACL_CACHE_MISS
+int acl_cache_get(const char *path, ACL *acl_out);
+
+// Insert or replace the ACL for path
+void acl_cache_put(const char *path, const ACL *acl);
+
+// Remember that the SS had no ACL for path (expires after the negative TTL)
+void acl_cache_put_negative(const char *path);
+
+// Drop any entry for path
+void acl_cache_invalidate(const char *path);
+
+// Snapshot of the hit/miss/eviction counters and occupancy
+void acl_cache_get_stats(AclCacheStats *out);
+
+#endif
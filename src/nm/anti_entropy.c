@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200809L
+#include "anti_entropy.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/log.h"
+#include "../common/net.h"
+#include "../common/protocol.h"
+#include "../common/ss_pool.h"
+#include "index.h"
+#include "registry.h"
+#include "replication_worker.h"
+
+#define AE_FANOUT 16                // Tree shape, as in src/ss/merkle.h
+#define AE_LEAVES (AE_FANOUT * AE_FANOUT)
+#define AE_MAX_FILES 1024           // Index files considered, as before
+#define AE_CONNECT_TRIES 20         // A recovered SS listens shortly after registering
+#define AE_CONNECT_DELAY_MS 100
+
+typedef struct {
+    char filename[MAX_FILENAME];
+    uint64_t hash;
+} LeafFile;
+
+typedef struct {
+    const char *name;
+    int fd;
+    int healthy;                    // All replies so far read in full
+} Peer;
+
+static int peer_open(Peer *peer, const char *ss_username) {
+    peer->name = ss_username;
+    peer->fd = -1;
+    peer->healthy = 1;
+    char host[64];
+    int port = 0;
+    if (registry_get_ss_info(ss_username, host, sizeof(host), &port) != 0) return -1;
+    for (int i = 0; i < AE_CONNECT_TRIES && peer->fd < 0; i++) {
+        if (i > 0) {
+            struct timespec delay = {0, AE_CONNECT_DELAY_MS * 1000000L};
+            nanosleep(&delay, NULL);
+        }
+        peer->fd = ss_pool_acquire(host, port);
+    }
+    return peer->fd >= 0 ? 0 : -1;
+}
+
+static void peer_close(Peer *peer) {
+    if (peer->fd >= 0) ss_pool_release(peer->fd, peer->healthy);
+    peer->fd = -1;
+}
+
+static int peer_send(Peer *peer, const char *type, const char *payload) {
+    Message msg = {0};
+    snprintf(msg.type, sizeof(msg.type), "%s", type);
+    snprintf(msg.id, sizeof(msg.id), "ae");
+    snprintf(msg.username, sizeof(msg.username), "NM");
+    snprintf(msg.role, sizeof(msg.role), "NM");
+    snprintf(msg.payload, sizeof(msg.payload), "%s", payload);
+    char line[MAX_LINE];
+    proto_format_line(&msg, line, sizeof(line));
+    if (send_all(peer->fd, line, strlen(line)) != 0) {
+        peer->healthy = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Read one MERKLE_NODE reply
+// Returns: 0 on success, 1 if the SS answered with an error, -1 if the
+//          connection failed
+static int peer_read_node(Peer *peer, uint64_t out[AE_FANOUT]) {
+    char line[MAX_LINE];
+    Message reply;
+    if (recv_line(peer->fd, line, sizeof(line)) <= 0 || proto_parse_line(line, &reply) != 0) {
+        peer->healthy = 0;
+        return -1;
+    }
+    if (strcmp(reply.type, "ACK") != 0) return 1;
+    const char *p = reply.payload;
+    for (int i = 0; i < AE_FANOUT; i++) {
+        char *end = NULL;
+        out[i] = strtoull(p, &end, 16);
+        if (end == p) return 1;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+// Read one MERKLE_LEAF reply (DATA lines up to STOP)
+// Returns: number of files (*out malloc'd), or -1 if the connection failed,
+//          the SS answered with an error or the list could not be stored
+static int peer_read_leaf(Peer *peer, LeafFile **out) {
+    *out = NULL;
+    int count = 0, cap = 0;
+    while (1) {
+        char line[MAX_LINE];
+        Message msg;
+        if (recv_line(peer->fd, line, sizeof(line)) <= 0 || proto_parse_line(line, &msg) != 0) {
+            peer->healthy = 0;
+            free(*out);
+            *out = NULL;
+            return -1;
+        }
+        if (strcmp(msg.type, "STOP") == 0) break;
+        if (strcmp(msg.type, "DATA") != 0) {
+            // ERROR ends the reply; no list rather than a short one
+            free(*out);
+            *out = NULL;
+            return -1;
+        }
+        const char *sep = strchr(msg.payload, '|');
+        if (!sep) continue;
+        if (count == cap) {
+            int new_cap = cap ? cap * 2 : 8;
+            LeafFile *grown = realloc(*out, sizeof(LeafFile) * (size_t)new_cap);
+            if (!grown) {
+                // A short list would hide files; the rest of the reply is unread
+                peer->healthy = 0;
+                free(*out);
+                *out = NULL;
+                return -1;
+            }
+            *out = grown;
+            cap = new_cap;
+        }
+        LeafFile *f = &(*out)[count++];
+        f->hash = strtoull(msg.payload, NULL, 16);
+        snprintf(f->filename, sizeof(f->filename), "%s", sep + 1);
+    }
+    return count;
+}
+
+static int name_listed(char **names, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+// Walk both trees and collect the files to copy
+// Returns: number of names (*names_out malloc'd, each entry malloc'd),
+//          or -1 if either SS cannot be walked
+static int merkle_diff(Peer *src, Peer *tgt, char ***names_out, int *leaves_out) {
+    *names_out = NULL;
+    *leaves_out = 0;
+    uint64_t src_nodes[AE_FANOUT], tgt_nodes[AE_FANOUT];
+    if (peer_send(src, "MERKLE_NODE", "0|0") != 0 || peer_send(tgt, "MERKLE_NODE", "0|0") != 0) {
+        return -1;
+    }
+    int rs = peer_read_node(src, src_nodes);
+    int rt = peer_read_node(tgt, tgt_nodes);
+    if (rs != 0 || rt != 0) return -1;
+
+    // Inner nodes that differ, then their leaves, each level pipelined
+    int nodes[AE_FANOUT], node_count = 0;
+    for (int i = 0; i < AE_FANOUT; i++) {
+        if (src_nodes[i] != tgt_nodes[i]) nodes[node_count++] = i;
+    }
+    for (int n = 0; n < node_count; n++) {
+        char payload[16];
+        snprintf(payload, sizeof(payload), "1|%d", nodes[n]);
+        if (peer_send(src, "MERKLE_NODE", payload) != 0 || peer_send(tgt, "MERKLE_NODE", payload) != 0) {
+            return -1;
+        }
+    }
+    int leaves[AE_LEAVES], leaf_count = 0;
+    int failed = 0;
+    for (int n = 0; n < node_count; n++) {
+        uint64_t src_leaves[AE_FANOUT], tgt_leaves[AE_FANOUT];
+        rs = peer_read_node(src, src_leaves);
+        rt = peer_read_node(tgt, tgt_leaves);
+        if (rs < 0 || rt < 0) return -1;
+        if (rs != 0 || rt != 0) {
+            failed = 1;
+            continue;
+        }
+        for (int j = 0; j < AE_FANOUT; j++) {
+            if (src_leaves[j] != tgt_leaves[j]) leaves[leaf_count++] = nodes[n] * AE_FANOUT + j;
+        }
+    }
+    if (failed) return -1;
+
+    for (int l = 0; l < leaf_count; l++) {
+        char payload[16];
+        snprintf(payload, sizeof(payload), "%d", leaves[l]);
+        if (peer_send(src, "MERKLE_LEAF", payload) != 0 || peer_send(tgt, "MERKLE_LEAF", payload) != 0) {
+            return -1;
+        }
+    }
+    char **names = NULL;
+    int count = 0, cap = 0;
+    for (int l = 0; l < leaf_count && !failed; l++) {
+        LeafFile *src_files = NULL, *tgt_files = NULL;
+        int ns = peer_read_leaf(src, &src_files);
+        int nt = peer_read_leaf(tgt, &tgt_files);
+        if (ns < 0 || nt < 0) failed = 1;
+        // Both lists are in name order
+        for (int i = 0, j = 0; !failed && i < ns; i++) {
+            while (j < nt && strcmp(tgt_files[j].filename, src_files[i].filename) < 0) j++;
+            if (j < nt && strcmp(tgt_files[j].filename, src_files[i].filename) == 0 &&
+                tgt_files[j].hash == src_files[i].hash) {
+                continue;
+            }
+            if (count == cap) {
+                cap = cap ? cap * 2 : 16;
+                char **grown = realloc(names, sizeof(char *) * (size_t)cap);
+                if (!grown) {
+                    failed = 1;
+                    break;
+                }
+                names = grown;
+            }
+            names[count] = strdup(src_files[i].filename);
+            if (!names[count]) failed = 1;
+            else count++;
+        }
+        free(src_files);
+        free(tgt_files);
+    }
+    if (failed) {
+        for (int i = 0; i < count; i++) free(names[i]);
+        free(names);
+        return -1;
+    }
+    *names_out = names;
+    *leaves_out = leaf_count;
+    return count;
+}
+
+int anti_entropy_sync(const char *source_ss, const char *target_ss) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    Peer src = { source_ss, -1, 1 }, tgt = { target_ss, -1, 1 };
+    char **names = NULL;
+    int diff_count = -1;
+    int leaves = 0;
+    if (peer_open(&src, source_ss) == 0 && peer_open(&tgt, target_ss) == 0) {
+        diff_count = merkle_diff(&src, &tgt, &names, &leaves);
+    }
+    if (diff_count < 0) {
+        // Replies may be left unread
+        src.healthy = 0;
+        tgt.healthy = 0;
+    }
+    peer_close(&src);
+    peer_close(&tgt);
+    if (diff_count < 0) {
+        log_warning("anti_entropy_fallback", "Cannot compare %s and %s, syncing every file",
+                    source_ss, target_ss);
+    }
+
+    FileEntry *all_files = malloc(sizeof(FileEntry) * AE_MAX_FILES);
+    int total_files = all_files ? index_get_all_files(all_files, AE_MAX_FILES) : -1;
+    int queued = 0;
+    for (int i = 0; i < total_files; i++) {
+        const FileEntry *entry = &all_files[i];
+        // Files of the pair (they may point to either SS now)
+        if (strcmp(entry->ss_username, source_ss) != 0 &&
+            strcmp(entry->ss_username, target_ss) != 0) {
+            continue;
+        }
+        if (diff_count >= 0) {
+            // SSs name nested files by their path under files/
+            char path[MAX_FOLDER_PATH + MAX_FILENAME];
+            snprintf(path, sizeof(path), "%s%s",
+                     strcmp(entry->folder_path, "/") == 0 ? "" : entry->folder_path, entry->filename);
+            if (!name_listed(names, diff_count, entry->filename) &&
+                !name_listed(names, diff_count, path)) {
+                continue;
+            }
+        }
+        log_info("nm_recovery_sync_file", "Queueing %s from %s to %s",
+                 entry->filename, source_ss, target_ss);
+        replication_worker_queue(REPL_OP_UPDATE, entry->filename, source_ss, target_ss);
+        queued++;
+    }
+    free(all_files);
+    for (int i = 0; i < diff_count; i++) free(names[i]);
+    free(names);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long long ms = (long long)(t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+    log_info("anti_entropy_sync", "%s -> %s: %d differing leaves, %d differing files, %d queued in %lld ms",
+             source_ss, target_ss, leaves, diff_count < 0 ? -1 : diff_count, queued, ms);
+    return total_files < 0 ? -1 : queued;
+}
@@ -0,0 +1,26 @@
+#ifndef ANTI_ENTROPY_H
+#define ANTI_ENTROPY_H
+
+// Anti-entropy sync of a recovered storage server
+//
+// When an SS re-registered after a failure, the NM queued a copy of every
+// file of its pair, so recovery re-sent the whole dataset even if nothing
+// had changed. Recovery now queues one REPL_OP_SYNC_ALL job, and the
+// replication worker runs anti_entropy_sync for it:
+// - Both SSs keep a Merkle tree over their files (src/ss/merkle.h). The
+//   NM asks each for the root's children (MERKLE_NODE), then only for the
+//   inner nodes that differ, then for the files of the leaves that differ
+//   (MERKLE_LEAF), pipelined on one pooled connection per SS.
+// - Files that the source has and the target lacks or holds with another
+//   content hash are copied, if the NM index places them on the pair; a
+//   REPL_OP_UPDATE is queued for each (direct or delta, like any update).
+// - The number of requests grows with the number of differing leaves, not
+//   the number of files; two identical SSs cost one request each.
+// - An SS that does not answer MERKLE_NODE (or cannot be reached) gets the
+//   old full sync: an update for every indexed file of the pair.
+
+// Queue updates bringing target_ss up to date with source_ss
+// Returns: number of files queued, or -1 if the NM index could not be read
+int anti_entropy_sync(const char *source_ss, const char *target_ss);
+
+#endif
@@ -11,26 +11,17 @@
 
 #include "../common/net.h"
 #include "../common/log.h"
+#include "../common/ss_pool.h"
 #include "registry.h"
 #include "access_requests.h"
 #include "replication.h"
 #include "replication_worker.h"
 #include "heartbeat_monitor.h"
+#include "acl_cache.h"
 
 #define MAX_SS_CANDIDATES 64
-#define ACL_CACHE_CAPACITY 256
 #define ACL_CACHE_KEY_MAX 768
 
-typedef struct {
-    char path[ACL_CACHE_KEY_MAX];
-    ACL acl;
-    int valid;
-} AclCacheEntry;
-
-static AclCacheEntry g_acl_cache[ACL_CACHE_CAPACITY];
-static int g_acl_cache_next_slot = 0;
-static pthread_mutex_t g_acl_cache_mu = PTHREAD_MUTEX_INITIALIZER;
-
 static int get_ss_connection_for_file(const FileEntry *entry);
 static int fetch_file_content_from_ss(const FileEntry *entry, char **content_out);
 static int execute_script_text(const char *script_text, char **output_out, char *error_buf, size_t error_len);
@@ -75,58 +66,15 @@ static void build_full_path(const FileEntry *entry, char *full_path, size_t len)
     }
 }
 
-static int acl_cache_get(const char *path, ACL *acl_out) {
-    if (!path || !acl_out) return -1;
-    pthread_mutex_lock(&g_acl_cache_mu);
-    for (int i = 0; i < ACL_CACHE_CAPACITY; i++) {
-        if (g_acl_cache[i].valid && strcmp(g_acl_cache[i].path, path) == 0) {
-            *acl_out = g_acl_cache[i].acl;
-            pthread_mutex_unlock(&g_acl_cache_mu);
-            return 0;
-        }
-    }
-    pthread_mutex_unlock(&g_acl_cache_mu);
-    return -1;
-}
-
-static void acl_cache_put(const char *path, const ACL *acl) {
-    if (!path || !acl) return;
-    pthread_mutex_lock(&g_acl_cache_mu);
-    // Update existing entry if present
-    for (int i = 0; i < ACL_CACHE_CAPACITY; i++) {
-        if (g_acl_cache[i].valid && strcmp(g_acl_cache[i].path, path) == 0) {
-            g_acl_cache[i].acl = *acl;
-            pthread_mutex_unlock(&g_acl_cache_mu);
-            return;
-        }
-    }
-    AclCacheEntry *slot = &g_acl_cache[g_acl_cache_next_slot];
-    snprintf(slot->path, sizeof(slot->path), "%s", path);
-    slot->acl = *acl;
-    slot->valid = 1;
-    g_acl_cache_next_slot = (g_acl_cache_next_slot + 1) % ACL_CACHE_CAPACITY;
-    pthread_mutex_unlock(&g_acl_cache_mu);
-}
-
-static void acl_cache_invalidate(const char *path) {
-    if (!path) return;
-    pthread_mutex_lock(&g_acl_cache_mu);
-    for (int i = 0; i < ACL_CACHE_CAPACITY; i++) {
-        if (g_acl_cache[i].valid && strcmp(g_acl_cache[i].path, path) == 0) {
-            g_acl_cache[i].valid = 0;
-        }
-    }
-    pthread_mutex_unlock(&g_acl_cache_mu);
-}
-
 // Helper: Fetch ACL from storage server (with cache)
 static int fetch_acl_from_ss(const FileEntry *entry, ACL *acl_out) {
     if (!entry || !acl_out) return -1;
 
     char full_path[ACL_CACHE_KEY_MAX];
     build_full_path(entry, full_path, sizeof(full_path));
-    if (acl_cache_get(full_path, acl_out) == 0) {
-        return 0;
+    int cached = acl_cache_get(full_path, acl_out);
+    if (cached != ACL_CACHE_MISS) {
+        return cached == ACL_CACHE_HIT ? 0 : -1;
     }
 
     int ss_fd = get_ss_connection_for_file(entry);
@@ -146,18 +94,18 @@ static int fetch_acl_from_ss(const FileEntry *entry, ACL *acl_out) {
 
     char req_buf[MAX_LINE];
     if (proto_format_line(&req, req_buf, sizeof(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         return -1;
     }
     if (send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         return -1;
     }
 
     // Receive response
     char resp_buf[MAX_LINE];
     int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-    close(ss_fd);
+    ss_pool_release(ss_fd, n > 0);
     if (n <= 0) {
         return -1;
     }
@@ -168,6 +116,8 @@ static int fetch_acl_from_ss(const FileEntry *entry, ACL *acl_out) {
     }
 
     if (strcmp(resp.type, "ERROR") == 0) {
+        // The SS answered: remember the refusal briefly
+        acl_cache_put_negative(full_path);
         return -1;
     }
 
@@ -195,9 +145,49 @@ static int fetch_acl_from_ss(const FileEntry *entry, ACL *acl_out) {
     return 0;
 }
 
+// Receive a DATA...STOP stream sent as binary frames into a heap buffer.
+static int recv_frame_stream(NetReader *reader, char **content_out) {
+    size_t cap = 4096;
+    size_t len = 0;
+    char *buffer = (char*)malloc(cap);
+    if (!buffer) return -1;
+
+    while (1) {
+        FrameHeader hdr;
+        if (proto_reader_frame_header(reader, &hdr) != 0 || hdr.type == FRAME_ERROR) {
+            free(buffer);
+            return -1;
+        }
+        if (hdr.type == FRAME_STOP) break;
+        if (len + hdr.payload_len + 1 > cap) {
+            while (len + hdr.payload_len + 1 > cap) cap *= 2;
+            char *tmp = realloc(buffer, cap);
+            if (!tmp) {
+                free(buffer);
+                return -1;
+            }
+            buffer = tmp;
+        }
+        if (net_reader_read(reader, buffer + len, hdr.payload_len) != 0) {
+            free(buffer);
+            return -1;
+        }
+        if (hdr.type == FRAME_DATA) len += hdr.payload_len;
+    }
+    buffer[len] = '\0';
+    *content_out = buffer;
+    return 0;
+}
+
 static int fetch_file_content_from_ss(const FileEntry *entry, char **content_out) {
     if (!entry || !content_out) return -1;
-    int ss_fd = get_ss_connection_for_file(entry);
+    // Prefer binary framing (negotiated once per pooled connection)
+    const char *active_host;
+    int active_port;
+    const char *active_ss_name;
+    get_active_ss_for_file(entry, &active_host, &active_port, &active_ss_name);
+    int binary = 0;
+    int ss_fd = ss_pool_acquire_binary(active_host, active_port, &binary);
     if (ss_fd < 0) return -1;
 
     Message req = {0};
@@ -210,35 +200,53 @@ static int fetch_file_content_from_ss(const FileEntry *entry, char **content_out
     char req_buf[MAX_LINE];
     if (proto_format_line(&req, req_buf, sizeof(req_buf)) != 0 ||
         send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         return -1;
     }
 
+    NetReader *reader = (NetReader*)malloc(sizeof(NetReader));
+    if (!reader) {
+        ss_pool_release(ss_fd, 0);
+        return -1;
+    }
+    net_reader_init(reader, ss_fd);
+
+    if (binary) {
+        int rc = recv_frame_stream(reader, content_out);
+        ss_pool_release(ss_fd, rc == 0 && net_reader_buffered(reader) == 0);
+        free(reader);
+        return rc;
+    }
+
     size_t cap = 4096;
     size_t len = 0;
     char *buffer = (char*)malloc(cap);
     if (!buffer) {
-        close(ss_fd);
+        free(reader);
+        ss_pool_release(ss_fd, 0);
         return -1;
     }
 
     while (1) {
         char resp_buf[MAX_LINE];
-        int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
+        int n = net_reader_line(reader, resp_buf, sizeof(resp_buf));
         if (n <= 0) {
             free(buffer);
-            close(ss_fd);
+            free(reader);
+            ss_pool_release(ss_fd, 0);
             return -1;
         }
         Message resp;
         if (proto_parse_line(resp_buf, &resp) != 0) {
             free(buffer);
-            close(ss_fd);
+            free(reader);
+            ss_pool_release(ss_fd, 0);
             return -1;
         }
         if (strcmp(resp.type, "ERROR") == 0) {
             free(buffer);
-            close(ss_fd);
+            free(reader);
+            ss_pool_release(ss_fd, 0);
             return -1;
         }
         if (strcmp(resp.type, "STOP") == 0) {
@@ -252,7 +260,8 @@ static int fetch_file_content_from_ss(const FileEntry *entry, char **content_out
                     char *tmp = realloc(buffer, cap);
                     if (!tmp) {
                         free(buffer);
-                        close(ss_fd);
+                        free(reader);
+                        ss_pool_release(ss_fd, 0);
                         return -1;
                     }
                     buffer = tmp;
@@ -261,7 +270,8 @@ static int fetch_file_content_from_ss(const FileEntry *entry, char **content_out
             }
         }
     }
-    close(ss_fd);
+    ss_pool_release(ss_fd, net_reader_buffered(reader) == 0);
+    free(reader);
     if (len + 1 >= cap) {
         char *tmp = realloc(buffer, len + 1);
         if (!tmp) {
@@ -450,7 +460,7 @@ int send_data_response(int client_fd, const char *id, const char *username,
 }
 
 // Helper: Get SS connection for a file
-// Returns: SS connection fd, or -1 on error
+// Returns: Pooled SS connection fd (give back with ss_pool_release), or -1
 static int get_ss_connection_for_file(const FileEntry *entry) {
     if (!entry) return -1;
     
@@ -460,17 +470,11 @@ static int get_ss_connection_for_file(const FileEntry *entry) {
     const char *active_ss_name;
     get_active_ss_for_file(entry, &active_host, &active_port, &active_ss_name);
     
-    // Connect to active SS
-    int fd = connect_to_host(active_host, active_port);
-    if (fd < 0) {
-        return -1;
-    }
-    
-    return fd;
+    return ss_pool_acquire(active_host, active_port);
 }
 
 // Helper: Find SS by username (for CREATE - need to select SS)
-// Returns: SS connection fd, or -1 on error
+// Returns: Pooled SS connection fd (give back with ss_pool_release), or -1
 static int find_ss_connection(const char *ss_username) {
     if (!ss_username) return -1;
     
@@ -484,7 +488,7 @@ static int find_ss_connection(const char *ss_username) {
     
     // Connect to SS
     if (strlen(ss_host) > 0 && ss_client_port > 0) {
-        return connect_to_host(ss_host, ss_client_port);
+        return ss_pool_acquire(ss_host, ss_client_port);
     }
     return -1;
 }
@@ -520,7 +524,7 @@ static int load_owner_from_ss(FileEntry *entry) {
     char cmd_line[MAX_LINE];
     proto_format_line(&meta_cmd, cmd_line, sizeof(cmd_line));
     if (send_all(ss_fd, cmd_line, strlen(cmd_line)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         log_error("nm_load_owner", "Failed to send GETMETA to SS");
         return -1;
     }
@@ -528,7 +532,7 @@ static int load_owner_from_ss(FileEntry *entry) {
     // Wait for response from SS
     char resp_buf[MAX_LINE];
     int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-    close(ss_fd);
+    ss_pool_release(ss_fd, n > 0);
     
     if (n <= 0) {
         log_error("nm_load_owner", "No response from SS");
@@ -557,6 +561,7 @@ static int load_owner_from_ss(FileEntry *entry) {
             if (owner_len < sizeof(entry->owner)) {
                 memcpy(entry->owner, owner_start, owner_len);
                 entry->owner[owner_len] = '\0';
+                index_set_owner(full_path, entry->owner);
                 log_info("nm_owner_loaded", "file=%s owner=%s", entry->filename, entry->owner);
                 return 0;
             }
@@ -564,6 +569,7 @@ static int load_owner_from_ss(FileEntry *entry) {
             // No comma after owner (it's the last field or only field)
             strncpy(entry->owner, owner_start, sizeof(entry->owner) - 1);
             entry->owner[sizeof(entry->owner) - 1] = '\0';
+            index_set_owner(full_path, entry->owner);
             log_info("nm_owner_loaded", "file=%s owner=%s", entry->filename, entry->owner);
             return 0;
         }
@@ -591,8 +597,13 @@ int handle_view(int client_fd, const char *username, const char *flags) {
         if (strchr(flags, 'l')) show_details = 1;
     }
     
-    // Get files from index
-    FileEntry *all_files[1000];
+    // Get a snapshot of the index (copies, so no lock is held while
+    // owners are fetched from storage servers below)
+    FileEntry *all_files = malloc(sizeof(FileEntry) * 1000);
+    if (!all_files) {
+        Error err = error_simple(ERR_INTERNAL, "Out of memory");
+        return send_error_response(client_fd, "", username, &err);
+    }
     int total_count = index_get_all_files(all_files, 1000);
     
     // Filter files based on access (if not -a)
@@ -602,16 +613,16 @@ int handle_view(int client_fd, const char *username, const char *flags) {
     // Load owner from SS metadata for files that don't have it set
     // printf("DEBUG: SHOW_ALL :%d total_count=%d\n", show_all, total_count);
     for (int i = 0; i < total_count; i++) {
-        if (all_files[i]->owner[0] == '\0') {
+        if (all_files[i].owner[0] == '\0') {
             // Owner not set - load from SS metadata
-            load_owner_from_ss(all_files[i]);
+            load_owner_from_ss(&all_files[i]);
         }
     }
     
     if (show_all) {
         // Show all files
         for (int i = 0; i < total_count; i++) {
-            filtered_files[filtered_count++] = all_files[i];
+            filtered_files[filtered_count++] = &all_files[i];
         }
     } else {
         // Show files owned by user
@@ -619,9 +630,9 @@ int handle_view(int client_fd, const char *username, const char *flags) {
         // fflush(stdout);
         for (int i = 0; i < total_count; i++) {
             log_info("nm_view_check_owner", "file=%s owner=%s user=%s",
-                     all_files[i]->filename, all_files[i]->owner, username);
-            if (strcmp(all_files[i]->owner, username) == 0) {
-                filtered_files[filtered_count++] = all_files[i];
+                     all_files[i].filename, all_files[i].owner, username);
+            if (strcmp(all_files[i].owner, username) == 0) {
+                filtered_files[filtered_count++] = &all_files[i];
             }
         }
     }
@@ -709,6 +720,8 @@ int handle_view(int client_fd, const char *username, const char *flags) {
         }
     }
     
+    free(all_files);
+    
     // Send response
     return send_data_response(client_fd, "", username, output);
 }
@@ -721,7 +734,8 @@ int handle_create(int client_fd, const char *username, const char *filename) {
     }
     
     // Check if file already exists
-    FileEntry *existing = index_lookup_file(filename);
+    FileEntry existing_buf;
+    FileEntry *existing = index_get_file(filename, &existing_buf);
     if (existing) {
         Error err = error_create(ERR_CONFLICT, "File '%s' already exists", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -756,13 +770,13 @@ int handle_create(int client_fd, const char *username, const char *filename) {
         proto_format_line(&create_cmd, cmd_line, sizeof(cmd_line));
         if (send_all(ss_fd, cmd_line, strlen(cmd_line)) != 0) {
             log_error("nm_create_send", "Failed to send CREATE to SS %s", candidate);
-            close(ss_fd);
+            ss_pool_release(ss_fd, 0);
             continue;
         }
 
         char resp_buf[MAX_LINE];
         int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-        close(ss_fd);
+        ss_pool_release(ss_fd, n > 0);
 
         if (n <= 0) {
             log_error("nm_create_resp", "No response from SS %s", candidate);
@@ -795,7 +809,8 @@ int handle_create(int client_fd, const char *username, const char *filename) {
     
     // SS created file successfully - add to index or update existing entry
     // Get SS info for index
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     
     // Get SS info from registry
     char ss_host[64] = {0};
@@ -804,14 +819,15 @@ int handle_create(int client_fd, const char *username, const char *filename) {
     if (registry_get_ss_info(selected_ss, ss_host, sizeof(ss_host), &ss_client_port) == 0) {
         if (!entry) {
             // File not in index - add it
-            entry = index_add_file(filename, username, ss_host, ss_client_port, selected_ss);
+            if (index_add_file(filename, username, ss_host, ss_client_port, selected_ss,
+                               &entry_buf) == 0) {
+                entry = &entry_buf;
+            }
         } else {
             // File exists in index (probably from SS registration with owner=ss1)
             // Update the owner to the actual creator
-            size_t owner_len = strlen(username);
-            size_t copy_len = (owner_len < sizeof(entry->owner) - 1) ? owner_len : sizeof(entry->owner) - 1;
-            memcpy(entry->owner, username, copy_len);
-            entry->owner[copy_len] = '\0';
+            index_set_owner(filename, username);
+            snprintf(entry->owner, sizeof(entry->owner), "%s", username);
             log_info("nm_file_owner_updated", "file=%s new_owner=%s", filename, username);
         }
     }
@@ -822,6 +838,11 @@ int handle_create(int client_fd, const char *username, const char *filename) {
             index_add_folder(entry->folder_path, selected_ss);
         }
         
+        // Drop anything cached for a previous file at this path
+        char full_path[ACL_CACHE_KEY_MAX];
+        build_full_path(entry, full_path, sizeof(full_path));
+        acl_cache_invalidate(full_path);
+
         log_info("nm_file_created", "file=%s owner=%s", filename, entry->owner);
         registry_adjust_ss_file_count(selected_ss, 1);
         
@@ -853,7 +874,8 @@ int handle_delete(int client_fd, const char *username, const char *filename) {
     }
     
     // Lookup file in index
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -888,7 +910,7 @@ int handle_delete(int client_fd, const char *username, const char *filename) {
     char cmd_line[MAX_LINE];
     proto_format_line(&delete_cmd, cmd_line, sizeof(cmd_line));
     if (send_all(ss_fd, cmd_line, strlen(cmd_line)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send command to storage server");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -896,7 +918,7 @@ int handle_delete(int client_fd, const char *username, const char *filename) {
     // Wait for ACK from SS
     char resp_buf[MAX_LINE];
     int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-    close(ss_fd);
+    ss_pool_release(ss_fd, n > 0);
     
     if (n <= 0) {
         Error err = error_simple(ERR_INTERNAL, "No response from storage server");
@@ -953,7 +975,8 @@ int handle_info(int client_fd, const char *username, const char *filename) {
     }
     
     // Lookup file in index
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -973,8 +996,8 @@ int handle_info(int client_fd, const char *username, const char *filename) {
     
     // Update last accessed timestamp
     time_t now = time(NULL);
-    index_update_metadata(filename, now, 0, entry->size_bytes,
-                         entry->word_count, entry->char_count);
+    index_touch_file(filename, now);
+    entry->last_accessed = now;
     
     // Format INFO output
     char output[1024] = {0};
@@ -1030,7 +1053,8 @@ int handle_read(int client_fd, const char *username, const char *filename) {
     
     // Lookup file in index
     log_info("nm_read_lookup", "file=%s user=%s", filename, username);
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         log_error("nm_read_not_found", "file=%s user=%s", filename, username);
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
@@ -1087,7 +1111,8 @@ int handle_stream(int client_fd, const char *username, const char *filename) {
     }
     
     // Lookup file in index
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -1139,7 +1164,8 @@ int handle_undo(int client_fd, const char *username, const char *filename) {
         return send_error_response(client_fd, "", username, &err);
     }
 
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -1180,7 +1206,8 @@ int handle_exec(int client_fd, const char *username, const char *filename, const
         return send_error_response(client_fd, "", username, &err);
     }
 
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -1227,7 +1254,8 @@ int handle_write(int client_fd, const char *username, const char *filename, int
         return send_error_response(client_fd, "", username, &err);
     }
 
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -1277,7 +1305,8 @@ int handle_addaccess(int client_fd, const char *username, const char *flag,
     }
     
     // Lookup file in index
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -1315,7 +1344,7 @@ int handle_addaccess(int client_fd, const char *username, const char *flag,
     char cmd_line[MAX_LINE];
     proto_format_line(&update_cmd, cmd_line, sizeof(cmd_line));
     if (send_all(ss_fd, cmd_line, strlen(cmd_line)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send command to storage server");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -1323,7 +1352,7 @@ int handle_addaccess(int client_fd, const char *username, const char *flag,
     // Wait for ACK from SS
     char resp_buf[MAX_LINE];
     int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-    close(ss_fd);
+    ss_pool_release(ss_fd, n > 0);
     
     if (n <= 0) {
         Error err = error_simple(ERR_INTERNAL, "No response from storage server");
@@ -1365,7 +1394,8 @@ int handle_remaccess(int client_fd, const char *username,
     }
     
     // Lookup file in index
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -1403,7 +1433,7 @@ int handle_remaccess(int client_fd, const char *username,
     char cmd_line[MAX_LINE];
     proto_format_line(&update_cmd, cmd_line, sizeof(cmd_line));
     if (send_all(ss_fd, cmd_line, strlen(cmd_line)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send command to storage server");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -1411,7 +1441,7 @@ int handle_remaccess(int client_fd, const char *username,
     // Wait for ACK from SS
     char resp_buf[MAX_LINE];
     int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-    close(ss_fd);
+    ss_pool_release(ss_fd, n > 0);
     
     if (n <= 0) {
         Error err = error_simple(ERR_INTERNAL, "No response from storage server");
@@ -1481,7 +1511,7 @@ int handle_createfolder(int client_fd, const char *username, const char *folder_
     }
     
     // Connect to SS and send CREATE_FOLDER command
-    int ss_fd = connect_to_host(ss_host, ss_client_port);
+    int ss_fd = ss_pool_acquire(ss_host, ss_client_port);
     if (ss_fd < 0) {
         Error err = error_simple(ERR_UNAVAILABLE, "Failed to connect to storage server");
         return send_error_response(client_fd, "", username, &err);
@@ -1497,7 +1527,7 @@ int handle_createfolder(int client_fd, const char *username, const char *folder_
     char req_buf[MAX_LINE];
     if (proto_format_line(&req, req_buf, sizeof(req_buf)) != 0 ||
         send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send command to storage server");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -1505,7 +1535,7 @@ int handle_createfolder(int client_fd, const char *username, const char *folder_
     // Wait for response
     char resp_buf[MAX_LINE];
     int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-    close(ss_fd);
+    ss_pool_release(ss_fd, n > 0);
     
     if (n <= 0) {
         Error err = error_simple(ERR_INTERNAL, "No response from storage server");
@@ -1544,7 +1574,8 @@ int handle_move(int client_fd, const char *username, const char *filename,
     }
     
     // Look up file
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_simple(ERR_NOT_FOUND, "File not found");
         return send_error_response(client_fd, "", username, &err);
@@ -1570,7 +1601,7 @@ int handle_move(int client_fd, const char *username, const char *filename,
     }
     
     // Connect to SS and send MOVE command
-    int ss_fd = connect_to_host(entry->ss_host, entry->ss_client_port);
+    int ss_fd = ss_pool_acquire(entry->ss_host, entry->ss_client_port);
     if (ss_fd < 0) {
         Error err = error_simple(ERR_UNAVAILABLE, "Failed to connect to storage server");
         return send_error_response(client_fd, "", username, &err);
@@ -1591,7 +1622,7 @@ int handle_move(int client_fd, const char *username, const char *filename,
     char req_buf[MAX_LINE];
     if (proto_format_line(&req, req_buf, sizeof(req_buf)) != 0 ||
         send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send command to storage server");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -1599,7 +1630,7 @@ int handle_move(int client_fd, const char *username, const char *filename,
     // Wait for response
     char resp_buf[MAX_LINE];
     int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-    close(ss_fd);
+    ss_pool_release(ss_fd, n > 0);
     
     if (n <= 0) {
         Error err = error_simple(ERR_INTERNAL, "No response from storage server");
@@ -1653,12 +1684,16 @@ int handle_viewfolder(int client_fd, const char *username, const char *folder_pa
         return send_error_response(client_fd, "", username, &err);
     }
     
-    // Get files in folder
-    FileEntry *files[1000];
+    // Snapshot files and subfolders in folder
+    FileEntry *files = malloc(sizeof(FileEntry) * 1000);
+    FolderEntry *folders = malloc(sizeof(FolderEntry) * 1000);
+    if (!files || !folders) {
+        free(files);
+        free(folders);
+        Error err = error_simple(ERR_INTERNAL, "Out of memory");
+        return send_error_response(client_fd, "", username, &err);
+    }
     int file_count = index_get_files_in_folder(folder_path, files, 1000);
-    
-    // Get subfolders in folder
-    FolderEntry *folders[1000];
     int folder_count = index_get_subfolders(folder_path, folders, 1000);
     
     // Build response
@@ -1677,7 +1712,7 @@ int handle_viewfolder(int client_fd, const char *username, const char *folder_pa
         
         for (int i = 0; i < folder_count && remaining > 0; i++) {
             // Extract folder name from full path
-            const char *folder_name = folders[i]->folder_path;
+            const char *folder_name = folders[i].folder_path;
             const char *last_slash = strrchr(folder_name, '/');
             if (last_slash && last_slash != folder_name) {
                 // Find second-to-last slash
@@ -1703,7 +1738,7 @@ int handle_viewfolder(int client_fd, const char *username, const char *folder_pa
         if (written > 0) { p += written; remaining -= written; }
         
         for (int i = 0; i < file_count && remaining > 0; i++) {
-            written = snprintf(p, remaining, "  %s\n", files[i]->filename);
+            written = snprintf(p, remaining, "  %s\n", files[i].filename);
             if (written > 0) { p += written; remaining -= written; }
         }
     }
@@ -1713,6 +1748,9 @@ int handle_viewfolder(int client_fd, const char *username, const char *folder_pa
         if (written > 0) { p += written; remaining -= written; }
     }
     
+    free(files);
+    free(folders);
+    
     log_info("nm_viewfolder", "folder=%s user=%s files=%d folders=%d", 
              folder_path, username, file_count, folder_count);
     return send_data_response(client_fd, "", username, response);
@@ -1761,7 +1799,8 @@ int handle_requestaccess(int client_fd, const char *username, const char *payloa
     }
     
     // Lookup file
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -1830,8 +1869,7 @@ int handle_requestaccess(int client_fd, const char *username, const char *payloa
         
         // Wait for ACK (don't fail if SS fails - request is in memory)
         char resp_buf[MAX_LINE];
-        recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-        close(ss_fd);
+        ss_pool_release(ss_fd, recv_line(ss_fd, resp_buf, sizeof(resp_buf)) > 0);
         log_info("nm_request_persisted", "id=%d file=%s", request_id, filename);
     }
     
@@ -2007,7 +2045,8 @@ int handle_approveaccessrequest(int client_fd, const char *username, const char
     log_info("nm_approve_step4", "Looking up file with path: %s", full_path);
     
     // Lookup file to get SS info
-    FileEntry *entry = index_lookup_file(full_path);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(full_path, &entry_buf);
     if (!entry) {
         // File was deleted - remove request
         log_error("nm_approve_fail", "File %s not found in index", full_path);
@@ -2049,7 +2088,7 @@ int handle_approveaccessrequest(int client_fd, const char *username, const char
     proto_format_line(&ss_req, req_buf, sizeof(req_buf));
     
     if (send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         log_error("nm_approve_fail", "Failed to send to SS");
         Error err = error_simple(ERR_INTERNAL, "Failed to send command to storage server");
         return send_error_response(client_fd, "", username, &err);
@@ -2060,7 +2099,7 @@ int handle_approveaccessrequest(int client_fd, const char *username, const char
     // Wait for response
     char resp_buf[MAX_LINE];
     int n = recv_line(ss_fd, resp_buf, sizeof(resp_buf));
-    close(ss_fd);
+    ss_pool_release(ss_fd, n > 0);
     
     log_info("nm_approve_step9", "Got SS response: n=%d", n);
     
@@ -2103,8 +2142,7 @@ int handle_approveaccessrequest(int client_fd, const char *username, const char
         send_all(ss_fd2, rm_buf, strlen(rm_buf));
         
         char rm_resp[MAX_LINE];
-        recv_line(ss_fd2, rm_resp, sizeof(rm_resp));
-        close(ss_fd2);
+        ss_pool_release(ss_fd2, recv_line(ss_fd2, rm_resp, sizeof(rm_resp)) > 0);
     }
     
     // Success - remove request from queue
@@ -2162,7 +2200,8 @@ int handle_disapproveaccessrequest(int client_fd, const char *username, const ch
     }
     
     // Lookup file to get SS connection
-    FileEntry *entry = index_lookup_file(full_path);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(full_path, &entry_buf);
     
     // Remove request from SS metadata (if file still exists)
     if (entry) {
@@ -2183,8 +2222,7 @@ int handle_disapproveaccessrequest(int client_fd, const char *username, const ch
             send_all(ss_fd, rm_buf, strlen(rm_buf));
             
             char rm_resp[MAX_LINE];
-            recv_line(ss_fd, rm_resp, sizeof(rm_resp));
-            close(ss_fd);
+            ss_pool_release(ss_fd, recv_line(ss_fd, rm_resp, sizeof(rm_resp)) > 0);
         }
     }
     
@@ -2206,7 +2244,8 @@ int handle_checkpoint(int client_fd, const char *username, const char *filename,
     }
 
     // Lookup file
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -2245,7 +2284,7 @@ int handle_checkpoint(int client_fd, const char *username, const char *filename,
     char req_buf[MAX_LINE];
     proto_format_line(&ss_req, req_buf, sizeof(req_buf));
     if (send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send request to SS");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -2253,11 +2292,11 @@ int handle_checkpoint(int client_fd, const char *username, const char *filename,
     // Receive response from SS
     char ss_resp[MAX_LINE];
     if (recv_line(ss_fd, ss_resp, sizeof(ss_resp)) <= 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "No response from SS");
         return send_error_response(client_fd, "", username, &err);
     }
-    close(ss_fd);
+    ss_pool_release(ss_fd, 1);
 
     // Parse SS response
     Message ss_msg = {0};
@@ -2279,7 +2318,8 @@ int handle_viewcheckpoint(int client_fd, const char *username, const char *filen
     }
 
     // Lookup file
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -2318,7 +2358,7 @@ int handle_viewcheckpoint(int client_fd, const char *username, const char *filen
     char req_buf[MAX_LINE];
     proto_format_line(&ss_req, req_buf, sizeof(req_buf));
     if (send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send request to SS");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -2329,14 +2369,14 @@ int handle_viewcheckpoint(int client_fd, const char *username, const char *filen
         char ss_resp[MAX_LINE];
         int n = recv_line(ss_fd, ss_resp, sizeof(ss_resp));
         if (n <= 0) {
-            close(ss_fd);
+            ss_pool_release(ss_fd, 0);
             Error err = error_simple(ERR_INTERNAL, "Connection to SS closed unexpectedly");
             return send_error_response(client_fd, "", username, &err);
         }
         
         // Forward message to client
         if (send_all(client_fd, ss_resp, strlen(ss_resp)) != 0) {
-            close(ss_fd);
+            ss_pool_release(ss_fd, 0);
             return -1;
         }
         
@@ -2352,7 +2392,7 @@ int handle_viewcheckpoint(int client_fd, const char *username, const char *filen
             }
         }
     }
-    close(ss_fd);
+    ss_pool_release(ss_fd, 1);
     return 0;
 }
 
@@ -2363,7 +2403,8 @@ int handle_revert_checkpoint(int client_fd, const char *username, const char *fi
     }
 
     // Lookup file
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -2402,7 +2443,7 @@ int handle_revert_checkpoint(int client_fd, const char *username, const char *fi
     char req_buf[MAX_LINE];
     proto_format_line(&ss_req, req_buf, sizeof(req_buf));
     if (send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send request to SS");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -2410,11 +2451,11 @@ int handle_revert_checkpoint(int client_fd, const char *username, const char *fi
     // Receive response from SS
     char ss_resp[MAX_LINE];
     if (recv_line(ss_fd, ss_resp, sizeof(ss_resp)) <= 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "No response from SS");
         return send_error_response(client_fd, "", username, &err);
     }
-    close(ss_fd);
+    ss_pool_release(ss_fd, 1);
 
     // Forward response to client
     log_info("nm_revert", "user=%s file=%s tag=%s", username, filename, tag);
@@ -2428,7 +2469,8 @@ int handle_listcheckpoints(int client_fd, const char *username, const char *file
     }
 
     // Lookup file
-    FileEntry *entry = index_lookup_file(filename);
+    FileEntry entry_buf;
+    FileEntry *entry = index_get_file(filename, &entry_buf);
     if (!entry) {
         Error err = error_create(ERR_NOT_FOUND, "File '%s' not found", filename);
         return send_error_response(client_fd, "", username, &err);
@@ -2463,7 +2505,7 @@ int handle_listcheckpoints(int client_fd, const char *username, const char *file
     char req_buf[MAX_LINE];
     proto_format_line(&ss_req, req_buf, sizeof(req_buf));
     if (send_all(ss_fd, req_buf, strlen(req_buf)) != 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "Failed to send request to SS");
         return send_error_response(client_fd, "", username, &err);
     }
@@ -2471,11 +2513,11 @@ int handle_listcheckpoints(int client_fd, const char *username, const char *file
     // Receive response from SS
     char ss_resp[MAX_LINE];
     if (recv_line(ss_fd, ss_resp, sizeof(ss_resp)) <= 0) {
-        close(ss_fd);
+        ss_pool_release(ss_fd, 0);
         Error err = error_simple(ERR_INTERNAL, "No response from SS");
         return send_error_response(client_fd, "", username, &err);
     }
-    close(ss_fd);
+    ss_pool_release(ss_fd, 1);
 
     // Forward response to client
     log_info("nm_listcheckpoints", "user=%s file=%s", username, filename);
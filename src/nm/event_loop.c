@@ -0,0 +1,327 @@
+#define _POSIX_C_SOURCE 200809L
+#include "event_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../common/log.h"
+#include "../common/net.h"
+
+// Per-connection state. Only the worker that popped the connection from the
+// ready list touches inbuf/len, because the fd is armed with EPOLLONESHOT.
+typedef struct NmConn {
+    int fd;
+    struct sockaddr_in addr;
+    size_t len;                    // Bytes buffered in inbuf
+    char inbuf[MAX_LINE];          // Partial line carried between reads
+    struct NmConn *ready_next;     // Ready list link
+    struct NmConn *all_prev;       // All-connections list (for shutdown)
+    struct NmConn *all_next;
+} NmConn;
+
+// Global state
+static int g_epoll_fd = -1;
+static int g_server_fd = -1;
+static EventLoopHandler g_handler = NULL;
+
+static pthread_t g_workers[EVENT_LOOP_MAX_WORKERS];
+static int g_worker_count = 0;
+static volatile int g_workers_running = 0;
+
+// Ready list: connections with pending input, waiting for a worker
+static NmConn *g_ready_head = NULL;
+static NmConn *g_ready_tail = NULL;
+static int g_ready_depth = 0;
+static pthread_mutex_t g_ready_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_ready_cond = PTHREAD_COND_INITIALIZER;
+
+// All open connections and counters
+static NmConn *g_conns = NULL;
+static int g_active_connections = 0;
+static unsigned long g_accepted_total = 0;
+static unsigned long g_messages_total = 0;
+static pthread_mutex_t g_conns_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void ready_push(NmConn *conn) {
+    pthread_mutex_lock(&g_ready_mu);
+    conn->ready_next = NULL;
+    if (g_ready_tail) {
+        g_ready_tail->ready_next = conn;
+    } else {
+        g_ready_head = conn;
+    }
+    g_ready_tail = conn;
+    g_ready_depth++;
+    pthread_cond_signal(&g_ready_cond);
+    pthread_mutex_unlock(&g_ready_mu);
+}
+
+// Returns NULL once the pool is stopping
+static NmConn *ready_pop(void) {
+    pthread_mutex_lock(&g_ready_mu);
+    while (g_workers_running && g_ready_head == NULL) {
+        pthread_cond_wait(&g_ready_cond, &g_ready_mu);
+    }
+    NmConn *conn = NULL;
+    if (g_workers_running && g_ready_head) {
+        conn = g_ready_head;
+        g_ready_head = conn->ready_next;
+        if (!g_ready_head) g_ready_tail = NULL;
+        g_ready_depth--;
+    }
+    pthread_mutex_unlock(&g_ready_mu);
+    return conn;
+}
+
+static void conn_close(NmConn *conn) {
+    epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+
+    pthread_mutex_lock(&g_conns_mu);
+    if (conn->all_prev) {
+        conn->all_prev->all_next = conn->all_next;
+    } else {
+        g_conns = conn->all_next;
+    }
+    if (conn->all_next) conn->all_next->all_prev = conn->all_prev;
+    g_active_connections--;
+    pthread_mutex_unlock(&g_conns_mu);
+
+    free(conn);
+}
+
+// Hand every complete line in inbuf to the handler, keeping any partial tail.
+// A full buffer without a newline is dispatched as-is, like recv_line() does.
+static void conn_dispatch_lines(NmConn *conn) {
+    size_t start = 0;
+    while (start < conn->len) {
+        char *nl = memchr(conn->inbuf + start, '\n', conn->len - start);
+        size_t line_len;
+        if (nl) {
+            line_len = (size_t)(nl - (conn->inbuf + start)) + 1;
+        } else if (start == 0 && conn->len >= sizeof(conn->inbuf) - 1) {
+            line_len = conn->len;
+        } else {
+            break;
+        }
+
+        char line[MAX_LINE];
+        memcpy(line, conn->inbuf + start, line_len);
+        line[line_len] = '\0';
+        start += line_len;
+
+        Message msg;
+        if (proto_parse_line(line, &msg) == 0) {
+            pthread_mutex_lock(&g_conns_mu);
+            g_messages_total++;
+            pthread_mutex_unlock(&g_conns_mu);
+            g_handler(conn->fd, &conn->addr, &msg);
+        }
+    }
+    if (start > 0) {
+        memmove(conn->inbuf, conn->inbuf + start, conn->len - start);
+        conn->len -= start;
+    }
+}
+
+// Drain a ready connection until EAGAIN. Returns 0 to keep it, -1 to close it.
+static int conn_service(NmConn *conn) {
+    while (1) {
+        ssize_t n = recv(conn->fd, conn->inbuf + conn->len,
+                         sizeof(conn->inbuf) - 1 - conn->len, 0);
+        if (n > 0) {
+            conn->len += (size_t)n;
+            conn_dispatch_lines(conn);
+            continue;
+        }
+        if (n == 0) return -1;  // Peer closed
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        return -1;
+    }
+}
+
+static void *worker_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        NmConn *conn = ready_pop();
+        if (!conn) break;
+        if (conn_service(conn) != 0) {
+            conn_close(conn);
+            continue;
+        }
+        // Re-arm; epoll reports again if data arrived while we were busy
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+        ev.data.ptr = conn;
+        if (epoll_ctl(g_epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) {
+            conn_close(conn);
+        }
+    }
+    return NULL;
+}
+
+static void accept_pending(void) {
+    while (1) {
+        struct sockaddr_in addr;
+        socklen_t alen = sizeof(addr);
+        int fd = accept(g_server_fd, (struct sockaddr*)&addr, &alen);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_error("event_loop_accept", "accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        NmConn *conn = (NmConn*)calloc(1, sizeof(NmConn));
+        if (!conn || set_nonblocking(fd) != 0) {
+            log_error("event_loop_accept", "failed to set up connection");
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->addr = addr;
+
+        pthread_mutex_lock(&g_conns_mu);
+        conn->all_next = g_conns;
+        if (g_conns) g_conns->all_prev = conn;
+        g_conns = conn;
+        g_active_connections++;
+        g_accepted_total++;
+        pthread_mutex_unlock(&g_conns_mu);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+        ev.data.ptr = conn;
+        if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            log_error("event_loop_accept", "epoll_ctl add failed: %s", strerror(errno));
+            conn_close(conn);
+        }
+    }
+}
+
+int event_loop_init(int server_fd, int worker_count, EventLoopHandler handler) {
+    if (server_fd < 0 || !handler) return -1;
+    if (worker_count <= 0) worker_count = EVENT_LOOP_DEFAULT_WORKERS;
+    if (worker_count > EVENT_LOOP_MAX_WORKERS) worker_count = EVENT_LOOP_MAX_WORKERS;
+
+    long fd_limit = net_raise_fd_limit();
+    if (fd_limit > 0) {
+        log_info("event_loop_fd_limit", "raised fd limit to %ld", fd_limit);
+    }
+
+    g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_epoll_fd < 0) {
+        log_error("event_loop_init", "epoll_create1 failed: %s", strerror(errno));
+        return -1;
+    }
+    if (set_nonblocking(server_fd) != 0) {
+        close(g_epoll_fd);
+        g_epoll_fd = -1;
+        return -1;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;  // NULL marks the listening socket
+    if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) != 0) {
+        log_error("event_loop_init", "epoll_ctl add listen fd failed: %s", strerror(errno));
+        close(g_epoll_fd);
+        g_epoll_fd = -1;
+        return -1;
+    }
+    g_server_fd = server_fd;
+    g_handler = handler;
+
+    g_workers_running = 1;
+    g_worker_count = 0;
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&g_workers[i], NULL, worker_thread, NULL) != 0) {
+            log_error("event_loop_init", "failed to start worker %d", i);
+            break;
+        }
+        g_worker_count++;
+    }
+    if (g_worker_count == 0) {
+        g_workers_running = 0;
+        close(g_epoll_fd);
+        g_epoll_fd = -1;
+        return -1;
+    }
+
+    log_info("event_loop_init", "epoll reactor ready with %d workers", g_worker_count);
+    return 0;
+}
+
+void event_loop_run(volatile int *running) {
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    while (*running) {
+        int n = epoll_wait(g_epoll_fd, events, EVENT_LOOP_MAX_EVENTS, EVENT_LOOP_WAIT_MS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("event_loop_wait", "epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            NmConn *conn = (NmConn*)events[i].data.ptr;
+            if (!conn) {
+                accept_pending();
+            } else {
+                // Errors and hangups are discovered by the worker's recv()
+                ready_push(conn);
+            }
+        }
+    }
+}
+
+void event_loop_shutdown(void) {
+    pthread_mutex_lock(&g_ready_mu);
+    g_workers_running = 0;
+    pthread_cond_broadcast(&g_ready_cond);
+    pthread_mutex_unlock(&g_ready_mu);
+    for (int i = 0; i < g_worker_count; i++) {
+        pthread_join(g_workers[i], NULL);
+    }
+    g_worker_count = 0;
+
+    // Workers are gone, so remaining connections are ours to close
+    g_ready_head = g_ready_tail = NULL;
+    g_ready_depth = 0;
+    while (g_conns) {
+        conn_close(g_conns);
+    }
+    if (g_epoll_fd >= 0) {
+        close(g_epoll_fd);
+        g_epoll_fd = -1;
+    }
+    log_info("event_loop_shutdown", "accepted=%lu messages=%lu",
+             g_accepted_total, g_messages_total);
+}
+
+void event_loop_get_stats(EventLoopStats *stats) {
+    if (!stats) return;
+    pthread_mutex_lock(&g_conns_mu);
+    stats->active_connections = g_active_connections;
+    stats->accepted_total = g_accepted_total;
+    stats->messages_total = g_messages_total;
+    pthread_mutex_unlock(&g_conns_mu);
+    pthread_mutex_lock(&g_ready_mu);
+    stats->ready_depth = g_ready_depth;
+    pthread_mutex_unlock(&g_ready_mu);
+}
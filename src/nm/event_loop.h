@@ -0,0 +1,50 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <netinet/in.h>
+
+#include "../common/protocol.h"
+
+// Event loop for the Name Server
+// Replaces thread-per-connection: one reactor thread waits on an
+// edge-triggered epoll set, and a fixed pool of workers drains ready
+// sockets and runs the message handler.
+//
+// Each connection is registered with EPOLLONESHOT, so at most one worker
+// owns a connection at a time. Messages from one peer are therefore handled
+// in order, and handlers can keep writing replies with send_all().
+//
+// Usage:
+//   event_loop_init(server_fd, 16, handle_message);
+//   event_loop_run(&g_running);   // Returns after g_running becomes 0
+//   event_loop_shutdown();
+
+#define EVENT_LOOP_DEFAULT_WORKERS 16
+#define EVENT_LOOP_MAX_WORKERS 256
+#define EVENT_LOOP_MAX_EVENTS 256    // epoll_wait batch size
+#define EVENT_LOOP_WAIT_MS 500       // Wake-up interval to observe shutdown
+
+// Called on a worker thread for every complete line received
+typedef void (*EventLoopHandler)(int fd, const struct sockaddr_in *peer, const Message *msg);
+
+typedef struct {
+    int active_connections;          // Currently open sessions
+    unsigned long accepted_total;    // Connections accepted since start
+    unsigned long messages_total;    // Messages dispatched to the handler
+    int ready_depth;                 // Connections waiting for a worker
+} EventLoopStats;
+
+// Set up epoll and start the worker pool.
+// server_fd must be a listening socket; it is switched to non-blocking.
+// Returns 0 on success, -1 on error.
+int event_loop_init(int server_fd, int worker_count, EventLoopHandler handler);
+
+// Run the reactor on the calling thread until *running becomes 0.
+void event_loop_run(volatile int *running);
+
+// Stop workers and close all open connections.
+void event_loop_shutdown(void);
+
+void event_loop_get_stats(EventLoopStats *stats);
+
+#endif
@@ -1,372 +1,1005 @@
+#define _POSIX_C_SOURCE 200809L
 #include "index.h"
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
-// Global index and cache instances
-FileIndex g_file_index = {0};
-LRUCache g_lru_cache = {0};
-FolderIndex g_folder_index = {0};
+// ===== Storage layout =====
+//
+// Files are not stored as FileEntry records (those are well over 1KB of
+// fixed arrays). Internally each file is a compact node:
+// - Strings repeated across many files (folder path, owner, SS host and
+//   name) are interned once and referenced by 32-bit ids.
+// - Base filenames are variable length and live in a name arena.
+// - Each node is split into a hot half (what a chain walk reads) and a
+//   cold half (timestamps and counts). The halves sit in separate chunked
+//   arrays, so a lookup touches one 32-byte record per chain step.
+// Nodes are addressed by 32-bit ids; id 0 means "none". FileEntry is only
+// materialized when copying out to callers.
 
-// Initialize the file index and LRU cache
-// Sets up empty hash table and empty cache
+#define NODE_CHUNK 4096                        // Nodes per hot/cold chunk
+#define ARENA_BLOCK_SIZE 65536                 // Bytes per name arena block
+#define NAME_CLASSES (MAX_FILENAME / 8 + 1)    // Free lists for names, 8-byte classes
+
+typedef struct {
+    uint64_t path_hash;   // index_hash() of the normalized full path
+    const char *name;     // Base filename (name arena)
+    uint32_t next;        // Next node in bucket chain (or free list)
+    uint32_t folder_id;   // Interned folder path
+    uint32_t owner_id;    // Interned owner (0 = "" = not yet loaded)
+    uint32_t loc_id;      // Primary SS location
+} HotNode;
+
+typedef struct {
+    time_t created;
+    time_t last_modified;
+    time_t last_accessed;     // Written under shared lock (relaxed atomics)
+    time_t last_lookup;       // Recency stamp, same rules
+    size_t size_bytes;
+    int word_count;
+    int char_count;
+    uint32_t replica_loc_id;  // Backup SS location (0 = none)
+} ColdNode;
+
+// Interned strings: id -> string, plus an open-addressing table of ids
+// Id 0 is always the empty string
+typedef struct {
+    const char **strs;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *slots;       // 0 = empty slot
+    uint32_t mask;
+} StringPool;
+
+// Interned SS location (host, client port, SS username); id 0 = none
+typedef struct {
+    uint32_t host_id;
+    uint32_t user_id;
+    int port;
+} SSLocation;
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    char data[ARENA_BLOCK_SIZE];
+} ArenaBlock;
+
+// One generation of the file hash table
+typedef struct {
+    uint32_t *buckets;     // Hash buckets (node id of chain head)
+    size_t mask;           // bucket count - 1 (bucket count is a power of two)
+    size_t used;           // Entries stored in this table
+} FileTable;
+
+// File index (guarded by g_index_lock)
+// tables[0] is the active table; while resizing, entries migrate from
+// tables[0] to tables[1] bucket by bucket starting at rehash_idx
+typedef struct {
+    FileTable tables[2];
+    long rehash_idx;       // -1 when no resize is in progress
+} FileIndex;
+
+typedef struct {
+    FolderEntry *buckets[INDEX_HASH_SIZE];
+    int count;
+} FolderIndex;
+
+static FileIndex g_file_index = {{{0}}, -1};
+static FolderIndex g_folder_index = {0};
+static pthread_rwlock_t g_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Node storage (chunk pointer arrays grow; chunks never move)
+static HotNode **g_hot = NULL;
+static ColdNode **g_cold = NULL;
+static uint32_t g_chunk_count = 0;
+static uint32_t g_node_top = 1;        // Next never-used id (0 is reserved)
+static uint32_t g_free_nodes = 0;      // Free list through HotNode.next
+
+// Name arena with per-size-class free lists
+static ArenaBlock *g_arena = NULL;
+static char *g_name_free[NAME_CLASSES];
+static size_t g_arena_blocks = 0;
+
+static StringPool g_folders = {0};
+static StringPool g_owners = {0};
+static StringPool g_ss_strings = {0};   // SS hosts and usernames
+static SSLocation *g_locs = NULL;
+static uint32_t g_loc_count = 0;
+static uint32_t g_loc_cap = 0;
+
+#define HOT(id) (&g_hot[(id) / NODE_CHUNK][(id) % NODE_CHUNK])
+#define COLD(id) (&g_cold[(id) / NODE_CHUNK][(id) % NODE_CHUNK])
+
+static int add_folder_locked(const char *folder_path, const char *ss_username,
+                             time_t created);
+
+// Initialize the file index
+// Sets up empty hash tables
 void index_init(void) {
-    // Clear hash table (all buckets are NULL)
-    memset(g_file_index.buckets, 0, sizeof(g_file_index.buckets));
-    g_file_index.count = 0;
-    
-    // Clear LRU cache
-    g_lru_cache.head = NULL;
-    g_lru_cache.tail = NULL;
-    g_lru_cache.size = 0;
-    
+    pthread_rwlock_wrlock(&g_index_lock);
+
+    // Start with a single empty table
+    for (int t = 0; t < 2; t++) {
+        free(g_file_index.tables[t].buckets);
+        memset(&g_file_index.tables[t], 0, sizeof(g_file_index.tables[t]));
+    }
+    g_file_index.tables[0].buckets = calloc(INDEX_INITIAL_BUCKETS, sizeof(uint32_t));
+    g_file_index.tables[0].mask = g_file_index.tables[0].buckets ? INDEX_INITIAL_BUCKETS - 1 : 0;
+    g_file_index.rehash_idx = -1;
+
     // Clear folder index
     memset(g_folder_index.buckets, 0, sizeof(g_folder_index.buckets));
     g_folder_index.count = 0;
-    
+
     // Add root folder by default
-    index_add_folder("/", "");
-}
-
-// Hash function: djb2 hash algorithm (simple and effective)
-// Converts filename string to hash value for bucket selection
-unsigned int index_hash(const char *filename) {
-    unsigned long hash = 5381;
-    int c;
-    
-    // Hash each character: hash = hash * 33 + c
-    while ((c = *filename++)) {
-        hash = ((hash << 5) + hash) + c;  // hash * 33 + c
-    }
-    
-    // Modulo to get bucket index (0 to INDEX_HASH_SIZE-1)
-    return hash % INDEX_HASH_SIZE;
-}
-
-// Add entry to LRU cache (at front - most recently used)
-// This is called when a file is accessed (looked up)
-static void lru_add_to_front(FileEntry *entry) {
-    if (!entry) return;
-    
-    // Remove from current position if already in cache
-    if (entry->lru_prev) {
-        entry->lru_prev->lru_next = entry->lru_next;
-    } else if (g_lru_cache.head == entry) {
-        g_lru_cache.head = entry->lru_next;
-    }
-    
-    if (entry->lru_next) {
-        entry->lru_next->lru_prev = entry->lru_prev;
-    } else if (g_lru_cache.tail == entry) {
-        g_lru_cache.tail = entry->lru_prev;
-    }
-    
-    // Add to front
-    entry->lru_prev = NULL;
-    entry->lru_next = g_lru_cache.head;
-    
-    if (g_lru_cache.head) {
-        g_lru_cache.head->lru_prev = entry;
-    }
-    g_lru_cache.head = entry;
-    
-    if (!g_lru_cache.tail) {
-        g_lru_cache.tail = entry;
-    }
-    
-    g_lru_cache.size++;
-}
-
-// Remove least recently used entry from cache (when cache is full)
-static void lru_remove_tail(void) {
-    if (!g_lru_cache.tail) return;
-    
-    FileEntry *old_tail = g_lru_cache.tail;
-    g_lru_cache.tail = old_tail->lru_prev;
-    
-    if (g_lru_cache.tail) {
-        g_lru_cache.tail->lru_next = NULL;
-    } else {
-        g_lru_cache.head = NULL;
-    }
-    
-    old_tail->lru_prev = NULL;
-    old_tail->lru_next = NULL;
-    g_lru_cache.size--;
+    add_folder_locked("/", "", 0);
+
+    pthread_rwlock_unlock(&g_index_lock);
 }
 
-// Add a file to the index
-FileEntry *index_add_file(const char *filename, const char *owner,
-                          const char *ss_host, int ss_client_port,
-                          const char *ss_username) {
-    if (!filename) return NULL;
-    
-    // Check if file already exists
-    FileEntry *existing = index_lookup_file(filename);
-    if (existing) {
-        // Update SS information (in case SS re-registered)
-        if (ss_host) strncpy(existing->ss_host, ss_host, sizeof(existing->ss_host) - 1);
-        existing->ss_client_port = ss_client_port;
-        if (ss_username) strncpy(existing->ss_username, ss_username, sizeof(existing->ss_username) - 1);
-        return existing;
-    }
-    
-    // Create new file entry
-    FileEntry *entry = (FileEntry *)calloc(1, sizeof(FileEntry));
-    if (!entry) return NULL;
-    
-    // Parse filename to extract folder path and base filename
-    // Format can be "/folder/file.txt" or just "file.txt" (root folder)
-    const char *last_slash = strrchr(filename, '/');
-    if (last_slash) {
-        // File has a folder path
-        size_t folder_len = last_slash - filename + 1; // Include the trailing /
-        if (folder_len < sizeof(entry->folder_path)) {
-            memcpy(entry->folder_path, filename, folder_len);
-            entry->folder_path[folder_len] = '\0';
+// wyhash (final version 4) building blocks
+static const uint64_t g_wyp[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static void wymum(uint64_t *a, uint64_t *b) {
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static uint64_t wymix(uint64_t a, uint64_t b) {
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t wyr8(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint64_t wyr4(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t wyr3(const unsigned char *p, size_t k) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+// Hash function: wyhash over the whole key
+// Paths are short, so the <=16 byte and 16..48 byte paths dominate
+uint64_t index_hash(const char *key, size_t len) {
+    const unsigned char *p = (const unsigned char *)key;
+    uint64_t seed = wymix(g_wyp[0], g_wyp[1]);
+    uint64_t a, b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
         } else {
-            // Path too long, default to root
-            strcpy(entry->folder_path, "/");
+            a = b = 0;
         }
-        // Copy just the filename part (after last /)
-        strncpy(entry->filename, last_slash + 1, sizeof(entry->filename) - 1);
-    } else {
-        // No path separator, file is in root folder
-        strcpy(entry->folder_path, "/");
-        strncpy(entry->filename, filename, sizeof(entry->filename) - 1);
-    }
-    
-    // Copy owner (leave empty if NULL - will be loaded from metadata later)
-    if (owner) {
-        strncpy(entry->owner, owner, sizeof(entry->owner) - 1);
     } else {
-        entry->owner[0] = '\0';  // Empty string indicates owner not yet loaded
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ g_wyp[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ g_wyp[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ g_wyp[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ g_wyp[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+
+    a ^= g_wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ g_wyp[0] ^ len, b ^ g_wyp[1]);
+}
+
+// ===== Name arena =====
+
+// Allocate len bytes (including NUL) from the arena
+// Sizes up to MAX_FILENAME are rounded to 8-byte classes and recycled
+static char *arena_alloc(size_t len) {
+    size_t cls = (len + 7) / 8;
+    size_t size = cls * 8;
+
+    if (cls < NAME_CLASSES && g_name_free[cls]) {
+        char *p = g_name_free[cls];
+        memcpy(&g_name_free[cls], p, sizeof(char *));
+        return p;
     }
-    
-    // Copy SS information
-    if (ss_host) {
-        strncpy(entry->ss_host, ss_host, sizeof(entry->ss_host) - 1);
+
+    if (size > ARENA_BLOCK_SIZE) return NULL;
+    if (!g_arena || g_arena->used + size > ARENA_BLOCK_SIZE) {
+        ArenaBlock *block = malloc(sizeof(ArenaBlock));
+        if (!block) return NULL;
+        block->next = g_arena;
+        block->used = 0;
+        g_arena = block;
+        g_arena_blocks++;
     }
-    entry->ss_client_port = ss_client_port;
-    if (ss_username) {
-        strncpy(entry->ss_username, ss_username, sizeof(entry->ss_username) - 1);
+    char *p = g_arena->data + g_arena->used;
+    g_arena->used += size;
+    return p;
+}
+
+// Return a name to its size-class free list
+static void arena_free(char *p, size_t len) {
+    size_t cls = (len + 7) / 8;
+    if (!p || cls >= NAME_CLASSES) return;
+    memcpy(p, &g_name_free[cls], sizeof(char *));
+    g_name_free[cls] = p;
+}
+
+static char *arena_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *p = arena_alloc(len);
+    if (p) memcpy(p, s, len);
+    return p;
+}
+
+// ===== Interned strings =====
+
+static const char *pool_str(const StringPool *pool, uint32_t id) {
+    return (id > 0 && id < pool->count) ? pool->strs[id] : "";
+}
+
+// Find the id of s; read-only, safe under the shared lock
+// Returns: id, or 0 if s is empty or not interned
+static uint32_t pool_find(const StringPool *pool, const char *s) {
+    if (!s[0] || !pool->slots) return 0;
+    uint64_t h = index_hash(s, strlen(s));
+    for (uint32_t i = (uint32_t)h & pool->mask; pool->slots[i]; i = (i + 1) & pool->mask) {
+        uint32_t id = pool->slots[i];
+        if (strcmp(pool->strs[id], s) == 0) return id;
     }
-    
-    // Initialize timestamps
-    time_t now = time(NULL);
-    entry->created = now;
-    entry->last_modified = now;
-    entry->last_accessed = now;
-    
-    // Initialize counts
-    entry->size_bytes = 0;
-    entry->word_count = 0;
-    entry->char_count = 0;
-    
-    // Add to hash map
-    // Hash the base filename (not the full path) for consistent lookups
-    unsigned int hash = index_hash(entry->filename);
-    entry->next = g_file_index.buckets[hash];
-    g_file_index.buckets[hash] = entry;
-    g_file_index.count++;
-    
-    return entry;
+    return 0;
 }
 
-// Remove a file from the index
-int index_remove_file(const char *filename) {
-    if (!filename) return -1;
-    
-    // Parse input to get folder path and base filename
-    char folder_path[MAX_FOLDER_PATH] = "/";
-    char base_filename[MAX_FILENAME];
-    
-    const char *last_slash = strrchr(filename, '/');
-    if (last_slash) {
-        size_t folder_len = last_slash - filename + 1;
-        if (folder_len < sizeof(folder_path)) {
-            memcpy(folder_path, filename, folder_len);
-            folder_path[folder_len] = '\0';
+// Rebuild the slot table with size slots (a power of two)
+static int pool_rebuild_slots(StringPool *pool, uint32_t size) {
+    uint32_t *slots = calloc(size, sizeof(uint32_t));
+    if (!slots) return -1;
+    for (uint32_t id = 1; id < pool->count; id++) {
+        uint64_t h = index_hash(pool->strs[id], strlen(pool->strs[id]));
+        uint32_t i = (uint32_t)h & (size - 1);
+        while (slots[i]) i = (i + 1) & (size - 1);
+        slots[i] = id;
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->mask = size - 1;
+    return 0;
+}
+
+// Rebuild the slot table at twice the size
+static int pool_grow_slots(StringPool *pool) {
+    return pool_rebuild_slots(pool, pool->slots ? (pool->mask + 1) * 2 : 64);
+}
+
+// Intern s; caller holds g_index_lock exclusively
+// Returns: 0 on success (id in *id_out), -1 on allocation failure
+static int pool_intern(StringPool *pool, const char *s, uint32_t *id_out) {
+    uint32_t id = pool_find(pool, s);
+    if (id || !s[0]) {
+        *id_out = id;
+        return 0;
+    }
+
+    if (pool->count == 0) pool->count = 1;  // Reserve id 0 for ""
+    if (pool->count >= pool->cap) {
+        uint32_t cap = pool->cap ? pool->cap * 2 : 64;
+        const char **strs = realloc(pool->strs, cap * sizeof(char *));
+        if (!strs) return -1;
+        strs[0] = "";
+        pool->strs = strs;
+        pool->cap = cap;
+    }
+    if (!pool->slots || (pool->count + 1) * 2 > pool->mask + 1) {
+        if (pool_grow_slots(pool) != 0) return -1;
+    }
+
+    char *copy = arena_strdup(s);
+    if (!copy) return -1;
+
+    id = pool->count++;
+    pool->strs[id] = copy;
+    uint64_t h = index_hash(s, strlen(s));
+    uint32_t i = (uint32_t)h & pool->mask;
+    while (pool->slots[i]) i = (i + 1) & pool->mask;
+    pool->slots[i] = id;
+
+    *id_out = id;
+    return 0;
+}
+
+// Intern an SS location; caller holds g_index_lock exclusively
+// There are only a handful of storage servers, so a linear scan is enough
+static int intern_location(const char *host, int port, const char *user, uint32_t *id_out) {
+    uint32_t host_id, user_id;
+    if (pool_intern(&g_ss_strings, host ? host : "", &host_id) != 0 ||
+        pool_intern(&g_ss_strings, user ? user : "", &user_id) != 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 1; i < g_loc_count; i++) {
+        if (g_locs[i].host_id == host_id && g_locs[i].user_id == user_id &&
+            g_locs[i].port == port) {
+            *id_out = i;
+            return 0;
         }
-        strncpy(base_filename, last_slash + 1, sizeof(base_filename) - 1);
-        base_filename[sizeof(base_filename) - 1] = '\0';
+    }
+
+    if (g_loc_count == 0) g_loc_count = 1;  // Reserve id 0 for "none"
+    if (g_loc_count >= g_loc_cap) {
+        uint32_t cap = g_loc_cap ? g_loc_cap * 2 : 8;
+        SSLocation *locs = realloc(g_locs, cap * sizeof(SSLocation));
+        if (!locs) return -1;
+        memset(&locs[0], 0, sizeof(locs[0]));
+        g_locs = locs;
+        g_loc_cap = cap;
+    }
+    g_locs[g_loc_count] = (SSLocation){host_id, user_id, port};
+    *id_out = g_loc_count++;
+    return 0;
+}
+
+// ===== Node storage =====
+
+// Allocate a zeroed node; caller holds g_index_lock exclusively
+// Returns: node id, or 0 on allocation failure
+static uint32_t node_alloc(void) {
+    uint32_t id;
+    if (g_free_nodes) {
+        id = g_free_nodes;
+        g_free_nodes = HOT(id)->next;
     } else {
-        strncpy(base_filename, filename, sizeof(base_filename) - 1);
-        base_filename[sizeof(base_filename) - 1] = '\0';
-    }
-    
-    unsigned int hash = index_hash(base_filename);
-    FileEntry *curr = g_file_index.buckets[hash];
-    FileEntry *prev = NULL;
-    
-    // Search for file in hash bucket chain
-    while (curr) {
-        if (strcmp(curr->filename, base_filename) == 0 &&
-            strcmp(curr->folder_path, folder_path) == 0) {
-            // Found it - remove from chain
-            if (prev) {
-                prev->next = curr->next;
-            } else {
-                g_file_index.buckets[hash] = curr->next;
-            }
-            
-            // Remove from LRU cache if present
-            if (curr->lru_prev || curr->lru_next || g_lru_cache.head == curr) {
-                if (curr->lru_prev) {
-                    curr->lru_prev->lru_next = curr->lru_next;
-                } else {
-                    g_lru_cache.head = curr->lru_next;
-                }
-                if (curr->lru_next) {
-                    curr->lru_next->lru_prev = curr->lru_prev;
-                } else {
-                    g_lru_cache.tail = curr->lru_prev;
-                }
-                if (g_lru_cache.head == curr) g_lru_cache.head = NULL;
-                if (g_lru_cache.tail == curr) g_lru_cache.tail = NULL;
-                g_lru_cache.size--;
+        if (g_node_top / NODE_CHUNK >= g_chunk_count) {
+            uint32_t n = g_chunk_count + 1;
+            HotNode **hot = realloc(g_hot, n * sizeof(HotNode *));
+            if (!hot) return 0;
+            g_hot = hot;
+            ColdNode **cold = realloc(g_cold, n * sizeof(ColdNode *));
+            if (!cold) return 0;
+            g_cold = cold;
+            g_hot[g_chunk_count] = malloc(NODE_CHUNK * sizeof(HotNode));
+            g_cold[g_chunk_count] = malloc(NODE_CHUNK * sizeof(ColdNode));
+            if (!g_hot[g_chunk_count] || !g_cold[g_chunk_count]) {
+                free(g_hot[g_chunk_count]);
+                free(g_cold[g_chunk_count]);
+                return 0;
             }
-            
-            free(curr);
-            g_file_index.count--;
-            return 0;
+            g_chunk_count = n;
         }
-        prev = curr;
-        curr = curr->next;
+        id = g_node_top++;
     }
-    
-    return -1;  // Not found
+    memset(HOT(id), 0, sizeof(HotNode));
+    memset(COLD(id), 0, sizeof(ColdNode));
+    return id;
 }
 
-// Lookup a file in the index (O(1) average case)
-FileEntry *index_lookup_file(const char *filename) {
-    if (!filename) return NULL;
-    
-    // Parse input to get folder path and base filename
-    char folder_path[MAX_FOLDER_PATH];
-    char base_filename[MAX_FILENAME];
-    
+// Release a node and its name; caller holds g_index_lock exclusively
+static void node_free(uint32_t id) {
+    HotNode *hot = HOT(id);
+    if (hot->name) arena_free((char *)hot->name, strlen(hot->name) + 1);
+    hot->name = NULL;
+    hot->next = g_free_nodes;
+    g_free_nodes = id;
+}
+
+// ===== Keys and hash table =====
+
+// Normalize folder path to "/.../" form: leading and trailing slash
+// ("" and "/" both mean the root folder)
+static void normalize_folder(const char *folder_path, char *out, size_t out_len) {
+    size_t len = strlen(folder_path);
+    const char *lead = (folder_path[0] == '/') ? "" : "/";
+    const char *trail = (len > 0 && folder_path[len - 1] == '/') ? "" : "/";
+
+    if (len == 0 || strcmp(folder_path, "/") == 0) {
+        snprintf(out, out_len, "/");
+    } else {
+        snprintf(out, out_len, "%s%s%s", lead, folder_path, trail);
+    }
+}
+
+// Split "folder/.../name" into normalized folder path and base filename
+// Inputs without a slash live in the root folder
+static void split_path(const char *filename, char *folder_path, size_t folder_len_max,
+                       char *base_filename, size_t base_len_max) {
     const char *last_slash = strrchr(filename, '/');
     if (last_slash) {
-        // Input has folder path with trailing /
-        size_t folder_len = last_slash - filename + 1;
-        if (folder_len < sizeof(folder_path)) {
-            memcpy(folder_path, filename, folder_len);
-            folder_path[folder_len] = '\0';
+        char raw[MAX_FOLDER_PATH];
+        size_t folder_len = last_slash - filename + 1;  // Include the trailing /
+        if (folder_len < sizeof(raw)) {
+            memcpy(raw, filename, folder_len);
+            raw[folder_len] = '\0';
+            normalize_folder(raw, folder_path, folder_len_max);
         } else {
-            strcpy(folder_path, "/");
+            // Path too long, default to root
+            snprintf(folder_path, folder_len_max, "/");
         }
-        strncpy(base_filename, last_slash + 1, sizeof(base_filename) - 1);
-        base_filename[sizeof(base_filename) - 1] = '\0';
+        strncpy(base_filename, last_slash + 1, base_len_max - 1);
     } else {
-        // No folder path, use root folder
-        strcpy(folder_path, "/");
-        strncpy(base_filename, filename, sizeof(base_filename) - 1);
-        base_filename[sizeof(base_filename) - 1] = '\0';
-    }
-    
-    unsigned int hash = index_hash(base_filename);
-    FileEntry *curr = g_file_index.buckets[hash];
-    
-    // Search chain for matching filename AND folder_path
-    while (curr) {
-        if (strcmp(curr->filename, base_filename) == 0 &&
-            strcmp(curr->folder_path, folder_path) == 0) {
-            // Found - update LRU cache
-            // If cache is full, remove least recently used
-            if (g_lru_cache.size >= LRU_CACHE_SIZE && 
-                (!curr->lru_prev && !curr->lru_next && g_lru_cache.head != curr)) {
-                lru_remove_tail();
+        snprintf(folder_path, folder_len_max, "/");
+        strncpy(base_filename, filename, base_len_max - 1);
+    }
+    base_filename[base_len_max - 1] = '\0';
+}
+
+// Parsed lookup key: normalized folder, base name and hash of folder+name
+typedef struct {
+    char folder_path[MAX_FOLDER_PATH];
+    char filename[MAX_FILENAME];
+    uint64_t hash;
+} PathKey;
+
+static uint64_t hash_parts(const char *folder_path, const char *filename) {
+    char full[MAX_FOLDER_PATH + MAX_FILENAME];
+    int n = snprintf(full, sizeof(full), "%s%s", folder_path, filename);
+    if (n < 0) n = 0;
+    if ((size_t)n >= sizeof(full)) n = sizeof(full) - 1;
+    return index_hash(full, (size_t)n);
+}
+
+// Build a key from a user path; pure, so it runs before taking the lock
+static void make_key(const char *filename, PathKey *key) {
+    split_path(filename, key->folder_path, sizeof(key->folder_path),
+               key->filename, sizeof(key->filename));
+    key->hash = hash_parts(key->folder_path, key->filename);
+}
+
+static int node_matches(uint32_t id, const PathKey *key, uint32_t folder_id) {
+    const HotNode *hot = HOT(id);
+    return hot->path_hash == key->hash && hot->folder_id == folder_id &&
+           strcmp(hot->name, key->filename) == 0;
+}
+
+static int rehashing(void) {
+    return g_file_index.rehash_idx >= 0;
+}
+
+// Find the link (bucket slot or next field) holding the node for key
+// Caller holds g_index_lock; read-only, safe to call from many readers
+// table_out (optional) receives which table the node lives in
+static uint32_t *find_link_locked(const PathKey *key, int *table_out) {
+    // Every indexed folder is interned, so an unknown folder means no file
+    uint32_t folder_id = pool_find(&g_folders, key->folder_path);
+    if (!folder_id) return NULL;
+
+    int tables = rehashing() ? 2 : 1;
+    for (int t = 0; t < tables; t++) {
+        FileTable *tab = &g_file_index.tables[t];
+        if (!tab->buckets) continue;
+        uint32_t *link = &tab->buckets[key->hash & tab->mask];
+        while (*link) {
+            if (node_matches(*link, key, folder_id)) {
+                if (table_out) *table_out = t;
+                return link;
             }
-            lru_add_to_front(curr);
-            return curr;
+            link = &HOT(*link)->next;
         }
-        curr = curr->next;
     }
-    
-    return NULL;  // Not found
+    return NULL;
 }
 
-// Get all files in the index
-int index_get_all_files(FileEntry **files, int max_files) {
-    if (!files || max_files <= 0) return 0;
-    
-    int count = 0;
-    
-    // Iterate through all hash buckets
-    for (int i = 0; i < INDEX_HASH_SIZE && count < max_files; i++) {
-        FileEntry *curr = g_file_index.buckets[i];
-        while (curr && count < max_files) {
-            files[count++] = curr;
-            curr = curr->next;
+static uint32_t lookup_locked(const PathKey *key) {
+    uint32_t *link = find_link_locked(key, NULL);
+    return link ? *link : 0;
+}
+
+// Move up to INDEX_REHASH_STEP buckets from the old table to the new one
+// Caller holds g_index_lock exclusively
+static void rehash_step_locked(void) {
+    if (!rehashing()) return;
+
+    FileTable *from = &g_file_index.tables[0];
+    FileTable *to = &g_file_index.tables[1];
+    int moved = 0;
+    int empty_visits = INDEX_REHASH_STEP * 10;  // Bound work on sparse tables
+
+    while (moved < INDEX_REHASH_STEP && from->used > 0 &&
+           (size_t)g_file_index.rehash_idx <= from->mask) {
+        uint32_t curr = from->buckets[g_file_index.rehash_idx];
+        if (!curr) {
+            g_file_index.rehash_idx++;
+            if (--empty_visits == 0) break;
+            continue;
         }
+        while (curr) {
+            HotNode *hot = HOT(curr);
+            uint32_t next = hot->next;
+            size_t b = hot->path_hash & to->mask;
+            hot->next = to->buckets[b];
+            to->buckets[b] = curr;
+            from->used--;
+            to->used++;
+            curr = next;
+        }
+        from->buckets[g_file_index.rehash_idx++] = 0;
+        moved++;
+    }
+
+    if (from->used == 0) {
+        // Migration complete: the new table becomes the active one
+        free(from->buckets);
+        *from = *to;
+        memset(to, 0, sizeof(*to));
+        g_file_index.rehash_idx = -1;
     }
-    
-    return count;
 }
 
-// Get files owned by a specific user
-int index_get_files_by_owner(const char *owner, FileEntry **files, int max_files) {
-    if (!owner || !files || max_files <= 0) return 0;
-    
+// Start a resize when the active table is over its load factor
+// Caller holds g_index_lock exclusively
+static void maybe_grow_locked(void) {
+    if (rehashing()) return;
+
+    FileTable *tab = &g_file_index.tables[0];
+    size_t buckets = tab->mask + 1;
+    if (tab->used * 100 < buckets * INDEX_MAX_LOAD_PCT) return;
+
+    uint32_t *bigger = calloc(buckets * 2, sizeof(uint32_t));
+    if (!bigger) return;  // Keep chaining in the current table
+
+    g_file_index.tables[1].buckets = bigger;
+    g_file_index.tables[1].mask = buckets * 2 - 1;
+    g_file_index.tables[1].used = 0;
+    g_file_index.rehash_idx = 0;
+}
+
+// Link a node into the table new entries go to
+// Caller holds g_index_lock exclusively
+// Returns: 0 on success, -1 if the index has no table (allocation failed)
+static int insert_locked(uint32_t id) {
+    maybe_grow_locked();
+    FileTable *tab = &g_file_index.tables[rehashing() ? 1 : 0];
+    if (!tab->buckets) return -1;
+    HotNode *hot = HOT(id);
+    size_t b = hot->path_hash & tab->mask;
+    hot->next = tab->buckets[b];
+    tab->buckets[b] = id;
+    tab->used++;
+    return 0;
+}
+
+// Unlink the node at link from table t
+static uint32_t unlink_locked(uint32_t *link, int t) {
+    uint32_t id = *link;
+    *link = HOT(id)->next;
+    HOT(id)->next = 0;
+    g_file_index.tables[t].used--;
+    return id;
+}
+
+// Copy a string into a fixed FileEntry field, truncating if needed
+static void copy_field(char *dst, size_t size, const char *src) {
+    size_t len = strlen(src);
+    if (len >= size) len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+// Materialize a node as a FileEntry; caller holds g_index_lock
+// The stamps written by readers under the shared lock are loaded atomically
+static void copy_entry_locked(FileEntry *dst, uint32_t id) {
+    const HotNode *hot = HOT(id);
+    const ColdNode *cold = COLD(id);
+    const SSLocation *loc = &g_locs[hot->loc_id];
+
+    copy_field(dst->filename, sizeof(dst->filename), hot->name);
+    copy_field(dst->folder_path, sizeof(dst->folder_path), pool_str(&g_folders, hot->folder_id));
+    copy_field(dst->owner, sizeof(dst->owner), pool_str(&g_owners, hot->owner_id));
+    copy_field(dst->ss_host, sizeof(dst->ss_host), pool_str(&g_ss_strings, loc->host_id));
+    dst->ss_client_port = loc->port;
+    copy_field(dst->ss_username, sizeof(dst->ss_username), pool_str(&g_ss_strings, loc->user_id));
+
+    const SSLocation *replica = &g_locs[cold->replica_loc_id];
+    copy_field(dst->replica_ss_host, sizeof(dst->replica_ss_host),
+               pool_str(&g_ss_strings, replica->host_id));
+    dst->replica_ss_client_port = replica->port;
+    copy_field(dst->replica_ss_username, sizeof(dst->replica_ss_username),
+               pool_str(&g_ss_strings, replica->user_id));
+
+    dst->created = cold->created;
+    dst->last_modified = cold->last_modified;
+    dst->last_accessed = __atomic_load_n(&cold->last_accessed, __ATOMIC_RELAXED);
+    dst->last_lookup = __atomic_load_n(&cold->last_lookup, __ATOMIC_RELAXED);
+    dst->size_bytes = cold->size_bytes;
+    dst->word_count = cold->word_count;
+    dst->char_count = cold->char_count;
+}
+
+// Mark a node as recently used
+// Only stores when the stamp changes, so hot files do not bounce their
+// cache line between readers more than once a second
+static void mark_recent(uint32_t id, time_t now) {
+    ColdNode *cold = COLD(id);
+    if (__atomic_load_n(&cold->last_lookup, __ATOMIC_RELAXED) != now) {
+        __atomic_store_n(&cold->last_lookup, now, __ATOMIC_RELAXED);
+    }
+}
+
+// ===== Mutations =====
+//
+// Each mutation has a *_locked core (caller holds g_index_lock exclusively)
+// shared by the public wrapper and by index_apply() replay. Wrappers report
+// every successful mutation to the journal hook, in order, tagged with the
+// index version it produced.
+
+static IndexJournalFn g_journal = NULL;
+static uint64_t g_index_version = 0;
+
+// Stamp and report a mutation; caller holds g_index_lock exclusively
+static void journal_locked(IndexMutation *m) {
+    m->version = ++g_index_version;
+    if (g_journal) g_journal(m);
+}
+
+void index_set_journal(IndexJournalFn fn) {
+    pthread_rwlock_wrlock(&g_index_lock);
+    g_journal = fn;
+    pthread_rwlock_unlock(&g_index_lock);
+}
+
+uint64_t index_version(void) {
+    pthread_rwlock_rdlock(&g_index_lock);
+    uint64_t version = g_index_version;
+    pthread_rwlock_unlock(&g_index_lock);
+    return version;
+}
+
+// Add (or refresh the SS location of) a file
+// created: creation time for a new node, 0 for now
+// Returns: node id, or 0 on allocation failure
+static uint32_t add_file_locked(const PathKey *key, const char *owner,
+                                const char *ss_host, int ss_client_port,
+                                const char *ss_username, time_t created) {
+    rehash_step_locked();
+
+    // Check if file already exists
+    uint32_t existing = lookup_locked(key);
+    if (existing) {
+        // Update SS information (in case SS re-registered)
+        const SSLocation *old = &g_locs[HOT(existing)->loc_id];
+        const char *host = ss_host ? ss_host : pool_str(&g_ss_strings, old->host_id);
+        const char *user = ss_username ? ss_username : pool_str(&g_ss_strings, old->user_id);
+        uint32_t loc_id;
+        if (intern_location(host, ss_client_port, user, &loc_id) != 0) return 0;
+        HOT(existing)->loc_id = loc_id;
+        return existing;
+    }
+
+    // Intern the shared strings; owner stays empty if NULL (loaded from
+    // metadata later)
+    uint32_t folder_id, owner_id, loc_id;
+    if (pool_intern(&g_folders, key->folder_path, &folder_id) != 0 ||
+        pool_intern(&g_owners, owner ? owner : "", &owner_id) != 0 ||
+        intern_location(ss_host, ss_client_port, ss_username, &loc_id) != 0) {
+        return 0;
+    }
+
+    // Create new node
+    uint32_t id = node_alloc();
+    char *name = id ? arena_strdup(key->filename) : NULL;
+    if (!name) {
+        if (id) node_free(id);
+        return 0;
+    }
+
+    HotNode *hot = HOT(id);
+    hot->path_hash = key->hash;
+    hot->name = name;
+    hot->folder_id = folder_id;
+    hot->owner_id = owner_id;
+    hot->loc_id = loc_id;
+
+    // Initialize timestamps (counts start at zero)
+    ColdNode *cold = COLD(id);
+    time_t now = created > 0 ? created : time(NULL);
+    cold->created = now;
+    cold->last_modified = now;
+    cold->last_accessed = now;
+    cold->last_lookup = now;
+
+    // Add to hash map (keyed on the full normalized path)
+    if (insert_locked(id) != 0) {
+        node_free(id);
+        return 0;
+    }
+    return id;
+}
+
+// Add a file to the index
+int index_add_file(const char *filename, const char *owner,
+                   const char *ss_host, int ss_client_port,
+                   const char *ss_username, FileEntry *out) {
+    if (!filename) return -1;
+
+    PathKey key;
+    make_key(filename, &key);
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    uint32_t id = add_file_locked(&key, owner, ss_host, ss_client_port, ss_username, 0);
+    if (id) {
+        // Journal the effective values so replay reproduces this exact state
+        char full[MAX_FOLDER_PATH + MAX_FILENAME];
+        snprintf(full, sizeof(full), "%s%s", key.folder_path, key.filename);
+        const SSLocation *loc = &g_locs[HOT(id)->loc_id];
+        IndexMutation m = {
+            .op = INDEX_OP_ADD, .path = full,
+            .a = pool_str(&g_owners, HOT(id)->owner_id),
+            .b = pool_str(&g_ss_strings, loc->host_id),
+            .c = pool_str(&g_ss_strings, loc->user_id),
+            .port = loc->port, .t0 = COLD(id)->created
+        };
+        journal_locked(&m);
+        if (out) copy_entry_locked(out, id);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+
+    return id ? 0 : -1;
+}
+
+// Remove a file
+// Returns: 0 on success, -1 if not found
+static int remove_file_locked(const PathKey *key) {
+    rehash_step_locked();
+
+    // Search for file in the hash bucket chain(s)
+    int t = 0;
+    uint32_t *link = find_link_locked(key, &t);
+    if (!link) return -1;  // Not found
+
+    node_free(unlink_locked(link, t));
+    return 0;
+}
+
+// Remove a file from the index
+int index_remove_file(const char *filename) {
+    if (!filename) return -1;
+
+    PathKey key;
+    make_key(filename, &key);
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    int rc = remove_file_locked(&key);
+    if (rc == 0) {
+        IndexMutation m = {.op = INDEX_OP_REMOVE, .path = filename};
+        journal_locked(&m);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+    return rc;
+}
+
+// Lookup a file in the index (O(1) average case)
+FileEntry *index_get_file(const char *filename, FileEntry *out) {
+    if (!filename || !out) return NULL;
+
+    PathKey key;
+    make_key(filename, &key);
+
+    pthread_rwlock_rdlock(&g_index_lock);
+    uint32_t id = lookup_locked(&key);
+    if (id) {
+        mark_recent(id, time(NULL));
+        copy_entry_locked(out, id);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+
+    return id ? out : NULL;
+}
+
+// Copy every file matching the filter into files[]
+// owner / folder_path may be NULL to skip that filter
+static int collect_files(const char *owner, const char *folder_path,
+                         FileEntry *files, int max_files) {
     int count = 0;
-    
-    // Iterate through all hash buckets
-    for (int i = 0; i < INDEX_HASH_SIZE && count < max_files; i++) {
-        FileEntry *curr = g_file_index.buckets[i];
-        while (curr && count < max_files) {
-            // Filter by owner
-            if (strcmp(curr->owner, owner) == 0) {
-                files[count++] = curr;
+
+    pthread_rwlock_rdlock(&g_index_lock);
+
+    // Filters compare interned ids; an unknown string matches nothing
+    uint32_t owner_id = owner ? pool_find(&g_owners, owner) : 0;
+    uint32_t folder_id = folder_path ? pool_find(&g_folders, folder_path) : 0;
+    if ((owner && owner[0] && !owner_id) || (folder_path && !folder_id)) {
+        pthread_rwlock_unlock(&g_index_lock);
+        return 0;
+    }
+
+    // Iterate through all hash buckets of both tables
+    for (int t = 0; t < 2; t++) {
+        FileTable *tab = &g_file_index.tables[t];
+        if (!tab->buckets) continue;
+        for (size_t i = 0; i <= tab->mask && count < max_files; i++) {
+            uint32_t curr = tab->buckets[i];
+            while (curr && count < max_files) {
+                const HotNode *hot = HOT(curr);
+                if ((!owner || hot->owner_id == owner_id) &&
+                    (!folder_path || hot->folder_id == folder_id)) {
+                    copy_entry_locked(&files[count++], curr);
+                }
+                curr = hot->next;
             }
-            curr = curr->next;
         }
     }
-    
+
+    pthread_rwlock_unlock(&g_index_lock);
     return count;
 }
 
+// Get all files in the index
+int index_get_all_files(FileEntry *files, int max_files) {
+    if (!files || max_files <= 0) return 0;
+    return collect_files(NULL, NULL, files, max_files);
+}
+
+// Get files owned by a specific user
+int index_get_files_by_owner(const char *owner, FileEntry *files, int max_files) {
+    if (!owner || !files || max_files <= 0) return 0;
+    return collect_files(owner, NULL, files, max_files);
+}
+
+// Update file metadata
+static int update_metadata_locked(const PathKey *key, time_t last_accessed,
+                                  time_t last_modified, size_t size_bytes,
+                                  int word_count, int char_count) {
+    uint32_t id = lookup_locked(key);
+    if (!id) return -1;
+
+    ColdNode *cold = COLD(id);
+    if (last_accessed > 0) cold->last_accessed = last_accessed;
+    if (last_modified > 0) cold->last_modified = last_modified;
+    cold->size_bytes = size_bytes;
+    cold->word_count = word_count;
+    cold->char_count = char_count;
+    return 0;
+}
+
 // Update file metadata in index
 int index_update_metadata(const char *filename, time_t last_accessed,
                           time_t last_modified, size_t size_bytes,
                           int word_count, int char_count) {
-    FileEntry *entry = index_lookup_file(filename);
-    if (!entry) return -1;
-    
-    if (last_accessed > 0) entry->last_accessed = last_accessed;
-    if (last_modified > 0) entry->last_modified = last_modified;
-    entry->size_bytes = size_bytes;
-    entry->word_count = word_count;
-    entry->char_count = char_count;
-    
+    if (!filename) return -1;
+
+    PathKey key;
+    make_key(filename, &key);
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    int rc = update_metadata_locked(&key, last_accessed, last_modified,
+                                    size_bytes, word_count, char_count);
+    if (rc == 0) {
+        IndexMutation m = {
+            .op = INDEX_OP_META, .path = filename,
+            .t0 = last_accessed, .t1 = last_modified,
+            .size = size_bytes, .words = word_count, .chars = char_count
+        };
+        journal_locked(&m);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+    return rc;
+}
+
+// Record a read access under the shared lock
+int index_touch_file(const char *filename, time_t accessed) {
+    if (!filename) return -1;
+
+    PathKey key;
+    make_key(filename, &key);
+
+    pthread_rwlock_rdlock(&g_index_lock);
+    uint32_t id = lookup_locked(&key);
+    if (id) {
+        __atomic_store_n(&COLD(id)->last_accessed, accessed, __ATOMIC_RELAXED);
+        mark_recent(id, accessed);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+
+    return id ? 0 : -1;
+}
+
+// Set the owner of a file
+static int set_owner_locked(const PathKey *key, const char *owner) {
+    uint32_t id = lookup_locked(key);
+    uint32_t owner_id;
+    if (!id || pool_intern(&g_owners, owner, &owner_id) != 0) return -1;
+    HOT(id)->owner_id = owner_id;
     return 0;
 }
 
+// Set the owner of a file
+int index_set_owner(const char *filename, const char *owner) {
+    if (!filename || !owner) return -1;
+
+    PathKey key;
+    make_key(filename, &key);
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    int rc = set_owner_locked(&key, owner);
+    if (rc == 0) {
+        IndexMutation m = {.op = INDEX_OP_OWNER, .path = filename, .a = owner};
+        journal_locked(&m);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+    return rc;
+}
+
+// Point every file hosted on from_ss at another SS
+// Returns: Number of nodes rewritten
+static int reassign_ss_locked(const char *from_ss, const char *to_host, int to_port,
+                              const char *to_ss) {
+    uint32_t from_user = pool_find(&g_ss_strings, from_ss);
+    uint32_t to_loc = 0;
+    if (!from_user || intern_location(to_host, to_port, to_ss, &to_loc) != 0) return 0;
+
+    int updated = 0;
+    for (int t = 0; t < 2; t++) {
+        FileTable *tab = &g_file_index.tables[t];
+        if (!tab->buckets) continue;
+        for (size_t i = 0; i <= tab->mask; i++) {
+            for (uint32_t curr = tab->buckets[i]; curr; curr = HOT(curr)->next) {
+                HotNode *hot = HOT(curr);
+                if (g_locs[hot->loc_id].user_id != from_user) continue;
+                hot->loc_id = to_loc;
+                updated++;
+            }
+        }
+    }
+    return updated;
+}
+
+// Point every file hosted on from_ss at another SS
+int index_reassign_ss(const char *from_ss, const char *to_host, int to_port,
+                      const char *to_ss) {
+    if (!from_ss || !to_host || !to_ss) return 0;
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    int updated = reassign_ss_locked(from_ss, to_host, to_port, to_ss);
+    if (updated > 0) {
+        IndexMutation m = {
+            .op = INDEX_OP_REASSIGN, .a = from_ss, .b = to_host, .c = to_ss, .port = to_port
+        };
+        journal_locked(&m);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+    return updated;
+}
+
 // ===== Folder Management Functions =====
 
-// Add a folder to the index
-FolderEntry *index_add_folder(const char *folder_path, const char *ss_username) {
-    if (!folder_path) return NULL;
-    
-    // Normalize folder path to have trailing slash (except for "/")
+// Add a folder; caller holds g_index_lock exclusively
+static int add_folder_locked(const char *folder_path, const char *ss_username,
+                             time_t created) {
     char normalized_path[MAX_FOLDER_PATH];
-    size_t len = strlen(folder_path);
-    
-    if (strcmp(folder_path, "/") == 0) {
-        strcpy(normalized_path, "/");
-    } else if (len > 0 && folder_path[len - 1] == '/') {
-        // Already has trailing slash
-        strncpy(normalized_path, folder_path, sizeof(normalized_path) - 1);
-        normalized_path[sizeof(normalized_path) - 1] = '\0';
-    } else {
-        // Add trailing slash
-        snprintf(normalized_path, sizeof(normalized_path), "%s/", folder_path);
-    }
-    
+    normalize_folder(folder_path, normalized_path, sizeof(normalized_path));
+
     // Check if folder already exists
-    unsigned int hash = index_hash(normalized_path);
+    size_t hash = index_hash(normalized_path, strlen(normalized_path)) & (INDEX_HASH_SIZE - 1);
     FolderEntry *curr = g_folder_index.buckets[hash];
     while (curr) {
         if (strcmp(curr->folder_path, normalized_path) == 0) {
@@ -374,112 +1007,89 @@ FolderEntry *index_add_folder(const char *folder_path, const char *ss_username)
             if (ss_username && ss_username[0]) {
                 strncpy(curr->ss_username, ss_username, sizeof(curr->ss_username) - 1);
             }
-            return curr;
+            return 0;
         }
         curr = curr->next;
     }
-    
+
     // Create new folder entry
     FolderEntry *entry = (FolderEntry *)calloc(1, sizeof(FolderEntry));
-    if (!entry) return NULL;
-    
-    size_t copy_len = strlen(normalized_path);
-    if (copy_len >= sizeof(entry->folder_path)) {
-        copy_len = sizeof(entry->folder_path) - 1;
-    }
-    memcpy(entry->folder_path, normalized_path, copy_len);
-    entry->folder_path[copy_len] = '\0';
-    entry->created = time(NULL);
+    if (!entry) return -1;
+
+    snprintf(entry->folder_path, sizeof(entry->folder_path), "%s", normalized_path);
+    entry->created = created > 0 ? created : time(NULL);
     if (ss_username && ss_username[0]) {
         strncpy(entry->ss_username, ss_username, sizeof(entry->ss_username) - 1);
     }
-    
+
     // Add to hash map
     entry->next = g_folder_index.buckets[hash];
     g_folder_index.buckets[hash] = entry;
     g_folder_index.count++;
-    
-    return entry;
+
+    return 0;
+}
+
+// Add a folder to the index
+int index_add_folder(const char *folder_path, const char *ss_username) {
+    if (!folder_path) return -1;
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    int rc = add_folder_locked(folder_path, ss_username, 0);
+    if (rc == 0) {
+        IndexMutation m = {
+            .op = INDEX_OP_FOLDER, .path = folder_path, .a = ss_username, .t0 = time(NULL)
+        };
+        journal_locked(&m);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+    return rc;
 }
 
 // Check if a folder exists in the index
 int index_folder_exists(const char *folder_path) {
     if (!folder_path) return 0;
-    
-    // Normalize folder path to have trailing slash (except for "/")
+
     char normalized_path[MAX_FOLDER_PATH];
-    size_t len = strlen(folder_path);
-    
-    if (strcmp(folder_path, "/") == 0) {
-        strcpy(normalized_path, "/");
-    } else if (len > 0 && folder_path[len - 1] == '/') {
-        // Already has trailing slash
-        strncpy(normalized_path, folder_path, sizeof(normalized_path) - 1);
-        normalized_path[sizeof(normalized_path) - 1] = '\0';
-    } else {
-        // Add trailing slash
-        snprintf(normalized_path, sizeof(normalized_path), "%s/", folder_path);
-    }
-    
-    unsigned int hash = index_hash(normalized_path);
-    FolderEntry *curr = g_folder_index.buckets[hash];
-    
-    while (curr) {
+    normalize_folder(folder_path, normalized_path, sizeof(normalized_path));
+
+    int found = 0;
+    size_t hash = index_hash(normalized_path, strlen(normalized_path)) & (INDEX_HASH_SIZE - 1);
+
+    pthread_rwlock_rdlock(&g_index_lock);
+    for (FolderEntry *curr = g_folder_index.buckets[hash]; curr; curr = curr->next) {
         if (strcmp(curr->folder_path, normalized_path) == 0) {
-            return 1;
+            found = 1;
+            break;
         }
-        curr = curr->next;
     }
-    
-    return 0;
+    pthread_rwlock_unlock(&g_index_lock);
+
+    return found;
 }
 
 // Get all files in a specific folder (not recursive)
-int index_get_files_in_folder(const char *folder_path, FileEntry **files, int max_files) {
+int index_get_files_in_folder(const char *folder_path, FileEntry *files, int max_files) {
     if (!folder_path || !files || max_files <= 0) return 0;
-    
-    // Normalize folder path to have trailing slash (except for "/")
+
     char normalized_path[MAX_FOLDER_PATH];
-    size_t len = strlen(folder_path);
-    
-    if (strcmp(folder_path, "/") == 0) {
-        strcpy(normalized_path, "/");
-    } else if (len > 0 && folder_path[len - 1] == '/') {
-        // Already has trailing slash
-        strncpy(normalized_path, folder_path, sizeof(normalized_path) - 1);
-        normalized_path[sizeof(normalized_path) - 1] = '\0';
-    } else {
-        // Add trailing slash
-        snprintf(normalized_path, sizeof(normalized_path), "%s/", folder_path);
-    }
-    
-    int count = 0;
-    
-    // Iterate through all hash buckets
-    for (int i = 0; i < INDEX_HASH_SIZE && count < max_files; i++) {
-        FileEntry *curr = g_file_index.buckets[i];
-        while (curr && count < max_files) {
-            // Check if file is in the specified folder
-            if (strcmp(curr->folder_path, normalized_path) == 0) {
-                files[count++] = curr;
-            }
-            curr = curr->next;
-        }
-    }
-    
-    return count;
+    normalize_folder(folder_path, normalized_path, sizeof(normalized_path));
+
+    return collect_files(NULL, normalized_path, files, max_files);
 }
 
 // Get all subfolders in a specific folder (not recursive)
-int index_get_subfolders(const char *folder_path, FolderEntry **folders, int max_folders) {
+int index_get_subfolders(const char *folder_path, FolderEntry *folders, int max_folders) {
     if (!folder_path || !folders || max_folders <= 0) return 0;
-    
+
     int count = 0;
     size_t parent_len = strlen(folder_path);
-    
+
     // Ensure parent path ends with /
     int parent_has_slash = (parent_len > 0 && folder_path[parent_len - 1] == '/');
-    
+
+    pthread_rwlock_rdlock(&g_index_lock);
+
     // Iterate through all folder buckets
     for (int i = 0; i < INDEX_HASH_SIZE && count < max_folders; i++) {
         FolderEntry *curr = g_folder_index.buckets[i];
@@ -489,39 +1099,511 @@ int index_get_subfolders(const char *folder_path, FolderEntry **folders, int max
             if (strncmp(curr->folder_path, folder_path, parent_len) == 0) {
                 const char *rest = curr->folder_path + parent_len;
                 if (!parent_has_slash && rest[0] == '/') rest++;
-                
+
                 // Check if rest contains exactly one more folder level
                 // Should have exactly one '/' at the end
                 const char *slash = strchr(rest, '/');
                 if (slash && slash[1] == '\0') {
                     // This is a direct child
-                    folders[count++] = curr;
+                    folders[count] = *curr;
+                    folders[count].next = NULL;
+                    count++;
                 }
             }
             curr = curr->next;
         }
     }
-    
+
+    pthread_rwlock_unlock(&g_index_lock);
     return count;
 }
 
+
+// Update file's folder path
+static int move_file_locked(const char *filename, const char *old_folder_path,
+                            const char *new_folder_path) {
+    // Build old and new keys (the key is the full path, so a move rehashes)
+    PathKey old_key;
+    normalize_folder(old_folder_path, old_key.folder_path, sizeof(old_key.folder_path));
+    snprintf(old_key.filename, sizeof(old_key.filename), "%s", filename);
+    old_key.hash = hash_parts(old_key.folder_path, old_key.filename);
+
+    PathKey new_key;
+    normalize_folder(new_folder_path, new_key.folder_path, sizeof(new_key.folder_path));
+    snprintf(new_key.filename, sizeof(new_key.filename), "%s", filename);
+    new_key.hash = hash_parts(new_key.folder_path, new_key.filename);
+
+    rehash_step_locked();
+
+    // Look up the file; refuse to shadow a file already at the destination
+    int t = 0;
+    uint32_t folder_id;
+    uint32_t *link = find_link_locked(&old_key, &t);
+    if (!link || lookup_locked(&new_key) ||
+        pool_intern(&g_folders, new_key.folder_path, &folder_id) != 0) {
+        return -1;
+    }
+
+    // Relink under the new folder path
+    uint32_t id = unlink_locked(link, t);
+    HOT(id)->folder_id = folder_id;
+    HOT(id)->path_hash = new_key.hash;
+    insert_locked(id);
+    return 0;
+}
+
 // Update file's folder path (for MOVE operation)
-int index_move_file(const char *filename, const char *old_folder_path, 
+int index_move_file(const char *filename, const char *old_folder_path,
                     const char *new_folder_path) {
     if (!filename || !old_folder_path || !new_folder_path) return -1;
-    
-    // Build full old path
-    char old_full_path[MAX_FOLDER_PATH + MAX_FILENAME];
-    snprintf(old_full_path, sizeof(old_full_path), "%s%s", old_folder_path, filename);
-    
-    // Look up the file
-    FileEntry *entry = index_lookup_file(old_full_path);
-    if (!entry) return -1;
-    
-    // Update folder path
-    strncpy(entry->folder_path, new_folder_path, sizeof(entry->folder_path) - 1);
-    entry->folder_path[sizeof(entry->folder_path) - 1] = '\0';
-    
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    int rc = move_file_locked(filename, old_folder_path, new_folder_path);
+    if (rc == 0) {
+        IndexMutation m = {
+            .op = INDEX_OP_MOVE, .a = filename, .b = old_folder_path, .c = new_folder_path
+        };
+        journal_locked(&m);
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+    return rc;
+}
+
+// Apply a journaled mutation (WAL replay); the journal hook is not called
+int index_apply(const IndexMutation *m) {
+    if (!m) return -1;
+
+    const char *path = m->path ? m->path : "";
+    const char *a = m->a ? m->a : "";
+    const char *b = m->b ? m->b : "";
+    const char *c = m->c ? m->c : "";
+    PathKey key;
+    make_key(path, &key);
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    int rc = -1;
+    switch (m->op) {
+        case INDEX_OP_ADD:
+            rc = add_file_locked(&key, a, b, m->port, c, m->t0) ? 0 : -1;
+            break;
+        case INDEX_OP_REMOVE:
+            rc = remove_file_locked(&key);
+            break;
+        case INDEX_OP_MOVE:
+            rc = move_file_locked(a, b, c);
+            break;
+        case INDEX_OP_OWNER:
+            rc = set_owner_locked(&key, a);
+            break;
+        case INDEX_OP_META:
+            rc = update_metadata_locked(&key, m->t0, m->t1, m->size, m->words, m->chars);
+            break;
+        case INDEX_OP_REASSIGN:
+            rc = reassign_ss_locked(a, b, m->port, c) >= 0 ? 0 : -1;
+            break;
+        case INDEX_OP_FOLDER:
+            rc = add_folder_locked(path, a, m->t0);
+            break;
+    }
+    // Stay in step with the log even if a record no longer applies
+    if (m->version > g_index_version) g_index_version = m->version;
+    pthread_rwlock_unlock(&g_index_lock);
+    return rc;
+}
+
+// ===== Snapshots =====
+//
+// A snapshot is the whole index in one file, laid out so that loading it is
+// mostly pointer fix-ups over an mmap of the file:
+//   SnapHeader
+//   string tables   folder, owner and SS pools; NUL-terminated, in id order
+//   locations       SSLocation records, verbatim (ids preserved)
+//   files           SnapFile records, 8-byte aligned
+//   names           base filenames, each padded to its 8-byte size class
+//   folders         [u16 len][path][u16 len][ss username][i64 created]
+// Interned ids are written as-is, so file records need no translation. The
+// mapping stays for the life of the process: pool strings and node names
+// point straight into it (MAP_PRIVATE, so recycling a name slot through the
+// arena free lists only dirties a private copy of the page).
+// Files are native-endian; they are restart state, not an exchange format.
+
+#define SNAP_MAGIC "NMSNAP01"
+
+typedef struct {
+    char magic[8];
+    uint64_t version;         // Index version the snapshot reflects
+    uint64_t body_len;        // Bytes after the header
+    uint64_t checksum;        // index_hash() of the body
+    uint32_t pool_count[3];   // Folder/owner/SS pool sizes (including id 0)
+    uint32_t loc_count;       // Locations (including id 0)
+    uint64_t file_count;
+    uint64_t folder_count;
+    uint64_t off_pools[3];    // Section offsets from the start of the file
+    uint64_t off_locs;
+    uint64_t off_files;
+    uint64_t off_names;
+    uint64_t off_folders;
+} SnapHeader;
+
+typedef struct {
+    uint64_t path_hash;
+    uint64_t name_off;        // Offset into the names section
+    uint32_t folder_id;
+    uint32_t owner_id;
+    uint32_t loc_id;
+    uint32_t replica_loc_id;
+    int64_t created;
+    int64_t last_modified;
+    int64_t last_accessed;
+    uint64_t size_bytes;
+    int32_t word_count;
+    int32_t char_count;
+} SnapFile;
+
+// Growable output buffer for building a snapshot in memory
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} SnapBuf;
+
+static int snap_reserve(SnapBuf *buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) return 0;
+    size_t cap = buf->cap ? buf->cap : 1 << 20;
+    while (cap < buf->len + extra) cap *= 2;
+    char *data = realloc(buf->data, cap);
+    if (!data) return -1;
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+static int snap_put(SnapBuf *buf, const void *p, size_t n) {
+    if (snap_reserve(buf, n) != 0) return -1;
+    memcpy(buf->data + buf->len, p, n);
+    buf->len += n;
+    return 0;
+}
+
+// Zero-pad to a multiple of 8 bytes
+static int snap_align(SnapBuf *buf) {
+    static const char zeros[8] = {0};
+    size_t pad = (8 - buf->len % 8) % 8;
+    return pad ? snap_put(buf, zeros, pad) : 0;
+}
+
+static int snap_put_pool(SnapBuf *buf, const StringPool *pool) {
+    for (uint32_t id = 1; id < pool->count; id++) {
+        if (snap_put(buf, pool->strs[id], strlen(pool->strs[id]) + 1) != 0) return -1;
+    }
+    return 0;
+}
+
+// Serialize the index; caller holds g_index_lock (shared is enough)
+static int snap_build_locked(SnapBuf *buf, SnapBuf *names) {
+    SnapHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = g_index_version;
+    if (snap_put(buf, &hdr, sizeof(hdr)) != 0) return -1;
+
+    const StringPool *pools[3] = {&g_folders, &g_owners, &g_ss_strings};
+    for (int i = 0; i < 3; i++) {
+        hdr.pool_count[i] = pools[i]->count ? pools[i]->count : 1;
+        hdr.off_pools[i] = buf->len;
+        if (snap_put_pool(buf, pools[i]) != 0) return -1;
+    }
+
+    if (snap_align(buf) != 0) return -1;
+    hdr.off_locs = buf->len;
+    hdr.loc_count = g_loc_count;
+    if (g_loc_count && snap_put(buf, g_locs, g_loc_count * sizeof(SSLocation)) != 0) return -1;
+
+    // File records go to buf, names to their own buffer (appended after)
+    if (snap_align(buf) != 0) return -1;
+    hdr.off_files = buf->len;
+    size_t files = g_file_index.tables[0].used + g_file_index.tables[1].used;
+    if (snap_reserve(buf, files * sizeof(SnapFile)) != 0) return -1;
+    for (int t = 0; t < 2; t++) {
+        const FileTable *tab = &g_file_index.tables[t];
+        if (!tab->buckets) continue;
+        for (size_t i = 0; i <= tab->mask; i++) {
+            for (uint32_t id = tab->buckets[i]; id; id = HOT(id)->next) {
+                const HotNode *hot = HOT(id);
+                const ColdNode *cold = COLD(id);
+                size_t len = strlen(hot->name) + 1;
+                SnapFile rec = {
+                    .path_hash = hot->path_hash,
+                    .name_off = names->len,
+                    .folder_id = hot->folder_id,
+                    .owner_id = hot->owner_id,
+                    .loc_id = hot->loc_id,
+                    .replica_loc_id = cold->replica_loc_id,
+                    .created = cold->created,
+                    .last_modified = cold->last_modified,
+                    .last_accessed = __atomic_load_n(&cold->last_accessed, __ATOMIC_RELAXED),
+                    .size_bytes = cold->size_bytes,
+                    .word_count = cold->word_count,
+                    .char_count = cold->char_count
+                };
+                if (snap_put(buf, &rec, sizeof(rec)) != 0 ||
+                    snap_put(names, hot->name, len) != 0 || snap_align(names) != 0) {
+                    return -1;
+                }
+                hdr.file_count++;
+            }
+        }
+    }
+
+    hdr.off_names = buf->len;
+    if (snap_put(buf, names->data, names->len) != 0) return -1;
+
+    hdr.off_folders = buf->len;
+    for (int i = 0; i < INDEX_HASH_SIZE; i++) {
+        for (const FolderEntry *f = g_folder_index.buckets[i]; f; f = f->next) {
+            uint16_t plen = (uint16_t)strlen(f->folder_path);
+            uint16_t slen = (uint16_t)strlen(f->ss_username);
+            int64_t created = f->created;
+            if (snap_put(buf, &plen, sizeof(plen)) != 0 ||
+                snap_put(buf, f->folder_path, plen) != 0 ||
+                snap_put(buf, &slen, sizeof(slen)) != 0 ||
+                snap_put(buf, f->ss_username, slen) != 0 ||
+                snap_put(buf, &created, sizeof(created)) != 0) {
+                return -1;
+            }
+            hdr.folder_count++;
+        }
+    }
+
+    hdr.body_len = buf->len - sizeof(hdr);
+    hdr.checksum = index_hash(buf->data + sizeof(hdr), hdr.body_len);
+    memcpy(buf->data, &hdr, sizeof(hdr));
+    return 0;
+}
+
+// Write a snapshot of the index to path (atomically: tmp file + rename)
+int index_snapshot_write(const char *path, uint64_t *version_out) {
+    if (!path) return -1;
+
+    // Serialize under the shared lock; disk I/O happens after releasing it
+    SnapBuf buf = {0}, names = {0};
+    pthread_rwlock_rdlock(&g_index_lock);
+    int rc = snap_build_locked(&buf, &names);
+    pthread_rwlock_unlock(&g_index_lock);
+    free(names.data);
+    if (rc != 0) {
+        free(buf.data);
+        return -1;
+    }
+
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(buf.data);
+        return -1;
+    }
+    size_t off = 0;
+    while (off < buf.len) {
+        ssize_t n = write(fd, buf.data + off, buf.len - off);
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    if (off != buf.len || fsync(fd) != 0 || close(fd) != 0 || rename(tmp, path) != 0) {
+        if (off != buf.len) close(fd);
+        unlink(tmp);
+        free(buf.data);
+        return -1;
+    }
+
+    if (version_out) {
+        SnapHeader hdr;
+        memcpy(&hdr, buf.data, sizeof(hdr));
+        *version_out = hdr.version;
+    }
+    free(buf.data);
     return 0;
 }
 
+// Restore a pool whose strings live in the mapping
+static int snap_load_pool(StringPool *pool, const char *p, const char *end, uint32_t count) {
+    const char **strs = malloc((size_t)count * sizeof(char *));
+    if (!strs) return -1;
+    strs[0] = "";
+    for (uint32_t id = 1; id < count; id++) {
+        const char *nul = memchr(p, '\0', (size_t)(end - p));
+        if (!nul) {
+            free(strs);
+            return -1;
+        }
+        strs[id] = p;
+        p = nul + 1;
+    }
+    pool->strs = strs;
+    pool->count = count;
+    pool->cap = count;
+
+    uint32_t size = 64;
+    while (size < count * 2) size *= 2;
+    return pool_rebuild_slots(pool, size);
+}
+
+// Load a snapshot into an empty index
+int index_snapshot_load(const char *path, uint64_t *version_out) {
+    if (!path) return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapHeader)) {
+        close(fd);
+        return -1;
+    }
+    size_t len = (size_t)st.st_size;
+    char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    // Validate before touching the index
+    SnapHeader hdr;
+    memcpy(&hdr, map, sizeof(hdr));
+    const char *end = map + len;
+    int valid = memcmp(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic)) == 0 &&
+                hdr.body_len == len - sizeof(hdr) &&
+                hdr.off_files + hdr.file_count * sizeof(SnapFile) <= hdr.off_names &&
+                hdr.off_locs + (uint64_t)hdr.loc_count * sizeof(SSLocation) <= hdr.off_files &&
+                hdr.off_names <= hdr.off_folders && hdr.off_folders <= len &&
+                hdr.pool_count[0] > 0 && hdr.pool_count[1] > 0 && hdr.pool_count[2] > 0 &&
+                index_hash(map + sizeof(hdr), hdr.body_len) == hdr.checksum;
+    if (!valid) {
+        munmap(map, len);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    if (g_node_top != 1 || g_folders.count > 1 || g_owners.count > 1 ||
+        g_ss_strings.count > 1 || g_loc_count > 1) {
+        pthread_rwlock_unlock(&g_index_lock);
+        munmap(map, len);
+        return -1;  // Only an empty index can be restored into
+    }
+
+    int rc = 0;
+    StringPool *pools[3] = {&g_folders, &g_owners, &g_ss_strings};
+    for (int i = 0; i < 3 && rc == 0; i++) {
+        rc = snap_load_pool(pools[i], map + hdr.off_pools[i], end, hdr.pool_count[i]);
+    }
+
+    if (rc == 0 && hdr.loc_count > 0) {
+        g_locs = malloc(hdr.loc_count * sizeof(SSLocation));
+        if (g_locs) {
+            memcpy(g_locs, map + hdr.off_locs, hdr.loc_count * sizeof(SSLocation));
+            g_loc_count = g_loc_cap = hdr.loc_count;
+        } else {
+            rc = -1;
+        }
+    }
+
+    // Size the table for the final count up front so loading never rehashes
+    size_t buckets = INDEX_INITIAL_BUCKETS;
+    while (hdr.file_count * 100 >= buckets * INDEX_MAX_LOAD_PCT) buckets *= 2;
+    if (rc == 0 && buckets > g_file_index.tables[0].mask + 1) {
+        uint32_t *table = calloc(buckets, sizeof(uint32_t));
+        if (table) {
+            free(g_file_index.tables[0].buckets);
+            g_file_index.tables[0].buckets = table;
+            g_file_index.tables[0].mask = buckets - 1;
+        } else {
+            rc = -1;
+        }
+    }
+
+    const SnapFile *recs = (const SnapFile *)(map + hdr.off_files);
+    char *names = map + hdr.off_names;
+    for (uint64_t i = 0; i < hdr.file_count && rc == 0; i++) {
+        const SnapFile *rec = &recs[i];
+        uint32_t id = node_alloc();
+        if (!id) {
+            rc = -1;
+            break;
+        }
+        HotNode *hot = HOT(id);
+        hot->path_hash = rec->path_hash;
+        hot->name = names + rec->name_off;
+        hot->folder_id = rec->folder_id;
+        hot->owner_id = rec->owner_id;
+        hot->loc_id = rec->loc_id;
+        ColdNode *cold = COLD(id);
+        cold->created = rec->created;
+        cold->last_modified = rec->last_modified;
+        cold->last_accessed = rec->last_accessed;
+        cold->last_lookup = rec->last_accessed;
+        cold->size_bytes = rec->size_bytes;
+        cold->word_count = rec->word_count;
+        cold->char_count = rec->char_count;
+        cold->replica_loc_id = rec->replica_loc_id;
+        rc = insert_locked(id);
+    }
+
+    const char *p = map + hdr.off_folders;
+    for (uint64_t i = 0; i < hdr.folder_count && rc == 0; i++) {
+        char folder[MAX_FOLDER_PATH], ss[MAX_SS_USERNAME];
+        uint16_t plen, slen;
+        int64_t created;
+        memcpy(&plen, p, sizeof(plen));
+        p += sizeof(plen);
+        snprintf(folder, sizeof(folder), "%.*s", (int)plen, p);
+        p += plen;
+        memcpy(&slen, p, sizeof(slen));
+        p += sizeof(slen);
+        snprintf(ss, sizeof(ss), "%.*s", (int)slen, p);
+        p += slen;
+        memcpy(&created, p, sizeof(created));
+        p += sizeof(created);
+        rc = add_folder_locked(folder, ss, (time_t)created);
+    }
+
+    if (rc == 0) g_index_version = hdr.version;
+    pthread_rwlock_unlock(&g_index_lock);
+
+    // The mapping is never unmapped: the index now points into it
+    if (rc == 0 && version_out) *version_out = hdr.version;
+    return rc;
+}
+
+// Index statistics
+void index_get_stats(IndexStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+
+    pthread_rwlock_rdlock(&g_index_lock);
+    out->files = g_file_index.tables[0].used + g_file_index.tables[1].used;
+    out->rehashing = rehashing();
+    FileTable *tab = &g_file_index.tables[out->rehashing ? 1 : 0];
+    if (tab->buckets) {
+        out->buckets = tab->mask + 1;
+        for (size_t i = 0; i <= tab->mask; i++) {
+            size_t chain = 0;
+            for (uint32_t curr = tab->buckets[i]; curr; curr = HOT(curr)->next) chain++;
+            if (chain > out->max_chain) out->max_chain = chain;
+        }
+    }
+
+    // Heap owned by the file index (folder index excluded)
+    size_t bytes = (size_t)g_chunk_count * NODE_CHUNK * (sizeof(HotNode) + sizeof(ColdNode));
+    bytes += g_arena_blocks * sizeof(ArenaBlock);
+    for (int t = 0; t < 2; t++) {
+        if (g_file_index.tables[t].buckets) {
+            bytes += (g_file_index.tables[t].mask + 1) * sizeof(uint32_t);
+        }
+    }
+    const StringPool *pools[3] = {&g_folders, &g_owners, &g_ss_strings};
+    for (int i = 0; i < 3; i++) {
+        bytes += pools[i]->cap * sizeof(char *);
+        if (pools[i]->slots) bytes += (pools[i]->mask + 1) * sizeof(uint32_t);
+    }
+    bytes += g_loc_cap * sizeof(SSLocation);
+    out->memory_bytes = bytes;
+    out->interned_strings = g_folders.count + g_owners.count + g_ss_strings.count;
+    pthread_rwlock_unlock(&g_index_lock);
+}
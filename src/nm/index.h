@@ -2,11 +2,14 @@
 #define INDEX_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
 // File Index Module for Name Server
-// Provides efficient O(1) file lookup using hash map
-// Also includes LRU cache for frequently accessed files
+// Provides efficient O(1) file lookup using hash map keyed on the full
+// normalized path ("/folder/file.txt"), so same-named files in different
+// folders do not share a chain.
+// Safe for concurrent use from the NM worker pool (see Locking below)
 
 // Maximum filename length
 #define MAX_FILENAME 256
@@ -14,8 +17,14 @@
 #define MAX_SS_HOST 64
 #define MAX_SS_USERNAME 64
 
-// Structure representing a file entry in the index
-// This stores all metadata needed for file operations and VIEW/INFO commands
+// Structure describing a file in the index
+// This carries all metadata needed for file operations and VIEW/INFO commands
+//
+// FileEntry is the copy-out form only. The index stores files as compact
+// nodes (interned strings, arena names, hot/cold split; see index.c) and
+// fills a FileEntry when a caller looks one up. Callers never hold pointers
+// into the index, so a concurrent DELETE cannot free an entry that a READ
+// is still using.
 typedef struct FileEntry {
     char filename[MAX_FILENAME];      // Name of the file (without path)
     char folder_path[MAX_FOLDER_PATH]; // Folder path (e.g., "/" or "/folder1/folder2/")
@@ -31,21 +40,23 @@ typedef struct FileEntry {
     
     time_t created;                   // Creation timestamp
     time_t last_modified;             // Last modification timestamp
-    time_t last_accessed;             // Last access timestamp
+    time_t last_accessed;             // Last access timestamp (updated under shared lock)
+    time_t last_lookup;               // Recency stamp (CLOCK-style, replaces LRU list)
     size_t size_bytes;                // File size in bytes
     int word_count;                   // Word count (for INFO command)
     int char_count;                   // Character count (for INFO command)
-    
-    // Internal: for hash map chaining
-    struct FileEntry *next;
-    
-    // Internal: for LRU cache (doubly-linked list)
-    struct FileEntry *lru_prev;
-    struct FileEntry *lru_next;
 } FileEntry;
 
-// Hash map structure for O(1) file lookup
-// Uses chaining to handle collisions
+// File hash map: chained buckets, power-of-two sized, grows incrementally.
+// When the load factor passes INDEX_MAX_LOAD_PCT a table twice the size is
+// allocated and every subsequent mutation migrates INDEX_REHASH_STEP buckets
+// from the old table; lookups consult both tables until migration finishes.
+// No single operation ever rehashes the whole index.
+#define INDEX_INITIAL_BUCKETS 1024
+#define INDEX_MAX_LOAD_PCT 75
+#define INDEX_REHASH_STEP 64
+
+// Folder hash map size (folders are few; fixed size is enough)
 #define INDEX_HASH_SIZE 1024  // Hash table size (power of 2 for efficiency)
 
 // Structure representing a folder in the index
@@ -59,131 +70,187 @@ typedef struct FolderEntry {
     struct FolderEntry *next;
 } FolderEntry;
 
-// Folder hash map structure (use same hash size as files)
-typedef struct {
-    FolderEntry *buckets[INDEX_HASH_SIZE];
-    int count;
-} FolderIndex;
-
-// Global folder index
-extern FolderIndex g_folder_index;
-
-typedef struct {
-    FileEntry *buckets[INDEX_HASH_SIZE];  // Hash buckets (array of linked lists)
-    int count;                             // Total number of files indexed
-} FileIndex;
-
-// LRU Cache structure for frequently accessed files
-// Recent lookups are cached for faster subsequent access
-#define LRU_CACHE_SIZE 100  // Maximum files in cache
-
-typedef struct {
-    FileEntry *head;  // Most recently used
-    FileEntry *tail;  // Least recently used
-    int size;         // Current cache size
-} LRUCache;
-
-// Global index (one per NM instance)
-// Initialized once and used throughout NM lifetime
-extern FileIndex g_file_index;
-extern LRUCache g_lru_cache;
+// ===== Locking =====
+//
+// The file index and folder index share one reader-writer lock.
+// - Lookups and listings (READ, STREAM, INFO, VIEW, VIEWFOLDER) take it shared
+//   and never modify list pointers. Recency and last-access stamps are plain
+//   per-entry stores made with relaxed atomics, so readers never contend on a
+//   shared LRU list head.
+// - Mutations (CREATE, DELETE, MOVE, SS registration, failover rewrites) take
+//   it exclusive.
+// All functions below acquire the lock internally; none may be called with
+// the lock already held.
 
-// Initialize the file index and LRU cache
+// Initialize the file index
 // Must be called before any other index operations
 void index_init(void);
 
 // Add a file to the index
 // Called when SS registers with file list, or when file is created
-// filename: Name of the file
+// filename: Name of the file (optionally with folder path)
 // owner: Username of file owner
 // ss_host: IP address of Storage Server
 // ss_client_port: Port on SS for client connections
 // ss_username: Username of SS
-// Returns: Pointer to created FileEntry, or NULL on error
+// out: Optional; receives a copy of the indexed entry
+// Returns: 0 on success, -1 on error
 //
-// This function:
-// 1. Hashes the filename to find the bucket
-// 2. Checks if file already exists (returns existing entry if found)
-// 3. Creates new FileEntry and adds to hash map
-// 4. Increments file count
+// If the file already exists its SS location is refreshed instead.
 //
 // Usage:
-//   FileEntry *entry = index_add_file("test.txt", "alice", "127.0.0.1", 6001, "ss1");
-FileEntry *index_add_file(const char *filename, const char *owner,
-                          const char *ss_host, int ss_client_port,
-                          const char *ss_username);
+//   FileEntry entry;
+//   if (index_add_file("test.txt", "alice", "127.0.0.1", 6001, "ss1", &entry) == 0) { ... }
+int index_add_file(const char *filename, const char *owner,
+                   const char *ss_host, int ss_client_port,
+                   const char *ss_username, FileEntry *out);
 
 // Remove a file from the index
 // Called when file is deleted
 // filename: Name of the file to remove
 // Returns: 0 on success, -1 if file not found
-//
-// This function:
-// 1. Hashes filename to find bucket
-// 2. Searches chain for file
-// 3. Removes from hash map
-// 4. Removes from LRU cache if present
-// 5. Decrements file count
 int index_remove_file(const char *filename);
 
-// Lookup a file in the index (O(1) average case)
-// filename: Name of the file to find
-// Returns: Pointer to FileEntry if found, NULL otherwise
-//
-// This function:
-// 1. Hashes filename to find bucket
-// 2. Searches chain for matching file
-// 3. Updates LRU cache (moves to front if found in cache)
-// 4. Returns entry or NULL
+// Lookup a file in the index (O(1) average case, shared lock)
+// filename: Name of the file to find (optionally with folder path)
+// out: Receives a copy of the entry
+// Returns: out if found, NULL otherwise
 //
 // Usage:
-//   FileEntry *entry = index_lookup_file("test.txt");
+//   FileEntry entry_buf;
+//   FileEntry *entry = index_get_file("test.txt", &entry_buf);
 //   if (entry) {
 //       printf("File found: owner=%s\n", entry->owner);
 //   }
-FileEntry *index_lookup_file(const char *filename);
+FileEntry *index_get_file(const char *filename, FileEntry *out);
 
 // Get all files in the index
-// files: Array to populate with FileEntry pointers
+// files: Array to populate with entry copies
 // max_files: Maximum number of files to return
 // Returns: Number of files actually returned
 //
-// This iterates through all hash buckets and collects all files
 // Used for VIEW command (lists all files)
-int index_get_all_files(FileEntry **files, int max_files);
+int index_get_all_files(FileEntry *files, int max_files);
 
 // Get files owned by a specific user
 // owner: Username of file owner
-// files: Array to populate with FileEntry pointers
+// files: Array to populate with entry copies
 // max_files: Maximum number of files to return
 // Returns: Number of files found
-//
-// Iterates through all files and filters by owner
-// Used for VIEW command (lists user's files)
-int index_get_files_by_owner(const char *owner, FileEntry **files, int max_files);
+int index_get_files_by_owner(const char *owner, FileEntry *files, int max_files);
 
-// Update file metadata in index
+// Update file metadata in index (exclusive lock)
 // filename: Name of the file
 // Updates: last_accessed, last_modified, size_bytes, word_count, char_count
 // Returns: 0 on success, -1 if file not found
-//
-// This is called when file is accessed (READ) or modified (WRITE)
-// Updates the in-memory index (metadata file on SS is updated separately)
 int index_update_metadata(const char *filename, time_t last_accessed,
                           time_t last_modified, size_t size_bytes,
                           int word_count, int char_count);
 
-// Hash function for filename (simple djb2 hash)
-// Returns: Hash value (0 to INDEX_HASH_SIZE-1)
-unsigned int index_hash(const char *filename);
+// Record a read access (shared lock)
+// Only the entry's last_accessed stamp is written, with a relaxed atomic
+// store, so concurrent readers of the same file do not serialize.
+// Returns: 0 on success, -1 if file not found
+int index_touch_file(const char *filename, time_t accessed);
+
+// Set the owner of a file (exclusive lock)
+// Used when the owner is learned from SS metadata or on CREATE over an
+// entry that was indexed from SS registration.
+// Returns: 0 on success, -1 if file not found
+int index_set_owner(const char *filename, const char *owner);
+
+// Point every file hosted on from_ss at another SS (exclusive lock)
+// Used by failover to switch files from a failed primary to its replica.
+// Returns: Number of entries rewritten
+int index_reassign_ss(const char *from_ss, const char *to_host, int to_port,
+                      const char *to_ss);
+
+// 64-bit hash of a path (wyhash; fast on short keys, well mixed)
+// Returns: Full 64-bit hash; callers mask it down to a bucket
+uint64_t index_hash(const char *key, size_t len);
+
+// Index statistics (for benchmarks and diagnostics)
+typedef struct {
+    size_t files;          // Indexed files
+    size_t buckets;        // Buckets in the active (largest) table
+    int rehashing;         // 1 while an incremental resize is in progress
+    size_t max_chain;      // Longest chain seen in the active table
+    size_t memory_bytes;   // Heap held by file nodes, names, strings and buckets
+    size_t interned_strings; // Distinct folder/owner/SS strings
+} IndexStats;
+
+void index_get_stats(IndexStats *out);
+
+// ===== Journaling and snapshots =====
+//
+// Every successful namespace mutation is reported to an optional journal
+// hook (see index_wal.h), tagged with a monotonically increasing index
+// version. The record carries effective values (e.g. the normalized path and
+// the owner actually stored), so replaying it with index_apply() reproduces
+// the same index. A snapshot captures the whole index at one version;
+// restart = load snapshot, then apply journal records newer than it.
+
+typedef enum {
+    INDEX_OP_ADD = 1,      // path, a=owner, b=SS host, c=SS username, port, t0=created
+    INDEX_OP_REMOVE,       // path
+    INDEX_OP_MOVE,         // a=filename, b=old folder, c=new folder
+    INDEX_OP_OWNER,        // path, a=owner
+    INDEX_OP_META,         // path, t0=last accessed, t1=last modified, size, words, chars
+    INDEX_OP_REASSIGN,     // a=from SS, b=to host, c=to SS, port
+    INDEX_OP_FOLDER        // path=folder, a=SS username, t0=created
+} IndexOp;
+
+typedef struct {
+    IndexOp op;
+    uint64_t version;      // Index version after this mutation
+    const char *path;
+    const char *a;
+    const char *b;
+    const char *c;
+    int port;
+    time_t t0;
+    time_t t1;
+    size_t size;
+    int words;
+    int chars;
+} IndexMutation;
+
+// Journal hook; called with the index lock held exclusively, in version
+// order. Must not call back into the index.
+typedef void (*IndexJournalFn)(const IndexMutation *m);
+
+// Install (or clear, with NULL) the journal hook
+void index_set_journal(IndexJournalFn fn);
+
+// Current index version (number of journaled mutations since the first boot)
+uint64_t index_version(void);
+
+// Apply a journaled mutation without journaling it again (WAL replay)
+// The index version advances to m->version even if the record no longer
+// applies (e.g. removing a file that is already gone).
+// Returns: 0 if the mutation applied, -1 otherwise
+int index_apply(const IndexMutation *m);
+
+// Write a snapshot of the whole index to path (tmp file, fsync, rename)
+// The index is serialized under the shared lock, then written unlocked.
+// version_out: Optional; receives the index version the snapshot reflects
+// Returns: 0 on success, -1 on error
+int index_snapshot_write(const char *path, uint64_t *version_out);
+
+// Load a snapshot into an empty index (right after index_init)
+// The file is mmapped and stays mapped: interned strings and filenames are
+// used in place, so a million-file snapshot loads in well under a second.
+// version_out: Optional; receives the snapshot's index version
+// Returns: 0 on success, -1 if missing, corrupt, or the index is not empty
+int index_snapshot_load(const char *path, uint64_t *version_out);
 
 // ===== Folder Management Functions =====
 
 // Add a folder to the index
 // folder_path: Full folder path (e.g., "/folder1/subfolder2/")
 // ss_username: Username of SS where folder exists
-// Returns: Pointer to created FolderEntry, or NULL on error
-FolderEntry *index_add_folder(const char *folder_path, const char *ss_username);
+// Returns: 0 on success, -1 on error
+int index_add_folder(const char *folder_path, const char *ss_username);
 
 // Check if a folder exists
 // folder_path: Full folder path to check
@@ -192,17 +259,17 @@ int index_folder_exists(const char *folder_path);
 
 // Get all files in a specific folder (not recursive)
 // folder_path: Folder path to list (e.g., "/folder1/")
-// files: Array to populate with FileEntry pointers
+// files: Array to populate with entry copies
 // max_files: Maximum number of files to return
 // Returns: Number of files found in the folder
-int index_get_files_in_folder(const char *folder_path, FileEntry **files, int max_files);
+int index_get_files_in_folder(const char *folder_path, FileEntry *files, int max_files);
 
 // Get all subfolders in a specific folder (not recursive)
 // folder_path: Parent folder path (e.g., "/folder1/")
-// folders: Array to populate with FolderEntry pointers
+// folders: Array to populate with entry copies
 // max_folders: Maximum number of folders to return
 // Returns: Number of subfolders found
-int index_get_subfolders(const char *folder_path, FolderEntry **folders, int max_folders);
+int index_get_subfolders(const char *folder_path, FolderEntry *folders, int max_folders);
 
 // Update file's folder path (for MOVE operation)
 // filename: Name of the file
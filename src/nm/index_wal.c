@@ -0,0 +1,360 @@
+#define _POSIX_C_SOURCE 200809L
+#include "index_wal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "../common/log.h"
+
+// Record format (native-endian):
+//   u32 body_len, u32 checksum (low half of index_hash(body)), body
+// Body:
+//   u64 version, u8 op, 4 x (u16 len, bytes) for path/a/b/c,
+//   i32 port, i64 t0, i64 t1, u64 size, i32 words, i32 chars
+#define WAL_MAX_FIELD 1024
+#define WAL_MAX_BODY (8 + 1 + 4 * (2 + WAL_MAX_FIELD) + 4 + 8 + 8 + 8 + 4 + 4)
+
+#define WAL_PATH_MAX 1024
+
+static pthread_mutex_t g_wal_mu = PTHREAD_MUTEX_INITIALIZER;
+static FILE *g_wal = NULL;                 // Active log (append)
+static int g_wal_dirty = 0;                // Appended since the last fdatasync
+static unsigned long g_wal_records = 0;    // Appended since the last checkpoint
+static int g_old_pending = 0;              // index.wal.old still needed
+static time_t g_last_checkpoint = 0;
+
+// Serializes checkpoints (thread vs. shutdown); never held with g_wal_mu
+// by the journal hook path
+static pthread_mutex_t g_checkpoint_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static char g_snap_path[WAL_PATH_MAX];
+static char g_wal_path[WAL_PATH_MAX];
+static char g_old_path[WAL_PATH_MAX];
+
+static pthread_t g_wal_thread;
+static volatile int g_wal_running = 0;
+
+// ===== Encoding =====
+
+static void put_bytes(char **p, const void *src, size_t n) {
+    memcpy(*p, src, n);
+    *p += n;
+}
+
+static void put_str(char **p, const char *s) {
+    size_t len = s ? strlen(s) : 0;
+    if (len > WAL_MAX_FIELD) len = WAL_MAX_FIELD;
+    uint16_t len16 = (uint16_t)len;
+    put_bytes(p, &len16, sizeof(len16));
+    if (len) put_bytes(p, s, len);
+}
+
+// Encode m as a full record (header + body) into buf
+// Returns: record length
+static size_t wal_encode(const IndexMutation *m, char *buf) {
+    char *p = buf + 8;
+    uint64_t version = m->version;
+    uint8_t op = (uint8_t)m->op;
+    int32_t port = m->port, words = m->words, chars = m->chars;
+    int64_t t0 = m->t0, t1 = m->t1;
+    uint64_t size = m->size;
+
+    put_bytes(&p, &version, sizeof(version));
+    put_bytes(&p, &op, sizeof(op));
+    put_str(&p, m->path);
+    put_str(&p, m->a);
+    put_str(&p, m->b);
+    put_str(&p, m->c);
+    put_bytes(&p, &port, sizeof(port));
+    put_bytes(&p, &t0, sizeof(t0));
+    put_bytes(&p, &t1, sizeof(t1));
+    put_bytes(&p, &size, sizeof(size));
+    put_bytes(&p, &words, sizeof(words));
+    put_bytes(&p, &chars, sizeof(chars));
+
+    uint32_t body_len = (uint32_t)(p - buf - 8);
+    uint32_t checksum = (uint32_t)index_hash(buf + 8, body_len);
+    memcpy(buf, &body_len, sizeof(body_len));
+    memcpy(buf + 4, &checksum, sizeof(checksum));
+    return 8 + body_len;
+}
+
+// Bounds-checked reader over one record body
+typedef struct {
+    const char *p;
+    const char *end;
+    int ok;
+} WalReader;
+
+static void get_bytes(WalReader *r, void *dst, size_t n) {
+    if (!r->ok || (size_t)(r->end - r->p) < n) {
+        r->ok = 0;
+        memset(dst, 0, n);
+        return;
+    }
+    memcpy(dst, r->p, n);
+    r->p += n;
+}
+
+static void get_str(WalReader *r, char *dst) {
+    uint16_t len = 0;
+    get_bytes(r, &len, sizeof(len));
+    if (len > WAL_MAX_FIELD) r->ok = 0;
+    if (!r->ok) len = 0;
+    get_bytes(r, dst, len);
+    dst[len] = '\0';
+}
+
+// ===== Replay =====
+
+// Replay every record in path newer than after_version
+// Stops at the first torn or corrupt record and truncates the file there.
+// Returns: number of records applied, or -1 if the file does not exist
+static long wal_replay(const char *path, uint64_t after_version) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+
+    static char body[WAL_MAX_BODY];
+    char path_buf[WAL_MAX_FIELD + 1], a[WAL_MAX_FIELD + 1];
+    char b[WAL_MAX_FIELD + 1], c[WAL_MAX_FIELD + 1];
+    long applied = 0;
+    long good_end = 0;
+
+    for (;;) {
+        uint32_t hdr[2];
+        if (fread(hdr, sizeof(hdr), 1, fp) != 1) break;
+        if (hdr[0] > WAL_MAX_BODY || fread(body, hdr[0], 1, fp) != 1) break;
+        if ((uint32_t)index_hash(body, hdr[0]) != hdr[1]) break;
+
+        WalReader r = {body, body + hdr[0], 1};
+        IndexMutation m;
+        memset(&m, 0, sizeof(m));
+        uint8_t op = 0;
+        int32_t port, words, chars;
+        int64_t t0, t1;
+        uint64_t size;
+        get_bytes(&r, &m.version, sizeof(m.version));
+        get_bytes(&r, &op, sizeof(op));
+        get_str(&r, path_buf);
+        get_str(&r, a);
+        get_str(&r, b);
+        get_str(&r, c);
+        get_bytes(&r, &port, sizeof(port));
+        get_bytes(&r, &t0, sizeof(t0));
+        get_bytes(&r, &t1, sizeof(t1));
+        get_bytes(&r, &size, sizeof(size));
+        get_bytes(&r, &words, sizeof(words));
+        get_bytes(&r, &chars, sizeof(chars));
+        if (!r.ok) break;
+
+        good_end = ftell(fp);
+        if (m.version <= after_version) continue;
+
+        m.op = (IndexOp)op;
+        m.path = path_buf;
+        m.a = a;
+        m.b = b;
+        m.c = c;
+        m.port = port;
+        m.t0 = (time_t)t0;
+        m.t1 = (time_t)t1;
+        m.size = (size_t)size;
+        m.words = words;
+        m.chars = chars;
+        index_apply(&m);
+        applied++;
+    }
+
+    int torn = !feof(fp) || ftell(fp) != good_end;
+    fclose(fp);
+    if (torn && truncate(path, good_end) == 0) {
+        log_warning("index_wal_replay", "Truncated torn log tail of %s at %ld bytes",
+                    path, good_end);
+    }
+    return applied;
+}
+
+// ===== Journal hook =====
+
+static void wal_journal(const IndexMutation *m) {
+    char buf[8 + WAL_MAX_BODY];
+    size_t len = wal_encode(m, buf);
+
+    pthread_mutex_lock(&g_wal_mu);
+    if (g_wal) {
+        // Flush per record: the mutation reaches the kernel before the
+        // index lock is released (and before the client sees a reply)
+        if (fwrite(buf, 1, len, g_wal) != len || fflush(g_wal) != 0) {
+            log_error("index_wal_append", "Failed to append version %llu: %s",
+                      (unsigned long long)m->version, strerror(errno));
+        }
+        g_wal_dirty = 1;
+        g_wal_records++;
+    }
+    pthread_mutex_unlock(&g_wal_mu);
+}
+
+// fdatasync the log if anything was appended since the last sync
+// The sync runs on a dup'ed descriptor so appends are not blocked meanwhile
+static void wal_sync(void) {
+    int fd = -1;
+    pthread_mutex_lock(&g_wal_mu);
+    if (g_wal && g_wal_dirty) {
+        fd = dup(fileno(g_wal));
+        g_wal_dirty = 0;
+    }
+    pthread_mutex_unlock(&g_wal_mu);
+    if (fd >= 0) {
+        fdatasync(fd);
+        close(fd);
+    }
+}
+
+// ===== Checkpoints =====
+
+int index_wal_checkpoint(void) {
+    pthread_mutex_lock(&g_checkpoint_mu);
+
+    // Rotate: everything in index.wal.old will be covered by the snapshot
+    // taken below. If an earlier snapshot failed, index.wal.old is still
+    // needed, so keep appending to the current log instead.
+    pthread_mutex_lock(&g_wal_mu);
+    if (!g_wal) {
+        pthread_mutex_unlock(&g_wal_mu);
+        pthread_mutex_unlock(&g_checkpoint_mu);
+        return -1;
+    }
+    if (!g_old_pending) {
+        fflush(g_wal);
+        fdatasync(fileno(g_wal));
+        fclose(g_wal);
+        g_wal = NULL;
+        if (rename(g_wal_path, g_old_path) == 0) g_old_pending = 1;
+        g_wal = fopen(g_wal_path, "ab");
+        if (!g_wal) {
+            log_error("index_wal_checkpoint", "Cannot reopen %s: %s", g_wal_path, strerror(errno));
+        }
+    }
+    g_wal_records = 0;
+    g_wal_dirty = 0;
+    g_last_checkpoint = time(NULL);
+    pthread_mutex_unlock(&g_wal_mu);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t version = 0;
+    int rc = index_snapshot_write(g_snap_path, &version);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (rc == 0) {
+        if (g_old_pending) unlink(g_old_path);
+        g_old_pending = 0;
+        log_info("index_wal_checkpoint", "Snapshot at version %llu written in %.1f ms",
+                 (unsigned long long)version,
+                 (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    } else {
+        log_error("index_wal_checkpoint", "Snapshot to %s failed; keeping logs", g_snap_path);
+    }
+
+    pthread_mutex_unlock(&g_checkpoint_mu);
+    return rc;
+}
+
+static void *wal_thread(void *arg) {
+    (void)arg;
+    struct timespec tick = {INDEX_WAL_SYNC_INTERVAL_MS / 1000,
+                            (INDEX_WAL_SYNC_INTERVAL_MS % 1000) * 1000000L};
+    while (g_wal_running) {
+        nanosleep(&tick, NULL);
+        if (!g_wal_running) break;
+        wal_sync();
+
+        pthread_mutex_lock(&g_wal_mu);
+        int due = g_wal_records >= INDEX_WAL_CHECKPOINT_RECORDS ||
+                  (g_wal_records > 0 &&
+                   time(NULL) - g_last_checkpoint >= INDEX_WAL_CHECKPOINT_SECS);
+        pthread_mutex_unlock(&g_wal_mu);
+        if (due) index_wal_checkpoint();
+    }
+    return NULL;
+}
+
+// ===== Lifecycle =====
+
+int index_wal_open(const char *dir) {
+    if (!dir || !dir[0]) return -1;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        log_error("index_wal_open", "Cannot create %s: %s", dir, strerror(errno));
+        return -1;
+    }
+    snprintf(g_snap_path, sizeof(g_snap_path), "%s/index.snap", dir);
+    snprintf(g_wal_path, sizeof(g_wal_path), "%s/index.wal", dir);
+    snprintf(g_old_path, sizeof(g_old_path), "%s/index.wal.old", dir);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    uint64_t snap_version = 0;
+    int have_snap = index_snapshot_load(g_snap_path, &snap_version) == 0;
+    if (!have_snap && access(g_snap_path, F_OK) == 0) {
+        log_error("index_wal_open", "Ignoring unreadable snapshot %s", g_snap_path);
+    }
+
+    long old_applied = wal_replay(g_old_path, snap_version);
+    long applied = wal_replay(g_wal_path, snap_version);
+    g_old_pending = old_applied >= 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    IndexStats stats;
+    index_get_stats(&stats);
+    log_info("index_wal_open",
+             "Restored %zu files (snapshot v%llu, %ld log records) in %.1f ms",
+             stats.files, (unsigned long long)snap_version,
+             (old_applied > 0 ? old_applied : 0) + (applied > 0 ? applied : 0),
+             (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+
+    pthread_mutex_lock(&g_wal_mu);
+    g_wal = fopen(g_wal_path, "ab");
+    g_wal_records = applied > 0 ? (unsigned long)applied : 0;
+    g_last_checkpoint = time(NULL);
+    pthread_mutex_unlock(&g_wal_mu);
+    if (!g_wal) {
+        log_error("index_wal_open", "Cannot open %s: %s", g_wal_path, strerror(errno));
+        return -1;
+    }
+    index_set_journal(wal_journal);
+
+    g_wal_running = 1;
+    if (pthread_create(&g_wal_thread, NULL, wal_thread, NULL) != 0) {
+        g_wal_running = 0;
+        log_warning("index_wal_open", "No checkpoint thread; log grows until shutdown");
+    }
+    return 0;
+}
+
+void index_wal_close(void) {
+    if (g_wal_running) {
+        g_wal_running = 0;
+        pthread_join(g_wal_thread, NULL);
+    }
+    if (!g_wal) return;
+
+    index_wal_checkpoint();
+    index_set_journal(NULL);
+
+    pthread_mutex_lock(&g_wal_mu);
+    if (g_wal) {
+        fflush(g_wal);
+        fdatasync(fileno(g_wal));
+        fclose(g_wal);
+        g_wal = NULL;
+    }
+    pthread_mutex_unlock(&g_wal_mu);
+}
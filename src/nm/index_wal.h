@@ -0,0 +1,46 @@
+#ifndef INDEX_WAL_H
+#define INDEX_WAL_H
+
+#include <stdint.h>
+
+// Durable NM namespace: snapshot + write-ahead log for the file index
+//
+// State directory layout:
+//   index.snap     Snapshot of the whole index at some version (see index.h)
+//   index.wal      Mutations journaled since the last checkpoint started
+//   index.wal.old  Previous log, only present while a checkpoint is running
+//                  (or if its snapshot failed); replayed before index.wal
+//
+// Every index mutation (CREATE, DELETE, MOVE, owner changes, metadata,
+// failover reassignment, CREATEFOLDER) is appended to index.wal and flushed
+// to the kernel before the index lock is released, so an NM crash loses
+// nothing; the log is fdatasync'ed once per second, bounding what a power
+// loss can lose. A background thread checkpoints periodically: it rotates
+// the log, writes a fresh snapshot, then drops the rotated log.
+//
+// Restart cost is one mmap of the snapshot plus replay of at most one
+// checkpoint interval of records.
+
+#define INDEX_WAL_CHECKPOINT_SECS 60        // Checkpoint at least this often (if dirty)
+#define INDEX_WAL_CHECKPOINT_RECORDS 100000 // ...or after this many records
+#define INDEX_WAL_SYNC_INTERVAL_MS 1000     // fdatasync cadence for the log
+
+// Restore the index from dir and start journaling into it
+// Must be called after index_init() and before the NM accepts connections.
+// Creates dir if needed. A torn record at the end of the log (crash during
+// append) is discarded and the log truncated there.
+// Returns: 0 on success, -1 if the directory or log cannot be opened
+//
+// Usage:
+//   index_init();
+//   if (index_wal_open("nm_state") != 0) { ... run without persistence ... }
+int index_wal_open(const char *dir);
+
+// Write a snapshot now and drop the log records it covers
+// Returns: 0 on success, -1 on error (the log is kept, nothing is lost)
+int index_wal_checkpoint(void);
+
+// Stop the checkpoint thread, write a final checkpoint and close the log
+void index_wal_close(void);
+
+#endif
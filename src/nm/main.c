@@ -1,5 +1,6 @@
 // Name Server (NM): accepts connections from SS/Clients and handles
-// registration and heartbeats in Phase 1. Thread-per-connection model.
+// registration and heartbeats in Phase 1. Connections are multiplexed by an
+// epoll reactor and served by a fixed worker pool (see event_loop.h).
 #define _POSIX_C_SOURCE 200809L  // For strdup
 #include <arpa/inet.h>
 #include <pthread.h>
@@ -12,7 +13,10 @@
 #include "../common/net.h"
 #include "../common/log.h"
 #include "../common/protocol.h"
+#include "../common/ss_pool.h"
 #include "index.h"
+#include "index_wal.h"
+#include "acl_cache.h"
 #include "access_control.h"
 #include "commands.h"
 #include "registry.h"
@@ -20,12 +24,7 @@
 #include "heartbeat_monitor.h"
 #include "replication.h"
 #include "replication_worker.h"
-
-// Argument passed to each connection handler thread.
-typedef struct ClientConnArg {
-    int fd;
-    struct sockaddr_in addr;
-} ClientConnArg;
+#include "event_loop.h"
 
 static volatile int g_running = 1;
 
@@ -56,26 +55,7 @@ static void on_ss_failure(const char *ss_username) {
     log_info("failover_replica_info", "Replica %s at %s:%d", replica_ss, replica_host, replica_port);
     
     // Update file index: switch all files from failed SS to replica
-    FileEntry *files[1024];
-    int file_count = index_get_all_files(files, 1024);
-    int updated = 0;
-    
-    for (int i = 0; i < file_count; i++) {
-        FileEntry *entry = files[i];
-        if (strcmp(entry->ss_username, ss_username) == 0) {
-            // This file was on the failed primary, switch to replica
-            log_info("failover_update_file", "Switching file %s from %s to %s", 
-                     entry->filename, ss_username, replica_ss);
-            
-            // Update primary SS info to point to replica
-            strncpy(entry->ss_host, replica_host, sizeof(entry->ss_host) - 1);
-            entry->ss_host[sizeof(entry->ss_host) - 1] = '\0';
-            entry->ss_client_port = replica_port;
-            strncpy(entry->ss_username, replica_ss, sizeof(entry->ss_username) - 1);
-            entry->ss_username[sizeof(entry->ss_username) - 1] = '\0';
-            updated++;
-        }
-    }
+    int updated = index_reassign_ss(ss_username, replica_host, replica_port, replica_ss);
     
     log_info("failover_complete", "Failover complete for %s: updated %d files to use replica %s", 
              ss_username, updated, replica_ss);
@@ -153,21 +133,19 @@ static void handle_message(int fd, const struct sockaddr_in *peer, const Message
 
                         const char *final_owner = (owner_buf[0] != '\0') ? owner_buf : msg->username;
 
-                        FileEntry *entry = index_add_file(filename_buf, final_owner, ss_host, 
-                                                          ss_client_port, msg->username);
-                        if (entry) {
-                            entry->size_bytes = size_bytes;
-                            entry->word_count = words;
-                            entry->char_count = chars;
+                        FileEntry entry;
+                        if (index_add_file(filename_buf, final_owner, ss_host,
+                                           ss_client_port, msg->username, &entry) == 0) {
+                            index_update_metadata(filename_buf, 0, 0, size_bytes, words, chars);
                             file_count++;
                             
                             // Auto-register folder if file has a folder path
-                            if (strcmp(entry->folder_path, "/") != 0) {
-                                index_add_folder(entry->folder_path, msg->username);
+                            if (strcmp(entry.folder_path, "/") != 0) {
+                                index_add_folder(entry.folder_path, msg->username);
                             }
                             
                             log_info("nm_file_indexed", "file=%s ss=%s owner=%s", 
-                                     filename_buf, msg->username, entry->owner);
+                                     filename_buf, msg->username, entry.owner);
                         }
                         entry_str = strtok_r(NULL, ",", &saveptr);
                     }
@@ -195,9 +173,9 @@ static void handle_message(int fd, const struct sockaddr_in *peer, const Message
             replication_assign_replica(msg->username);
         }
         
-        // If this is a recovery, trigger full sync
+        // If this is a recovery, sync the SS from its pair
         if (is_recovery) {
-            log_info("nm_ss_recovery", "SS %s recovered from failure, triggering full sync", msg->username);
+            log_info("nm_ss_recovery", "SS %s recovered from failure, triggering sync", msg->username);
             
             // Get the paired SS (source for sync) BEFORE calling recover (which changes status)
             const char *pair_ss = NULL;
@@ -221,27 +199,12 @@ static void handle_message(int fd, const struct sockaddr_in *peer, const Message
             // Now update the replication status
             replication_recover(msg->username);
             
-            // Queue sync jobs for all files that should be on this SS
+            // Queue an anti-entropy sync: the worker compares the two SSs'
+            // Merkle trees and copies only the files that differ
             if (pair_ss) {
-                FileEntry *all_files[1024];
-                int total_files = index_get_all_files(all_files, 1024);
-                int sync_count = 0;
-                
-                // Queue sync for all files that were on the recovered SS
-                for (int i = 0; i < total_files; i++) {
-                    FileEntry *entry = all_files[i];
-                    // Sync files that belong to this recovered SS (they may point to either SS now)
-                    if (strcmp(entry->ss_username, pair_ss) == 0 ||
-                        strcmp(entry->ss_username, msg->username) == 0) {
-                        log_info("nm_recovery_sync_file", "Queueing %s from %s to %s",
-                                 entry->filename, pair_ss, msg->username);
-                        replication_worker_queue(REPL_OP_UPDATE, entry->filename, 
-                                                pair_ss, msg->username);
-                        sync_count++;
-                    }
-                }
-                log_info("nm_recovery_sync_queued", "Queued %d files for recovery sync from %s to %s",
-                         sync_count, pair_ss, msg->username);
+                replication_worker_queue(REPL_OP_SYNC_ALL, "*", pair_ss, msg->username);
+                log_info("nm_recovery_sync_queued", "Queued anti-entropy sync from %s to %s",
+                         pair_ss, msg->username);
             } else {
                 log_warning("nm_recovery_no_pair", "No pair found for %s, cannot sync", msg->username);
             }
@@ -691,42 +654,39 @@ static void handle_message(int fd, const struct sockaddr_in *peer, const Message
     (void)send_error_response(fd, msg->id, msg->username, &err);
 }
 
-// Thread function: read lines, parse, and handle messages until peer closes.
-static void *client_thread(void *arg) {
-    // printf("DEBUG: client_thread started\n");
-    ClientConnArg *c = (ClientConnArg*)arg;
-    char line[MAX_LINE];
-    while (g_running) {
-        int n = recv_line(c->fd, line, sizeof(line));
-        if (n <= 0) break;
-        Message msg;
-        // printf("DEBUG: line received: %s", line);
-        if (proto_parse_line(line, &msg) == 0) {
-            // printf("DEBUG: Received message type=%s from %s\n", msg.type, inet_ntoa(c->addr.sin_addr));
-            // printf("DEBUG: message details: %s %s", msg.username, msg.payload);
-            handle_message(c->fd, &c->addr, &msg);
-        }
-    }
-    close(c->fd);
-    free(c);
-    return NULL;
-}
-
 static void on_sigint(int sig) { (void)sig; g_running = 0; }
 
 int main(int argc, char **argv) {
     const char *host = "0.0.0.0"; int port = 5000;
+    int workers = EVENT_LOOP_DEFAULT_WORKERS;
+    const char *state_dir = "nm_state";
+    long acl_cache_capacity = ACL_CACHE_DEFAULT_CAPACITY;
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--host") && i+1 < argc) host = argv[++i];
         else if (!strcmp(argv[i], "--port") && i+1 < argc) port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--workers") && i+1 < argc) workers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--state-dir") && i+1 < argc) state_dir = argv[++i];
+        else if (!strcmp(argv[i], "--acl-cache") && i+1 < argc) acl_cache_capacity = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--repl-workers") && i+1 < argc) replication_worker_set_workers(atoi(argv[++i]));
     }
     
     registry_init_persistence("registry_clients.txt");
 
-    // Step 3: Initialize file index and LRU cache
+    // Step 3: Initialize file index
     index_init();
     log_info("nm_index_init", "File index initialized");
+
+    // Restore the namespace (snapshot + log) and journal mutations from here on
+    if (index_wal_open(state_dir) != 0) {
+        log_warning("nm_startup", "Index persistence disabled (state dir %s)", state_dir);
+    }
     
+    // Size the ACL cache consulted by every READ/STREAM/WRITE authorization
+    if (acl_cache_init(acl_cache_capacity > 0 ? (size_t)acl_cache_capacity : 0,
+                       ACL_CACHE_NEGATIVE_TTL_SEC) != 0) {
+        log_warning("nm_startup", "ACL cache disabled (allocation failed)");
+    }
+
     // Initialize access request queue
     request_queue_init();
     log_info("nm_request_queue_init", "Access request queue initialized");
@@ -753,25 +713,57 @@ int main(int argc, char **argv) {
     log_info("nm_startup", "Failover callback registered");
     
     signal(SIGINT, on_sigint);
+    signal(SIGPIPE, SIG_IGN);  // Replication relays splice() into SS sockets
     int server_fd = create_server_socket(host, port);
     if (server_fd < 0) { perror("NM listen"); return 1; }
     log_info("nm_listen", "host=%s port=%d", host, port);
 
-    while (g_running) {
-        struct sockaddr_in addr; socklen_t alen = sizeof(addr);
-        int fd = accept(server_fd, (struct sockaddr*)&addr, &alen);
-        if (fd < 0) { if (!g_running) break; continue; }
-        ClientConnArg *c = (ClientConnArg*)calloc(1, sizeof(ClientConnArg));
-        c->fd = fd; c->addr = addr;
-        pthread_t th; (void)pthread_create(&th, NULL, client_thread, c); pthread_detach(th);
+    if (event_loop_init(server_fd, workers, handle_message) != 0) {
+        log_error("nm_startup", "Failed to start event loop");
+        close(server_fd);
+        return 1;
     }
+    event_loop_run(&g_running);
+    event_loop_shutdown();
+    log_info("nm_shutdown", "Event loop stopped");
     
     // Shutdown: stop replication and heartbeat monitoring
     replication_worker_stop();
     log_info("nm_shutdown", "Replication worker stopped");
+
+    ReplicationStats repl_stats;
+    replication_worker_get_stats(&repl_stats);
+    log_info("nm_replication_stats", "completed=%d failed=%d coalesced=%d batches=%d pending=%d",
+             repl_stats.completed_jobs, repl_stats.failed_jobs, repl_stats.coalesced_jobs,
+             repl_stats.batches, repl_stats.pending_jobs);
+    ReplicationWorkerStats worker_stats[REPL_MAX_WORKERS];
+    int repl_workers = replication_worker_get_worker_stats(worker_stats, REPL_MAX_WORKERS);
+    for (int w = 0; w < repl_workers; w++) {
+        const ReplicationWorkerStats *ws = &worker_stats[w];
+        log_info("nm_replication_worker_stats",
+                 "worker=%d completed=%lu failed=%lu coalesced=%lu batches=%lu bytes=%llu "
+                 "lag_avg_ms=%lld lag_max_ms=%lld pending=%d",
+                 w, ws->completed_jobs, ws->failed_jobs, ws->coalesced_jobs, ws->batches,
+                 ws->bytes_replicated, ws->lag_avg_ms, ws->lag_max_ms, ws->pending_jobs);
+    }
     
     heartbeat_monitor_stop();
     log_info("nm_shutdown", "Heartbeat monitoring stopped");
+
+    index_wal_close();
+    log_info("nm_shutdown", "Index checkpointed");
+
+    AclCacheStats acl_stats;
+    acl_cache_get_stats(&acl_stats);
+    log_info("nm_acl_cache_stats", "hits=%lu negative_hits=%lu misses=%lu evictions=%lu entries=%zu capacity=%zu",
+             acl_stats.hits, acl_stats.negative_hits, acl_stats.misses, acl_stats.evictions,
+             acl_stats.entries, acl_stats.capacity);
+
+    SsPoolStats pool_stats;
+    ss_pool_get_stats(&pool_stats);
+    log_info("nm_ss_pool_stats", "connects=%lu reuses=%lu discards=%lu idle=%zu",
+             pool_stats.connects, pool_stats.reuses, pool_stats.discards, pool_stats.idle);
+    ss_pool_drain();
     
     close(server_fd);
     return 0;
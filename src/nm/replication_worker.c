@@ -5,323 +5,687 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../common/log.h"
 #include "../common/net.h"
 #include "../common/protocol.h"
+#include "../common/ss_pool.h"
+#include "anti_entropy.h"
 #include "registry.h"
 #include "replication.h"
 
-#define MAX_QUEUE_SIZE 1000
+#define MAX_QUEUE_SIZE 1000          // Pending jobs per worker
+#define REPL_BATCH_MAX 32           // Jobs sent over one connection pair
+#define REPL_INDEX_BUCKETS 256
+
+// One worker thread and its shard of the queue. Pending jobs form a FIFO
+// list; index chains them by (file, replica) so a new job can find and
+// merge with one still waiting.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    int started;
+    ReplicationJob *head;
+    ReplicationJob *tail;
+    ReplicationJob *index[REPL_INDEX_BUCKETS];
+    int count;
+
+    // Statistics (under mu)
+    unsigned long completed;
+    unsigned long failed;
+    unsigned long coalesced;
+    unsigned long batches;
+    unsigned long long bytes;
+    long long lag_total_ms;
+    long long lag_max_ms;
+} ReplWorker;
 
 // Global state
-static ReplicationJob *g_job_queue_head = NULL;
-static ReplicationJob *g_job_queue_tail = NULL;
-static int g_job_count = 0;
-static pthread_mutex_t g_queue_mu = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t g_queue_cond = PTHREAD_COND_INITIALIZER;
-static pthread_t g_worker_thread;
+static ReplWorker g_workers[REPL_MAX_WORKERS];
+static int g_worker_count = REPL_DEFAULT_WORKERS;
 static volatile int g_worker_running = 0;
 
-// Statistics
-static int g_completed_jobs = 0;
-static int g_failed_jobs = 0;
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void replication_worker_set_workers(int count) {
+    if (g_worker_running) return;
+    if (count < 1) count = 1;
+    if (count > REPL_MAX_WORKERS) count = REPL_MAX_WORKERS;
+    g_worker_count = count;
+}
 
 // Initialize worker
 void replication_worker_init(void) {
-    pthread_mutex_lock(&g_queue_mu);
-    
-    // Clear queue
-    ReplicationJob *current = g_job_queue_head;
-    while (current) {
-        ReplicationJob *next = current->next;
-        free(current);
-        current = next;
+    for (int w = 0; w < REPL_MAX_WORKERS; w++) {
+        ReplWorker *worker = &g_workers[w];
+        
+        // Clear queue
+        ReplicationJob *current = worker->head;
+        while (current) {
+            ReplicationJob *next = current->next;
+            free(current);
+            current = next;
+        }
+        memset(worker, 0, sizeof(*worker));
+        pthread_mutex_init(&worker->mu, NULL);
+        pthread_cond_init(&worker->cond, NULL);
     }
-    
-    g_job_queue_head = NULL;
-    g_job_queue_tail = NULL;
-    g_job_count = 0;
-    g_completed_jobs = 0;
-    g_failed_jobs = 0;
     g_worker_running = 0;
     
-    pthread_mutex_unlock(&g_queue_mu);
-    
     log_info("replication_worker_init", "Worker initialized");
 }
 
-// Process a single replication job
-static int process_job(const ReplicationJob *job) {
-    log_info("replication_worker_process", "op=%d file=%s primary=%s replica=%s",
-             job->operation, job->filename, job->primary_ss, job->replica_ss);
-    
-    // Get SS connection info
-    char primary_host[64], replica_host[64];
-    int primary_port, replica_port;
-    
-    if (registry_get_ss_info(job->primary_ss, primary_host, sizeof(primary_host), &primary_port) != 0) {
-        log_error("replication_worker_error", "Primary SS %s not found in registry", job->primary_ss);
+static uint32_t job_hash(const char *filename, const char *replica_ss) {
+    uint32_t h = 2166136261u;
+    for (const char *p = filename; *p; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+    h = (h ^ '|') * 16777619u;
+    for (const char *p = replica_ss; *p; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+    return h;
+}
+
+// Jobs are sharded by (file, replica): every job for one file on one
+// replica lands on the same worker and runs in queue order, while other
+// files and replicas replicate in parallel
+static ReplWorker *job_worker(const char *filename, const char *replica_ss) {
+    return &g_workers[job_hash(filename, replica_ss) % (uint32_t)g_worker_count];
+}
+
+static unsigned job_bucket(const char *filename, const char *replica_ss) {
+    return (job_hash(filename, replica_ss) / (uint32_t)g_worker_count) % REPL_INDEX_BUCKETS;
+}
+
+// Newest pending job for (filename, replica_ss); caller holds worker->mu
+static ReplicationJob *find_pending_locked(ReplWorker *worker, const char *filename,
+                                           const char *replica_ss) {
+    for (ReplicationJob *j = worker->index[job_bucket(filename, replica_ss)]; j; j = j->hash_next) {
+        if (strcmp(j->filename, filename) == 0 && strcmp(j->replica_ss, replica_ss) == 0) return j;
+    }
+    return NULL;
+}
+
+// Take a job out of the list and index; caller holds worker->mu
+static void unlink_job_locked(ReplWorker *worker, ReplicationJob *job) {
+    if (job->prev) job->prev->next = job->next;
+    else worker->head = job->next;
+    if (job->next) job->next->prev = job->prev;
+    else worker->tail = job->prev;
+    ReplicationJob **pp = &worker->index[job_bucket(job->filename, job->replica_ss)];
+    while (*pp && *pp != job) pp = &(*pp)->hash_next;
+    if (*pp) *pp = job->hash_next;
+    job->next = job->prev = job->hash_next = NULL;
+    worker->count--;
+}
+
+// Dequeue the oldest job plus the following jobs for the same replica, in
+// order, as long as they come from the same primary (up to max). Jobs of
+// one replica are never reordered; other replicas are skipped over.
+static int dequeue_batch_locked(ReplWorker *worker, ReplicationJob **batch, int max) {
+    ReplicationJob *head = worker->head;
+    if (!head) return 0;
+    int n = 0;
+    ReplicationJob *next = head->next;
+    unlink_job_locked(worker, head);
+    batch[n++] = head;
+    for (ReplicationJob *j = next; j && n < max; j = next) {
+        next = j->next;
+        if (strcmp(j->replica_ss, head->replica_ss) != 0) continue;
+        if (strcmp(j->primary_ss, head->primary_ss) != 0) break;
+        unlink_job_locked(worker, j);
+        batch[n++] = j;
+    }
+    return n;
+}
+
+static void fill_repl_message(Message *msg, const char *type, const char *payload) {
+    memset(msg, 0, sizeof(*msg));
+    snprintf(msg->type, sizeof(msg->type), "%s", type);
+    snprintf(msg->id, sizeof(msg->id), "repl_%ld", (long)time(NULL));
+    snprintf(msg->username, sizeof(msg->username), "NM");
+    snprintf(msg->role, sizeof(msg->role), "NM");
+    snprintf(msg->payload, sizeof(msg->payload), "%s", payload ? payload : "");
+}
+
+// Append bytes to a growable buffer (always leaves room for a terminator)
+static int buffer_append(char **buf, size_t *size, size_t *cap, const char *data, size_t len) {
+    if (*size + len + 1 > *cap) {
+        size_t new_cap = *cap;
+        while (*size + len + 1 > new_cap) new_cap *= 2;
+        char *tmp = (char*)realloc(*buf, new_cap);
+        if (!tmp) return -1;
+        *buf = tmp;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *size, data, len);
+    *size += len;
+    return 0;
+}
+
+// Fetch a file (or "metadata/<file>.meta") from an SS with GET_FILE_CONTENT.
+// Returns 0 and a heap buffer in *content_out on success, -1 on error.
+static int fetch_from_ss(const char *host, int port, const char *path,
+                         char **content_out, size_t *size_out) {
+    int binary = 0;
+    int fd = ss_pool_acquire_binary(host, port, &binary);
+    if (fd < 0) {
+        log_error("replication_worker_fetch", "Failed to connect to %s:%d", host, port);
         return -1;
     }
-    
-    if (registry_get_ss_info(job->replica_ss, replica_host, sizeof(replica_host), &replica_port) != 0) {
-        log_error("replication_worker_error", "Replica SS %s not found in registry", job->replica_ss);
+
+    Message get_msg;
+    fill_repl_message(&get_msg, "GET_FILE_CONTENT", path);
+    char get_line[MAX_LINE];
+    proto_format_line(&get_msg, get_line, sizeof(get_line));
+    if (send_all(fd, get_line, strlen(get_line)) != 0) {
+        ss_pool_release(fd, 0);
         return -1;
     }
-    
-    if (job->operation == REPL_OP_CREATE || job->operation == REPL_OP_UPDATE) {
-        // Step 1: Fetch file content from primary
-        int primary_fd = connect_to_host(primary_host, primary_port);
-        if (primary_fd < 0) {
-            log_error("replication_worker_fetch", "Failed to connect to primary %s:%d", 
-                     primary_host, primary_port);
-            return -1;
-        }
-        
-        // Send GET_FILE_CONTENT request
-        Message get_msg = {0};
-        snprintf(get_msg.type, sizeof(get_msg.type), "GET_FILE_CONTENT");
-        snprintf(get_msg.id, sizeof(get_msg.id), "repl_%ld", (long)time(NULL));
-        snprintf(get_msg.username, sizeof(get_msg.username), "NM");
-        snprintf(get_msg.role, sizeof(get_msg.role), "NM");
-        snprintf(get_msg.payload, sizeof(get_msg.payload), "%s", job->filename);
-        
-        char get_line[MAX_LINE];
-        proto_format_line(&get_msg, get_line, sizeof(get_line));
-        send_all(primary_fd, get_line, strlen(get_line));
-        
-        // Receive file content
-        char *content = NULL;
-        size_t content_size = 0;
-        size_t content_capacity = 4096;
-        content = (char*)malloc(content_capacity);
-        if (!content) {
-            close(primary_fd);
-            log_error("replication_worker_fetch", "Memory allocation failed");
-            return -1;
+
+    size_t content_size = 0;
+    size_t content_capacity = 4096;
+    char *content = (char*)malloc(content_capacity);
+    if (!content) {
+        ss_pool_release(fd, 0);
+        log_error("replication_worker_fetch", "Memory allocation failed");
+        return -1;
+    }
+
+    NetReader *reader = (NetReader*)malloc(sizeof(NetReader));
+    if (!reader) {
+        free(content);
+        ss_pool_release(fd, 0);
+        return -1;
+    }
+    net_reader_init(reader, fd);
+
+    int rc = -1;
+    if (binary) {
+        // Raw DATA frames until STOP
+        while (1) {
+            FrameHeader hdr;
+            if (proto_reader_frame_header(reader, &hdr) != 0) break;
+            if (hdr.type == FRAME_STOP) {
+                rc = 0;
+                break;
+            }
+            if (hdr.type == FRAME_ERROR) {
+                log_error("replication_worker_fetch", "Primary returned error for %s", path);
+                break;
+            }
+            if (content_size + hdr.payload_len + 1 > content_capacity) {
+                size_t need = content_size + hdr.payload_len + 1;
+                size_t new_cap = content_capacity;
+                while (need > new_cap) new_cap *= 2;
+                char *tmp = (char*)realloc(content, new_cap);
+                if (!tmp) break;
+                content = tmp;
+                content_capacity = new_cap;
+            }
+            if (net_reader_read(reader, content + content_size, hdr.payload_len) != 0) break;
+            if (hdr.type == FRAME_DATA) content_size += hdr.payload_len;
         }
-        
+    } else {
+        // Escaped DATA lines until STOP (metadata replies start with an ACK carrying the size)
         char line[MAX_LINE];
         while (1) {
-            int n = recv_line(primary_fd, line, sizeof(line));
+            int n = net_reader_line(reader, line, sizeof(line));
             if (n <= 0) break;
-            
+
             Message msg;
             if (proto_parse_line(line, &msg) != 0) continue;
-            
+
             if (strcmp(msg.type, "STOP") == 0) {
+                rc = 0;
                 break;
             }
-            
             if (strcmp(msg.type, "ERROR") == 0) {
                 log_error("replication_worker_fetch", "Primary returned error: %s", msg.payload);
-                free(content);
-                close(primary_fd);
-                return -1;
+                break;
             }
-            
             if (strcmp(msg.type, "DATA") == 0) {
                 size_t payload_len = strlen(msg.payload);
-                
-                // Ensure capacity
-                while (content_size + payload_len + 1 > content_capacity) {
-                    content_capacity *= 2;
-                    char *new_content = (char*)realloc(content, content_capacity);
-                    if (!new_content) {
-                        free(content);
-                        close(primary_fd);
-                        log_error("replication_worker_fetch", "Memory reallocation failed");
-                        return -1;
-                    }
-                    content = new_content;
-                }
-                
-                // Copy and decode (\x01 back to \n)
+                // Decode \x01 back to \n in place
                 for (size_t i = 0; i < payload_len; i++) {
-                    if (msg.payload[i] == '\x01') {
-                        content[content_size++] = '\n';
-                    } else {
-                        content[content_size++] = msg.payload[i];
-                    }
+                    if (msg.payload[i] == '\x01') msg.payload[i] = '\n';
+                }
+                if (buffer_append(&content, &content_size, &content_capacity,
+                                  msg.payload, payload_len) != 0) {
+                    log_error("replication_worker_fetch", "Memory reallocation failed");
+                    break;
                 }
             }
         }
-        
-        close(primary_fd);
-        content[content_size] = '\0';
-        
-        log_info("replication_worker_fetched", "file=%s size=%zu from %s", 
-                 job->filename, content_size, job->primary_ss);
-        
-        // Step 2: Write file content to replica
-        int replica_fd = connect_to_host(replica_host, replica_port);
-        if (replica_fd < 0) {
-            log_error("replication_worker_push", "Failed to connect to replica %s:%d", 
-                     replica_host, replica_port);
-            free(content);
-            return -1;
+    }
+    ss_pool_release(fd, rc == 0 && net_reader_buffered(reader) == 0);
+    free(reader);
+
+    if (rc != 0) {
+        free(content);
+        return -1;
+    }
+    content[content_size] = '\0';
+    *content_out = content;
+    *size_out = content_size;
+    return 0;
+}
+
+// Push content to an SS with PUT_FILE_CONTENT and wait for its ACK.
+static int push_to_ss(const char *host, int port, const char *path,
+                      const char *content, size_t content_size) {
+    int binary = 0;
+    int fd = ss_pool_acquire_binary(host, port, &binary);
+    if (fd < 0) {
+        log_error("replication_worker_push", "Failed to connect to %s:%d", host, port);
+        return -1;
+    }
+
+    Message put_msg;
+    fill_repl_message(&put_msg, "PUT_FILE_CONTENT", path);
+    char put_line[MAX_LINE];
+    proto_format_line(&put_msg, put_line, sizeof(put_line));
+    if (send_all(fd, put_line, strlen(put_line)) != 0) {
+        ss_pool_release(fd, 0);
+        return -1;
+    }
+
+    if (binary) {
+        uint32_t rid = proto_frame_request_id(put_msg.id);
+        size_t offset = 0;
+        while (offset < content_size) {
+            size_t chunk = content_size - offset;
+            if (chunk > PROTO_FRAME_CHUNK) chunk = PROTO_FRAME_CHUNK;
+            if (proto_send_frame(fd, FRAME_DATA, rid, content + offset, (uint32_t)chunk) != 0) {
+                ss_pool_release(fd, 0);
+                return -1;
+            }
+            offset += chunk;
         }
-        
-        // Send PUT_FILE_CONTENT request
-        Message put_msg = {0};
-        snprintf(put_msg.type, sizeof(put_msg.type), "PUT_FILE_CONTENT");
-        snprintf(put_msg.id, sizeof(put_msg.id), "repl_%ld", (long)time(NULL));
-        snprintf(put_msg.username, sizeof(put_msg.username), "NM");
-        snprintf(put_msg.role, sizeof(put_msg.role), "NM");
-        snprintf(put_msg.payload, sizeof(put_msg.payload), "%s", job->filename);
-        
-        char put_line[MAX_LINE];
-        proto_format_line(&put_msg, put_line, sizeof(put_line));
-        send_all(replica_fd, put_line, strlen(put_line));
-        
-        // Send content in DATA messages
+        proto_send_frame(fd, FRAME_STOP, rid, NULL, 0);
+    } else {
+        // Send content in DATA messages, escaping \n as \x01
         size_t offset = 0;
         while (offset < content_size) {
-            Message data_msg = {0};
-            snprintf(data_msg.type, sizeof(data_msg.type), "DATA");
-            snprintf(data_msg.id, sizeof(data_msg.id), "repl_%ld", (long)time(NULL));
-            snprintf(data_msg.username, sizeof(data_msg.username), "NM");
-            snprintf(data_msg.role, sizeof(data_msg.role), "NM");
-            
+            Message data_msg;
+            fill_repl_message(&data_msg, "DATA", NULL);
+
             size_t payload_pos = 0;
             size_t payload_max = sizeof(data_msg.payload) - 1;
-            
             while (offset < content_size && payload_pos < payload_max) {
-                if (content[offset] == '\n') {
-                    data_msg.payload[payload_pos++] = '\x01';
-                } else {
-                    data_msg.payload[payload_pos++] = content[offset];
-                }
-                offset++;
+                char c = content[offset++];
+                data_msg.payload[payload_pos++] = (c == '\n') ? '\x01' : c;
             }
             data_msg.payload[payload_pos] = '\0';
-            
+
             char data_line[MAX_LINE];
             proto_format_line(&data_msg, data_line, sizeof(data_line));
-            send_all(replica_fd, data_line, strlen(data_line));
+            send_all(fd, data_line, strlen(data_line));
         }
-        
-        // Send STOP
-        Message stop_msg = {0};
-        snprintf(stop_msg.type, sizeof(stop_msg.type), "STOP");
-        snprintf(stop_msg.id, sizeof(stop_msg.id), "repl_%ld", (long)time(NULL));
-        snprintf(stop_msg.username, sizeof(stop_msg.username), "NM");
-        snprintf(stop_msg.role, sizeof(stop_msg.role), "NM");
-        
+
+        Message stop_msg;
+        fill_repl_message(&stop_msg, "STOP", NULL);
         char stop_line[MAX_LINE];
         proto_format_line(&stop_msg, stop_line, sizeof(stop_line));
-        send_all(replica_fd, stop_line, strlen(stop_line));
-        
-        // Wait for ACK
-        int n = recv_line(replica_fd, line, sizeof(line));
-        if (n > 0) {
-            Message ack_msg;
-            if (proto_parse_line(line, &ack_msg) == 0) {
-                if (strcmp(ack_msg.type, "ACK") == 0) {
-                    log_info("replication_worker_success", "file=%s replicated to %s", 
-                             job->filename, job->replica_ss);
-                    replication_mark_synced(job->primary_ss, job->replica_ss);
-                } else if (strcmp(ack_msg.type, "ERROR") == 0) {
-                    log_error("replication_worker_push", "Replica returned error: %s", ack_msg.payload);
-                    free(content);
-                    close(replica_fd);
-                    return -1;
-                }
+        send_all(fd, stop_line, strlen(stop_line));
+    }
+
+    // Wait for ACK
+    int rc = -1;
+    int answered = 0;
+    char line[MAX_LINE];
+    if (recv_line(fd, line, sizeof(line)) > 0) {
+        answered = 1;
+        Message ack_msg;
+        if (proto_parse_line(line, &ack_msg) == 0) {
+            if (strcmp(ack_msg.type, "ACK") == 0) {
+                rc = 0;
+            } else if (strcmp(ack_msg.type, "ERROR") == 0) {
+                log_error("replication_worker_push", "Replica returned error: %s", ack_msg.payload);
+            }
+        }
+    }
+    ss_pool_release(fd, answered);
+    return rc;
+}
+
+// Files are copied from the primary to the replica without buffering them
+// in the NM: the primary's GET_FILE_CONTENT frames are re-addressed to a
+// PUT_FILE_CONTENT on the replica and their payloads moved socket to socket
+// with splice(2) (the primary in turn sends them with sendfile(2)).
+typedef struct {
+    int src;
+    int dst;
+    int src_ok;         // Primary connection still in sync
+    int dst_ok;         // Replica connection still in sync
+    const int *pipefd;  // splice(2) pipe, or NULL
+} RelayLink;
+
+// Relay the next GET_FILE_CONTENT response on link->src as a
+// PUT_FILE_CONTENT of path on link->dst, without waiting for the reply.
+// Returns: 1 if the PUT went out in full (one reply pending on dst),
+//          0 if the primary answered with an error (nothing sent),
+//          -1 if the transfer failed (see link->src_ok / dst_ok)
+static int relay_response(RelayLink *link, uint32_t src_rid, const char *path,
+                          size_t *size_out) {
+    Message put_msg;
+    fill_repl_message(&put_msg, "PUT_FILE_CONTENT", path);
+    uint32_t dst_rid = proto_frame_request_id(put_msg.id);
+    char line[MAX_LINE];
+    int put_sent = 0;   // PUT_FILE_CONTENT goes out with the first frame
+    size_t total = 0;
+    while (1) {
+        FrameHeader hdr;
+        if (proto_recv_frame_header(link->src, &hdr) != 0 || hdr.request_id != src_rid) {
+            link->src_ok = 0;
+            break;
+        }
+        if (hdr.type == FRAME_ERROR) {
+            char err[512];
+            if (hdr.payload_len < sizeof(err) && recv_exact(link->src, err, hdr.payload_len) == 0) {
+                err[hdr.payload_len] = '\0';
+                log_error("replication_worker_fetch", "Primary returned error for %s: %s", path, err);
+            } else {
+                link->src_ok = 0;
+            }
+            break;
+        }
+        if (!put_sent) {
+            proto_format_line(&put_msg, line, sizeof(line));
+            if (send_all(link->dst, line, strlen(line)) != 0) {
+                link->src_ok = 0;   // Rest of the response left unread
+                link->dst_ok = 0;
+                return -1;
+            }
+            put_sent = 1;
+        }
+        if (hdr.type == FRAME_STOP) {
+            if (proto_send_frame(link->dst, FRAME_STOP, dst_rid, NULL, 0) != 0) {
+                link->dst_ok = 0;
+                return -1;
+            }
+            if (size_out) *size_out = total;
+            return 1;
+        }
+        if (hdr.type != FRAME_DATA) {
+            link->src_ok = 0;
+            break;
+        }
+        FrameHeader out = {FRAME_DATA, dst_rid, hdr.payload_len};
+        unsigned char raw[PROTO_FRAME_HEADER_SIZE];
+        proto_encode_frame_header(&out, raw);
+        if (send_all(link->dst, (const char*)raw, sizeof(raw)) != 0 ||
+            net_splice(link->src, link->dst, hdr.payload_len, link->pipefd) != 0) {
+            link->src_ok = 0;
+            link->dst_ok = 0;
+            return -1;
+        }
+        total += hdr.payload_len;
+    }
+    if (put_sent) {
+        // Primary failed mid-stream: abort the replica's PUT
+        proto_send_frame_error(link->dst, dst_rid, "INTERNAL", "Replication source failed");
+        link->dst_ok = 0;
+        return -1;
+    }
+    return link->src_ok ? 0 : -1;
+}
+
+// Read and drop the next GET_FILE_CONTENT response on link->src
+static int discard_response(RelayLink *link, uint32_t src_rid) {
+    char buf[4096];
+    while (1) {
+        FrameHeader hdr;
+        if (proto_recv_frame_header(link->src, &hdr) != 0 || hdr.request_id != src_rid) break;
+        if (hdr.type == FRAME_STOP) return 0;
+        size_t left = hdr.payload_len;
+        while (left > 0) {
+            size_t chunk = left < sizeof(buf) ? left : sizeof(buf);
+            if (recv_exact(link->src, buf, chunk) != 0) {
+                link->src_ok = 0;
+                return -1;
+            }
+            left -= chunk;
+        }
+        if (hdr.type == FRAME_ERROR) return 0;
+        if (hdr.type != FRAME_DATA) break;
+    }
+    link->src_ok = 0;
+    return -1;
+}
+
+static void send_repl_delete(RelayLink *link, const char *path) {
+    Message del_msg;
+    fill_repl_message(&del_msg, "DELETE", path);
+    char line[MAX_LINE];
+    proto_format_line(&del_msg, line, sizeof(line));
+    if (send_all(link->dst, line, strlen(line)) != 0) link->dst_ok = 0;
+}
+
+// Relay a batch of jobs for one primary -> replica pair through the NM,
+// over one connection to each SS, pipelined: every GET_FILE_CONTENT goes to
+// the primary up front, files are relayed in job order as the primary
+// streams them back, DELETEs are interleaved in order on the replica
+// connection, and the replica's replies are collected once at the end.
+// Copies only come here when the primary predates REPLICATE_TO; runs of
+// DELETEs, which carry no data, always do.
+// ok: Set per job to 1 on success
+// bytes_out: Bytes relayed to the replica
+// Returns: 0 if the batch ran, 1 if either SS only speaks text (the caller
+//          then runs the jobs one at a time with process_job)
+static int relay_batch(ReplicationJob **jobs, int count, int *ok, size_t *bytes_out) {
+    for (int i = 0; i < count; i++) ok[i] = 0;
+    *bytes_out = 0;
+    const char *primary_ss = jobs[0]->primary_ss;
+    const char *replica_ss = jobs[0]->replica_ss;
+    char primary_host[64], replica_host[64];
+    int primary_port, replica_port;
+    if (registry_get_ss_info(primary_ss, primary_host, sizeof(primary_host), &primary_port) != 0) {
+        log_error("replication_worker_error", "Primary SS %s not found in registry", primary_ss);
+        return 0;
+    }
+    if (registry_get_ss_info(replica_ss, replica_host, sizeof(replica_host), &replica_port) != 0) {
+        log_error("replication_worker_error", "Replica SS %s not found in registry", replica_ss);
+        return 0;
+    }
+
+    int copies = 0;
+    for (int i = 0; i < count; i++) {
+        if (jobs[i]->operation == REPL_OP_CREATE || jobs[i]->operation == REPL_OP_UPDATE) copies++;
+    }
+    int src_binary = 1, dst_binary = 0;
+    int dst = ss_pool_acquire_binary(replica_host, replica_port, &dst_binary);
+    if (dst < 0) {
+        log_error("replication_worker_push", "Failed to connect to %s:%d", replica_host, replica_port);
+        return 0;
+    }
+    int src = -1;
+    if (copies > 0) {
+        src = ss_pool_acquire_binary(primary_host, primary_port, &src_binary);
+        if (src < 0) {
+            ss_pool_release(dst, 1);
+            log_error("replication_worker_fetch", "Failed to connect to %s:%d", primary_host, primary_port);
+            return 0;
+        }
+    }
+    if (!src_binary || !dst_binary) {
+        if (src >= 0) ss_pool_release(src, 1);
+        ss_pool_release(dst, 1);
+        return 1;
+    }
+
+    // Request every file and its .meta from the primary in one write
+    Message get_msg;
+    fill_repl_message(&get_msg, "GET_FILE_CONTENT", "");
+    uint32_t src_rid = proto_frame_request_id(get_msg.id);
+    char *requests = NULL;
+    size_t req_size = 0, req_cap = 4096;
+    int src_sent = 1;
+    if (copies > 0) {
+        requests = (char*)malloc(req_cap);
+        for (int i = 0; requests && i < count; i++) {
+            if (jobs[i]->operation != REPL_OP_CREATE && jobs[i]->operation != REPL_OP_UPDATE) continue;
+            char line[MAX_LINE];
+            snprintf(get_msg.payload, sizeof(get_msg.payload), "%s", jobs[i]->filename);
+            proto_format_line(&get_msg, line, sizeof(line));
+            if (buffer_append(&requests, &req_size, &req_cap, line, strlen(line)) != 0) break;
+            snprintf(get_msg.payload, sizeof(get_msg.payload), "metadata/%s.meta", jobs[i]->filename);
+            proto_format_line(&get_msg, line, sizeof(line));
+            if (buffer_append(&requests, &req_size, &req_cap, line, strlen(line)) != 0) break;
+        }
+        src_sent = requests && req_size > 0 && send_all(src, requests, req_size) == 0;
+        free(requests);
+    }
+
+    int pipefd[2];
+    int have_pipe = copies > 0 && pipe(pipefd) == 0;
+    RelayLink link = { src, dst, src_sent, 1, have_pipe ? pipefd : NULL };
+    int replies[REPL_BATCH_MAX * 2];    // Job each replica reply confirms, -1 for .meta
+    int pending = 0;
+    int copied = 0;                     // Primary responses consumed
+    for (int i = 0; i < count && link.src_ok && link.dst_ok; i++) {
+        ReplicationJob *job = jobs[i];
+        if (job->operation == REPL_OP_DELETE) {
+            char meta_path[MAX_REPL_FILENAME + 32];
+            snprintf(meta_path, sizeof(meta_path), "metadata/%s.meta", job->filename);
+            send_repl_delete(&link, job->filename);
+            if (link.dst_ok) replies[pending++] = i;
+            send_repl_delete(&link, meta_path);
+            if (link.dst_ok) replies[pending++] = -1;
+            continue;
+        }
+        if (job->operation != REPL_OP_CREATE && job->operation != REPL_OP_UPDATE) {
+            log_warning("replication_worker_unsupported", "Operation %d not yet implemented", job->operation);
+            continue;
+        }
+        size_t size = 0;
+        int rc = relay_response(&link, src_rid, job->filename, &size);
+        if (rc < 0) break;
+        if (rc == 1) {
+            replies[pending++] = i;
+            *bytes_out += size;
+            log_info("replication_worker_relayed", "file=%s size=%zu from %s",
+                     job->filename, size, primary_ss);
+            // Metadata file (.meta), best effort
+            char meta_path[MAX_REPL_FILENAME + 32];
+            snprintf(meta_path, sizeof(meta_path), "metadata/%s.meta", job->filename);
+            rc = relay_response(&link, src_rid, meta_path, &size);
+            if (rc == 1) {
+                replies[pending++] = -1;
+                *bytes_out += size;
+            }
+        } else {
+            rc = discard_response(&link, src_rid);
+        }
+        if (rc < 0) break;
+        copied++;
+    }
+    if (have_pipe) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+
+    // Replies come back in command order; a broken or aborted replica
+    // connection still answers the commands sent before the failure
+    int answered = 0;
+    for (; answered < pending; answered++) {
+        char line[MAX_LINE];
+        if (recv_line(dst, line, sizeof(line)) <= 0) break;
+        Message reply;
+        int acked = 0;
+        if (proto_parse_line(line, &reply) == 0) {
+            acked = strcmp(reply.type, "ACK") == 0;
+            if (!acked && strcmp(reply.type, "ERROR") == 0) {
+                log_error("replication_worker_push", "Replica returned error: %s", reply.payload);
             }
         }
+        int j = replies[answered];
+        if (j < 0) continue;
+        // A DELETE the replica cannot apply (file already gone) is still done
+        ok[j] = jobs[j]->operation == REPL_OP_DELETE ? 1 : acked;
+        if (ok[j] && jobs[j]->operation == REPL_OP_DELETE) {
+            log_info("replication_worker_delete_success", "file=%s deleted from %s",
+                     jobs[j]->filename, replica_ss);
+        } else if (ok[j]) {
+            log_info("replication_worker_success", "file=%s replicated to %s",
+                     jobs[j]->filename, replica_ss);
+        }
+    }
+    if (src >= 0) ss_pool_release(src, link.src_ok && copied == copies);
+    ss_pool_release(dst, link.dst_ok && answered == pending);
+
+    for (int i = 0; i < count; i++) {
+        if (ok[i]) {
+            replication_mark_synced(primary_ss, replica_ss);
+            break;
+        }
+    }
+    return 0;
+}
+
+// Process a single replication job (text-mode SS; see process_batch)
+static int process_job(const ReplicationJob *job, size_t *bytes_out) {
+    *bytes_out = 0;
+    log_info("replication_worker_process", "op=%d file=%s primary=%s replica=%s",
+             job->operation, job->filename, job->primary_ss, job->replica_ss);
+    
+    // Get SS connection info
+    char primary_host[64], replica_host[64];
+    int primary_port, replica_port;
+    
+    if (registry_get_ss_info(job->primary_ss, primary_host, sizeof(primary_host), &primary_port) != 0) {
+        log_error("replication_worker_error", "Primary SS %s not found in registry", job->primary_ss);
+        return -1;
+    }
+    
+    if (registry_get_ss_info(job->replica_ss, replica_host, sizeof(replica_host), &replica_port) != 0) {
+        log_error("replication_worker_error", "Replica SS %s not found in registry", job->replica_ss);
+        return -1;
+    }
+    
+    if (job->operation == REPL_OP_CREATE || job->operation == REPL_OP_UPDATE) {
+        // Text-mode SS: Step 1, fetch file content from primary
+        char *content = NULL;
+        size_t content_size = 0;
+        if (fetch_from_ss(primary_host, primary_port, job->filename, &content, &content_size) != 0) {
+            return -1;
+        }
         
-        free(content);
-        close(replica_fd);
+        log_info("replication_worker_fetched", "file=%s size=%zu from %s", 
+                 job->filename, content_size, job->primary_ss);
         
-        // Also replicate metadata file (.meta)
-        char meta_filename[MAX_REPL_FILENAME + 10];
-        snprintf(meta_filename, sizeof(meta_filename), "%s.meta", job->filename);
+        // Step 2: Write file content to replica
+        int rc = push_to_ss(replica_host, replica_port, job->filename, content, content_size);
+        free(content);
+        if (rc != 0) {
+            return -1;
+        }
+        *bytes_out = content_size;
+        log_info("replication_worker_success", "file=%s replicated to %s", 
+                 job->filename, job->replica_ss);
+        replication_mark_synced(job->primary_ss, job->replica_ss);
         
-        // Try to fetch metadata from primary
-        primary_fd = connect_to_host(primary_host, primary_port);
-        if (primary_fd >= 0) {
-            Message meta_req = {0};
-            snprintf(meta_req.type, sizeof(meta_req.type), "GET_FILE_CONTENT");
-            snprintf(meta_req.id, sizeof(meta_req.id), "repl_meta_%ld", (long)time(NULL));
-            snprintf(meta_req.username, sizeof(meta_req.username), "NM");
-            snprintf(meta_req.role, sizeof(meta_req.role), "NM");
-            snprintf(meta_req.payload, sizeof(meta_req.payload), "metadata/%s", meta_filename);
-            
-            char meta_line[MAX_LINE];
-            proto_format_line(&meta_req, meta_line, sizeof(meta_line));
-            send_all(primary_fd, meta_line, strlen(meta_line));
-            
-            char meta_resp[MAX_LINE];
-            if (recv_line(primary_fd, meta_resp, sizeof(meta_resp)) > 0) {
-                Message meta_msg;
-                if (proto_parse_line(meta_resp, &meta_msg) == 0 && strcmp(meta_msg.type, "ACK") == 0) {
-                    size_t meta_size = (size_t)strtoull(meta_msg.payload, NULL, 10);
-                    if (meta_size > 0 && meta_size < 65536) {
-                        char *meta_content = (char*)malloc(meta_size + 1);
-                        if (meta_content) {
-                            size_t meta_received = 0;
-                            while (meta_received < meta_size) {
-                                char meta_chunk[MAX_LINE];
-                                int meta_n = recv_line(primary_fd, meta_chunk, sizeof(meta_chunk));
-                                if (meta_n <= 0) break;
-                                Message meta_data;
-                                if (proto_parse_line(meta_chunk, &meta_data) == 0 && 
-                                    strcmp(meta_data.type, "DATA") == 0) {
-                                    size_t chunk_len = strlen(meta_data.payload);
-                                    if (meta_received + chunk_len <= meta_size) {
-                                        memcpy(meta_content + meta_received, meta_data.payload, chunk_len);
-                                        meta_received += chunk_len;
-                                    }
-                                }
-                            }
-                            meta_content[meta_received] = '\0';
-                            
-                            // Push metadata to replica
-                            replica_fd = connect_to_host(replica_host, replica_port);
-                            if (replica_fd >= 0) {
-                                Message meta_put = {0};
-                                snprintf(meta_put.type, sizeof(meta_put.type), "PUT_FILE_CONTENT");
-                                snprintf(meta_put.id, sizeof(meta_put.id), "repl_meta_%ld", (long)time(NULL));
-                                snprintf(meta_put.username, sizeof(meta_put.username), "NM");
-                                snprintf(meta_put.role, sizeof(meta_put.role), "NM");
-                                snprintf(meta_put.payload, sizeof(meta_put.payload), "metadata/%s|%zu", meta_filename, meta_size);
-                                
-                                char meta_put_line[MAX_LINE];
-                                proto_format_line(&meta_put, meta_put_line, sizeof(meta_put_line));
-                                send_all(replica_fd, meta_put_line, strlen(meta_put_line));
-                                
-                                size_t meta_sent = 0;
-                                while (meta_sent < meta_size) {
-                                    size_t chunk_size = (meta_size - meta_sent > 1024) ? 1024 : (meta_size - meta_sent);
-                                    Message meta_data = {0};
-                                    snprintf(meta_data.type, sizeof(meta_data.type), "DATA");
-                                    snprintf(meta_data.id, sizeof(meta_data.id), "repl_meta_%ld", (long)time(NULL));
-                                    memcpy(meta_data.payload, meta_content + meta_sent, chunk_size);
-                                    meta_data.payload[chunk_size] = '\0';
-                                    
-                                    char meta_data_line[MAX_LINE];
-                                    proto_format_line(&meta_data, meta_data_line, sizeof(meta_data_line));
-                                    send_all(replica_fd, meta_data_line, strlen(meta_data_line));
-                                    meta_sent += chunk_size;
-                                }
-                                
-                                close(replica_fd);
-                            }
-                            free(meta_content);
-                        }
-                    }
-                }
+        // Also replicate metadata file (.meta), best effort
+        char meta_path[MAX_REPL_FILENAME + 32];
+        snprintf(meta_path, sizeof(meta_path), "metadata/%s.meta", job->filename);
+        char *meta_content = NULL;
+        size_t meta_size = 0;
+        if (fetch_from_ss(primary_host, primary_port, meta_path, &meta_content, &meta_size) == 0) {
+            if (meta_size > 0) {
+                push_to_ss(replica_host, replica_port, meta_path, meta_content, meta_size);
             }
-            close(primary_fd);
+            free(meta_content);
         }
         
         return 0;
         
     } else if (job->operation == REPL_OP_DELETE) {
         // Connect to replica and send DELETE command
-        int replica_fd = connect_to_host(replica_host, replica_port);
+        int replica_fd = ss_pool_acquire(replica_host, replica_port);
         if (replica_fd < 0) {
             log_error("replication_worker_delete", "Failed to connect to replica %s:%d", 
                      replica_host, replica_port);
@@ -352,13 +716,13 @@ static int process_job(const ReplicationJob *job) {
             }
         }
         
-        close(replica_fd);
+        ss_pool_release(replica_fd, n > 0);
         
         // Also delete metadata file (.meta)
         char meta_filename[MAX_REPL_FILENAME + 10];
         snprintf(meta_filename, sizeof(meta_filename), "%s.meta", job->filename);
         
-        replica_fd = connect_to_host(replica_host, replica_port);
+        replica_fd = ss_pool_acquire(replica_host, replica_port);
         if (replica_fd >= 0) {
             Message meta_del = {0};
             snprintf(meta_del.type, sizeof(meta_del.type), "DELETE");
@@ -370,7 +734,9 @@ static int process_job(const ReplicationJob *job) {
             char meta_del_line[MAX_LINE];
             proto_format_line(&meta_del, meta_del_line, sizeof(meta_del_line));
             send_all(replica_fd, meta_del_line, strlen(meta_del_line));
-            close(replica_fd);
+            // Read the ACK/ERROR so the connection can go back to the pool
+            char meta_resp[MAX_LINE];
+            ss_pool_release(replica_fd, recv_line(replica_fd, meta_resp, sizeof(meta_resp)) > 0);
         }
         
         return 0;
@@ -380,58 +746,211 @@ static int process_job(const ReplicationJob *job) {
     return -1;
 }
 
+// Copy a run of CREATE/UPDATE jobs without the data passing through the
+// NM: one REPLICATE_TO directive per file, pipelined on one connection to
+// the primary, which pushes the file and its .meta straight to the replica
+// and answers with the bytes it sent.
+// ok: Set per job to 1 on success
+// bytes_out: Bytes the primary pushed
+// Returns: 0 if the run was handled, 1 if the primary does not know
+//          REPLICATE_TO (the caller then relays the run)
+static int direct_run(ReplicationJob **jobs, int count, int *ok, size_t *bytes_out) {
+    for (int i = 0; i < count; i++) ok[i] = 0;
+    *bytes_out = 0;
+    const char *primary_ss = jobs[0]->primary_ss;
+    const char *replica_ss = jobs[0]->replica_ss;
+    char primary_host[64], replica_host[64];
+    int primary_port, replica_port;
+    if (registry_get_ss_info(primary_ss, primary_host, sizeof(primary_host), &primary_port) != 0) {
+        log_error("replication_worker_error", "Primary SS %s not found in registry", primary_ss);
+        return 0;
+    }
+    if (registry_get_ss_info(replica_ss, replica_host, sizeof(replica_host), &replica_port) != 0) {
+        log_error("replication_worker_error", "Replica SS %s not found in registry", replica_ss);
+        return 0;
+    }
+
+    int fd = ss_pool_acquire(primary_host, primary_port);
+    if (fd < 0) {
+        log_error("replication_worker_direct", "Failed to connect to %s:%d", primary_host, primary_port);
+        return 0;
+    }
+
+    // Every directive in one write
+    Message msg;
+    fill_repl_message(&msg, "REPLICATE_TO", "");
+    char *requests = NULL;
+    size_t req_size = 0, req_cap = 4096;
+    int sent[REPL_BATCH_MAX];
+    int pending = 0;
+    requests = (char*)malloc(req_cap);
+    for (int i = 0; requests && i < count; i++) {
+        if (jobs[i]->operation != REPL_OP_CREATE && jobs[i]->operation != REPL_OP_UPDATE) {
+            log_warning("replication_worker_unsupported", "Operation %d not yet implemented",
+                        jobs[i]->operation);
+            continue;
+        }
+        char line[MAX_LINE];
+        snprintf(msg.payload, sizeof(msg.payload), "%s|%s|%d",
+                 jobs[i]->filename, replica_host, replica_port);
+        proto_format_line(&msg, line, sizeof(line));
+        if (buffer_append(&requests, &req_size, &req_cap, line, strlen(line)) != 0) break;
+        sent[pending++] = i;
+    }
+    if (pending == 0 || send_all(fd, requests, req_size) != 0) {
+        free(requests);
+        ss_pool_release(fd, pending == 0);
+        return 0;
+    }
+    free(requests);
+
+    // Replies come back in directive order, each after its push finished
+    int answered = 0;
+    int unsupported = 0;
+    for (; answered < pending; answered++) {
+        char line[MAX_LINE];
+        if (recv_line(fd, line, sizeof(line)) <= 0) break;
+        Message reply;
+        if (proto_parse_line(line, &reply) != 0) continue;
+        ReplicationJob *job = jobs[sent[answered]];
+        if (strcmp(reply.type, "ACK") == 0) {
+            ok[sent[answered]] = 1;
+            // Payload: "bytes|delta" or "bytes|full" (just bytes from older primaries)
+            char *end = NULL;
+            size_t size = (size_t)strtoull(reply.payload, &end, 10);
+            const char *mode = *end == '|' ? end + 1 : "full";
+            *bytes_out += size;
+            log_info("replication_worker_success", "file=%s replicated to %s size=%zu mode=%s (direct from %s)",
+                     job->filename, replica_ss, size, mode, primary_ss);
+            continue;
+        }
+        char code[32], err[256];
+        if (proto_parse_error(&reply, code, sizeof(code), err, sizeof(err)) != 0) {
+            snprintf(code, sizeof(code), "INTERNAL");
+            snprintf(err, sizeof(err), "%.200s", reply.payload);
+        }
+        if (answered == 0 && strcmp(code, "INVALID") == 0) unsupported = 1;
+        if (!unsupported) {
+            log_error("replication_worker_direct", "Primary %s could not push %s: %s",
+                      primary_ss, job->filename, err);
+        }
+    }
+    ss_pool_release(fd, answered == pending);
+
+    if (unsupported) {
+        log_warning("replication_worker_direct", "Primary %s does not support REPLICATE_TO, relaying",
+                    primary_ss);
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (ok[i]) {
+            replication_mark_synced(primary_ss, replica_ss);
+            break;
+        }
+    }
+    return 0;
+}
+
+// Run a batch of jobs for one primary -> replica pair. Copies go out as
+// REPLICATE_TO directives (direct_run) and DELETEs straight to the replica
+// (relay_batch). The batch is split into runs of copies and of DELETEs,
+// each finished before the next starts, so a DELETE never overtakes an
+// earlier copy of the same file on the other connection, or vice versa.
+// A SYNC_ALL (recovery) compares the two SSs and queues the copies it
+// finds (anti_entropy_sync).
+// ok: Set per job to 1 on success
+// bytes_out: Bytes replicated
+static void process_batch(ReplicationJob **jobs, int count, int *ok, size_t *bytes_out) {
+    *bytes_out = 0;
+    int start = 0;
+    while (start < count) {
+        ReplicationOp kind = jobs[start]->operation;
+        if (kind == REPL_OP_SYNC_ALL) {
+            ok[start] = anti_entropy_sync(jobs[start]->primary_ss, jobs[start]->replica_ss) >= 0;
+            start++;
+            continue;
+        }
+        int is_delete = kind == REPL_OP_DELETE;
+        int end = start + 1;
+        while (end < count && jobs[end]->operation != REPL_OP_SYNC_ALL &&
+               (jobs[end]->operation == REPL_OP_DELETE) == is_delete) {
+            end++;
+        }
+        int n = end - start;
+        size_t bytes = 0;
+        int rc = is_delete ? 1 : direct_run(jobs + start, n, ok + start, &bytes);
+        if (rc != 0) rc = relay_batch(jobs + start, n, ok + start, &bytes);
+        if (rc != 0) {
+            bytes = 0;
+            for (int i = start; i < end; i++) {
+                size_t job_bytes = 0;
+                ok[i] = process_job(jobs[i], &job_bytes) == 0;
+                bytes += job_bytes;
+            }
+        }
+        *bytes_out += bytes;
+        start = end;
+    }
+}
+
 // Worker thread function
 static void *worker_thread_func(void *arg) {
-    (void)arg;
+    ReplWorker *worker = (ReplWorker*)arg;
+    int id = (int)(worker - g_workers);
     
-    log_info("replication_worker_thread", "Worker thread started");
+    log_info("replication_worker_thread", "Worker thread %d started", id);
     
+    ReplicationJob *batch[REPL_BATCH_MAX];
+    int ok[REPL_BATCH_MAX];
     while (g_worker_running) {
-        pthread_mutex_lock(&g_queue_mu);
+        pthread_mutex_lock(&worker->mu);
         
         // Wait for jobs
-        while (g_worker_running && g_job_queue_head == NULL) {
-            pthread_cond_wait(&g_queue_cond, &g_queue_mu);
+        while (g_worker_running && worker->head == NULL) {
+            pthread_cond_wait(&worker->cond, &worker->mu);
         }
         
         if (!g_worker_running) {
-            pthread_mutex_unlock(&g_queue_mu);
+            pthread_mutex_unlock(&worker->mu);
             break;
         }
         
-        // Dequeue job
-        ReplicationJob *job = g_job_queue_head;
-        if (job) {
-            g_job_queue_head = job->next;
-            if (g_job_queue_head == NULL) {
-                g_job_queue_tail = NULL;
-            }
-            g_job_count--;
-        }
+        int count = dequeue_batch_locked(worker, batch, REPL_BATCH_MAX);
+        if (count > 0) worker->batches++;
         
-        pthread_mutex_unlock(&g_queue_mu);
+        pthread_mutex_unlock(&worker->mu);
         
-        if (job) {
-            // Process job
-            if (process_job(job) == 0) {
-                pthread_mutex_lock(&g_queue_mu);
-                g_completed_jobs++;
-                pthread_mutex_unlock(&g_queue_mu);
-            } else {
-                pthread_mutex_lock(&g_queue_mu);
-                g_failed_jobs++;
-                pthread_mutex_unlock(&g_queue_mu);
-            }
-            
-            free(job);
+        if (count == 0) continue;
+        log_info("replication_worker_batch", "worker=%d jobs=%d primary=%s replica=%s",
+                 id, count, batch[0]->primary_ss, batch[0]->replica_ss);
+        size_t bytes = 0;
+        process_batch(batch, count, ok, &bytes);
+        
+        // Lag: from the (first merged) change being queued to it landing
+        long long now = now_ms();
+        int completed = 0;
+        long long lag_total = 0, lag_max = 0;
+        for (int i = 0; i < count; i++) {
+            completed += ok[i];
+            long long lag = now - batch[i]->queued_ms;
+            lag_total += lag;
+            if (lag > lag_max) lag_max = lag;
+            free(batch[i]);
         }
+        pthread_mutex_lock(&worker->mu);
+        worker->completed += (unsigned long)completed;
+        worker->failed += (unsigned long)(count - completed);
+        worker->bytes += bytes;
+        worker->lag_total_ms += lag_total;
+        if (lag_max > worker->lag_max_ms) worker->lag_max_ms = lag_max;
+        pthread_mutex_unlock(&worker->mu);
     }
     
-    log_info("replication_worker_thread", "Worker thread stopped");
+    log_info("replication_worker_thread", "Worker thread %d stopped", id);
     return NULL;
 }
 
-// Start worker thread
+// Start worker threads
 int replication_worker_start(void) {
     if (g_worker_running) {
         log_warning("replication_worker_start", "Worker already running");
@@ -440,32 +959,86 @@ int replication_worker_start(void) {
     
     g_worker_running = 1;
     
-    int rc = pthread_create(&g_worker_thread, NULL, worker_thread_func, NULL);
-    if (rc != 0) {
-        g_worker_running = 0;
-        log_error("replication_worker_start", "Failed to create worker thread: %d", rc);
-        return -1;
+    for (int w = 0; w < g_worker_count; w++) {
+        int rc = pthread_create(&g_workers[w].thread, NULL, worker_thread_func, &g_workers[w]);
+        if (rc != 0) {
+            log_error("replication_worker_start", "Failed to create worker thread: %d", rc);
+            if (w == 0) {
+                g_worker_running = 0;
+                return -1;
+            }
+            // Run with the threads that did start
+            g_worker_count = w;
+            break;
+        }
+        g_workers[w].started = 1;
     }
     
-    log_info("replication_worker_start", "Replication worker started");
+    log_info("replication_worker_start", "Replication worker started (%d workers)", g_worker_count);
     return 0;
 }
 
-// Stop worker thread
+// Stop worker threads
 void replication_worker_stop(void) {
     if (!g_worker_running) return;
     
-    log_info("replication_worker_stop", "Stopping worker thread...");
+    log_info("replication_worker_stop", "Stopping worker threads...");
     
     g_worker_running = 0;
     
-    // Wake up worker thread
-    pthread_cond_signal(&g_queue_cond);
-    
-    // Wait for thread to finish
-    pthread_join(g_worker_thread, NULL);
+    for (int w = 0; w < g_worker_count; w++) {
+        ReplWorker *worker = &g_workers[w];
+        if (!worker->started) continue;
+        // Wake up worker thread
+        pthread_mutex_lock(&worker->mu);
+        pthread_cond_broadcast(&worker->cond);
+        pthread_mutex_unlock(&worker->mu);
+        
+        // Wait for thread to finish
+        pthread_join(worker->thread, NULL);
+        worker->started = 0;
+    }
     
-    log_info("replication_worker_stop", "Worker thread stopped");
+    log_info("replication_worker_stop", "Worker threads stopped");
+}
+
+// Fold a new job into a pending one for the same (file, replica) when the
+// pair replicates to the same end state; caller holds worker->mu.
+// Only pending jobs are merged: one already being processed is left alone
+// and the new job queues behind it.
+// Returns: 1 if the new job was absorbed, 0 if it must be queued
+static int coalesce_locked(ReplWorker *worker, ReplicationOp operation, const char *filename,
+                           const char *primary_ss, const char *replica_ss) {
+    ReplicationJob *pending = find_pending_locked(worker, filename, replica_ss);
+    if (!pending) return 0;
+    ReplicationOp prev = pending->operation;
+    int copy = operation == REPL_OP_CREATE || operation == REPL_OP_UPDATE;
+    int prev_copy = prev == REPL_OP_CREATE || prev == REPL_OP_UPDATE;
+    if (copy && prev_copy) {
+        // The content is fetched when the job runs, so one copy covers both
+        snprintf(pending->primary_ss, sizeof(pending->primary_ss), "%s", primary_ss);
+        worker->coalesced++;
+    } else if (operation == REPL_OP_DELETE && prev == REPL_OP_CREATE) {
+        // Never reached the replica: drop both
+        unlink_job_locked(worker, pending);
+        free(pending);
+        worker->coalesced += 2;
+    } else if (operation == REPL_OP_DELETE && prev == REPL_OP_UPDATE) {
+        pending->operation = REPL_OP_DELETE;
+        snprintf(pending->primary_ss, sizeof(pending->primary_ss), "%s", primary_ss);
+        worker->coalesced++;
+    } else if (operation == REPL_OP_DELETE && prev == REPL_OP_DELETE) {
+        worker->coalesced++;
+    } else if (operation == REPL_OP_SYNC_ALL && prev == REPL_OP_SYNC_ALL) {
+        // The trees are compared when the job runs
+        snprintf(pending->primary_ss, sizeof(pending->primary_ss), "%s", primary_ss);
+        worker->coalesced++;
+    } else {
+        return 0;
+    }
+    log_info("replication_worker_coalesced", "op=%d file=%s replica=%s pending_op=%d",
+             operation, filename, replica_ss, prev);
+    return 1;
 }
 
 // Queue a replication job
@@ -475,19 +1048,26 @@ int replication_worker_queue(ReplicationOp operation,
                               const char *replica_ss) {
     if (!filename || !primary_ss || !replica_ss) return -1;
     
-    pthread_mutex_lock(&g_queue_mu);
+    ReplWorker *worker = job_worker(filename, replica_ss);
+    pthread_mutex_lock(&worker->mu);
+    
+    if (coalesce_locked(worker, operation, filename, primary_ss, replica_ss)) {
+        pthread_mutex_unlock(&worker->mu);
+        return 0;
+    }
     
     // Check queue size
-    if (g_job_count >= MAX_QUEUE_SIZE) {
-        pthread_mutex_unlock(&g_queue_mu);
-        log_error("replication_worker_queue", "Queue full (%d jobs)", g_job_count);
+    if (worker->count >= MAX_QUEUE_SIZE) {
+        pthread_mutex_unlock(&worker->mu);
+        log_error("replication_worker_queue", "Queue full (%d jobs on worker %d)",
+                  worker->count, (int)(worker - g_workers));
         return -1;
     }
     
     // Create job
     ReplicationJob *job = (ReplicationJob *)calloc(1, sizeof(ReplicationJob));
     if (!job) {
-        pthread_mutex_unlock(&g_queue_mu);
+        pthread_mutex_unlock(&worker->mu);
         log_error("replication_worker_queue", "Memory allocation failed");
         return -1;
     }
@@ -496,35 +1076,68 @@ int replication_worker_queue(ReplicationOp operation,
     strncpy(job->filename, filename, sizeof(job->filename) - 1);
     strncpy(job->primary_ss, primary_ss, sizeof(job->primary_ss) - 1);
     strncpy(job->replica_ss, replica_ss, sizeof(job->replica_ss) - 1);
+    job->queued_ms = now_ms();
     job->next = NULL;
     
     // Enqueue
-    if (g_job_queue_tail) {
-        g_job_queue_tail->next = job;
+    job->prev = worker->tail;
+    if (worker->tail) {
+        worker->tail->next = job;
     } else {
-        g_job_queue_head = job;
+        worker->head = job;
     }
-    g_job_queue_tail = job;
-    g_job_count++;
-    
-    pthread_mutex_unlock(&g_queue_mu);
+    worker->tail = job;
+    unsigned bucket = job_bucket(job->filename, job->replica_ss);
+    job->hash_next = worker->index[bucket];
+    worker->index[bucket] = job;
+    worker->count++;
+    int queued = worker->count;
     
     // Signal worker
-    pthread_cond_signal(&g_queue_cond);
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mu);
     
-    log_info("replication_worker_queued", "op=%d file=%s primary=%s replica=%s queued=%d",
-             operation, filename, primary_ss, replica_ss, g_job_count);
+    log_info("replication_worker_queued", "op=%d file=%s primary=%s replica=%s worker=%d queued=%d",
+             operation, filename, primary_ss, replica_ss, (int)(worker - g_workers), queued);
     
     return 0;
 }
 
-// Get statistics
+int replication_worker_get_worker_stats(ReplicationWorkerStats *out, int max) {
+    if (!out || max <= 0) return 0;
+    int n = g_worker_count < max ? g_worker_count : max;
+    long long now = now_ms();
+    for (int w = 0; w < n; w++) {
+        ReplWorker *worker = &g_workers[w];
+        ReplicationWorkerStats *st = &out[w];
+        pthread_mutex_lock(&worker->mu);
+        st->pending_jobs = worker->count;
+        st->completed_jobs = worker->completed;
+        st->failed_jobs = worker->failed;
+        st->coalesced_jobs = worker->coalesced;
+        st->batches = worker->batches;
+        st->bytes_replicated = worker->bytes;
+        unsigned long done = worker->completed + worker->failed;
+        st->lag_avg_ms = done ? worker->lag_total_ms / (long long)done : 0;
+        st->lag_max_ms = worker->lag_max_ms;
+        st->oldest_pending_ms = worker->head ? now - worker->head->queued_ms : 0;
+        pthread_mutex_unlock(&worker->mu);
+    }
+    return n;
+}
+
+// Get statistics (sum over workers)
 void replication_worker_get_stats(ReplicationStats *stats) {
     if (!stats) return;
     
-    pthread_mutex_lock(&g_queue_mu);
-    stats->pending_jobs = g_job_count;
-    stats->completed_jobs = g_completed_jobs;
-    stats->failed_jobs = g_failed_jobs;
-    pthread_mutex_unlock(&g_queue_mu);
+    ReplicationWorkerStats per[REPL_MAX_WORKERS];
+    int n = replication_worker_get_worker_stats(per, REPL_MAX_WORKERS);
+    memset(stats, 0, sizeof(*stats));
+    for (int w = 0; w < n; w++) {
+        stats->pending_jobs += per[w].pending_jobs;
+        stats->completed_jobs += (int)per[w].completed_jobs;
+        stats->failed_jobs += (int)per[w].failed_jobs;
+        stats->coalesced_jobs += (int)per[w].coalesced_jobs;
+        stats->batches += (int)per[w].batches;
+    }
 }
@@ -2,7 +2,16 @@
 #define REPLICATION_WORKER_H
 
 // Asynchronous replication worker
-// Processes replication jobs in background thread
+// A pool of threads, each owning a shard of the job queue (sharded by file
+// and replica, so one file's jobs stay in order). Pending jobs for the same
+// file and replica are merged, and each batch for one primary/replica pair
+// runs pipelined, normally as REPLICATE_TO directives to the primary.
+// All functions are thread-safe.
+
+#include <stddef.h>
+
+#define REPL_DEFAULT_WORKERS 4
+#define REPL_MAX_WORKERS 64
 
 #define MAX_REPL_FILENAME 256
 #define MAX_REPL_SS_NAME 64
@@ -13,7 +22,8 @@ typedef enum {
     REPL_OP_DELETE,      // Replicate file deletion
     REPL_OP_UPDATE,      // Replicate file content update
     REPL_OP_METADATA,    // Replicate metadata only
-    REPL_OP_SYNC_ALL     // Full sync (all files)
+    REPL_OP_SYNC_ALL     // Recovery sync of replica_ss from primary_ss (see
+                         // anti_entropy.h; filename is "*")
 } ReplicationOp;
 
 // Replication job
@@ -23,19 +33,27 @@ typedef struct ReplicationJob {
     char primary_ss[MAX_REPL_SS_NAME];
     char replica_ss[MAX_REPL_SS_NAME];
     struct ReplicationJob *next;
+    struct ReplicationJob *prev;
+    struct ReplicationJob *hash_next;   // Pending jobs by (file, replica)
+    long long queued_ms;                // Monotonic time the job was queued
 } ReplicationJob;
 
+// Number of worker threads (call before replication_worker_start; clamped
+// to 1..REPL_MAX_WORKERS)
+void replication_worker_set_workers(int count);
+
 // Initialize replication worker
 void replication_worker_init(void);
 
-// Start worker thread
+// Start worker threads
 int replication_worker_start(void);
 
-// Stop worker thread
+// Stop worker threads (pending jobs are dropped)
 void replication_worker_stop(void);
 
-// Queue a replication job (async, non-blocking)
-// Returns 0 on success, -1 if queue is full
+// Queue a replication job (async, non-blocking); may be merged into a
+// pending job for the same file and replica
+// Returns 0 on success (queued or merged), -1 if queue is full
 int replication_worker_queue(ReplicationOp operation,
                               const char *filename,
                               const char *primary_ss,
@@ -46,8 +64,27 @@ typedef struct {
     int pending_jobs;
     int completed_jobs;
     int failed_jobs;
+    int coalesced_jobs;     // Queued jobs merged away before running
+    int batches;            // Connection batches run
 } ReplicationStats;
 
 void replication_worker_get_stats(ReplicationStats *stats);
 
+// Per-worker statistics
+typedef struct {
+    int pending_jobs;                   // Queue depth
+    unsigned long completed_jobs;
+    unsigned long failed_jobs;
+    unsigned long coalesced_jobs;
+    unsigned long batches;
+    unsigned long long bytes_replicated;
+    long long lag_avg_ms;               // Queued -> replicated, per job run
+    long long lag_max_ms;
+    long long oldest_pending_ms;        // Age of the oldest waiting job
+} ReplicationWorkerStats;
+
+// Fill out[0..] for each worker
+// Returns: number of workers reported (at most max)
+int replication_worker_get_worker_stats(ReplicationWorkerStats *out, int max);
+
 #endif
@@ -0,0 +1,223 @@
+#define _POSIX_C_SOURCE 200809L
+#include "access_time.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "file_storage.h"
+
+#define ATIME_BUCKETS 1024  // Power of two
+
+typedef struct PendingAtime {
+    char *filename;
+    time_t accessed;
+    struct PendingAtime *next;
+} PendingAtime;
+
+static struct {
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int running;
+    int kicked;                 // Threshold reached or flush requested
+    char *storage_dir;
+    AtimeConfig cfg;
+    PendingAtime *buckets[ATIME_BUCKETS];
+    size_t pending;
+    AtimeStats stats;
+} g_atime = {
+    .mu = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// Serializes flushes (timer thread vs. explicit access_time_flush())
+static pthread_mutex_t g_flush_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t bucket_for(const char *filename) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h & (ATIME_BUCKETS - 1);
+}
+
+int access_time_parse_mode(const char *name, AtimeMode *out) {
+    if (!name || !out) return -1;
+    if (strcmp(name, "strict") == 0) *out = ATIME_STRICT;
+    else if (strcmp(name, "lazy") == 0) *out = ATIME_LAZY;
+    else if (strcmp(name, "relatime") == 0) *out = ATIME_RELATIME;
+    else return -1;
+    return 0;
+}
+
+// Take the whole pending table; caller holds g_atime.mu
+static PendingAtime *take_pending_locked(void) {
+    PendingAtime *list = NULL;
+    for (int b = 0; b < ATIME_BUCKETS; b++) {
+        PendingAtime *p = g_atime.buckets[b];
+        while (p) {
+            PendingAtime *next = p->next;
+            p->next = list;
+            list = p;
+            p = next;
+        }
+        g_atime.buckets[b] = NULL;
+    }
+    g_atime.pending = 0;
+    g_atime.kicked = 0;
+    return list;
+}
+
+static void flush_list(PendingAtime *list) {
+    unsigned long written = 0;
+    while (list) {
+        PendingAtime *p = list;
+        list = p->next;
+
+        // The cached copy may already carry p->accessed, so always save:
+        // the point of the flush is to get it onto disk
+        FileMetadata meta;
+        metadata_lock(g_atime.storage_dir, p->filename);
+        if (metadata_load(g_atime.storage_dir, p->filename, &meta) == 0) {
+            if (meta.last_accessed < p->accessed) meta.last_accessed = p->accessed;
+            if (metadata_save(g_atime.storage_dir, p->filename, &meta) == 0) written++;
+        }
+        metadata_unlock(g_atime.storage_dir, p->filename);
+        free(p->filename);
+        free(p);
+    }
+    pthread_mutex_lock(&g_atime.mu);
+    g_atime.stats.written += written;
+    g_atime.stats.flushes++;
+    pthread_mutex_unlock(&g_atime.mu);
+}
+
+void access_time_flush(void) {
+    pthread_mutex_lock(&g_flush_mu);
+    pthread_mutex_lock(&g_atime.mu);
+    PendingAtime *list = take_pending_locked();
+    pthread_mutex_unlock(&g_atime.mu);
+    if (list) flush_list(list);
+    pthread_mutex_unlock(&g_flush_mu);
+}
+
+static void *flusher_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_atime.mu);
+    while (g_atime.running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += g_atime.cfg.flush_interval_sec;
+        while (g_atime.running && !g_atime.kicked) {
+            if (pthread_cond_timedwait(&g_atime.cond, &g_atime.mu, &deadline) == ETIMEDOUT) break;
+        }
+        if (!g_atime.running) break;
+        pthread_mutex_unlock(&g_atime.mu);
+        access_time_flush();
+        pthread_mutex_lock(&g_atime.mu);
+    }
+    pthread_mutex_unlock(&g_atime.mu);
+    return NULL;
+}
+
+int access_time_start(const char *storage_dir, const AtimeConfig *cfg) {
+    if (!storage_dir || !cfg) return -1;
+    pthread_mutex_lock(&g_atime.mu);
+    if (g_atime.storage_dir) {
+        pthread_mutex_unlock(&g_atime.mu);
+        return 0;
+    }
+    g_atime.storage_dir = strdup(storage_dir);
+    g_atime.cfg = *cfg;
+    if (g_atime.cfg.flush_interval_sec <= 0) g_atime.cfg.flush_interval_sec = ATIME_DEFAULT_FLUSH_SEC;
+    if (g_atime.cfg.flush_threshold == 0) g_atime.cfg.flush_threshold = ATIME_DEFAULT_FLUSH_THRESHOLD;
+    if (g_atime.cfg.relatime_sec <= 0) g_atime.cfg.relatime_sec = ATIME_DEFAULT_RELATIME_SEC;
+    if (!g_atime.storage_dir) {
+        pthread_mutex_unlock(&g_atime.mu);
+        return -1;
+    }
+    if (g_atime.cfg.mode != ATIME_STRICT) {
+        g_atime.running = 1;
+        if (pthread_create(&g_atime.thread, NULL, flusher_thread, NULL) != 0) {
+            g_atime.running = 0;
+            g_atime.cfg.mode = ATIME_STRICT;
+            pthread_mutex_unlock(&g_atime.mu);
+            return -1;
+        }
+    }
+    pthread_mutex_unlock(&g_atime.mu);
+    return 0;
+}
+
+void access_time_record(const char *filename) {
+    if (!filename || !g_atime.storage_dir) return;
+    time_t now = time(NULL);
+
+    if (g_atime.cfg.mode == ATIME_STRICT) {
+        metadata_update_last_accessed(g_atime.storage_dir, filename);
+        return;
+    }
+    if (g_atime.cfg.mode == ATIME_RELATIME) {
+        // Header only: the cached copy already includes recorded accesses
+        FileMetadata meta;
+        if (metadata_load_sections(g_atime.storage_dir, filename, 0, &meta) == 0 &&
+            meta.last_accessed >= meta.last_modified &&
+            now - meta.last_accessed < g_atime.cfg.relatime_sec) {
+            pthread_mutex_lock(&g_atime.mu);
+            g_atime.stats.skipped++;
+            pthread_mutex_unlock(&g_atime.mu);
+            return;
+        }
+    }
+
+    metadata_note_accessed(g_atime.storage_dir, filename, now);
+
+    size_t b = bucket_for(filename);
+    pthread_mutex_lock(&g_atime.mu);
+    g_atime.stats.recorded++;
+    PendingAtime *p = g_atime.buckets[b];
+    while (p && strcmp(p->filename, filename) != 0) p = p->next;
+    if (p) {
+        if (p->accessed < now) p->accessed = now;
+    } else {
+        p = malloc(sizeof(*p));
+        char *name = strdup(filename);
+        if (!p || !name) {
+            free(p);
+            free(name);
+            pthread_mutex_unlock(&g_atime.mu);
+            return;
+        }
+        p->filename = name;
+        p->accessed = now;
+        p->next = g_atime.buckets[b];
+        g_atime.buckets[b] = p;
+        if (++g_atime.pending >= g_atime.cfg.flush_threshold && !g_atime.kicked) {
+            g_atime.kicked = 1;
+            pthread_cond_signal(&g_atime.cond);
+        }
+    }
+    pthread_mutex_unlock(&g_atime.mu);
+}
+
+void access_time_stop(void) {
+    pthread_mutex_lock(&g_atime.mu);
+    int was_running = g_atime.running;
+    g_atime.running = 0;
+    pthread_cond_signal(&g_atime.cond);
+    pthread_mutex_unlock(&g_atime.mu);
+    if (was_running) pthread_join(g_atime.thread, NULL);
+    access_time_flush();
+}
+
+void access_time_get_stats(AtimeStats *out) {
+    if (!out) return;
+    pthread_mutex_lock(&g_atime.mu);
+    *out = g_atime.stats;
+    out->pending = g_atime.pending;
+    pthread_mutex_unlock(&g_atime.mu);
+}
@@ -0,0 +1,66 @@
+#ifndef ACCESS_TIME_H
+#define ACCESS_TIME_H
+
+#include <stddef.h>
+
+// Deferred last-accessed timestamps for the Storage Server: accesses go
+// into the metadata cache and a flusher thread saves them in batches, each
+// file under its metadata lock. Thread-safe; a crash loses at most one
+// flush interval of access times.
+//
+// Policies (--atime):
+//   strict    Write every access through
+//   lazy      Record every access, flush in batches (default)
+//   relatime  Like lazy, but skip accesses while the recorded time is newer
+//             than the last modification and younger than relatime_sec
+
+typedef enum {
+    ATIME_STRICT,
+    ATIME_LAZY,
+    ATIME_RELATIME,
+} AtimeMode;
+
+#define ATIME_DEFAULT_FLUSH_SEC 30
+#define ATIME_DEFAULT_FLUSH_THRESHOLD 256
+#define ATIME_DEFAULT_RELATIME_SEC 3600
+
+typedef struct {
+    AtimeMode mode;
+    int flush_interval_sec;     // <= 0: ATIME_DEFAULT_FLUSH_SEC
+    size_t flush_threshold;     // 0: ATIME_DEFAULT_FLUSH_THRESHOLD
+    int relatime_sec;           // <= 0: ATIME_DEFAULT_RELATIME_SEC
+} AtimeConfig;
+
+typedef struct {
+    unsigned long recorded;     // Accesses recorded in memory
+    unsigned long skipped;      // Accesses dropped by relatime
+    unsigned long written;      // .meta files rewritten by flushes
+    unsigned long flushes;      // Flush batches run
+    size_t pending;
+} AtimeStats;
+
+// Parse "strict", "lazy" or "relatime"
+// Returns: 0 on success, -1 if name is unknown
+int access_time_parse_mode(const char *name, AtimeMode *out);
+
+// Start the flusher for one storage directory (call once at startup)
+// Returns: 0 on success, -1 if the thread cannot be started (accesses are
+//          then written through as in strict mode)
+//
+// Usage:
+//   AtimeConfig cfg = { ATIME_LAZY, 0, 0, 0 };
+//   access_time_start("./storage_ss1", &cfg);
+int access_time_start(const char *storage_dir, const AtimeConfig *cfg);
+
+// Record that filename was just read
+void access_time_record(const char *filename);
+
+// Write all pending access times now
+void access_time_flush(void);
+
+// Flush and stop the flusher thread
+void access_time_stop(void);
+
+void access_time_get_stats(AtimeStats *out);
+
+#endif
@@ -1,10 +1,18 @@
+#define _GNU_SOURCE  // copy_file_range()
 #include "file_storage.h"
+#include "meta_cache.h"
+#include "meta_format.h"
 #include "sentence_parser.h"
+#include "text_scan.h"
+#include "undo_log.h"
+#include "../common/log.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
@@ -56,12 +64,12 @@ static const char *normalize_filename(const char *filename) {
     return filename;
 }
 
-static void build_undo_paths(const char *storage_dir, const char *filename,
-                             char *meta_path, size_t meta_len,
-                             char *data_path, size_t data_len) {
-    const char *norm_filename = normalize_filename(filename);
-    snprintf(meta_path, meta_len, "%s/metadata/%s.undo.meta", storage_dir, norm_filename);
-    snprintf(data_path, data_len, "%s/metadata/%s.undo.data", storage_dir, norm_filename);
+// Helper: Build metadata/<file>.meta path (also the metadata cache key)
+static int build_meta_path(const char *storage_dir, const char *filename,
+                           char *meta_path, size_t meta_len) {
+    int n = snprintf(meta_path, meta_len, "%s/metadata/%s.meta",
+                     storage_dir, normalize_filename(filename));
+    return (n < 0 || (size_t)n >= meta_len) ? -1 : 0;
 }
 
 // Helper: Ensure directories exist (create if they don't)
@@ -188,6 +196,23 @@ int file_read(const char *storage_dir, const char *filename,
     return 0;  // Success
 }
 
+int file_open_read(const char *storage_dir, const char *filename, size_t *size_out) {
+    if (!storage_dir || !filename) return -1;
+
+    char file_path[512];
+    snprintf(file_path, sizeof(file_path), "%s/files/%s", storage_dir, normalize_filename(filename));
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    if (size_out) *size_out = (size_t)st.st_size;
+    return fd;
+}
+
 int file_read_all(const char *storage_dir, const char *filename,
                   char **out_buf, size_t *out_len) {
     if (!storage_dir || !filename || !out_buf) return -1;
@@ -257,6 +282,39 @@ int file_write_all(const char *storage_dir, const char *filename,
     return 0;
 }
 
+int file_copy_range(int in_fd, size_t in_off, int out_fd, size_t len) {
+    off_t off = (off_t)in_off;
+    while (len > 0) {
+        ssize_t n = copy_file_range(in_fd, &off, out_fd, NULL, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;  // Unsupported here (or EOF): fall back to read/write
+        len -= (size_t)n;
+    }
+    char buf[FILE_STREAM_CHUNK];
+    while (len > 0) {
+        size_t chunk = len < sizeof(buf) ? len : sizeof(buf);
+        ssize_t n = pread(in_fd, buf, chunk, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        if (file_write_fd(out_fd, buf, (size_t)n) != 0) return -1;
+        off += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int file_write_fd(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
 // Delete file and metadata
 int file_delete(const char *storage_dir, const char *filename) {
     if (!storage_dir || !filename) return -1;
@@ -273,6 +331,8 @@ int file_delete(const char *storage_dir, const char *filename) {
     
     // Delete metadata (unlink returns 0 on success)
     int meta_ok = (unlink(meta_path) == 0 || errno == ENOENT);
+    meta_cache_invalidate(meta_path);
+    undo_log_discard(storage_dir, filename);
     
     // Return success if at least one deletion succeeded (file might not exist)
     // In practice, if file doesn't exist, we should return error
@@ -295,186 +355,122 @@ int file_exists(const char *storage_dir, const char *filename) {
     return (access(file_path, F_OK) == 0) ? 1 : 0;
 }
 
-// Load metadata from disk
-// Metadata format: Simple text format (can be enhanced to JSON later)
-// Format: owner=username\ncreated=timestamp\nlast_modified=timestamp\n...
-int metadata_load(const char *storage_dir, const char *filename, FileMetadata *metadata) {
-    if (!storage_dir || !filename || !metadata) return -1;
-    
-    // Build metadata file path
-    const char *norm_filename = normalize_filename(filename);
-    char meta_path[512];
-    snprintf(meta_path, sizeof(meta_path), "%s/metadata/%s.meta", storage_dir, norm_filename);
-    
-    // Open metadata file
-    FILE *fp = fopen(meta_path, "r");
-    if (!fp) {
+// Read a .meta file: binary images are decoded straight from an mmap,
+// touching only the requested sections; legacy text is parsed whole
+// is_text: Set to 1 if the file is in the legacy text format
+static int metadata_read_file(const char *meta_path, unsigned sections,
+                              FileMetadata *metadata, int *is_text) {
+    *is_text = 0;
+    int fd = open(meta_path, O_RDONLY);
+    if (fd < 0) {
         return -1;  // Metadata file not found
     }
-    
-    // Initialize metadata structure
-    memset(metadata, 0, sizeof(FileMetadata));
-    metadata->next_sentence_id = 1;
-    
-    // Read entire file into buffer for ACL parsing
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    
-    char *file_content = (char *)malloc(file_size + 1);
-    if (!file_content) {
-        fclose(fp);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
         return -1;
     }
-    size_t read_bytes = fread(file_content, 1, file_size, fp);
-    if (read_bytes != (size_t)file_size && !feof(fp)) {
-        free(file_content);
-        fclose(fp);
+    size_t len = (size_t)st.st_size;
+    if (len == 0) {
+        // Empty legacy file: no fields at all
+        close(fd);
+        *is_text = 1;
+        char empty[1] = "";
+        return meta_format_parse_text(empty, metadata);
+    }
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
         return -1;
     }
-    file_content[read_bytes] = '\0';
-    fclose(fp);
-    
-    // Parse line by line
-    char *saveptr = NULL;
-    char *line = strtok_r(file_content, "\n", &saveptr);
-    while (line) {
-        // Parse key=value pairs
-        if (strncmp(line, "owner=", 6) == 0) {
-            // Copy owner, truncating if too long (owner field is 64 bytes)
-            const char *owner_val = line + 6;
-            size_t owner_len = strlen(owner_val);
-            if (owner_len >= sizeof(metadata->owner)) {
-                owner_len = sizeof(metadata->owner) - 1;
-            }
-            memcpy(metadata->owner, owner_val, owner_len);
-            metadata->owner[owner_len] = '\0';
-        } else if (strncmp(line, "created=", 8) == 0) {
-            metadata->created = (time_t)atoll(line + 8);
-        } else if (strncmp(line, "last_modified=", 14) == 0) {
-            metadata->last_modified = (time_t)atoll(line + 14);
-        } else if (strncmp(line, "last_accessed=", 14) == 0) {
-            metadata->last_accessed = (time_t)atoll(line + 14);
-        } else if (strncmp(line, "size_bytes=", 11) == 0) {
-            metadata->size_bytes = (size_t)atoll(line + 11);
-        } else if (strncmp(line, "word_count=", 11) == 0) {
-            metadata->word_count = atoi(line + 11);
-        } else if (strncmp(line, "char_count=", 11) == 0) {
-            metadata->char_count = atoi(line + 11);
-        } else if (strncmp(line, "sentence_count=", 15) == 0) {
-            int count = atoi(line + 15);
-            if (count < 0) count = 0;
-            if (count > MAX_SENTENCE_METADATA) count = MAX_SENTENCE_METADATA;
-            metadata->sentence_count = count;
-        } else if (strncmp(line, "next_sentence_id=", 17) == 0) {
-            int next_id = atoi(line + 17);
-            if (next_id <= 0) next_id = 1;
-            metadata->next_sentence_id = next_id;
-        } else if (strncmp(line, "sentence_", 9) == 0) {
-            char *eq = strchr(line, '=');
-            if (!eq) {
-                line = strtok_r(NULL, "\n", &saveptr);
-                continue;
-            }
-            int idx = atoi(line + 9);
-            if (idx < 0 || idx >= MAX_SENTENCE_METADATA) {
-                line = strtok_r(NULL, "\n", &saveptr);
-                continue;
-            }
-            SentenceMeta *sm = &metadata->sentences[idx];
-            int id = 0, version = 0, wcount = 0, ccount = 0;
-            size_t offset = 0, length = 0;
-            int parsed = sscanf(eq + 1, "%d,%d,%zu,%zu,%d,%d",
-                                &id, &version, &offset, &length, &wcount, &ccount);
-            if (parsed == 6) {
-                sm->sentence_id = id;
-                sm->version = version;
-                sm->offset = offset;
-                sm->length = length;
-                sm->word_count = wcount;
-                sm->char_count = ccount;
-                if (idx + 1 > metadata->sentence_count) {
-                    metadata->sentence_count = idx + 1;
-                }
-                if (metadata->next_sentence_id <= sm->sentence_id) {
-                    metadata->next_sentence_id = sm->sentence_id + 1;
-                }
-            }
-        } else if (strncmp(line, "ACL_START", 9) == 0) {
-            // ACL section starts - collect all ACL lines
-            char acl_buf[4096] = {0};
-            size_t acl_pos = 0;
-            
-            // Collect ACL lines until ACL_END
-            while ((line = strtok_r(NULL, "\n", &saveptr))) {
-                if (strncmp(line, "ACL_END", 7) == 0) {
-                    break;
-                }
-                // Append line to ACL buffer
-                size_t line_len = strlen(line);
-                if (acl_pos + line_len + 1 < sizeof(acl_buf)) {
-                    memcpy(acl_buf + acl_pos, line, line_len);
-                    acl_pos += line_len;
-                    acl_buf[acl_pos++] = '\n';
-                }
-            }
-            acl_buf[acl_pos] = '\0';
-            
-            // Deserialize ACL
-            acl_deserialize(&metadata->acl, acl_buf);
-            // Don't break - continue reading pending requests
-        } else if (strncmp(line, "pending_request_count=", 22) == 0) {
-            int count = atoi(line + 22);
-            if (count < 0) count = 0;
-            if (count > MAX_PENDING_REQUESTS) count = MAX_PENDING_REQUESTS;
-            metadata->pending_request_count = count;
-        } else if (strncmp(line, "pending_request_", 16) == 0) {
-            char *eq = strchr(line, '=');
-            if (!eq) {
-                line = strtok_r(NULL, "\n", &saveptr);
-                continue;
-            }
-            int idx = atoi(line + 16);
-            if (idx < 0 || idx >= MAX_PENDING_REQUESTS) {
-                line = strtok_r(NULL, "\n", &saveptr);
-                continue;
-            }
-            PendingRequest *req = &metadata->pending_requests[idx];
-            int request_id = 0;
-            char requester[64] = {0};
-            char access_type = 'R';
-            long timestamp = 0;
-            
-            // Parse: request_id,requester,access_type,timestamp
-            char *field_saveptr = NULL;
-            char *field = strtok_r(eq + 1, ",", &field_saveptr);
-            if (field) request_id = atoi(field);
-            field = strtok_r(NULL, ",", &field_saveptr);
-            if (field) strncpy(requester, field, sizeof(requester) - 1);
-            field = strtok_r(NULL, ",", &field_saveptr);
-            if (field) access_type = field[0];
-            field = strtok_r(NULL, ",", &field_saveptr);
-            if (field) timestamp = atol(field);
-            
-            req->request_id = request_id;
-            size_t req_len = strlen(requester);
-            if (req_len >= sizeof(req->requester)) req_len = sizeof(req->requester) - 1;
-            memcpy(req->requester, requester, req_len);
-            req->requester[req_len] = '\0';
-            req->access_type = access_type;
-            req->timestamp = (time_t)timestamp;
+    int result;
+    if (meta_format_is_binary(map, len)) {
+        result = meta_format_decode(map, len, sections, metadata);
+    } else {
+        *is_text = 1;
+        char *text = malloc(len + 1);
+        if (text) {
+            memcpy(text, map, len);
+            text[len] = '\0';
+            result = meta_format_parse_text(text, metadata);
+            free(text);
+        } else {
+            result = -1;
         }
-        line = strtok_r(NULL, "\n", &saveptr);
     }
+    munmap(map, len);
+    return result;
+}
+
+// Load metadata, from the metadata cache when possible
+int metadata_load_sections(const char *storage_dir, const char *filename,
+                           unsigned sections, FileMetadata *metadata) {
+    if (!storage_dir || !filename || !metadata) return -1;
+    sections &= META_SECTION_ALL;
     
-    free(file_content);
-    
-    // If ACL not found, initialize with owner
-    if (metadata->acl.count == 0 && strlen(metadata->owner) > 0) {
-        metadata->acl = acl_init(metadata->owner);
+    char meta_path[512];
+    if (build_meta_path(storage_dir, filename, meta_path, sizeof(meta_path)) != 0) {
+        return -1;
     }
-    
-    return 0;  // Success
+    uint64_t token;
+    if (meta_cache_get(meta_path, sections, metadata, &token) == 0) {
+        return 0;
+    }
+    int is_text;
+    if (metadata_read_file(meta_path, sections, metadata, &is_text) != 0) {
+        return -1;
+    }
+    if (!is_text) {
+        meta_cache_fill(meta_path, metadata, sections, token);
+        return 0;
+    }
+
+    // Legacy text: migrate to binary under the file's lock, re-reading in
+    // case another thread saved (or migrated) it in the meantime
+    meta_cache_lock(meta_path);
+    int result = metadata_read_file(meta_path, META_SECTION_ALL, metadata, &is_text);
+    if (result == 0 && is_text) {
+        if (metadata_save(storage_dir, filename, metadata) == 0) {
+            log_info("ss_meta_migrated", "file=%s", filename);
+        }
+    }
+    meta_cache_unlock(meta_path);
+    return result;
+}
+
+int metadata_load(const char *storage_dir, const char *filename, FileMetadata *metadata) {
+    return metadata_load_sections(storage_dir, filename, META_SECTION_ALL, metadata);
+}
+
+// Write image to a temp file beside meta_path, unique per call: concurrent
+// saves of the same file (e.g. last-accessed updates from parallel READs)
+// must not share one temp file, or a rename can publish another writer's
+// half-written copy
+// Returns: 0 on success, -1 on failure (no temp file left behind)
+static int write_meta_temp(const char *meta_path, const char *image, size_t image_len,
+                           char *tmp_path, size_t tmp_len) {
+    static unsigned long tmp_seq = 0;
+    unsigned long seq = __atomic_add_fetch(&tmp_seq, 1, __ATOMIC_RELAXED);
+    int n = snprintf(tmp_path, tmp_len, "%s.tmp.%d.%lu", meta_path, (int)getpid(), seq);
+    if (n < 0 || (size_t)n >= tmp_len) {
+        return -1;  // Temp path too long
+    }
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    size_t written = 0;
+    while (written < image_len) {
+        ssize_t w = write(fd, image + written, image_len - written);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += (size_t)w;
+    }
+    if (close(fd) != 0 || written != image_len) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
 }
 
 // Save metadata to disk (atomically)
@@ -487,86 +483,115 @@ int metadata_save(const char *storage_dir, const char *filename, const FileMetad
     mkdir(meta_dir, 0755);
     
     // Build paths
-    const char *norm_filename = normalize_filename(filename);
     char meta_path[512];
-    char tmp_path[520];  // Slightly larger to accommodate ".tmp"
-    int n = snprintf(meta_path, sizeof(meta_path), "%s/metadata/%s.meta", storage_dir, norm_filename);
-    if (n < 0 || (size_t)n >= sizeof(meta_path)) {
+    char tmp_path[560];  // Room for ".tmp.<pid>.<seq>"
+    if (build_meta_path(storage_dir, filename, meta_path, sizeof(meta_path)) != 0) {
         return -1;  // Path too long
     }
-    // Build temp path by appending ".tmp"
-    n = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", meta_path);
-    if (n < 0 || (size_t)n >= sizeof(tmp_path)) {
-        return -1;  // Temp path too long
-    }
     
-    // Write to temporary file first (atomic write)
-    FILE *fp = fopen(tmp_path, "w");
-    if (!fp) {
+    // Encode in the binary format (meta_format.h)
+    char *image = NULL;
+    size_t image_len = 0;
+    if (meta_format_encode(metadata, &image, &image_len) != 0) {
         return -1;
     }
     
-    // Write metadata in key=value format
-    fprintf(fp, "owner=%s\n", metadata->owner);
-    fprintf(fp, "created=%ld\n", (long)metadata->created);
-    fprintf(fp, "last_modified=%ld\n", (long)metadata->last_modified);
-    fprintf(fp, "last_accessed=%ld\n", (long)metadata->last_accessed);
-    fprintf(fp, "size_bytes=%zu\n", metadata->size_bytes);
-    fprintf(fp, "word_count=%d\n", metadata->word_count);
-    fprintf(fp, "char_count=%d\n", metadata->char_count);
-    fprintf(fp, "sentence_count=%d\n", metadata->sentence_count);
-    fprintf(fp, "next_sentence_id=%d\n", metadata->next_sentence_id);
-    for (int i = 0; i < metadata->sentence_count && i < MAX_SENTENCE_METADATA; i++) {
-        const SentenceMeta *sm = &metadata->sentences[i];
-        fprintf(fp, "sentence_%d=%d,%d,%zu,%zu,%d,%d\n",
-                i,
-                sm->sentence_id,
-                sm->version,
-                sm->offset,
-                sm->length,
-                sm->word_count,
-                sm->char_count);
-    }
-    
-    // Write ACL (Step 4)
-    fprintf(fp, "ACL_START\n");
-    char acl_buf[4096];
-    if (acl_serialize(&metadata->acl, acl_buf, sizeof(acl_buf)) == 0) {
-        fprintf(fp, "%s", acl_buf);
-    }
-    fprintf(fp, "ACL_END\n");
-    
-    // Write pending access requests
-    fprintf(fp, "pending_request_count=%d\n", metadata->pending_request_count);
-    for (int i = 0; i < metadata->pending_request_count && i < MAX_PENDING_REQUESTS; i++) {
-        const PendingRequest *req = &metadata->pending_requests[i];
-        fprintf(fp, "pending_request_%d=%d,%s,%c,%ld\n",
-                i, req->request_id, req->requester, req->access_type, (long)req->timestamp);
-    }
-    
-    fclose(fp);
+    // Write to temporary file first (atomic write)
+    int rc = write_meta_temp(meta_path, image, image_len, tmp_path, sizeof(tmp_path));
+    free(image);
+    if (rc != 0) return -1;
     
     // Atomically rename temp file to final file
     // This ensures metadata is never corrupted if SS crashes
+    // The rename and the cache update happen under the file's lock so
+    // concurrent saves publish to disk and cache in the same order
+    meta_cache_lock(meta_path);
     if (rename(tmp_path, meta_path) != 0) {
+        meta_cache_unlock(meta_path);
         unlink(tmp_path);  // Clean up temp file
         return -1;
     }
+    meta_cache_put(meta_path, metadata);
+    meta_cache_unlock(meta_path);
     
     return 0;  // Success
 }
 
+int metadata_replace(const char *storage_dir, const char *filename,
+                     const char *image, size_t image_len) {
+    if (!storage_dir || !filename || (!image && image_len > 0)) return -1;
+    
+    char meta_dir[512];
+    snprintf(meta_dir, sizeof(meta_dir), "%s/metadata", storage_dir);
+    mkdir(meta_dir, 0755);      // A fresh replica may not have one yet
+    
+    char meta_path[512];
+    char tmp_path[560];
+    if (build_meta_path(storage_dir, filename, meta_path, sizeof(meta_path)) != 0) {
+        return -1;
+    }
+    if (write_meta_temp(meta_path, image, image_len, tmp_path, sizeof(tmp_path)) != 0) {
+        return -1;
+    }
+    // Readers map the .meta they open, so it is never rewritten in place
+    meta_cache_lock(meta_path);
+    if (rename(tmp_path, meta_path) != 0) {
+        meta_cache_unlock(meta_path);
+        unlink(tmp_path);
+        return -1;
+    }
+    meta_cache_invalidate(meta_path);
+    meta_cache_unlock(meta_path);
+    return 0;
+}
+
+void metadata_lock(const char *storage_dir, const char *filename) {
+    char meta_path[512];
+    if (!storage_dir || !filename) return;
+    if (build_meta_path(storage_dir, filename, meta_path, sizeof(meta_path)) == 0) {
+        meta_cache_lock(meta_path);
+    }
+}
+
+void metadata_unlock(const char *storage_dir, const char *filename) {
+    char meta_path[512];
+    if (!storage_dir || !filename) return;
+    if (build_meta_path(storage_dir, filename, meta_path, sizeof(meta_path)) == 0) {
+        meta_cache_unlock(meta_path);
+    }
+}
+
+void metadata_note_accessed(const char *storage_dir, const char *filename, time_t accessed) {
+    char meta_path[512];
+    if (!storage_dir || !filename) return;
+    if (build_meta_path(storage_dir, filename, meta_path, sizeof(meta_path)) == 0) {
+        meta_cache_note_accessed(meta_path, accessed);
+    }
+}
+
+void metadata_invalidate(const char *storage_dir, const char *filename) {
+    char meta_path[512];
+    if (!storage_dir || !filename) return;
+    if (build_meta_path(storage_dir, filename, meta_path, sizeof(meta_path)) == 0) {
+        meta_cache_invalidate(meta_path);
+    }
+}
+
 // Update last accessed timestamp
 int metadata_update_last_accessed(const char *storage_dir, const char *filename) {
     if (!storage_dir || !filename) return -1;
     
     FileMetadata meta;
+    metadata_lock(storage_dir, filename);
     if (metadata_load(storage_dir, filename, &meta) != 0) {
+        metadata_unlock(storage_dir, filename);
         return -1;  // Can't load metadata
     }
     
     meta.last_accessed = time(NULL);
-    return metadata_save(storage_dir, filename, &meta);
+    int result = metadata_save(storage_dir, filename, &meta);
+    metadata_unlock(storage_dir, filename);
+    return result;
 }
 
 // Update last modified timestamp
@@ -574,7 +599,9 @@ int metadata_update_last_modified(const char *storage_dir, const char *filename)
     if (!storage_dir || !filename) return -1;
     
     FileMetadata meta;
+    metadata_lock(storage_dir, filename);
     if (metadata_load(storage_dir, filename, &meta) != 0) {
+        metadata_unlock(storage_dir, filename);
         return -1;  // Can't load metadata
     }
     
@@ -588,7 +615,9 @@ int metadata_update_last_modified(const char *storage_dir, const char *filename)
         count_file_stats(content, &meta.word_count, &meta.char_count);
     }
     
-    return metadata_save(storage_dir, filename, &meta);
+    int result = metadata_save(storage_dir, filename, &meta);
+    metadata_unlock(storage_dir, filename);
+    return result;
 }
 
 // Count words and characters in file content
@@ -599,28 +628,12 @@ void count_file_stats(const char *content, int *word_count, int *char_count) {
         return;
     }
     
-    int words = 0;
-    int chars = 0;
-    int in_word = 0;
-    
-    // Count characters (including spaces)
-    for (const char *p = content; *p; p++) {
-        chars++;
-        
-        // Count words: a word is a sequence of non-space characters
-        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
-            in_word = 0;  // Not in a word
-        } else {
-            if (!in_word) {
-                words++;  // Start of a new word
-                in_word = 1;
-            }
-        }
-    }
+    size_t chars = strlen(content);
+    size_t words = text_scan_words(content, chars, NULL, NULL);
     
     // Set results
-    if (word_count) *word_count = words;
-    if (char_count) *char_count = chars;
+    if (word_count) *word_count = (int)words;
+    if (char_count) *char_count = (int)chars;
 }
 
 int metadata_ensure_sentences(const char *storage_dir, const char *filename, FileMetadata *metadata) {
@@ -641,57 +654,17 @@ int metadata_ensure_sentences(const char *storage_dir, const char *filename, Fil
     return metadata_save(storage_dir, filename, metadata);
 }
 
+// Undo steps live in the per-file journal (see undo_log.h)
 int undo_save_state(const char *storage_dir, const char *filename) {
-    if (!storage_dir || !filename) return -1;
-    char meta_src[512];
-    snprintf(meta_src, sizeof(meta_src), "%s/metadata/%s.meta", storage_dir, filename);
-    char file_src[512];
-    snprintf(file_src, sizeof(file_src), "%s/files/%s", storage_dir, filename);
-    char undo_meta[512];
-    char undo_data[512];
-    build_undo_paths(storage_dir, filename, undo_meta, sizeof(undo_meta),
-                     undo_data, sizeof(undo_data));
-    if (copy_file_atomic(meta_src, undo_meta) != 0) {
-        return -1;
-    }
-    if (copy_file_atomic(file_src, undo_data) != 0) {
-        unlink(undo_meta);
-        return -1;
-    }
-    return 0;
+    return undo_log_record_snapshot(storage_dir, filename);
 }
 
 int undo_exists(const char *storage_dir, const char *filename) {
-    if (!storage_dir || !filename) return 0;
-    char undo_meta[512];
-    char undo_data[512];
-    build_undo_paths(storage_dir, filename, undo_meta, sizeof(undo_meta),
-                     undo_data, sizeof(undo_data));
-    return (access(undo_meta, F_OK) == 0 && access(undo_data, F_OK) == 0);
+    return undo_log_exists(storage_dir, filename);
 }
 
 int undo_restore_state(const char *storage_dir, const char *filename) {
-    if (!storage_dir || !filename) return -1;
-    char undo_meta[512];
-    char undo_data[512];
-    build_undo_paths(storage_dir, filename, undo_meta, sizeof(undo_meta),
-                     undo_data, sizeof(undo_data));
-    if (access(undo_meta, F_OK) != 0 || access(undo_data, F_OK) != 0) {
-        return -1;
-    }
-    char meta_dst[512];
-    snprintf(meta_dst, sizeof(meta_dst), "%s/metadata/%s.meta", storage_dir, filename);
-    char file_dst[512];
-    snprintf(file_dst, sizeof(file_dst), "%s/files/%s", storage_dir, filename);
-    if (copy_file_atomic(undo_meta, meta_dst) != 0) {
-        return -1;
-    }
-    if (copy_file_atomic(undo_data, file_dst) != 0) {
-        return -1;
-    }
-    unlink(undo_meta);
-    unlink(undo_data);
-    return 0;
+    return undo_log_undo(storage_dir, filename) == 0 ? 0 : -1;
 }
 
 // ===== Folder Operations =====
@@ -808,6 +781,8 @@ int file_move(const char *storage_dir, const char *filename,
             rename(new_file_path, old_file_path);
             return -1;
         }
+        meta_cache_invalidate(old_meta_path);
+        meta_cache_invalidate(new_meta_path);
         
         // Save updated metadata with new folder path
         // Note: metadata_save expects filename with folder path
@@ -1053,7 +1028,9 @@ int checkpoint_restore(const char *storage_dir, const char *filename, const char
     }
     
     // Restore metadata
-    if (copy_file_atomic(src_meta, dst_meta) != 0) {
+    int meta_rc = copy_file_atomic(src_meta, dst_meta);
+    meta_cache_invalidate(dst_meta);
+    if (meta_rc != 0) {
         return -1;
     }
     
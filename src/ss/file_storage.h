@@ -98,6 +98,24 @@ int file_create(const char *storage_dir, const char *filename, const char *owner
 int file_read(const char *storage_dir, const char *filename, 
               char *content_buf, size_t buf_size, size_t *actual_size);
 
+// Open a stored file for streaming reads. READ, STREAM, GET_FILE and
+// GET_FILE_CONTENT send files FILE_STREAM_CHUNK bytes at a time from this
+// fd instead of loading them whole, so memory per reader is constant and
+// there is no size limit. Writers replace files by rename, so an open fd
+// keeps reading one consistent version.
+// size_out: Receives the file size at open time (can be NULL)
+// Returns: open fd (caller closes), or -1 if the file cannot be opened
+//
+// Usage:
+//   size_t size;
+//   int fd = file_open_read("./storage_ss1", "test.txt", &size);
+//   char chunk[FILE_STREAM_CHUNK];
+//   ssize_t n;
+//   while ((n = read(fd, chunk, sizeof(chunk))) > 0) { ... }
+//   close(fd);
+#define FILE_STREAM_CHUNK 65536
+int file_open_read(const char *storage_dir, const char *filename, size_t *size_out);
+
 // Read entire file content into an allocated buffer.
 // Caller must free(*out_buf).
 int file_read_all(const char *storage_dir, const char *filename,
@@ -108,6 +126,15 @@ int file_read_all(const char *storage_dir, const char *filename,
 int file_write_all(const char *storage_dir, const char *filename,
                    const char *content, size_t content_len);
 
+// Copy len bytes at in_off of in_fd to the current position of out_fd,
+// in the kernel (copy_file_range) where the filesystem allows it
+// Returns: 0 on success, -1 on error or if in_fd ends early
+int file_copy_range(int in_fd, size_t in_off, int out_fd, size_t len);
+
+// Write all of buf to fd, retrying short writes
+// Returns: 0 on success, -1 on error
+int file_write_fd(int fd, const void *buf, size_t len);
+
 // Delete a file and its metadata
 // storage_dir: Base storage directory
 // filename: Name of the file to delete
@@ -142,7 +169,8 @@ int file_exists(const char *storage_dir, const char *filename);
 // Returns: 0 on success, -1 on error (metadata file not found, parse error, etc.)
 //
 // This reads the metadata file (metadata/filename.meta) and parses it
-// into the FileMetadata structure.
+// into the FileMetadata structure. Legacy text .meta files are rewritten
+// in the binary format on first load.
 //
 // Usage:
 //   FileMetadata meta;
@@ -151,13 +179,33 @@ int file_exists(const char *storage_dir, const char *filename);
 //   }
 int metadata_load(const char *storage_dir, const char *filename, FileMetadata *metadata);
 
+// Sections of a FileMetadata that metadata_load_sections() can skip. The
+// scalar fields (owner, folder, timestamps, sizes, counts) and the ACL
+// owner are always loaded.
+#define META_SECTION_SENTENCES 0x1   // sentences[], sentence_count
+#define META_SECTION_ACL       0x2   // acl.entries[], acl.count
+#define META_SECTION_PENDING   0x4   // pending_requests[], pending_request_count
+#define META_SECTION_ALL       0x7
+
+// Load only some sections of a file's metadata; skipped sections read as
+// empty. Use it where a command needs, say, only the ACL: a cache miss then
+// reads just the header and that section of the .meta file.
+//
+// Usage:
+//   FileMetadata meta;
+//   if (metadata_load_sections("./storage_ss1", "test.txt", META_SECTION_ACL, &meta) == 0 &&
+//       acl_check_read(&meta.acl, "bob")) { ... }
+int metadata_load_sections(const char *storage_dir, const char *filename,
+                           unsigned sections, FileMetadata *metadata);
+
 // Save metadata to disk
 // storage_dir: Base storage directory
 // filename: Name of the file
 // metadata: Pointer to FileMetadata structure to save
 // Returns: 0 on success, -1 on error
 //
-// This writes the metadata to disk atomically:
+// This writes the metadata to disk atomically, in the binary format of
+// meta_format.h:
 // 1. Write to temporary file (metadata/filename.meta.tmp)
 // 2. Rename to final file (metadata/filename.meta)
 // This ensures metadata is never corrupted if SS crashes during write.
@@ -171,6 +219,36 @@ int metadata_load(const char *storage_dir, const char *filename, FileMetadata *m
 //   }
 int metadata_save(const char *storage_dir, const char *filename, const FileMetadata *metadata);
 
+// metadata_load()/metadata_save() go through the SS metadata cache
+// (meta_cache.h): loads of hot files never touch disk and saves write
+// through. Hold the file's metadata lock across a load-modify-save so
+// concurrent updates of one file are not lost. The lock is recursive;
+// never hold the locks of two files at once.
+//
+// Usage:
+//   metadata_lock("./storage_ss1", "test.txt");
+//   if (metadata_load("./storage_ss1", "test.txt", &meta) == 0) {
+//       acl_add_read(&meta.acl, "bob");
+//       metadata_save("./storage_ss1", "test.txt", &meta);
+//   }
+//   metadata_unlock("./storage_ss1", "test.txt");
+void metadata_lock(const char *storage_dir, const char *filename);
+void metadata_unlock(const char *storage_dir, const char *filename);
+
+// Drop the cached metadata of a file whose .meta was replaced without
+// metadata_save() (e.g. copied in by replication)
+void metadata_invalidate(const char *storage_dir, const char *filename);
+
+// Replace a file's .meta with an image copied from another SS (written to
+// a temp file and renamed in under the file's metadata lock)
+// Returns: 0 on success, -1 on failure (the old .meta is left in place)
+int metadata_replace(const char *storage_dir, const char *filename,
+                     const char *image, size_t image_len);
+
+// Raise the cached last_accessed of a file without writing it to disk
+// (see access_time.h, which flushes such updates in batches)
+void metadata_note_accessed(const char *storage_dir, const char *filename, time_t accessed);
+
 // Update last accessed timestamp in metadata
 // This is called whenever a file is read (for INFO command)
 // storage_dir: Base storage directory
@@ -200,7 +278,7 @@ int metadata_ensure_sentences(const char *storage_dir, const char *filename, Fil
 // word_count: Pointer to store word count (can be NULL)
 // char_count: Pointer to store character count (can be NULL)
 //
-// Word definition: sequence of ASCII characters without spaces
+// Word definition: sequence of characters without whitespace (see text_scan.h)
 // Character count: total number of characters (including spaces)
 //
 // Usage:
@@ -3,33 +3,67 @@
 // Phase 2: Now includes file scanning and storage management.
 #define _POSIX_C_SOURCE 200809L
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "../common/net.h"
 #include "../common/log.h"
 #include "../common/protocol.h"
+#include "../common/ss_pool.h"
+#include "access_time.h"
 #include "file_scan.h"
 #include "file_storage.h"
+#include "meta_cache.h"
+#include "merkle.h"
+#include "meta_format.h"
+#include "repl_delta.h"
+#include "text_scan.h"
+#include "undo_log.h"
 #include "write_session.h"
 #include "runtime_state.h"
 
 #define DEFAULT_WORKERS 8
-#define WORK_QUEUE_CAP 64
+#define SS_MAX_WORKERS 256
+#define SS_SESSION_BATCH 32      // Commands served per turn before yielding the worker
+#define SS_REACTOR_MAX_EVENTS 256
+#define SS_REACTOR_WAIT_MS 250   // Wake-up interval for shutdown and idle sweeps
 
+// One client/NM connection. While idle it is parked in the reactor's epoll
+// set (EPOLLONESHOT) and costs no thread; when a command arrives the reactor
+// marks it busy and queues it for a worker, which serves every command it
+// can read without blocking and then parks it again.
+typedef struct SsSession {
+    int fd;
+    int binary;              // Negotiated framing, kept across commands
+    int busy;                // Queued for or owned by a worker (guarded by sessions_mu)
+    unsigned long commands;
+    long long idle_since_ms; // When the session was last parked
+    NetReader *reader;       // Only attached while a worker owns the session
+    struct SsSession *ready_next;
+    struct SsSession *prev;  // All-sessions list (idle sweep, shutdown)
+    struct SsSession *next;
+} SsSession;
+
+// Sessions with a pending command, waiting for a worker
 typedef struct {
-    int fds[WORK_QUEUE_CAP];
-    int head;
-    int tail;
-    int count;
+    SsSession *head;
+    SsSession *tail;
+    int depth;
     pthread_mutex_t mu;
     pthread_cond_t not_empty;
-    pthread_cond_t not_full;
-} WorkQueue;
+} ReadyQueue;
 
 typedef struct {
     const char *nm_host;
@@ -42,8 +76,13 @@ typedef struct {
     int server_fd;      // Server socket listening on client_port (for commands from NM)
     int running;
     int worker_count;
-    pthread_t workers[DEFAULT_WORKERS];
-    WorkQueue queue;
+    pthread_t workers[SS_MAX_WORKERS];
+    ReadyQueue queue;
+    int epoll_fd;
+    SsSession *sessions;
+    int session_count;
+    unsigned long sessions_total;
+    pthread_mutex_t sessions_mu;
 } Ctx;
 
 // Ensure storage directory exists and has proper structure
@@ -78,130 +117,723 @@ static void encode_newlines(const char *src, char *dst, size_t dst_len) {
     dst[pos] = '\0';
 }
 
-static void work_queue_init(WorkQueue *q) {
+// Reply with an error to a bulk request. In binary mode the error replaces the
+// DATA...STOP stream, so it is sent as a frame.
+static void send_stream_error(int fd, int binary, const Message *req,
+                              const char *code, const char *msg) {
+    if (binary) {
+        proto_send_frame_error(fd, proto_frame_request_id(req->id), code, msg);
+        return;
+    }
+    char error_buf[MAX_LINE];
+    proto_format_error(req->id, req->username, "SS", code, msg,
+                       error_buf, sizeof(error_buf));
+    send_all(fd, error_buf, strlen(error_buf));
+}
+
+// Send content as DATA records without the closing STOP, so a file can be
+// streamed through in several calls.
+// Binary mode: raw PROTO_FRAME_CHUNK-sized frames, no escaping.
+// Text mode: ~1.8KB DATA lines with '\n' escaped as '\x01'.
+// Returns: 0 on success, -1 if the peer is gone
+static int send_bulk_data(int fd, int binary, const Message *req,
+                          const char *content, size_t len) {
+    if (binary) {
+        uint32_t rid = proto_frame_request_id(req->id);
+        size_t off = 0;
+        while (off < len) {
+            size_t chunk = len - off;
+            if (chunk > PROTO_FRAME_CHUNK) chunk = PROTO_FRAME_CHUNK;
+            if (proto_send_frame(fd, FRAME_DATA, rid, content + off, (uint32_t)chunk) != 0) {
+                return -1;
+            }
+            off += chunk;
+        }
+        return 0;
+    }
+
+    size_t off = 0;
+    while (off < len) {
+        Message data_msg = {0};
+        (void)snprintf(data_msg.type, sizeof(data_msg.type), "%s", "DATA");
+        (void)snprintf(data_msg.id, sizeof(data_msg.id), "%s", req->id);
+        (void)snprintf(data_msg.username, sizeof(data_msg.username), "%s", req->username);
+        (void)snprintf(data_msg.role, sizeof(data_msg.role), "%s", "SS");
+
+        size_t payload_pos = 0;
+        size_t payload_max = sizeof(data_msg.payload) - 1;
+        while (off < len && payload_pos < payload_max) {
+            char c = content[off++];
+            data_msg.payload[payload_pos++] = (c == '\n') ? '\x01' : c;
+        }
+        data_msg.payload[payload_pos] = '\0';
+
+        char data_buf[MAX_LINE];
+        if (proto_format_line(&data_msg, data_buf, sizeof(data_buf)) == 0 &&
+            send_all(fd, data_buf, strlen(data_buf)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Terminate a DATA stream with STOP
+static void send_bulk_stop(int fd, int binary, const Message *req) {
+    if (binary) {
+        proto_send_frame(fd, FRAME_STOP, proto_frame_request_id(req->id), NULL, 0);
+        return;
+    }
+    Message stop_msg = {0};
+    (void)snprintf(stop_msg.type, sizeof(stop_msg.type), "%s", "STOP");
+    (void)snprintf(stop_msg.id, sizeof(stop_msg.id), "%s", req->id);
+    (void)snprintf(stop_msg.username, sizeof(stop_msg.username), "%s", req->username);
+    (void)snprintf(stop_msg.role, sizeof(stop_msg.role), "%s", "SS");
+    stop_msg.payload[0] = '\0';
+
+    char stop_buf[MAX_LINE];
+    if (proto_format_line(&stop_msg, stop_buf, sizeof(stop_buf)) == 0) {
+        send_all(fd, stop_buf, strlen(stop_buf));
+    }
+}
+
+// Send in-memory content as a DATA...STOP stream
+static void send_bulk_content(int fd, int binary, const Message *req,
+                              const char *content, size_t len) {
+    if (send_bulk_data(fd, binary, req, content, len) == 0) {
+        send_bulk_stop(fd, binary, req);
+    }
+}
+
+// Read binary DATA frames until STOP, appending to *buf (grown as needed,
+// with room left for a terminator)
+// Returns: 0 once STOP arrives, -1 on an ERROR or unknown frame, a read
+//          failure (the stream ended before STOP) or allocation failure
+static int recv_bulk_frames(NetReader *reader, char **buf, size_t *len, size_t *capacity) {
+    while (1) {
+        FrameHeader hdr;
+        if (proto_reader_frame_header(reader, &hdr) != 0) return -1;
+        if (hdr.type == FRAME_STOP) return 0;
+        if (hdr.type != FRAME_DATA) return -1;
+        if (*len + hdr.payload_len + 1 > *capacity) {
+            size_t new_capacity = *capacity;
+            while (*len + hdr.payload_len + 1 > new_capacity) new_capacity *= 2;
+            char *grown = realloc(*buf, new_capacity);
+            if (!grown) return -1;
+            *buf = grown;
+            *capacity = new_capacity;
+        }
+        if (net_reader_read(reader, *buf + *len, hdr.payload_len) != 0) return -1;
+        *len += hdr.payload_len;
+    }
+}
+
+// Send one STREAM word as a DATA line, then pause 0.1s
+// Returns: 0 on success, -1 if the client is gone
+static int send_stream_word(int fd, const Message *req, const char *word) {
+    Message data_msg = {0};
+    (void)snprintf(data_msg.type, sizeof(data_msg.type), "%s", "DATA");
+    (void)snprintf(data_msg.id, sizeof(data_msg.id), "%s", req->id);
+    (void)snprintf(data_msg.username, sizeof(data_msg.username), "%s", req->username);
+    (void)snprintf(data_msg.role, sizeof(data_msg.role), "%s", "SS");
+    (void)snprintf(data_msg.payload, sizeof(data_msg.payload), "%s", word);
+
+    char data_buf[MAX_LINE];
+    if (proto_format_line(&data_msg, data_buf, sizeof(data_buf)) == 0 &&
+        send_all(fd, data_buf, strlen(data_buf)) != 0) {
+        return -1;
+    }
+
+    // Delay 0.1 seconds using nanosleep
+    struct timespec delay = {0, 100000000};  // 0.1 seconds = 100000000 nanoseconds
+    nanosleep(&delay, NULL);
+    return 0;
+}
+
+// Stream an open file of file_size bytes as DATA...STOP with memory use
+// independent of the file size. Binary mode hands the payloads to
+// sendfile(2), so file bytes go from the page cache to the socket without
+// entering userspace. Text mode has to escape newlines, so it copies
+// FILE_STREAM_CHUNK bytes at a time through a heap buffer. A read error
+// after data has gone out ends the stream with an error instead of STOP, so
+// the receiver never mistakes a truncated file for a complete one.
+// Returns: bytes sent, or -1 if the stream did not complete
+static long long send_file_stream(int sock, int binary, const Message *req,
+                                  int file_fd, size_t file_size) {
+    if (binary) {
+        if (proto_send_file_frames(sock, proto_frame_request_id(req->id), file_fd, file_size) != 0) {
+            return -1;
+        }
+        send_bulk_stop(sock, binary, req);
+        return (long long)file_size;
+    }
+
+    char *chunk = (char*)malloc(FILE_STREAM_CHUNK);
+    if (!chunk) {
+        send_stream_error(sock, binary, req, "INTERNAL", "Memory allocation failed");
+        return -1;
+    }
+    long long total = 0;
+    for (;;) {
+        ssize_t n = read(file_fd, chunk, FILE_STREAM_CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            free(chunk);
+            send_stream_error(sock, binary, req, "INTERNAL", "Failed to read file content");
+            return -1;
+        }
+        if (n == 0) break;
+        if (send_bulk_data(sock, binary, req, chunk, (size_t)n) != 0) {
+            free(chunk);
+            return -1;
+        }
+        total += n;
+    }
+    free(chunk);
+    send_bulk_stop(sock, binary, req);
+    return total;
+}
+
+// Read a metadata file ("metadata/<file>.meta") whole for GET_FILE_CONTENT
+// or a push to a replica. Text DATA lines cannot carry the binary metadata
+// format, so text-mode peers get the legacy text form, which every SS still
+// loads.
+// Returns: 0 with a heap buffer in *content_out, -1 with *code/*msg set
+static int load_meta_for_transfer(const char *storage_dir, const char *path, int binary,
+                                  char **content_out, size_t *size_out,
+                                  const char **code, const char **msg) {
+    char meta_path[2048];
+    snprintf(meta_path, sizeof(meta_path), "%s/%s", storage_dir, path);
+    
+    FILE *fp = fopen(meta_path, "r");
+    if (!fp) {
+        *code = "NOT_FOUND";
+        *msg = "Metadata file not found";
+        return -1;
+    }
+    
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *content = size >= 0 ? (char*)malloc(size + 1) : NULL;
+    if (!content) {
+        fclose(fp);
+        *code = "INTERNAL";
+        *msg = "Memory allocation failed";
+        return -1;
+    }
+    size_t content_size = fread(content, 1, size, fp);
+    content[content_size] = '\0';
+    fclose(fp);
+    
+    if (!binary && meta_format_is_binary(content, content_size)) {
+        FileMetadata meta;
+        char *text = NULL;
+        size_t text_len = 0;
+        if (meta_format_decode(content, content_size, META_SECTION_ALL, &meta) != 0 ||
+            meta_format_render_text(&meta, &text, &text_len) != 0) {
+            free(content);
+            *code = "INTERNAL";
+            *msg = "Failed to encode metadata";
+            return -1;
+        }
+        free(content);
+        content = text;
+        content_size = text_len;
+    }
+    *content_out = content;
+    *size_out = content_size;
+    return 0;
+}
+
+// Send the replica the file's recent commits as a PUT_FILE_DELTA
+// (repl_delta.h) over a binary connection: the newest commit, then, if
+// the replica is further behind, the file's recent history
+// Returns: bytes sent if the replica applied them, 0 to fall back to a full
+//          copy on the same connection (no history, or the replica's copy
+//          matched no base state), -1 if the connection is no longer usable
+//          (e.g. a replica that does not know PUT_FILE_DELTA)
+static long long push_delta(Ctx *ctx, const Message *req, const char *filename, int fd) {
+    long long total = 0;
+    int max_steps = 1;
+    while (1) {
+        char *image = NULL;
+        size_t image_len = 0;
+        int steps = 0;
+        if (repl_delta_build(ctx->storage_dir, filename, max_steps,
+                             &image, &image_len, &steps) != 0) {
+            return 0;
+        }
+        
+        Message put = {0};
+        (void)snprintf(put.type, sizeof(put.type), "%s", "PUT_FILE_DELTA");
+        (void)snprintf(put.id, sizeof(put.id), "%s", req->id);
+        (void)snprintf(put.username, sizeof(put.username), "%s", ctx->username);
+        (void)snprintf(put.role, sizeof(put.role), "%s", "SS");
+        (void)snprintf(put.payload, sizeof(put.payload), "%s", filename);
+        char line[MAX_LINE];
+        proto_format_line(&put, line, sizeof(line));
+        int sent = send_all(fd, line, strlen(line)) == 0 &&
+                   send_bulk_data(fd, 1, &put, image, image_len) == 0;
+        free(image);
+        if (sent) send_bulk_stop(fd, 1, &put);
+        Message reply;
+        if (!sent || recv_line(fd, line, sizeof(line)) <= 0 || proto_parse_line(line, &reply) != 0) {
+            return -1;
+        }
+        total += (long long)image_len;
+        if (strcmp(reply.type, "ACK") == 0) return total;
+        char code[32], err[256];
+        if (proto_parse_error(&reply, code, sizeof(code), err, sizeof(err)) != 0 ||
+            strcmp(code, "CONFLICT") != 0) {
+            return -1;
+        }
+        // Nothing older to offer
+        if (steps < max_steps || max_steps == REPL_DELTA_MAX_STEPS) return 0;
+        max_steps = REPL_DELTA_MAX_STEPS;
+    }
+}
+
+// Push a file and its .meta to the SS at host:port as PUT_FILE_CONTENT
+// (REPLICATE_TO from the NM). A binary replica is first offered the
+// file's recent commits as a delta (push_delta); otherwise the file is
+// streamed straight from disk (sendfile(2) frames when the replica speaks
+// binary), the .meta follows on the same pooled connection and both
+// replies are read at the end. The .meta is best effort, as it was when
+// the NM relayed files.
+// delta_out: Set to 1 if the replica took a delta
+// Returns: bytes pushed (delta, or file + .meta), or -1 with *code/*msg set
+static long long push_to_replica(Ctx *ctx, const Message *req, const char *filename,
+                                 const char *host, int port, int *delta_out,
+                                 const char **code, const char **msg) {
+    *delta_out = 0;
+    int binary = 0;
+    int fd = ss_pool_acquire_binary(host, port, &binary);
+    if (fd >= 0 && binary) {
+        long long delta = push_delta(ctx, req, filename, fd);
+        if (delta > 0) {
+            ss_pool_release(fd, 1);
+            *delta_out = 1;
+            return delta;
+        }
+        if (delta < 0) {
+            ss_pool_release(fd, 0);
+            fd = ss_pool_acquire_binary(host, port, &binary);
+        }
+    }
+    if (fd < 0) {
+        *code = "UNAVAILABLE";
+        *msg = "Replica unreachable";
+        return -1;
+    }
+    size_t file_size = 0;
+    int file_fd = file_open_read(ctx->storage_dir, filename, &file_size);
+    if (file_fd < 0) {
+        ss_pool_release(fd, 1);
+        *code = "NOT_FOUND";
+        *msg = "File not found or read error";
+        return -1;
+    }
+    
+    Message put = {0};
+    (void)snprintf(put.type, sizeof(put.type), "%s", "PUT_FILE_CONTENT");
+    (void)snprintf(put.id, sizeof(put.id), "%s", req->id);
+    (void)snprintf(put.username, sizeof(put.username), "%s", ctx->username);
+    (void)snprintf(put.role, sizeof(put.role), "%s", "SS");
+    (void)snprintf(put.payload, sizeof(put.payload), "%s", filename);
+    char line[MAX_LINE];
+    proto_format_line(&put, line, sizeof(line));
+    long long sent = -1;
+    if (send_all(fd, line, strlen(line)) == 0) {
+        sent = send_file_stream(fd, binary, &put, file_fd, file_size);
+    }
+    close(file_fd);
+    if (sent < 0) {
+        ss_pool_release(fd, 0);
+        *code = "UNAVAILABLE";
+        *msg = "Failed to send file to replica";
+        return -1;
+    }
+    
+    int pending = 1;
+    char *meta = NULL;
+    size_t meta_size = 0;
+    const char *meta_code = NULL, *meta_msg = NULL;
+    (void)snprintf(put.id, sizeof(put.id), "%.48s_meta", req->id);
+    (void)snprintf(put.payload, sizeof(put.payload), "metadata/%s.meta", filename);
+    if (load_meta_for_transfer(ctx->storage_dir, put.payload, binary, &meta, &meta_size,
+                               &meta_code, &meta_msg) == 0) {
+        proto_format_line(&put, line, sizeof(line));
+        if (send_all(fd, line, strlen(line)) == 0) {
+            send_bulk_content(fd, binary, &put, meta, meta_size);
+            sent += (long long)meta_size;
+            pending++;
+        }
+        free(meta);
+    }
+    
+    // The file's reply decides the outcome; the .meta's is only drained
+    int answered = 0;
+    int acked = 0;
+    for (; answered < pending; answered++) {
+        if (recv_line(fd, line, sizeof(line)) <= 0) break;
+        Message reply;
+        if (answered == 0 && proto_parse_line(line, &reply) == 0) {
+            acked = strcmp(reply.type, "ACK") == 0;
+        }
+    }
+    ss_pool_release(fd, answered == pending);
+    if (!acked) {
+        *code = "UNAVAILABLE";
+        *msg = "Replica did not accept the file";
+        return -1;
+    }
+    return sent;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void ready_queue_init(ReadyQueue *q) {
     memset(q, 0, sizeof(*q));
     pthread_mutex_init(&q->mu, NULL);
     pthread_cond_init(&q->not_empty, NULL);
-    pthread_cond_init(&q->not_full, NULL);
 }
 
-static void work_queue_destroy(WorkQueue *q) {
+static void ready_queue_destroy(ReadyQueue *q) {
     pthread_mutex_destroy(&q->mu);
     pthread_cond_destroy(&q->not_empty);
-    pthread_cond_destroy(&q->not_full);
 }
 
-static int work_queue_push(Ctx *ctx, int fd) {
-    WorkQueue *q = &ctx->queue;
+static void ready_queue_push(Ctx *ctx, SsSession *s) {
+    ReadyQueue *q = &ctx->queue;
     pthread_mutex_lock(&q->mu);
-    while (q->count >= WORK_QUEUE_CAP && ctx->running) {
-        pthread_cond_wait(&q->not_full, &q->mu);
-    }
-    if (!ctx->running) {
-        pthread_mutex_unlock(&q->mu);
-        return -1;
+    s->ready_next = NULL;
+    if (q->tail) {
+        q->tail->ready_next = s;
+    } else {
+        q->head = s;
     }
-    q->fds[q->tail] = fd;
-    q->tail = (q->tail + 1) % WORK_QUEUE_CAP;
-    q->count++;
+    q->tail = s;
+    q->depth++;
     pthread_cond_signal(&q->not_empty);
     pthread_mutex_unlock(&q->mu);
-    return 0;
 }
 
-static int work_queue_pop(Ctx *ctx) {
-    WorkQueue *q = &ctx->queue;
+// Returns NULL once the server is stopping
+static SsSession *ready_queue_pop(Ctx *ctx) {
+    ReadyQueue *q = &ctx->queue;
     pthread_mutex_lock(&q->mu);
-    while (q->count == 0) {
-        if (!ctx->running) {
-            pthread_mutex_unlock(&q->mu);
-            return -1;
-        }
+    while (ctx->running && q->head == NULL) {
         pthread_cond_wait(&q->not_empty, &q->mu);
     }
-    int fd = q->fds[q->head];
-    q->head = (q->head + 1) % WORK_QUEUE_CAP;
-    q->count--;
-    pthread_cond_signal(&q->not_full);
+    SsSession *s = NULL;
+    if (ctx->running && q->head) {
+        s = q->head;
+        q->head = s->ready_next;
+        if (!q->head) q->tail = NULL;
+        q->depth--;
+    }
     pthread_mutex_unlock(&q->mu);
-    return fd;
+    return s;
+}
+
+// Unlink, deregister and free a session (caller holds sessions_mu)
+static void session_close_locked(Ctx *ctx, SsSession *s) {
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        ctx->sessions = s->next;
+    }
+    if (s->next) s->next->prev = s->prev;
+    ctx->session_count--;
+    if (s->commands > 1) {
+        log_info("ss_session_end", "fd=%d commands=%lu", s->fd, s->commands);
+    }
+    free(s->reader);
+    free(s);
+}
+
+static void session_close(Ctx *ctx, SsSession *s) {
+    pthread_mutex_lock(&ctx->sessions_mu);
+    session_close_locked(ctx, s);
+    pthread_mutex_unlock(&ctx->sessions_mu);
 }
 
-static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg);
+// Hand an idle session back to the reactor. The reader is dropped (nothing
+// is buffered at this point), so a parked session is just a few words.
+static void session_park(Ctx *ctx, SsSession *s) {
+    free(s->reader);
+    s->reader = NULL;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = s;
+    pthread_mutex_lock(&ctx->sessions_mu);
+    s->busy = 0;
+    s->idle_since_ms = now_ms();
+    if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_MOD, s->fd, &ev) != 0) {
+        session_close_locked(ctx, s);
+    }
+    pthread_mutex_unlock(&ctx->sessions_mu);
+}
+
+// True if a command can be read without blocking
+static int session_has_input(const SsSession *s) {
+    if (net_reader_buffered(s->reader) > 0) return 1;
+    struct pollfd pfd = {.fd = s->fd, .events = POLLIN};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+static int handle_command(Ctx *ctx, int client_fd, NetReader *reader, Message cmd_msg, int binary);
+
+// Serve the commands a session has pending. Commands run back to back in
+// arrival order (pipelined requests included) until no more input is
+// waiting; after SS_SESSION_BATCH commands the session goes to the back of
+// the ready queue so one busy peer cannot starve the others. An optional
+// HELLO between commands negotiates binary framing for bulk transfers.
+static void session_serve(Ctx *ctx, SsSession *s) {
+    if (!s->reader) {
+        // Worker stacks are default-sized, so the reader's ring buffer lives on the heap
+        s->reader = (NetReader*)malloc(sizeof(NetReader));
+        if (!s->reader) {
+            session_close(ctx, s);
+            return;
+        }
+        net_reader_init(s->reader, s->fd);
+    }
 
-static void process_connection(Ctx *ctx, int client_fd) {
     char cmd_line[MAX_LINE];
-    int n = recv_line(client_fd, cmd_line, sizeof(cmd_line));
-    if (n <= 0) {
-        close(client_fd);
-        return;
+    int served = 0;
+    while (ctx->running && served < SS_SESSION_BATCH && session_has_input(s)) {
+        int n = net_reader_line(s->reader, cmd_line, sizeof(cmd_line));
+        if (n <= 0) {
+            session_close(ctx, s);
+            return;
+        }
+        Message cmd_msg;
+        if (proto_parse_line(cmd_line, &cmd_msg) != 0) {
+            log_error("ss_parse_error", "failed to parse command");
+            session_close(ctx, s);
+            return;
+        }
+
+        if (strcmp(cmd_msg.type, PROTO_HELLO) == 0) {
+            s->binary = (strcmp(cmd_msg.payload, PROTO_MODE_BINARY) == 0);
+            Message ack = {0};
+            (void)snprintf(ack.type, sizeof(ack.type), "%s", "ACK");
+            (void)snprintf(ack.id, sizeof(ack.id), "%s", cmd_msg.id);
+            (void)snprintf(ack.username, sizeof(ack.username), "%s", cmd_msg.username);
+            (void)snprintf(ack.role, sizeof(ack.role), "%s", "SS");
+            (void)snprintf(ack.payload, sizeof(ack.payload), "%s",
+                           s->binary ? PROTO_MODE_BINARY : PROTO_MODE_TEXT);
+            char ack_line[MAX_LINE];
+            proto_format_line(&ack, ack_line, sizeof(ack_line));
+            if (send_all(s->fd, ack_line, strlen(ack_line)) != 0) {
+                session_close(ctx, s);
+                return;
+            }
+            continue;
+        }
+
+        served++;
+        s->commands++;
+        if (handle_command(ctx, s->fd, s->reader, cmd_msg, s->binary) != 0) {
+            session_close(ctx, s);
+            return;
+        }
     }
-    Message cmd_msg;
-    if (proto_parse_line(cmd_line, &cmd_msg) != 0) {
-        log_error("ss_parse_error", "failed to parse command");
-        close(client_fd);
-        return;
+
+    if (!ctx->running) {
+        session_close(ctx, s);
+    } else if (net_reader_buffered(s->reader) > 0) {
+        // Pipelined commands already read off the socket; epoll won't report them
+        ready_queue_push(ctx, s);
+    } else {
+        session_park(ctx, s);
     }
-    handle_command(ctx, client_fd, cmd_msg);
 }
 
 static void *worker_thread(void *arg) {
     Ctx *ctx = (Ctx*)arg;
     while (ctx->running) {
-        int fd = work_queue_pop(ctx);
-        if (fd < 0) break;
-        process_connection(ctx, fd);
+        SsSession *s = ready_queue_pop(ctx);
+        if (!s) break;
+        session_serve(ctx, s);
     }
     return NULL;
 }
 
+static void accept_sessions(Ctx *ctx) {
+    while (1) {
+        int fd = accept(ctx->server_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_error("ss_accept", "accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        // Accepted sockets stay blocking: handlers use send_all()/NetReader
+        // directly, and epoll is only used to wait for the next command.
+        // Replies to pipelined commands go out as separate small writes, so
+        // Nagle would hold each one back until the previous was ACKed.
+        int one = 1;
+        (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        SsSession *s = (SsSession*)calloc(1, sizeof(SsSession));
+        if (!s) {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = s;
+        pthread_mutex_lock(&ctx->sessions_mu);
+        s->idle_since_ms = now_ms();
+        s->next = ctx->sessions;
+        if (ctx->sessions) ctx->sessions->prev = s;
+        ctx->sessions = s;
+        ctx->session_count++;
+        ctx->sessions_total++;
+        if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            log_error("ss_accept", "epoll_ctl add failed: %s", strerror(errno));
+            session_close_locked(ctx, s);
+        }
+        pthread_mutex_unlock(&ctx->sessions_mu);
+    }
+}
+
+// Close parked sessions that have been idle for PROTO_SESSION_IDLE_MS
+static void sweep_idle_sessions(Ctx *ctx) {
+    long long now = now_ms();
+    pthread_mutex_lock(&ctx->sessions_mu);
+    SsSession *s = ctx->sessions;
+    while (s) {
+        SsSession *next = s->next;
+        if (!s->busy && now - s->idle_since_ms >= PROTO_SESSION_IDLE_MS) {
+            session_close_locked(ctx, s);
+        }
+        s = next;
+    }
+    pthread_mutex_unlock(&ctx->sessions_mu);
+}
+
+// Reactor: accepts connections and waits on every idle session with one
+// epoll set, so thousands of open sessions need only worker_count threads.
 static void *cmd_thread(void *arg) {
     Ctx *ctx = (Ctx*)arg;
-    work_queue_init(&ctx->queue);
-    ctx->worker_count = DEFAULT_WORKERS;
-    for (int i = 0; i < ctx->worker_count; i++) {
-        pthread_create(&ctx->workers[i], NULL, worker_thread, ctx);
+    ready_queue_init(&ctx->queue);
+    pthread_mutex_init(&ctx->sessions_mu, NULL);
+    long fd_limit = net_raise_fd_limit();
+    if (fd_limit > 0) {
+        log_info("ss_fd_limit", "raised fd limit to %ld", fd_limit);
     }
 
     int server_fd = create_server_socket(ctx->host, ctx->client_port);
-    if (server_fd < 0) {
+    ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event lev;
+    memset(&lev, 0, sizeof(lev));
+    lev.events = EPOLLIN;
+    lev.data.ptr = NULL;  // NULL marks the listening socket
+    if (server_fd < 0 || ctx->epoll_fd < 0 ||
+        fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL, 0) | O_NONBLOCK) != 0 ||
+        epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, server_fd, &lev) != 0) {
         log_error("ss_server_socket", "failed to create server socket on %s:%d", ctx->host, ctx->client_port);
+        if (server_fd >= 0) close(server_fd);
+        if (ctx->epoll_fd >= 0) close(ctx->epoll_fd);
         ctx->running = 0;
-        pthread_cond_broadcast(&ctx->queue.not_empty);
-        pthread_cond_broadcast(&ctx->queue.not_full);
-        work_queue_destroy(&ctx->queue);
+        ready_queue_destroy(&ctx->queue);
         return NULL;
     }
     ctx->server_fd = server_fd;
-    log_info("ss_listen", "listening on %s:%d for commands", ctx->host, ctx->client_port);
 
+    for (int i = 0; i < ctx->worker_count; i++) {
+        pthread_create(&ctx->workers[i], NULL, worker_thread, ctx);
+    }
+    log_info("ss_listen", "listening on %s:%d for commands (%d workers)",
+             ctx->host, ctx->client_port, ctx->worker_count);
+
+    struct epoll_event events[SS_REACTOR_MAX_EVENTS];
+    long long last_sweep = now_ms();
     while (ctx->running) {
-        struct sockaddr_in addr;
-        socklen_t addr_len = sizeof(addr);
-        int client_fd = accept(server_fd, (struct sockaddr*)&addr, &addr_len);
-        if (client_fd < 0) {
-            if (ctx->running) continue;
+        int n = epoll_wait(ctx->epoll_fd, events, SS_REACTOR_MAX_EVENTS, SS_REACTOR_WAIT_MS);
+        if (n < 0 && errno != EINTR) {
+            log_error("ss_reactor_wait", "epoll_wait failed: %s", strerror(errno));
             break;
         }
-        if (work_queue_push(ctx, client_fd) != 0) {
-            close(client_fd);
-            break;
+        for (int i = 0; i < n; i++) {
+            SsSession *s = (SsSession*)events[i].data.ptr;
+            if (!s) {
+                accept_sessions(ctx);
+                continue;
+            }
+            // Hangups and errors are discovered by the worker's read
+            pthread_mutex_lock(&ctx->sessions_mu);
+            s->busy = 1;
+            pthread_mutex_unlock(&ctx->sessions_mu);
+            ready_queue_push(ctx, s);
+        }
+        long long now = now_ms();
+        if (now - last_sweep >= 1000) {
+            sweep_idle_sessions(ctx);
+            last_sweep = now;
         }
     }
 
-    close(server_fd);
     pthread_mutex_lock(&ctx->queue.mu);
     ctx->running = 0;
     pthread_cond_broadcast(&ctx->queue.not_empty);
-    pthread_cond_broadcast(&ctx->queue.not_full);
     pthread_mutex_unlock(&ctx->queue.mu);
     for (int i = 0; i < ctx->worker_count; i++) {
         pthread_join(ctx->workers[i], NULL);
     }
-    work_queue_destroy(&ctx->queue);
+    // Workers are gone, so every remaining session is ours to close
+    pthread_mutex_lock(&ctx->sessions_mu);
+    while (ctx->sessions) {
+        session_close_locked(ctx, ctx->sessions);
+    }
+    log_info("ss_reactor_stop", "sessions_total=%lu", ctx->sessions_total);
+    pthread_mutex_unlock(&ctx->sessions_mu);
+    close(ctx->epoll_fd);
+    ready_queue_destroy(&ctx->queue);
     return NULL;
 }
 
+#define STORAGE_STATS_BEATS 12  // Log cache and access-time stats every ~60s
+
+static volatile sig_atomic_t g_stop = 0;
+static void on_signal(int sig) { (void)sig; g_stop = 1; }
+
+static void log_storage_stats(void) {
+    MetaCacheStats st;
+    meta_cache_get_stats(&st);
+    unsigned long lookups = st.hits + st.misses;
+    log_info("ss_meta_cache_stats",
+             "hits=%lu misses=%lu hit_rate=%.1f%% fills=%lu evictions=%lu invalidations=%lu "
+             "entries=%zu capacity=%zu bytes=%zu byte_budget=%zu",
+             st.hits, st.misses, lookups ? 100.0 * st.hits / lookups : 0.0,
+             st.fills, st.evictions, st.invalidations,
+             st.entries, st.capacity, st.bytes, st.byte_budget);
+
+    AtimeStats at;
+    access_time_get_stats(&at);
+    log_info("ss_atime_stats", "recorded=%lu skipped=%lu written=%lu flushes=%lu pending=%zu",
+             at.recorded, at.skipped, at.written, at.flushes, at.pending);
+
+    WriteCommitStats wc;
+    write_session_get_commit_stats(&wc);
+    log_info("ss_commit_stats", "commits=%lu groups=%lu largest_group=%zu",
+             wc.commits, wc.groups, wc.largest_group);
+}
+
 // Periodic heartbeat sender to NM.
 static void *hb_thread(void *arg) {
     Ctx *ctx = (Ctx*)arg;
@@ -218,13 +850,20 @@ static void *hb_thread(void *arg) {
             log_error("ss_hb_send", "lost nm connection");
             break;
         }
+        if (seq % STORAGE_STATS_BEATS == 0) log_storage_stats();
         sleep(5);
     }
     return NULL;
 }
 
-// Command handler logic for a single connection
-static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
+// Command handler logic for one command of a session. Every response ends
+// with a self-delimiting ACK/ERROR line or STOP, so the peer never has to
+// wait for EOF and may send the next command on the same connection.
+// reader: buffered reader owning all further reads from client_fd
+// binary: connection negotiated binary framing (see protocol.h)
+// Returns 0 to keep the session open, -1 if the stream is out of sync
+// (peer gone or request body only partly consumed) and must be closed.
+static int handle_command(Ctx *ctx, int client_fd, NetReader *reader, Message cmd_msg, int binary) {
         
         // Handle CREATE command
         if (strcmp(cmd_msg.type, "CREATE") == 0) {
@@ -257,8 +896,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                 send_all(client_fd, error_buf, strlen(error_buf));
                 log_error("ss_create_failed", "file=%s", filename);
             }
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle DELETE command
         else if (strcmp(cmd_msg.type, "DELETE") == 0) {
@@ -272,9 +910,8 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "CONFLICT", "File is locked for writing",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_delete_locked", "file=%s", filename);
-                return;
+                return 0;
             }
             
             // Delete file
@@ -301,7 +938,6 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                 send_all(client_fd, error_buf, strlen(error_buf));
                 log_error("ss_delete_failed", "file=%s", filename);
             }
-            close(client_fd);
         }
         // Handle CREATE_FOLDER command
         else if (strcmp(cmd_msg.type, "CREATE_FOLDER") == 0) {
@@ -333,7 +969,6 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                 send_all(client_fd, error_buf, strlen(error_buf));
                 log_error("ss_create_folder_failed", "folder=%s", folder_path);
             }
-            close(client_fd);
         }
         // Handle MOVE command
         else if (strcmp(cmd_msg.type, "MOVE") == 0) {
@@ -392,7 +1027,6 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                 send_all(client_fd, error_buf, strlen(error_buf));
                 log_error("ss_move_failed", "file=%s", filename);
             }
-            close(client_fd);
         }
         // Handle READ command (from client)
         else if (strcmp(cmd_msg.type, "READ") == 0) {
@@ -403,108 +1037,46 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             // Check if file exists
             if (!file_exists(ctx->storage_dir, filename)) {
-                char error_buf[MAX_LINE];
-                proto_format_error(cmd_msg.id, username, "SS",
-                                  "NOT_FOUND", "File not found",
-                                  error_buf, sizeof(error_buf));
-                send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
+                send_stream_error(client_fd, binary, &cmd_msg, "NOT_FOUND", "File not found");
                 log_error("ss_read_failed", "file=%s reason=not_found", filename);
-                return;
+                return 0;
             }
             
             // Load metadata to check read access
             FileMetadata meta;
-            if (metadata_load(ctx->storage_dir, filename, &meta) != 0) {
-                char error_buf[MAX_LINE];
-                proto_format_error(cmd_msg.id, username, "SS",
-                                  "INTERNAL", "Failed to load file metadata",
-                                  error_buf, sizeof(error_buf));
-                send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
+            if (metadata_load_sections(ctx->storage_dir, filename, META_SECTION_ACL, &meta) != 0) {
+                send_stream_error(client_fd, binary, &cmd_msg, "INTERNAL", "Failed to load file metadata");
                 log_error("ss_read_failed", "file=%s reason=metadata_load_failed", filename);
-                return;
+                return 0;
             }
             
             // Check read access using ACL
             if (!acl_check_read(&meta.acl, username)) {
-                char error_buf[MAX_LINE];
-                proto_format_error(cmd_msg.id, username, "SS",
-                                  "UNAUTHORIZED", "User does not have read access",
-                                  error_buf, sizeof(error_buf));
-                send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
+                send_stream_error(client_fd, binary, &cmd_msg, "UNAUTHORIZED", "User does not have read access");
                 log_error("ss_read_failed", "file=%s user=%s reason=unauthorized", filename, username);
-                return;
+                return 0;
             }
             
-            // Read file content
-            char content[65536];  // Max 64KB for now
-            size_t actual_size = 0;
-            if (file_read(ctx->storage_dir, filename, content, sizeof(content), &actual_size) != 0) {
-                char error_buf[MAX_LINE];
-                proto_format_error(cmd_msg.id, username, "SS",
-                                  "INTERNAL", "Failed to read file content",
-                                  error_buf, sizeof(error_buf));
-                send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
+            // Stream file content followed by STOP
+            size_t file_size = 0;
+            int file_fd = file_open_read(ctx->storage_dir, filename, &file_size);
+            if (file_fd < 0) {
+                send_stream_error(client_fd, binary, &cmd_msg, "INTERNAL", "Failed to read file content");
                 log_error("ss_read_failed", "file=%s reason=read_failed", filename);
-                return;
-            }
-            
-            // Send file content
-            // Replace newlines with \x01 (SOH) to avoid breaking line-based protocol
-            // Client will convert back to \n
-            // Send in chunks to handle large files
-            size_t content_pos = 0;
-            size_t content_len = actual_size;
-            
-            while (content_pos < content_len) {
-                Message data_msg = {0};
-                (void)snprintf(data_msg.type, sizeof(data_msg.type), "%s", "DATA");
-                (void)snprintf(data_msg.id, sizeof(data_msg.id), "%s", cmd_msg.id);
-                (void)snprintf(data_msg.username, sizeof(data_msg.username), "%s", username);
-                (void)snprintf(data_msg.role, sizeof(data_msg.role), "%s", "SS");
-                
-                // Copy chunk, replacing \n with \x01
-                size_t payload_pos = 0;
-                size_t payload_max = sizeof(data_msg.payload) - 1;
-                
-                while (content_pos < content_len && payload_pos < payload_max) {
-                    if (content[content_pos] == '\n') {
-                        data_msg.payload[payload_pos++] = '\x01';
-                    } else {
-                        data_msg.payload[payload_pos++] = content[content_pos];
-                    }
-                    content_pos++;
-                }
-                data_msg.payload[payload_pos] = '\0';
-                
-                char data_buf[MAX_LINE];
-                if (proto_format_line(&data_msg, data_buf, sizeof(data_buf)) == 0) {
-                    send_all(client_fd, data_buf, strlen(data_buf));
-                }
+                return 0;
             }
-            
-            // Send STOP packet
-            Message stop_msg = {0};
-            (void)snprintf(stop_msg.type, sizeof(stop_msg.type), "%s", "STOP");
-            (void)snprintf(stop_msg.id, sizeof(stop_msg.id), "%s", cmd_msg.id);
-            (void)snprintf(stop_msg.username, sizeof(stop_msg.username), "%s", username);
-            (void)snprintf(stop_msg.role, sizeof(stop_msg.role), "%s", "SS");
-            stop_msg.payload[0] = '\0';
-            
-            char stop_buf[MAX_LINE];
-            if (proto_format_line(&stop_msg, stop_buf, sizeof(stop_buf)) == 0) {
-                send_all(client_fd, stop_buf, strlen(stop_buf));
+            long long sent = send_file_stream(client_fd, binary, &cmd_msg, file_fd, file_size);
+            close(file_fd);
+            if (sent < 0) {
+                log_error("ss_read_failed", "file=%s reason=stream_failed", filename);
+                return -1;
             }
             
             // Update last accessed timestamp
-            metadata_update_last_accessed(ctx->storage_dir, filename);
+            access_time_record(filename);
             
-            log_info("ss_file_read", "file=%s user=%s size=%zu", filename, username, actual_size);
-            close(client_fd);
-            return;
+            log_info("ss_file_read", "file=%s user=%s size=%lld binary=%d", filename, username, sent, binary);
+            return 0;
         }
         // Handle STREAM command (from client)
         else if (strcmp(cmd_msg.type, "STREAM") == 0) {
@@ -520,22 +1092,20 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                   "NOT_FOUND", "File not found",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_stream_failed", "file=%s reason=not_found", filename);
-                return;
+                return 0;
             }
             
             // Load metadata to check read access
             FileMetadata meta;
-            if (metadata_load(ctx->storage_dir, filename, &meta) != 0) {
+            if (metadata_load_sections(ctx->storage_dir, filename, META_SECTION_ACL, &meta) != 0) {
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, username, "SS",
                                   "INTERNAL", "Failed to load file metadata",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_stream_failed", "file=%s reason=metadata_load_failed", filename);
-                return;
+                return 0;
             }
             
             // Check read access using ACL
@@ -545,78 +1115,70 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                   "UNAUTHORIZED", "User does not have read access",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_stream_failed", "file=%s user=%s reason=unauthorized", filename, username);
-                return;
+                return 0;
             }
             
-            // Read file content
-            char content[65536];  // Max 64KB for now
-            size_t actual_size = 0;
-            if (file_read(ctx->storage_dir, filename, content, sizeof(content), &actual_size) != 0) {
+            int file_fd = file_open_read(ctx->storage_dir, filename, NULL);
+            if (file_fd < 0) {
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, username, "SS",
                                   "INTERNAL", "Failed to read file content",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_stream_failed", "file=%s reason=read_failed", filename);
-                return;
+                return 0;
             }
-            
-            // Parse content into words (split by spaces)
-            // Send each word with 0.1s delay
-            char *word_start = content;
-            char *word_end;
-            int word_count = 0;
-            
-            // Skip leading whitespace
-            while (*word_start == ' ' || *word_start == '\t' || *word_start == '\n' || *word_start == '\r') {
-                word_start++;
+            char *content = (char*)malloc(FILE_STREAM_CHUNK);
+            if (!content) {
+                close(file_fd);
+                char error_buf[MAX_LINE];
+                proto_format_error(cmd_msg.id, username, "SS",
+                                  "INTERNAL", "Memory allocation failed",
+                                  error_buf, sizeof(error_buf));
+                send_all(client_fd, error_buf, strlen(error_buf));
+                return 0;
             }
             
-            while (*word_start != '\0') {
-                // Find end of word (space, tab, newline, or null)
-                word_end = word_start;
-                while (*word_end != '\0' && *word_end != ' ' && *word_end != '\t' && 
-                       *word_end != '\n' && *word_end != '\r') {
-                    word_end++;
-                }
-                
-                if (word_end > word_start) {
-                    // Extract word
-                    size_t word_len = word_end - word_start;
-                    char word[256] = {0};
-                    size_t copy_len = (word_len < sizeof(word) - 1) ? word_len : sizeof(word) - 1;
-                    memcpy(word, word_start, copy_len);
-                    word[copy_len] = '\0';
-                    
-                    // Send word as DATA packet
-                    Message data_msg = {0};
-                    (void)snprintf(data_msg.type, sizeof(data_msg.type), "%s", "DATA");
-                    (void)snprintf(data_msg.id, sizeof(data_msg.id), "%s", cmd_msg.id);
-                    (void)snprintf(data_msg.username, sizeof(data_msg.username), "%s", username);
-                    (void)snprintf(data_msg.role, sizeof(data_msg.role), "%s", "SS");
-                    (void)snprintf(data_msg.payload, sizeof(data_msg.payload), "%s", word);
-                    
-                    char data_buf[MAX_LINE];
-                    if (proto_format_line(&data_msg, data_buf, sizeof(data_buf)) == 0) {
-                        send_all(client_fd, data_buf, strlen(data_buf));
+            // Read the file chunk by chunk and split it into words (by spaces,
+            // tabs and newlines); a word cut by a chunk boundary is carried
+            // over in word[]. Each word is sent with a 0.1s delay.
+            char word[256] = {0};
+            size_t word_len = 0;
+            int word_count = 0;
+            int send_failed = 0;
+            ssize_t n;
+            
+            while (!send_failed &&
+                   ((n = read(file_fd, content, FILE_STREAM_CHUNK)) > 0 || (n < 0 && errno == EINTR))) {
+                for (ssize_t i = 0; i < n; i++) {
+                    char c = content[i];
+                    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                        if (word_len < sizeof(word) - 1) word[word_len] = c;
+                        word_len++;
+                        continue;
+                    }
+                    if (word_len == 0) continue;
+                    word[word_len < sizeof(word) - 1 ? word_len : sizeof(word) - 1] = '\0';
+                    word_len = 0;
+                    if (send_stream_word(client_fd, &cmd_msg, word) != 0) {
+                        send_failed = 1;
+                        break;
                     }
-                    
                     word_count++;
-                    
-                    // Delay 0.1 seconds using nanosleep
-                    struct timespec delay = {0, 100000000};  // 0.1 seconds = 100000000 nanoseconds
-                    nanosleep(&delay, NULL);
-                }
-                
-                // Move to next word (skip whitespace)
-                word_start = word_end;
-                while (*word_start == ' ' || *word_start == '\t' || *word_start == '\n' || *word_start == '\r') {
-                    word_start++;
                 }
             }
+            if (!send_failed && word_len > 0) {
+                word[word_len < sizeof(word) - 1 ? word_len : sizeof(word) - 1] = '\0';
+                if (send_stream_word(client_fd, &cmd_msg, word) != 0) send_failed = 1;
+                else word_count++;
+            }
+            free(content);
+            close(file_fd);
+            if (send_failed) {
+                log_error("ss_stream_failed", "file=%s reason=client_gone words=%d", filename, word_count);
+                return -1;
+            }
             
             // Send STOP packet
             Message stop_msg = {0};
@@ -632,62 +1194,23 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             }
             
             // Update last accessed timestamp
-            metadata_update_last_accessed(ctx->storage_dir, filename);
+            access_time_record(filename);
             
             log_info("ss_file_streamed", "file=%s user=%s words=%d", filename, username, word_count);
-            close(client_fd);
-            return;
+            return 0;
         }
         else if (strcmp(cmd_msg.type, "GET_FILE") == 0) {
             const char *filename = cmd_msg.payload;
 
-            char content[65536];
-            size_t actual_size = 0;
-            if (file_read(ctx->storage_dir, filename, content, sizeof(content), &actual_size) != 0) {
-                char error_buf[MAX_LINE];
-                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
-                                   "NOT_FOUND", "File not found",
-                                   error_buf, sizeof(error_buf));
-                send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
-            }
-
-            size_t content_pos = 0;
-            while (content_pos < actual_size) {
-                Message data_msg = {0};
-                (void)snprintf(data_msg.type, sizeof(data_msg.type), "%s", "DATA");
-                (void)snprintf(data_msg.id, sizeof(data_msg.id), "%s", cmd_msg.id);
-                (void)snprintf(data_msg.username, sizeof(data_msg.username), "%s", cmd_msg.username);
-                (void)snprintf(data_msg.role, sizeof(data_msg.role), "%s", "SS");
-
-                size_t payload_pos = 0;
-                size_t payload_max = sizeof(data_msg.payload) - 1;
-                while (content_pos < actual_size && payload_pos < payload_max) {
-                    char c = content[content_pos++];
-                    data_msg.payload[payload_pos++] = (c == '\n') ? '\x01' : c;
-                }
-                data_msg.payload[payload_pos] = '\0';
-
-                char data_buf[MAX_LINE];
-                if (proto_format_line(&data_msg, data_buf, sizeof(data_buf)) == 0) {
-                    send_all(client_fd, data_buf, strlen(data_buf));
-                }
-            }
-
-            Message stop_msg = {0};
-            (void)snprintf(stop_msg.type, sizeof(stop_msg.type), "%s", "STOP");
-            (void)snprintf(stop_msg.id, sizeof(stop_msg.id), "%s", cmd_msg.id);
-            (void)snprintf(stop_msg.username, sizeof(stop_msg.username), "%s", cmd_msg.username);
-            (void)snprintf(stop_msg.role, sizeof(stop_msg.role), "%s", "SS");
-            stop_msg.payload[0] = '\0';
-
-            char stop_buf[MAX_LINE];
-            if (proto_format_line(&stop_msg, stop_buf, sizeof(stop_buf)) == 0) {
-                send_all(client_fd, stop_buf, strlen(stop_buf));
-            }
-            close(client_fd);
-            return;
+            size_t file_size = 0;
+            int file_fd = file_open_read(ctx->storage_dir, filename, &file_size);
+            if (file_fd < 0) {
+                send_stream_error(client_fd, binary, &cmd_msg, "NOT_FOUND", "File not found");
+                return 0;
+            }
+            long long sent = send_file_stream(client_fd, binary, &cmd_msg, file_fd, file_size);
+            close(file_fd);
+            return sent < 0 ? -1 : 0;
         }
         // Handle WRITE command
         else if (strcmp(cmd_msg.type, "WRITE") == 0) {
@@ -722,8 +1245,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "NOT_FOUND", "File not found",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             if (!acl_check_write(&meta.acl, cmd_msg.username)) {
                 char error_buf[MAX_LINE];
@@ -731,8 +1253,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "UNAUTHORIZED", "User does not have write access",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
 
             WriteSession session;
@@ -746,8 +1267,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INVALID", err_buf,
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
 
             Message ready = {0};
@@ -768,11 +1288,11 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             int write_active = 1;
             while (write_active && ctx->running) {
                 char write_line[MAX_LINE];
-                int rn = recv_line(client_fd, write_line, sizeof(write_line));
+                int rn = net_reader_line(reader, write_line, sizeof(write_line));
                 if (rn <= 0) {
                     log_error("ss_write_disconnect", "user=%s file=%s", cmd_msg.username, filename);
                     write_session_abort(&session);
-                    break;
+                    return -1;
                 }
                 Message write_cmd;
                 if (proto_parse_line(write_line, &write_cmd) != 0) {
@@ -877,8 +1397,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                     send_all(client_fd, error_buf, strlen(error_buf));
                 }
             }
-            close(client_fd);
-            return;
+            return 0;
         }
         else if (strcmp(cmd_msg.type, "UNDO") == 0) {
             const char *filename = cmd_msg.payload;
@@ -892,29 +1411,29 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "NO_UNDO", "No undo information available",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
 
             FileMetadata current_meta;
+            metadata_lock(ctx->storage_dir, filename);
             if (metadata_load(ctx->storage_dir, filename, &current_meta) != 0) {
+                metadata_unlock(ctx->storage_dir, filename);
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
                                    "NOT_FOUND", "File not found",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
 
             if (undo_restore_state(ctx->storage_dir, filename) != 0) {
+                metadata_unlock(ctx->storage_dir, filename);
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
                                    "INTERNAL", "Failed to restore undo state",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
 
             FileMetadata restored_meta;
@@ -922,6 +1441,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                 restored_meta.acl = current_meta.acl;
                 metadata_save(ctx->storage_dir, filename, &restored_meta);
             }
+            metadata_unlock(ctx->storage_dir, filename);
 
             Message ack = {0};
             (void)snprintf(ack.type, sizeof(ack.type), "%s", "ACK");
@@ -934,8 +1454,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             proto_format_line(&ack, ack_line, sizeof(ack_line));
             send_all(client_fd, ack_line, strlen(ack_line));
             log_info("ss_undo_restored", "file=%s", filename);
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle CHECKPOINT command
         else if (strcmp(cmd_msg.type, "CHECKPOINT") == 0) {
@@ -952,8 +1471,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INVALID", "Invalid checkpoint payload format",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             size_t filename_len = sep - cmd_msg.payload;
@@ -973,8 +1491,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "NOT_FOUND", "File not found",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Create checkpoint
@@ -984,8 +1501,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "CHECKPOINT_FAILED", "Failed to create checkpoint (tag may exist or limit reached)",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Send success
@@ -1000,8 +1516,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             proto_format_line(&ack, ack_line, sizeof(ack_line));
             send_all(client_fd, ack_line, strlen(ack_line));
             log_info("ss_checkpoint_created", "file=%s tag=%s", filename, tag);
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle VIEWCHECKPOINT command
         else if (strcmp(cmd_msg.type, "VIEWCHECKPOINT") == 0) {
@@ -1018,8 +1533,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INVALID", "Invalid payload format",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             size_t filename_len = sep - cmd_msg.payload;
@@ -1039,8 +1553,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "NOT_FOUND", "Checkpoint not found",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Get checkpoint content
@@ -1053,8 +1566,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INTERNAL", "Failed to read checkpoint",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Send checkpoint content using DATA messages (same as READ)
@@ -1104,8 +1616,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             log_info("ss_viewcheckpoint_success", "file=%s tag=%s size=%zu", 
                     filename, tag, actual_size);
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle REVERT command
         else if (strcmp(cmd_msg.type, "REVERT") == 0) {
@@ -1122,8 +1633,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INVALID", "Invalid payload format",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             size_t filename_len = sep - cmd_msg.payload;
@@ -1143,8 +1653,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "NOT_FOUND", "Checkpoint not found",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Save current state as undo before reverting
@@ -1154,8 +1663,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INTERNAL", "Failed to save undo state",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Restore checkpoint
@@ -1165,8 +1673,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INTERNAL", "Failed to restore checkpoint",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Send success
@@ -1181,8 +1688,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             proto_format_line(&ack, ack_line, sizeof(ack_line));
             send_all(client_fd, ack_line, strlen(ack_line));
             log_info("ss_revert_success", "file=%s tag=%s", filename, tag);
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle LISTCHECKPOINTS command
         else if (strcmp(cmd_msg.type, "LISTCHECKPOINTS") == 0) {
@@ -1198,8 +1704,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "NOT_FOUND", "File not found",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Get checkpoint list
@@ -1211,8 +1716,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INTERNAL", "Failed to list checkpoints",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             log_info("ss_listcheckpoints_loaded", "count=%d", count);
@@ -1299,8 +1803,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             proto_format_line(&ack, ack_line, sizeof(ack_line));
             send_all(client_fd, ack_line, strlen(ack_line));
             log_info("ss_listcheckpoints_success", "file=%s count=%d", filename, count);
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle UPDATE_ACL command (from NM)
         else if (strcmp(cmd_msg.type, "UPDATE_ACL") == 0) {
@@ -1383,15 +1886,16 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             // Load metadata
             FileMetadata meta;
+            metadata_lock(ctx->storage_dir, filename);
             if (metadata_load(ctx->storage_dir, filename, &meta) != 0) {
+                metadata_unlock(ctx->storage_dir, filename);
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
                                   "NOT_FOUND", "File not found",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_update_acl_failed", "file=%s reason=not_found", filename);
-                return;
+                return 0;
             }
             
             // Update ACL based on action
@@ -1406,15 +1910,16 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             }
             
             // Save updated metadata
-            if (metadata_save(ctx->storage_dir, filename, &meta) != 0) {
+            int save_rc = metadata_save(ctx->storage_dir, filename, &meta);
+            metadata_unlock(ctx->storage_dir, filename);
+            if (save_rc != 0) {
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
                                   "INTERNAL", "Failed to save metadata",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_update_acl_failed", "file=%s reason=save_failed", filename);
-                return;
+                return 0;
             }
             
             // Send ACK
@@ -1430,8 +1935,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             send_all(client_fd, ack_line, strlen(ack_line));
             
             log_info("ss_acl_updated", "file=%s action=%s target=%s", filename, action, target_user);
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle GET_ACL command (from NM)
         else if (strcmp(cmd_msg.type, "GET_ACL") == 0) {
@@ -1440,15 +1944,14 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             log_info("ss_cmd_get_acl", "file=%s requester=%s", filename, cmd_msg.username);
 
             FileMetadata meta;
-            if (metadata_load(ctx->storage_dir, filename, &meta) != 0) {
+            if (metadata_load_sections(ctx->storage_dir, filename, META_SECTION_ACL, &meta) != 0) {
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
                                    "NOT_FOUND", "File not found",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_get_acl_failed", "file=%s reason=not_found", filename);
-                return;
+                return 0;
             }
 
             char acl_buf[4096];
@@ -1458,9 +1961,8 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                    "INTERNAL", "Failed to serialize ACL",
                                    error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
                 log_error("ss_get_acl_failed", "file=%s reason=serialize_failed", filename);
-                return;
+                return 0;
             }
 
             // Replace newlines with \x01
@@ -1484,11 +1986,16 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             char acl_line[MAX_LINE];
             if (proto_format_line(&acl_msg, acl_line, sizeof(acl_line)) == 0) {
                 send_all(client_fd, acl_line, strlen(acl_line));
+            } else {
+                // The session stays open, so the peer needs an answer either way
+                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                   "INTERNAL", "ACL too large",
+                                   acl_line, sizeof(acl_line));
+                send_all(client_fd, acl_line, strlen(acl_line));
             }
 
             log_info("ss_acl_sent", "file=%s requester=%s", filename, cmd_msg.username);
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle GETMETA command (get file metadata)
         else if (strcmp(cmd_msg.type, "GETMETA") == 0) {
@@ -1496,9 +2003,9 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             log_info("ss_cmd_getmeta", "file=%s", filename);
             
-            // Load metadata from disk
+            // Header fields only; no section is needed
             FileMetadata meta;
-            if (metadata_load(ctx->storage_dir, filename, &meta) == 0) {
+            if (metadata_load_sections(ctx->storage_dir, filename, 0, &meta) == 0) {
                 // Send metadata in DATA response
                 Message data_resp = {0};
                 (void)snprintf(data_resp.type, sizeof(data_resp.type), "%s", "DATA");
@@ -1553,14 +2060,15 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             // Load metadata
             FileMetadata meta;
+            metadata_lock(ctx->storage_dir, filename);
             if (metadata_load(ctx->storage_dir, filename, &meta) != 0) {
+                metadata_unlock(ctx->storage_dir, filename);
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
                                   "NOT_FOUND", "File not found",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Add request to metadata
@@ -1576,7 +2084,9 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                 meta.pending_request_count++;
                 
                 // Save metadata
-                if (metadata_save(ctx->storage_dir, filename, &meta) == 0) {
+                int save_rc = metadata_save(ctx->storage_dir, filename, &meta);
+                metadata_unlock(ctx->storage_dir, filename);
+                if (save_rc == 0) {
                     Message ack = {0};
                     snprintf(ack.type, sizeof(ack.type), "ACK");
                     snprintf(ack.id, sizeof(ack.id), "%s", cmd_msg.id);
@@ -1595,14 +2105,14 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                     send_all(client_fd, error_buf, strlen(error_buf));
                 }
             } else {
+                metadata_unlock(ctx->storage_dir, filename);
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
                                   "LIMIT", "Too many pending requests",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
             }
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle REMOVE_REQUEST command (from NM)
         else if (strcmp(cmd_msg.type, "REMOVE_REQUEST") == 0) {
@@ -1624,14 +2134,15 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             // Load metadata
             FileMetadata meta;
+            metadata_lock(ctx->storage_dir, filename);
             if (metadata_load(ctx->storage_dir, filename, &meta) != 0) {
+                metadata_unlock(ctx->storage_dir, filename);
                 char error_buf[MAX_LINE];
                 proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
                                   "NOT_FOUND", "File not found",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return 0;
             }
             
             // Find and remove request
@@ -1650,7 +2161,9 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             if (found) {
                 // Save metadata
-                if (metadata_save(ctx->storage_dir, filename, &meta) == 0) {
+                int save_rc = metadata_save(ctx->storage_dir, filename, &meta);
+                metadata_unlock(ctx->storage_dir, filename);
+                if (save_rc == 0) {
                     Message ack = {0};
                     snprintf(ack.type, sizeof(ack.type), "ACK");
                     snprintf(ack.id, sizeof(ack.id), "%s", cmd_msg.id);
@@ -1669,6 +2182,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                     send_all(client_fd, error_buf, strlen(error_buf));
                 }
             } else {
+                metadata_unlock(ctx->storage_dir, filename);
                 Message ack = {0};
                 snprintf(ack.type, sizeof(ack.type), "ACK");
                 snprintf(ack.id, sizeof(ack.id), "%s", cmd_msg.id);
@@ -1679,8 +2193,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                 proto_format_line(&ack, ack_line, sizeof(ack_line));
                 send_all(client_fd, ack_line, strlen(ack_line));
             }
-            close(client_fd);
-            return;
+            return 0;
         }
         // Handle GET_FILE_CONTENT command (for NM to fetch file for replication)
         else if (strcmp(cmd_msg.type, "GET_FILE_CONTENT") == 0) {
@@ -1688,59 +2201,38 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             log_info("ss_cmd_get_file_content", "file=%s requestor=%s", filename, cmd_msg.username);
             
-            // Read entire file content
-            // Special handling for metadata files - construct path directly
-            char *content = NULL;
-            size_t content_size = 0;
-            
-            if (strncmp(filename, "metadata/", 9) == 0) {
-                // Metadata file - read directly from metadata directory
-                char meta_path[2048];
-                snprintf(meta_path, sizeof(meta_path), "%s/%s", ctx->storage_dir, filename);
-                
-                FILE *fp = fopen(meta_path, "r");
-                if (!fp) {
-                    char error_buf[MAX_LINE];
-                    proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
-                                      "NOT_FOUND", "Metadata file not found",
-                                      error_buf, sizeof(error_buf));
-                    send_all(client_fd, error_buf, strlen(error_buf));
-                    close(client_fd);
-                    return;
+            // Regular files are streamed in chunks straight from disk
+            if (strncmp(filename, "metadata/", 9) != 0) {
+                size_t file_size = 0;
+                int file_fd = file_open_read(ctx->storage_dir, filename, &file_size);
+                if (file_fd < 0) {
+                    send_stream_error(client_fd, binary, &cmd_msg, "NOT_FOUND", "File not found or read error");
+                    return 0;
                 }
-                
-                fseek(fp, 0, SEEK_END);
-                long size = ftell(fp);
-                fseek(fp, 0, SEEK_SET);
-                content = (char*)malloc(size + 1);
-                if (!content) {
-                    fclose(fp);
-                    char error_buf[MAX_LINE];
-                    proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
-                                      "INTERNAL", "Memory allocation failed",
-                                      error_buf, sizeof(error_buf));
-                    send_all(client_fd, error_buf, strlen(error_buf));
-                    close(client_fd);
-                    return;
-                }
-                content_size = fread(content, 1, size, fp);
-                content[content_size] = '\0';
-                fclose(fp);
-            } else {
-                // Regular file - use file_read_all
-                if (file_read_all(ctx->storage_dir, filename, &content, &content_size) != 0) {
-                    char error_buf[MAX_LINE];
-                    proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
-                                      "NOT_FOUND", "File not found or read error",
-                                      error_buf, sizeof(error_buf));
-                    send_all(client_fd, error_buf, strlen(error_buf));
-                    close(client_fd);
-                    return;
+                long long sent = send_file_stream(client_fd, binary, &cmd_msg, file_fd, file_size);
+                close(file_fd);
+                if (sent < 0) {
+                    log_error("ss_get_file_content_failed", "file=%s reason=stream_failed", filename);
+                    return -1;
                 }
+                log_info("ss_get_file_content_success", "file=%s size=%lld", filename, sent);
+                return 0;
             }
             
-            // For metadata files, send ACK with size first
-            if (strncmp(filename, "metadata/", 9) == 0) {
+            // Metadata files are small; read them whole so the text-mode ACK
+            // can announce the size up front
+            char *content = NULL;
+            size_t content_size = 0;
+            const char *err_code = NULL, *err_msg = NULL;
+            if (load_meta_for_transfer(ctx->storage_dir, filename, binary, &content, &content_size,
+                                       &err_code, &err_msg) != 0) {
+                send_stream_error(client_fd, binary, &cmd_msg, err_code, err_msg);
+                return 0;
+            }
+            
+            // Send ACK with size first (text mode only; binary frames
+            // already carry their length)
+            if (!binary) {
                 Message ack_msg = {0};
                 snprintf(ack_msg.type, sizeof(ack_msg.type), "ACK");
                 snprintf(ack_msg.id, sizeof(ack_msg.id), "%s", cmd_msg.id);
@@ -1753,53 +2245,196 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                 send_all(client_fd, ack_buf, strlen(ack_buf));
             }
             
-            // Send content in chunks using DATA messages
-            size_t offset = 0;
-            while (offset < content_size) {
-                Message data_msg = {0};
-                snprintf(data_msg.type, sizeof(data_msg.type), "DATA");
-                snprintf(data_msg.id, sizeof(data_msg.id), "%s", cmd_msg.id);
-                snprintf(data_msg.username, sizeof(data_msg.username), "%s", cmd_msg.username);
-                snprintf(data_msg.role, sizeof(data_msg.role), "SS");
-                
-                // Copy chunk, replacing \n with \x01
-                size_t payload_pos = 0;
-                size_t payload_max = sizeof(data_msg.payload) - 1;
-                
-                while (offset < content_size && payload_pos < payload_max) {
-                    if (content[offset] == '\n') {
-                        data_msg.payload[payload_pos++] = '\x01';
-                    } else {
-                        data_msg.payload[payload_pos++] = content[offset];
-                    }
-                    offset++;
-                }
-                data_msg.payload[payload_pos] = '\0';
-                
-                char data_buf[MAX_LINE];
-                if (proto_format_line(&data_msg, data_buf, sizeof(data_buf)) == 0) {
-                    send_all(client_fd, data_buf, strlen(data_buf));
-                }
+            // Send content followed by STOP
+            send_bulk_content(client_fd, binary, &cmd_msg, content, content_size);
+            free(content);
+            
+            log_info("ss_get_file_content_success", "file=%s size=%zu", filename, content_size);
+            return 0;
+        }
+        // Handle MERKLE_NODE command (NM compares namespace hash trees)
+        else if (strcmp(cmd_msg.type, "MERKLE_NODE") == 0) {
+            // Payload format: "level|index"; ACK payload is the node's
+            // MERKLE_FANOUT child hashes, comma-separated hex
+            int level = atoi(cmd_msg.payload);
+            const char *sep = strchr(cmd_msg.payload, '|');
+            uint64_t children[MERKLE_FANOUT];
+            if (!sep || merkle_children(level, atoi(sep + 1), children) != 0) {
+                char error_buf[MAX_LINE];
+                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                  "INVALID", "Expected level|index of an inner node",
+                                  error_buf, sizeof(error_buf));
+                send_all(client_fd, error_buf, strlen(error_buf));
+                return 0;
             }
             
-            free(content);
+            Message ack = {0};
+            snprintf(ack.type, sizeof(ack.type), "ACK");
+            snprintf(ack.id, sizeof(ack.id), "%s", cmd_msg.id);
+            snprintf(ack.username, sizeof(ack.username), "%s", cmd_msg.username);
+            snprintf(ack.role, sizeof(ack.role), "SS");
+            size_t pos = 0;
+            for (int i = 0; i < MERKLE_FANOUT; i++) {
+                pos += (size_t)snprintf(ack.payload + pos, sizeof(ack.payload) - pos, "%s%016llx",
+                                        i ? "," : "", (unsigned long long)children[i]);
+            }
             
-            // Send STOP packet
-            Message stop_msg = {0};
-            snprintf(stop_msg.type, sizeof(stop_msg.type), "STOP");
-            snprintf(stop_msg.id, sizeof(stop_msg.id), "%s", cmd_msg.id);
-            snprintf(stop_msg.username, sizeof(stop_msg.username), "%s", cmd_msg.username);
-            snprintf(stop_msg.role, sizeof(stop_msg.role), "SS");
-            stop_msg.payload[0] = '\0';
+            char ack_line[MAX_LINE];
+            proto_format_line(&ack, ack_line, sizeof(ack_line));
+            send_all(client_fd, ack_line, strlen(ack_line));
+            return 0;
+        }
+        // Handle MERKLE_LEAF command (files and content hashes in one leaf)
+        else if (strcmp(cmd_msg.type, "MERKLE_LEAF") == 0) {
+            // Payload format: "leaf"; one "DATA|..|hash|filename" line per
+            // file, then STOP
+            MerkleFile *files = NULL;
+            int leaf = atoi(cmd_msg.payload);
+            int count = merkle_leaf(leaf, &files);
+            if (count < 0) {
+                int in_range = leaf >= 0 && leaf < MERKLE_LEAVES;
+                char error_buf[MAX_LINE];
+                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                  in_range ? "INTERNAL" : "INVALID",
+                                  in_range ? "Memory allocation failed" : "Leaf out of range",
+                                  error_buf, sizeof(error_buf));
+                send_all(client_fd, error_buf, strlen(error_buf));
+                return 0;
+            }
             
-            char stop_buf[MAX_LINE];
-            if (proto_format_line(&stop_msg, stop_buf, sizeof(stop_buf)) == 0) {
-                send_all(client_fd, stop_buf, strlen(stop_buf));
+            Message data = {0};
+            snprintf(data.type, sizeof(data.type), "DATA");
+            snprintf(data.id, sizeof(data.id), "%s", cmd_msg.id);
+            snprintf(data.username, sizeof(data.username), "%s", cmd_msg.username);
+            snprintf(data.role, sizeof(data.role), "SS");
+            char line[MAX_LINE];
+            for (int i = 0; i < count; i++) {
+                snprintf(data.payload, sizeof(data.payload), "%016llx|%s",
+                         (unsigned long long)files[i].hash, files[i].filename);
+                proto_format_line(&data, line, sizeof(line));
+                if (send_all(client_fd, line, strlen(line)) != 0) break;
+            }
+            free(files);
+            snprintf(data.type, sizeof(data.type), "STOP");
+            data.payload[0] = '\0';
+            proto_format_line(&data, line, sizeof(line));
+            send_all(client_fd, line, strlen(line));
+            return 0;
+        }
+        // Handle REPLICATE_TO command (NM asks the primary to push a file to a replica)
+        else if (strcmp(cmd_msg.type, "REPLICATE_TO") == 0) {
+            // Payload format: "filename|replica_host|replica_port"
+            char filename[1024];
+            char host[64];
+            int port = 0;
+            const char *sep = strchr(cmd_msg.payload, '|');
+            const char *port_sep = sep ? strchr(sep + 1, '|') : NULL;
+            size_t name_len = sep ? (size_t)(sep - cmd_msg.payload) : 0;
+            size_t host_len = port_sep ? (size_t)(port_sep - sep - 1) : 0;
+            if (port_sep) port = atoi(port_sep + 1);
+            if (name_len == 0 || name_len >= sizeof(filename) ||
+                host_len == 0 || host_len >= sizeof(host) || port <= 0) {
+                char error_buf[MAX_LINE];
+                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                  "INVALID", "Expected filename|host|port",
+                                  error_buf, sizeof(error_buf));
+                send_all(client_fd, error_buf, strlen(error_buf));
+                return 0;
+            }
+            memcpy(filename, cmd_msg.payload, name_len);
+            filename[name_len] = '\0';
+            memcpy(host, sep + 1, host_len);
+            host[host_len] = '\0';
+            
+            log_info("ss_cmd_replicate_to", "file=%s replica=%s:%d requestor=%s",
+                     filename, host, port, cmd_msg.username);
+            
+            const char *err_code = NULL, *err_msg = NULL;
+            int delta = 0;
+            long long sent = push_to_replica(ctx, &cmd_msg, filename, host, port, &delta,
+                                             &err_code, &err_msg);
+            if (sent < 0) {
+                log_error("ss_replicate_to_failed", "file=%s replica=%s:%d reason=%s",
+                          filename, host, port, err_msg);
+                char error_buf[MAX_LINE];
+                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                  err_code, err_msg, error_buf, sizeof(error_buf));
+                send_all(client_fd, error_buf, strlen(error_buf));
+                return 0;
             }
             
-            log_info("ss_get_file_content_success", "file=%s size=%zu", filename, content_size);
-            close(client_fd);
-            return;
+            // ACK carries the bytes pushed so the NM can account for them,
+            // and whether they were a delta or the whole file
+            Message ack = {0};
+            snprintf(ack.type, sizeof(ack.type), "ACK");
+            snprintf(ack.id, sizeof(ack.id), "%s", cmd_msg.id);
+            snprintf(ack.username, sizeof(ack.username), "%s", cmd_msg.username);
+            snprintf(ack.role, sizeof(ack.role), "SS");
+            snprintf(ack.payload, sizeof(ack.payload), "%lld|%s", sent, delta ? "delta" : "full");
+            
+            char ack_line[MAX_LINE];
+            proto_format_line(&ack, ack_line, sizeof(ack_line));
+            send_all(client_fd, ack_line, strlen(ack_line));
+            
+            log_info("ss_replicate_to_success", "file=%s replica=%s:%d size=%lld mode=%s",
+                     filename, host, port, sent, delta ? "delta" : "full");
+            return 0;
+        }
+        // Handle PUT_FILE_DELTA command (a primary's recent commits to a file)
+        else if (strcmp(cmd_msg.type, "PUT_FILE_DELTA") == 0) {
+            // Payload format: "filename"; the delta image (repl_delta.h)
+            // follows in DATA frames, terminated by STOP
+            const char *filename = cmd_msg.payload;
+            size_t image_len = 0;
+            size_t image_capacity = 4096;
+            char *image = malloc(image_capacity);
+            const char *err_code = NULL, *err_msg = NULL;
+            if (!binary) {
+                err_code = "INVALID";
+                err_msg = "Deltas are only sent in binary frames";
+            } else if (!image || recv_bulk_frames(reader, &image, &image_len, &image_capacity) != 0) {
+                free(image);
+                char error_buf[MAX_LINE];
+                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                  "INTERNAL", "Failed to receive delta",
+                                  error_buf, sizeof(error_buf));
+                send_all(client_fd, error_buf, strlen(error_buf));
+                return -1;
+            } else {
+                int rc = repl_delta_apply(ctx->storage_dir, filename, image, image_len);
+                if (rc > 0) {
+                    err_code = "CONFLICT";
+                    err_msg = "Local copy does not match the delta";
+                } else if (rc < 0) {
+                    err_code = "INTERNAL";
+                    err_msg = "Failed to apply delta";
+                }
+            }
+            free(image);
+            
+            if (err_code) {
+                log_warning("ss_put_file_delta", "file=%s sender=%s result=%s",
+                            filename, cmd_msg.username, err_code);
+                char error_buf[MAX_LINE];
+                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                  err_code, err_msg, error_buf, sizeof(error_buf));
+                send_all(client_fd, error_buf, strlen(error_buf));
+                return 0;
+            }
+            
+            Message ack = {0};
+            snprintf(ack.type, sizeof(ack.type), "ACK");
+            snprintf(ack.id, sizeof(ack.id), "%s", cmd_msg.id);
+            snprintf(ack.username, sizeof(ack.username), "%s", cmd_msg.username);
+            snprintf(ack.role, sizeof(ack.role), "SS");
+            snprintf(ack.payload, sizeof(ack.payload), "Delta applied");
+            
+            char ack_line[MAX_LINE];
+            proto_format_line(&ack, ack_line, sizeof(ack_line));
+            send_all(client_fd, ack_line, strlen(ack_line));
+            
+            log_info("ss_put_file_delta_success", "file=%s size=%zu", filename, image_len);
+            return 0;
         }
         // Handle PUT_FILE_CONTENT command (for NM to write file for replication)
         else if (strcmp(cmd_msg.type, "PUT_FILE_CONTENT") == 0) {
@@ -1832,15 +2467,33 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                   "INTERNAL", "Memory allocation failed",
                                   error_buf, sizeof(error_buf));
                 send_all(client_fd, error_buf, strlen(error_buf));
-                close(client_fd);
-                return;
+                return -1;
+            }
+            
+            // Read DATA until STOP: frames in binary mode, escaped lines otherwise
+            if (binary && recv_bulk_frames(reader, &content, &content_size, &content_capacity) != 0) {
+                free(content);
+                char error_buf[MAX_LINE];
+                proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                  "INTERNAL", "Failed to receive file content",
+                                  error_buf, sizeof(error_buf));
+                send_all(client_fd, error_buf, strlen(error_buf));
+                return -1;
             }
             
-            // Read DATA messages until STOP
             char line[MAX_LINE];
-            while (1) {
-                int n = recv_line(client_fd, line, sizeof(line));
-                if (n <= 0) break;
+            while (!binary) {
+                int n = net_reader_line(reader, line, sizeof(line));
+                if (n <= 0) {
+                    // The sender is gone; a partial copy must not be written
+                    free(content);
+                    char error_buf[MAX_LINE];
+                    proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
+                                      "INTERNAL", "Failed to receive file content",
+                                      error_buf, sizeof(error_buf));
+                    send_all(client_fd, error_buf, strlen(error_buf));
+                    return -1;
+                }
                 
                 Message data_msg;
                 if (proto_parse_line(line, &data_msg) != 0) continue;
@@ -1864,8 +2517,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                               "INTERNAL", "Memory allocation failed",
                                               error_buf, sizeof(error_buf));
                             send_all(client_fd, error_buf, strlen(error_buf));
-                            close(client_fd);
-                            return;
+                            return -1;
                         }
                         content = new_content;
                     }
@@ -1885,23 +2537,25 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             
             // Write file
             if (strncmp(filename, "metadata/", 9) == 0) {
-                // Metadata file - write directly to metadata directory
-                char meta_path[4096];
-                snprintf(meta_path, sizeof(meta_path), "%s/%s", ctx->storage_dir, filename);
-                
-                FILE *fp = fopen(meta_path, "w");
-                if (!fp) {
+                // Metadata file: "metadata/<file>.meta" names <file>'s .meta
+                char meta_file[MAX_LINE];
+                size_t name_len = strlen(filename + 9);
+                int rc = -1;
+                if (name_len > 5 && name_len - 5 < sizeof(meta_file) &&
+                    strcmp(filename + 9 + name_len - 5, ".meta") == 0) {
+                    memcpy(meta_file, filename + 9, name_len - 5);
+                    meta_file[name_len - 5] = '\0';
+                    rc = metadata_replace(ctx->storage_dir, meta_file, content, content_size);
+                }
+                if (rc != 0) {
                     free(content);
                     char error_buf[MAX_LINE];
                     proto_format_error(cmd_msg.id, cmd_msg.username, "SS",
-                                      "INTERNAL", "Failed to create metadata file",
+                                      "INTERNAL", "Failed to write metadata file",
                                       error_buf, sizeof(error_buf));
                     send_all(client_fd, error_buf, strlen(error_buf));
-                    close(client_fd);
-                    return;
+                    return 0;
                 }
-                fwrite(content, 1, content_size, fp);
-                fclose(fp);
             } else {
                 // Regular file - use file_write_all
                 if (file_write_all(ctx->storage_dir, filename, content, content_size) != 0) {
@@ -1911,8 +2565,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                                       "INTERNAL", "Failed to write file",
                                       error_buf, sizeof(error_buf));
                     send_all(client_fd, error_buf, strlen(error_buf));
-                    close(client_fd);
-                    return;
+                    return 0;
                 }
             }
             
@@ -1931,8 +2584,7 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
             send_all(client_fd, ack_line, strlen(ack_line));
             
             log_info("ss_put_file_content_success", "file=%s size=%zu", filename, content_size);
-            close(client_fd);
-            return;
+            return 0;
         }
         // Unknown command
         else {
@@ -1942,15 +2594,21 @@ static void handle_command(Ctx *ctx, int client_fd, Message cmd_msg) {
                               "INVALID", "Unknown command",
                               error_buf, sizeof(error_buf));
             send_all(client_fd, error_buf, strlen(error_buf));
-            close(client_fd);
-            return;
+            return 0;
         }
+        return 0;
 }
 
 int main(int argc, char **argv) {
     Ctx ctx = {0};
     ctx.nm_host = "127.0.0.1"; ctx.nm_port = 5000; ctx.host = "127.0.0.1"; ctx.client_port = 6001; ctx.storage_dir = "./storage_ss1"; ctx.username = "ss1"; ctx.running = 1;
     ctx.server_fd = -1;  // Initialize server_fd
+    ctx.epoll_fd = -1;
+    ctx.worker_count = DEFAULT_WORKERS;
+    long meta_cache_entries = META_CACHE_DEFAULT_ENTRIES;
+    long meta_cache_mb = META_CACHE_DEFAULT_BYTES / (1024 * 1024);
+    AtimeConfig atime = { ATIME_LAZY, ATIME_DEFAULT_FLUSH_SEC, ATIME_DEFAULT_FLUSH_THRESHOLD,
+                          ATIME_DEFAULT_RELATIME_SEC };
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--nm-host") && i+1 < argc) ctx.nm_host = argv[++i];
         else if (!strcmp(argv[i], "--nm-port") && i+1 < argc) ctx.nm_port = atoi(argv[++i]);
@@ -1958,14 +2616,40 @@ int main(int argc, char **argv) {
         else if (!strcmp(argv[i], "--client-port") && i+1 < argc) ctx.client_port = atoi(argv[++i]);
         else if (!strcmp(argv[i], "--storage") && i+1 < argc) ctx.storage_dir = argv[++i];
         else if (!strcmp(argv[i], "--username") && i+1 < argc) ctx.username = argv[++i];
+        else if (!strcmp(argv[i], "--workers") && i+1 < argc) ctx.worker_count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--meta-cache") && i+1 < argc) meta_cache_entries = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--meta-cache-mb") && i+1 < argc) meta_cache_mb = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--atime") && i+1 < argc) {
+            if (access_time_parse_mode(argv[++i], &atime.mode) != 0) {
+                fprintf(stderr, "--atime must be strict, lazy or relatime\n");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--atime-flush-sec") && i+1 < argc) atime.flush_interval_sec = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--atime-flush-batch") && i+1 < argc) atime.flush_threshold = (size_t)atol(argv[++i]);
+        else if (!strcmp(argv[i], "--relatime-sec") && i+1 < argc) atime.relatime_sec = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--undo-depth") && i+1 < argc) undo_log_set_depth(atoi(argv[++i]));
     }
+    if (ctx.worker_count <= 0) ctx.worker_count = DEFAULT_WORKERS;
+    if (ctx.worker_count > SS_MAX_WORKERS) ctx.worker_count = SS_MAX_WORKERS;
     if (ctx.username) {
         char log_path[128];
         snprintf(log_path, sizeof(log_path), "ss_%s.log", ctx.username);
         log_set_file(log_path);
     }
+    // sendfile() to a client that went away must fail with EPIPE, not kill us
+    signal(SIGPIPE, SIG_IGN);
+    // Stop cleanly so deferred access times are flushed
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
     // Ensure storage directory exists
     ensure_storage_dir(ctx.storage_dir);
+
+    // Size the metadata cache before the scan so it warms the cache
+    if (meta_cache_init(meta_cache_entries > 0 ? (size_t)meta_cache_entries : 0,
+                        meta_cache_mb > 0 ? (size_t)meta_cache_mb * 1024 * 1024 : 0) != 0) {
+        log_warning("ss_startup", "Metadata cache disabled (allocation failed)");
+    }
     
     // Phase 2: Scan directory for existing files
     // This discovers all files that were created before SS restart
@@ -1975,6 +2659,11 @@ int main(int argc, char **argv) {
     log_info("ss_scan_complete", "found %d files", scan_result.count);
 
     runtime_state_init();
+    log_info("ss_text_scan", "tokenizer kernel: %s", text_scan_impl_name());
+    if (access_time_start(ctx.storage_dir, &atime) != 0) {
+        log_warning("ss_startup", "Access-time batching disabled, writing through");
+    }
+    merkle_start(ctx.storage_dir);
     
     // Build file list string for registration payload
     // Format: "host=IP,client_port=PORT,storage=DIR,files=file1.txt,file2.txt,..."
@@ -2031,7 +2720,7 @@ int main(int argc, char **argv) {
     
     // Wait for threads to finish
     log_info("ss_ready", "SS running - heartbeat and command handler active");
-    while (ctx.running) {
+    while (ctx.running && !g_stop) {
         sleep(1);
     }
     
@@ -2042,7 +2731,10 @@ int main(int argc, char **argv) {
     if (ctx.server_fd >= 0) {
         close(ctx.server_fd);
     }
+    access_time_stop();
+    ss_pool_drain();
     runtime_state_shutdown();
+    log_storage_stats();
     return 0;
 }
 
@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200809L
+#include "merkle.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/log.h"
+#include "file_scan.h"
+#include "file_storage.h"
+#include "meta_format.h"
+
+#define MERKLE_CACHE_MAGIC "SSMK"
+#define MERKLE_CACHE_VERSION 2
+
+// One file, in memory and in merkle.cache
+typedef struct {
+    char filename[256];
+    uint64_t ino;               // Identity content_hash was computed for
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t content_hash;
+    uint64_t meta_ino;          // Same for the .meta and access_hash
+    uint64_t meta_size;
+    int64_t meta_mtime_ns;
+    uint64_t access_hash;       // Owner, ACL and pending requests
+    uint64_t hash;              // Both, as compared between SSs
+} MerkleEntry;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+} MerkleCacheHeader;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static char g_storage_dir[512];
+static MerkleEntry *g_entries;              // Sorted by (leaf, name)
+static int g_count;
+static int g_leaf_first[MERKLE_LEAVES + 1]; // Entries of leaf i: [first[i], first[i + 1])
+static uint64_t g_leaf_hash[MERKLE_LEAVES];
+static uint64_t g_node_hash[MERKLE_FANOUT];
+
+static uint64_t fnv_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+#define FNV_BASIS 14695981039346656037ull
+
+static int name_leaf(const char *filename) {
+    uint32_t h = 2166136261u;
+    for (const char *p = filename; *p; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+    return (int)(h % MERKLE_LEAVES);
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    const MerkleEntry *x = a, *y = b;
+    int lx = name_leaf(x->filename), ly = name_leaf(y->filename);
+    if (lx != ly) return lx < ly ? -1 : 1;
+    return strcmp(x->filename, y->filename);
+}
+
+static int hash_file(const char *path, uint64_t *out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    char *buf = malloc(FILE_STREAM_CHUNK);
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    uint64_t h = FNV_BASIS;
+    ssize_t n;
+    while ((n = read(fd, buf, FILE_STREAM_CHUNK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        h = fnv_bytes(h, buf, (size_t)n);
+    }
+    free(buf);
+    close(fd);
+    if (n < 0) return -1;
+    *out = h;
+    return 0;
+}
+
+// Access part of the file's .meta; a file without one hashes to 0
+static int hash_access(const char *name, const struct stat *meta_st, uint64_t *out) {
+    if (!meta_st) {
+        *out = 0;
+        return 0;
+    }
+    FileMetadata *meta = malloc(sizeof(FileMetadata));
+    if (!meta) return -1;
+    int rc = metadata_load_sections(g_storage_dir, name, META_SECTION_ACL | META_SECTION_PENDING, meta);
+    if (rc == 0) *out = meta_format_access_hash(meta);
+    free(meta);
+    return rc == 0 ? 0 : -1;
+}
+
+static void save_cache_locked(void) {
+    char path[600], tmp_path[640];
+    snprintf(path, sizeof(path), "%s/merkle.cache", g_storage_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) return;
+    MerkleCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MERKLE_CACHE_MAGIC, 4);
+    hdr.version = MERKLE_CACHE_VERSION;
+    hdr.count = (uint32_t)g_count;
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+             (g_count == 0 || fwrite(g_entries, sizeof(MerkleEntry), (size_t)g_count, fp) == (size_t)g_count);
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        log_warning("ss_merkle_cache", "Failed to save %s", path);
+    }
+}
+
+// Rescan the namespace and rebuild the tree; caller holds g_mu
+static void rebuild_locked(void) {
+    ScanResult *scan = malloc(sizeof(ScanResult));
+    MerkleEntry *entries = scan ? malloc(sizeof(MerkleEntry) * MAX_FILES_PER_SS) : NULL;
+    if (!entries) {
+        free(scan);
+        return;
+    }
+    *scan = scan_directory(g_storage_dir, "files");
+    int count = 0;
+    int rehashed = 0;
+    for (int i = 0; i < scan->count; i++) {
+        const char *name = scan->files[i].filename;
+        char path[1024];
+        char meta_path[1100];
+        snprintf(path, sizeof(path), "%s/files/%s", g_storage_dir, name[0] == '/' ? name + 1 : name);
+        snprintf(meta_path, sizeof(meta_path), "%s/metadata/%s.meta", g_storage_dir,
+                 name[0] == '/' ? name + 1 : name);
+        struct stat st, meta_st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        int has_meta = stat(meta_path, &meta_st) == 0;
+        MerkleEntry *e = &entries[count];
+        memset(e, 0, sizeof(*e));
+        snprintf(e->filename, sizeof(e->filename), "%s", name);
+        e->ino = (uint64_t)st.st_ino;
+        e->size = (uint64_t)st.st_size;
+        e->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        if (has_meta) {
+            e->meta_ino = (uint64_t)meta_st.st_ino;
+            e->meta_size = (uint64_t)meta_st.st_size;
+            e->meta_mtime_ns = (int64_t)meta_st.st_mtim.tv_sec * 1000000000 + meta_st.st_mtim.tv_nsec;
+        }
+        const MerkleEntry *old = g_count > 0 ?
+            bsearch(e, g_entries, (size_t)g_count, sizeof(MerkleEntry), entry_cmp) : NULL;
+        if (old && old->ino == e->ino && old->size == e->size && old->mtime_ns == e->mtime_ns) {
+            e->content_hash = old->content_hash;
+        } else if (hash_file(path, &e->content_hash) == 0) {
+            rehashed++;
+        } else {
+            continue;
+        }
+        if (old && old->meta_ino == e->meta_ino && old->meta_size == e->meta_size &&
+            old->meta_mtime_ns == e->meta_mtime_ns) {
+            e->access_hash = old->access_hash;
+        } else if (hash_access(name, has_meta ? &meta_st : NULL, &e->access_hash) == 0) {
+            rehashed++;
+        } else {
+            continue;
+        }
+        e->hash = fnv_bytes(fnv_bytes(FNV_BASIS, &e->content_hash, sizeof(e->content_hash)),
+                            &e->access_hash, sizeof(e->access_hash));
+        count++;
+    }
+    free(scan);
+    qsort(entries, (size_t)count, sizeof(MerkleEntry), entry_cmp);
+    int changed = rehashed > 0 || count != g_count;
+    free(g_entries);
+    g_entries = entries;
+    g_count = count;
+
+    int e = 0;
+    for (int leaf = 0; leaf < MERKLE_LEAVES; leaf++) {
+        g_leaf_first[leaf] = e;
+        uint64_t h = 0;         // Empty leaves hash to 0 on every SS
+        for (; e < count && name_leaf(entries[e].filename) == leaf; e++) {
+            if (h == 0) h = FNV_BASIS;
+            h = fnv_bytes(h, entries[e].filename, strlen(entries[e].filename) + 1);
+            h = fnv_bytes(h, &entries[e].hash, sizeof(entries[e].hash));
+        }
+        g_leaf_hash[leaf] = h;
+    }
+    g_leaf_first[MERKLE_LEAVES] = count;
+    for (int n = 0; n < MERKLE_FANOUT; n++) {
+        g_node_hash[n] = fnv_bytes(FNV_BASIS, &g_leaf_hash[n * MERKLE_FANOUT],
+                                   sizeof(uint64_t) * MERKLE_FANOUT);
+    }
+    if (changed) save_cache_locked();
+    log_info("ss_merkle_rebuild", "files=%d rehashed=%d", count, rehashed);
+}
+
+void merkle_start(const char *storage_dir) {
+    pthread_mutex_lock(&g_mu);
+    snprintf(g_storage_dir, sizeof(g_storage_dir), "%s", storage_dir);
+    char path[600];
+    snprintf(path, sizeof(path), "%s/merkle.cache", g_storage_dir);
+    FILE *fp = fopen(path, "rb");
+    MerkleCacheHeader hdr;
+    if (fp && fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+        memcmp(hdr.magic, MERKLE_CACHE_MAGIC, 4) == 0 && hdr.version == MERKLE_CACHE_VERSION &&
+        hdr.count <= MAX_FILES_PER_SS) {
+        MerkleEntry *entries = malloc(sizeof(MerkleEntry) * (hdr.count ? hdr.count : 1));
+        if (entries && fread(entries, sizeof(MerkleEntry), hdr.count, fp) == hdr.count) {
+            for (uint32_t i = 0; i < hdr.count; i++) {
+                entries[i].filename[sizeof(entries[i].filename) - 1] = '\0';
+            }
+            qsort(entries, hdr.count, sizeof(MerkleEntry), entry_cmp);
+            g_entries = entries;
+            g_count = (int)hdr.count;
+            log_info("ss_merkle_cache", "Loaded %d file hashes", g_count);
+        } else {
+            free(entries);
+        }
+    }
+    if (fp) fclose(fp);
+    rebuild_locked();
+    pthread_mutex_unlock(&g_mu);
+}
+
+int merkle_children(int level, int index, uint64_t out[MERKLE_FANOUT]) {
+    if (level == 0 && index == 0) {
+        pthread_mutex_lock(&g_mu);
+        rebuild_locked();
+        memcpy(out, g_node_hash, sizeof(g_node_hash));
+        pthread_mutex_unlock(&g_mu);
+        return 0;
+    }
+    if (level != 1 || index < 0 || index >= MERKLE_FANOUT) return -1;
+    pthread_mutex_lock(&g_mu);
+    memcpy(out, &g_leaf_hash[index * MERKLE_FANOUT], sizeof(uint64_t) * MERKLE_FANOUT);
+    pthread_mutex_unlock(&g_mu);
+    return 0;
+}
+
+int merkle_leaf(int leaf, MerkleFile **out) {
+    *out = NULL;
+    if (leaf < 0 || leaf >= MERKLE_LEAVES) return -1;
+    pthread_mutex_lock(&g_mu);
+    int count = g_leaf_first[leaf + 1] - g_leaf_first[leaf];
+    MerkleFile *files = count > 0 ? malloc(sizeof(MerkleFile) * (size_t)count) : NULL;
+    if (count > 0 && !files) {
+        pthread_mutex_unlock(&g_mu);
+        return -1;      // An empty list would hide the leaf's files
+    }
+    for (int i = 0; i < count; i++) {
+        const MerkleEntry *e = &g_entries[g_leaf_first[leaf] + i];
+        memcpy(files[i].filename, e->filename, sizeof(files[i].filename));
+        files[i].hash = e->hash;
+    }
+    pthread_mutex_unlock(&g_mu);
+    *out = files;
+    return count;
+}
@@ -0,0 +1,41 @@
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Merkle tree over the Storage Server's namespace, for anti-entropy: a hash
+// per file (content plus the owner, ACL and pending requests in its .meta,
+// cached in <storage>/merkle.cache by inode, size and mtime) and a
+// fixed-shape tree over them, so the NM can walk two SSs' trees and copy
+// only the files that differ. A file's leaf is (hash of its name) %
+// MERKLE_LEAVES. Thread-safe; queries below the root answer from the
+// tree the last root query built.
+
+#define MERKLE_FANOUT 16
+#define MERKLE_LEAVES (MERKLE_FANOUT * MERKLE_FANOUT)  // Root, 16 nodes, 256 leaves
+
+// Load the hash cache for one storage directory and build the tree (call
+// once at startup; hashes files that changed while the SS was down)
+void merkle_start(const char *storage_dir);
+
+// Children of a node
+// level: 0 for the root (children are the inner nodes), 1 for an inner
+//        node (children are leaves); level 0 rebuilds the tree first
+// index: Node index within its level (0 for the root)
+// out: Receives MERKLE_FANOUT hashes
+// Returns: 0 on success, -1 if the node does not exist
+int merkle_children(int level, int index, uint64_t out[MERKLE_FANOUT]);
+
+typedef struct {
+    char filename[256];
+    uint64_t hash;              // Content and access hash
+} MerkleFile;
+
+// Files in a leaf of the last build, in name order
+// out: Receives a malloc'd array (caller frees; NULL if the leaf is empty)
+// Returns: number of files, or -1 if leaf is out of range or the list
+//          cannot be allocated
+int merkle_leaf(int leaf, MerkleFile **out);
+
+#endif
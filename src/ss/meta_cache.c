@@ -0,0 +1,396 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "meta_cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fixed part of a FileMetadata; the variable-length arrays follow it in
+// the packed blob (sentences, then ACL entries, then pending requests)
+typedef struct {
+    char owner[64];
+    char folder_path[512];
+    time_t created;
+    time_t last_modified;
+    time_t last_accessed;
+    size_t size_bytes;
+    int word_count;
+    int char_count;
+    char acl_owner[MAX_USERNAME];
+    int acl_count;
+    int sentence_count;
+    int next_sentence_id;
+    int pending_request_count;
+    unsigned sections;      // META_SECTION_* mask of the arrays present
+} PackedMeta;
+
+typedef struct {
+    uint64_t hash;          // path_hash() of path
+    char *path;             // NULL = free slot
+    PackedMeta *blob;
+    size_t blob_len;
+    uint32_t next;          // Bucket chain / free list (slot index + 1; 0 = end)
+    unsigned char referenced;  // CLOCK bit, set by readers with relaxed atomics
+} MetaSlot;
+
+typedef struct {
+    pthread_rwlock_t lock;
+    MetaSlot *slots;
+    uint32_t cap;
+    uint32_t top;           // Slots ever handed out
+    uint32_t used;
+    uint32_t free_list;     // Evicted/invalidated slots (index + 1)
+    uint32_t hand;          // CLOCK hand
+    uint32_t *buckets;      // Chain heads (slot index + 1)
+    uint32_t mask;
+    size_t bytes;
+    size_t byte_budget;
+    uint64_t generation;    // Bumped by every put/invalidate (fill tokens)
+    // Counters, updated with relaxed atomics (per shard to avoid sharing)
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long fills;
+    unsigned long evictions;
+    unsigned long invalidations;
+} MetaShard;
+
+static MetaShard g_shards[META_CACHE_SHARDS];
+static int g_meta_cache_ready = 0;
+
+// Per-file locks are recursive so metadata_save() can take the lock
+// itself while a caller already holds it for a read-modify-write
+static pthread_mutex_t g_file_locks[META_CACHE_LOCK_STRIPES];
+static pthread_once_t g_file_locks_once = PTHREAD_ONCE_INIT;
+
+#define SLOT(shard, ref) (&(shard)->slots[(ref) - 1])
+
+// FNV-1a; paths are short and this keeps the SS free of NM dependencies
+static uint64_t path_hash(const char *path) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+int meta_cache_init(size_t entries, size_t bytes) {
+    if (g_meta_cache_ready) return 0;
+    if (entries == 0) entries = META_CACHE_DEFAULT_ENTRIES;
+    if (bytes == 0) bytes = META_CACHE_DEFAULT_BYTES;
+
+    uint32_t per_shard = (uint32_t)((entries + META_CACHE_SHARDS - 1) / META_CACHE_SHARDS);
+    uint32_t buckets = 16;
+    while (buckets < per_shard * 2) buckets *= 2;
+
+    for (int i = 0; i < META_CACHE_SHARDS; i++) {
+        MetaShard *shard = &g_shards[i];
+        memset(shard, 0, sizeof(*shard));
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->slots = calloc(per_shard, sizeof(MetaSlot));
+        shard->buckets = calloc(buckets, sizeof(uint32_t));
+        if (!shard->slots || !shard->buckets) return -1;
+        shard->cap = per_shard;
+        shard->mask = buckets - 1;
+        shard->byte_budget = bytes / META_CACHE_SHARDS;
+    }
+    g_meta_cache_ready = 1;
+    return 0;
+}
+
+static MetaShard *shard_for(uint64_t hash) {
+    // Low bits pick the bucket, high bits pick the shard
+    return &g_shards[(hash >> 56) & (META_CACHE_SHARDS - 1)];
+}
+
+// Find the link holding path's slot; caller holds the shard lock
+static uint32_t *find_link(MetaShard *shard, uint64_t hash, const char *path) {
+    uint32_t *link = &shard->buckets[hash & shard->mask];
+    while (*link) {
+        MetaSlot *slot = SLOT(shard, *link);
+        if (slot->hash == hash && strcmp(slot->path, path) == 0) return link;
+        link = &slot->next;
+    }
+    return NULL;
+}
+
+// Unlink slot ref from its chain, free its contents and put it on the free
+// list; caller holds the shard lock exclusively
+static void slot_release(MetaShard *shard, uint32_t ref) {
+    MetaSlot *slot = SLOT(shard, ref);
+    uint32_t *link = &shard->buckets[slot->hash & shard->mask];
+    while (*link && *link != ref) link = &SLOT(shard, *link)->next;
+    if (*link) *link = slot->next;
+    shard->bytes -= slot->blob_len + strlen(slot->path) + 1;
+    free(slot->path);
+    free(slot->blob);
+    memset(slot, 0, sizeof(*slot));
+    slot->next = shard->free_list;
+    shard->free_list = ref;
+    shard->used--;
+}
+
+// Evict one entry with CLOCK (second chance); caller holds the shard lock
+// exclusively and shard->used > 0
+static void clock_evict(MetaShard *shard) {
+    // Two sweeps clear every referenced bit, so a victim is always found
+    for (uint32_t steps = 0; steps < 2 * shard->top + 1; steps++) {
+        uint32_t ref = shard->hand + 1;
+        MetaSlot *slot = SLOT(shard, ref);
+        shard->hand = (shard->hand + 1) % shard->top;
+        if (!slot->path) continue;
+        if (__atomic_load_n(&slot->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&slot->referenced, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        slot_release(shard, ref);
+        __atomic_fetch_add(&shard->evictions, 1, __ATOMIC_RELAXED);
+        return;
+    }
+}
+
+// Pack the used parts of meta's loaded sections into one allocation
+static PackedMeta *pack(const FileMetadata *meta, unsigned sections, size_t *len_out) {
+    int sentences = (sections & META_SECTION_SENTENCES) ? meta->sentence_count : 0;
+    int acl_entries = (sections & META_SECTION_ACL) ? meta->acl.count : 0;
+    int pending = (sections & META_SECTION_PENDING) ? meta->pending_request_count : 0;
+    if (sentences < 0) sentences = 0;
+    if (sentences > MAX_SENTENCE_METADATA) sentences = MAX_SENTENCE_METADATA;
+    if (acl_entries < 0) acl_entries = 0;
+    if (acl_entries > MAX_ACL_ENTRIES) acl_entries = MAX_ACL_ENTRIES;
+    if (pending < 0) pending = 0;
+    if (pending > MAX_PENDING_REQUESTS) pending = MAX_PENDING_REQUESTS;
+
+    size_t len = sizeof(PackedMeta) +
+                 sentences * sizeof(SentenceMeta) +
+                 acl_entries * sizeof(ACLEntry) +
+                 pending * sizeof(PendingRequest);
+    PackedMeta *pm = malloc(len);
+    if (!pm) return NULL;
+
+    memcpy(pm->owner, meta->owner, sizeof(pm->owner));
+    memcpy(pm->folder_path, meta->folder_path, sizeof(pm->folder_path));
+    pm->created = meta->created;
+    pm->last_modified = meta->last_modified;
+    pm->last_accessed = meta->last_accessed;
+    pm->size_bytes = meta->size_bytes;
+    pm->word_count = meta->word_count;
+    pm->char_count = meta->char_count;
+    memcpy(pm->acl_owner, meta->acl.owner, sizeof(pm->acl_owner));
+    pm->acl_count = acl_entries;
+    pm->sentence_count = sentences;
+    pm->next_sentence_id = meta->next_sentence_id;
+    pm->pending_request_count = pending;
+    pm->sections = sections;
+
+    char *p = (char *)(pm + 1);
+    memcpy(p, meta->sentences, sentences * sizeof(SentenceMeta));
+    p += sentences * sizeof(SentenceMeta);
+    memcpy(p, meta->acl.entries, acl_entries * sizeof(ACLEntry));
+    p += acl_entries * sizeof(ACLEntry);
+    memcpy(p, meta->pending_requests, pending * sizeof(PendingRequest));
+    *len_out = len;
+    return pm;
+}
+
+static void unpack(const PackedMeta *pm, FileMetadata *out) {
+    // Callers get the same zeroed tail metadata_load() always produced
+    memset(out, 0, sizeof(*out));
+    memcpy(out->owner, pm->owner, sizeof(out->owner));
+    memcpy(out->folder_path, pm->folder_path, sizeof(out->folder_path));
+    out->created = pm->created;
+    out->last_modified = pm->last_modified;
+    // Raised under the shared lock by meta_cache_note_accessed()
+    out->last_accessed = __atomic_load_n(&pm->last_accessed, __ATOMIC_RELAXED);
+    out->size_bytes = pm->size_bytes;
+    out->word_count = pm->word_count;
+    out->char_count = pm->char_count;
+    memcpy(out->acl.owner, pm->acl_owner, sizeof(out->acl.owner));
+    out->acl.count = pm->acl_count;
+    out->sentence_count = pm->sentence_count;
+    out->next_sentence_id = pm->next_sentence_id;
+    out->pending_request_count = pm->pending_request_count;
+
+    const char *p = (const char *)(pm + 1);
+    memcpy(out->sentences, p, pm->sentence_count * sizeof(SentenceMeta));
+    p += pm->sentence_count * sizeof(SentenceMeta);
+    memcpy(out->acl.entries, p, pm->acl_count * sizeof(ACLEntry));
+    p += pm->acl_count * sizeof(ACLEntry);
+    memcpy(out->pending_requests, p, pm->pending_request_count * sizeof(PendingRequest));
+}
+
+int meta_cache_get(const char *path, unsigned sections, FileMetadata *out, uint64_t *token_out) {
+    if (token_out) *token_out = 0;
+    if (!g_meta_cache_ready || !path || !out) return -1;
+
+    uint64_t hash = path_hash(path);
+    MetaShard *shard = shard_for(hash);
+    int result = -1;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    uint32_t *link = find_link(shard, hash, path);
+    if (link && (SLOT(shard, *link)->blob->sections & sections) == sections) {
+        MetaSlot *slot = SLOT(shard, *link);
+        unpack(slot->blob, out);
+        if (!__atomic_load_n(&slot->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&slot->referenced, 1, __ATOMIC_RELAXED);
+        }
+        result = 0;
+    } else if (token_out) {
+        *token_out = shard->generation;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    __atomic_fetch_add(result == 0 ? &shard->hits : &shard->misses, 1, __ATOMIC_RELAXED);
+    return result;
+}
+
+// Insert or replace path. fill: only if nothing changed since token.
+static void cache_store(const char *path, const FileMetadata *meta, unsigned sections,
+                        int fill, uint64_t token) {
+    if (!g_meta_cache_ready || !path || !meta) return;
+
+    // Pack and copy out of the lock
+    uint64_t hash = path_hash(path);
+    size_t blob_len = 0;
+    PackedMeta *blob = pack(meta, sections, &blob_len);
+    char *path_copy = strdup(path);
+    if (!blob || !path_copy) {
+        free(blob);
+        free(path_copy);
+        meta_cache_invalidate(path);  // Never leave a stale copy behind
+        return;
+    }
+    size_t cost = blob_len + strlen(path) + 1;
+
+    MetaShard *shard = shard_for(hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    uint32_t *link = find_link(shard, hash, path);
+    if (fill && (shard->generation != token ||
+                 (link && (SLOT(shard, *link)->blob->sections & sections) == sections))) {
+        // A put/invalidate raced with the disk read, or another reader
+        // already filled the entry with at least these sections
+        pthread_rwlock_unlock(&shard->lock);
+        free(blob);
+        free(path_copy);
+        return;
+    }
+    if (!fill) shard->generation++;
+    if (link) slot_release(shard, *link);
+    if (cost > shard->byte_budget) {
+        pthread_rwlock_unlock(&shard->lock);
+        free(blob);
+        free(path_copy);
+        return;
+    }
+    while (shard->used > 0 && shard->bytes + cost > shard->byte_budget) {
+        clock_evict(shard);
+    }
+    if (!shard->free_list && shard->top == shard->cap) clock_evict(shard);
+
+    uint32_t ref;
+    if (shard->free_list) {
+        ref = shard->free_list;
+        shard->free_list = SLOT(shard, ref)->next;
+    } else {
+        ref = ++shard->top;
+    }
+    MetaSlot *slot = SLOT(shard, ref);
+    size_t b = hash & shard->mask;
+    slot->hash = hash;
+    slot->path = path_copy;
+    slot->blob = blob;
+    slot->blob_len = blob_len;
+    slot->referenced = 0;
+    slot->next = shard->buckets[b];
+    shard->buckets[b] = ref;
+    shard->used++;
+    shard->bytes += cost;
+    pthread_rwlock_unlock(&shard->lock);
+
+    if (fill) __atomic_fetch_add(&shard->fills, 1, __ATOMIC_RELAXED);
+}
+
+void meta_cache_fill(const char *path, const FileMetadata *meta, unsigned sections, uint64_t token) {
+    cache_store(path, meta, sections, 1, token);
+}
+
+void meta_cache_put(const char *path, const FileMetadata *meta) {
+    cache_store(path, meta, META_SECTION_ALL, 0, 0);
+}
+
+void meta_cache_invalidate(const char *path) {
+    if (!g_meta_cache_ready || !path) return;
+
+    uint64_t hash = path_hash(path);
+    MetaShard *shard = shard_for(hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    shard->generation++;
+    uint32_t *link = find_link(shard, hash, path);
+    if (link) slot_release(shard, *link);
+    pthread_rwlock_unlock(&shard->lock);
+    __atomic_fetch_add(&shard->invalidations, 1, __ATOMIC_RELAXED);
+}
+
+void meta_cache_note_accessed(const char *path, time_t t) {
+    if (!g_meta_cache_ready || !path) return;
+
+    uint64_t hash = path_hash(path);
+    MetaShard *shard = shard_for(hash);
+    pthread_rwlock_rdlock(&shard->lock);
+    uint32_t *link = find_link(shard, hash, path);
+    if (link) {
+        // Readers only ever raise it, so a CAS loop keeps the maximum
+        time_t *field = &SLOT(shard, *link)->blob->last_accessed;
+        time_t cur = __atomic_load_n(field, __ATOMIC_RELAXED);
+        while (cur < t &&
+               !__atomic_compare_exchange_n(field, &cur, t, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+static void file_locks_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (int i = 0; i < META_CACHE_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&g_file_locks[i], &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+}
+
+static pthread_mutex_t *file_lock_for(const char *path) {
+    pthread_once(&g_file_locks_once, file_locks_init);
+    return &g_file_locks[path_hash(path) & (META_CACHE_LOCK_STRIPES - 1)];
+}
+
+void meta_cache_lock(const char *path) {
+    if (path) pthread_mutex_lock(file_lock_for(path));
+}
+
+void meta_cache_unlock(const char *path) {
+    if (path) pthread_mutex_unlock(file_lock_for(path));
+}
+
+void meta_cache_get_stats(MetaCacheStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!g_meta_cache_ready) return;
+
+    for (int i = 0; i < META_CACHE_SHARDS; i++) {
+        MetaShard *shard = &g_shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        out->entries += shard->used;
+        out->capacity += shard->cap;
+        out->bytes += shard->bytes;
+        out->byte_budget += shard->byte_budget;
+        pthread_rwlock_unlock(&shard->lock);
+        out->hits += __atomic_load_n(&shard->hits, __ATOMIC_RELAXED);
+        out->misses += __atomic_load_n(&shard->misses, __ATOMIC_RELAXED);
+        out->fills += __atomic_load_n(&shard->fills, __ATOMIC_RELAXED);
+        out->evictions += __atomic_load_n(&shard->evictions, __ATOMIC_RELAXED);
+        out->invalidations += __atomic_load_n(&shard->invalidations, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef META_CACHE_H
+#define META_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "file_storage.h"
+
+// SS cache of parsed file metadata, used by metadata_load()/metadata_save()
+// (write-through). Sharded by .meta path, bounded in entries and bytes.
+// Callers hold the file's lock (meta_cache_lock()) around puts, and code
+// that rewrites a .meta behind metadata_save() must invalidate it.
+
+#define META_CACHE_SHARDS 16                       // Power of two
+#define META_CACHE_DEFAULT_ENTRIES 8192            // Files across all shards
+#define META_CACHE_DEFAULT_BYTES (32u * 1024 * 1024) // Packed metadata across all shards
+#define META_CACHE_LOCK_STRIPES 64                 // Per-file lock stripes (power of two)
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long fills;          // Misses that were loaded from disk and cached
+    unsigned long evictions;
+    unsigned long invalidations;
+    size_t entries;
+    size_t capacity;              // Max entries
+    size_t bytes;                 // Packed metadata + keys currently held
+    size_t byte_budget;
+} MetaCacheStats;
+
+// Size the cache (call once at startup, before serving requests)
+// entries: Max cached files (0 = META_CACHE_DEFAULT_ENTRIES)
+// bytes: Max packed metadata bytes (0 = META_CACHE_DEFAULT_BYTES)
+// Returns: 0 on success, -1 on allocation failure (cache stays disabled,
+//          metadata_load() then always reads disk)
+//
+// Usage:
+//   meta_cache_init(META_CACHE_DEFAULT_ENTRIES, META_CACHE_DEFAULT_BYTES);
+int meta_cache_init(size_t entries, size_t bytes);
+
+// Look up metadata for a .meta path (shared shard lock)
+// sections: META_SECTION_* mask the caller needs; entries filled by a
+//           partial load only hit for requests they cover
+// out: Receives a copy of the cached sections on a hit
+// token_out: On a miss, receives the token to pass to meta_cache_fill()
+// Returns: 0 on hit, -1 on miss
+//
+// Usage:
+//   uint64_t token;
+//   if (meta_cache_get(path, META_SECTION_ACL, &meta, &token) != 0) {
+//       if (parse_from_disk(path, &meta) == 0) meta_cache_fill(path, &meta, META_SECTION_ACL, token);
+//   }
+int meta_cache_get(const char *path, unsigned sections, FileMetadata *out, uint64_t *token_out);
+
+// Cache metadata read from disk after a miss; ignored if the entry was
+// written or invalidated since the miss, or already holds these sections
+void meta_cache_fill(const char *path, const FileMetadata *meta, unsigned sections, uint64_t token);
+
+// Insert or replace metadata that was just written to disk
+void meta_cache_put(const char *path, const FileMetadata *meta);
+
+// Drop any entry for path
+void meta_cache_invalidate(const char *path);
+
+// Raise the cached last_accessed of path to t without touching disk (no-op
+// if path is not cached); used by deferred access-time updates
+void meta_cache_note_accessed(const char *path, time_t t);
+
+// Per-file lock for read-modify-write of one file's metadata (load, change,
+// save). Recursive, so metadata_save() can take it inside a caller's hold.
+// Striped: unrelated files may share a lock, so never hold two.
+void meta_cache_lock(const char *path);
+void meta_cache_unlock(const char *path);
+
+// Snapshot of the hit/miss/eviction counters and occupancy
+void meta_cache_get_stats(MetaCacheStats *out);
+
+#endif
@@ -0,0 +1,421 @@
+#define _POSIX_C_SOURCE 200809L
+#include "meta_format.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof(MetaFileHeader) % 8 == 0, "sections must stay 8-byte aligned");
+_Static_assert(sizeof(MetaSentenceRecord) == 32, "on-disk sentence record changed");
+_Static_assert(sizeof(MetaAclRecord) == MAX_USERNAME + 4, "on-disk ACL record changed");
+_Static_assert(sizeof(MetaPendingRecord) == 80, "on-disk pending record changed");
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+int meta_format_is_binary(const void *buf, size_t len) {
+    return buf && len >= sizeof(MetaFileHeader) &&
+           memcmp(buf, META_FORMAT_MAGIC, 4) == 0;
+}
+
+static void copy_str(char *dst, size_t dst_len, const char *src, size_t src_len) {
+    size_t n = strnlen(src, src_len);
+    if (n >= dst_len) n = dst_len - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+int meta_format_encode(const FileMetadata *meta, char **out, size_t *len_out) {
+    if (!meta || !out || !len_out) return -1;
+    uint32_t counts[META_FORMAT_SECTIONS] = {
+        meta->sentence_count < 0 ? 0 :
+            meta->sentence_count > MAX_SENTENCE_METADATA ? MAX_SENTENCE_METADATA : meta->sentence_count,
+        meta->acl.count < 0 ? 0 :
+            meta->acl.count > MAX_ACL_ENTRIES ? MAX_ACL_ENTRIES : meta->acl.count,
+        meta->pending_request_count < 0 ? 0 :
+            meta->pending_request_count > MAX_PENDING_REQUESTS ? MAX_PENDING_REQUESTS : meta->pending_request_count,
+    };
+    const uint32_t sizes[META_FORMAT_SECTIONS] = {
+        sizeof(MetaSentenceRecord), sizeof(MetaAclRecord), sizeof(MetaPendingRecord),
+    };
+
+    MetaFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, META_FORMAT_MAGIC, 4);
+    hdr.version = META_FORMAT_VERSION;
+    hdr.section_count = META_FORMAT_SECTIONS;
+    hdr.header_size = sizeof(hdr);
+    hdr.next_sentence_id = meta->next_sentence_id;
+    hdr.created = meta->created;
+    hdr.last_modified = meta->last_modified;
+    hdr.last_accessed = meta->last_accessed;
+    hdr.size_bytes = meta->size_bytes;
+    hdr.word_count = meta->word_count;
+    hdr.char_count = meta->char_count;
+    copy_str(hdr.owner, sizeof(hdr.owner), meta->owner, sizeof(meta->owner));
+    copy_str(hdr.folder_path, sizeof(hdr.folder_path), meta->folder_path, sizeof(meta->folder_path));
+    copy_str(hdr.acl_owner, sizeof(hdr.acl_owner), meta->acl.owner, sizeof(meta->acl.owner));
+
+    size_t len = sizeof(hdr);
+    for (int s = 0; s < META_FORMAT_SECTIONS; s++) {
+        hdr.sections[s].offset = (uint32_t)len;
+        hdr.sections[s].count = counts[s];
+        hdr.sections[s].record_size = sizes[s];
+        len = ALIGN8(len + (size_t)counts[s] * sizes[s]);
+    }
+
+    char *buf = calloc(1, len);
+    if (!buf) return -1;
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    MetaSentenceRecord *sr = (MetaSentenceRecord *)(buf + hdr.sections[0].offset);
+    for (uint32_t i = 0; i < counts[0]; i++) {
+        const SentenceMeta *sm = &meta->sentences[i];
+        sr[i].sentence_id = sm->sentence_id;
+        sr[i].version = sm->version;
+        sr[i].offset = sm->offset;
+        sr[i].length = sm->length;
+        sr[i].word_count = sm->word_count;
+        sr[i].char_count = sm->char_count;
+    }
+    MetaAclRecord *ar = (MetaAclRecord *)(buf + hdr.sections[1].offset);
+    for (uint32_t i = 0; i < counts[1]; i++) {
+        const ACLEntry *e = &meta->acl.entries[i];
+        copy_str(ar[i].username, sizeof(ar[i].username), e->username, sizeof(e->username));
+        ar[i].read_access = e->read_access ? 1 : 0;
+        ar[i].write_access = e->write_access ? 1 : 0;
+    }
+    MetaPendingRecord *pr = (MetaPendingRecord *)(buf + hdr.sections[2].offset);
+    for (uint32_t i = 0; i < counts[2]; i++) {
+        const PendingRequest *req = &meta->pending_requests[i];
+        pr[i].request_id = req->request_id;
+        copy_str(pr[i].requester, sizeof(pr[i].requester), req->requester, sizeof(req->requester));
+        pr[i].access_type = req->access_type;
+        pr[i].timestamp = req->timestamp;
+    }
+
+    *out = buf;
+    *len_out = len;
+    return 0;
+}
+
+// Bounds-check section s and return its first record (NULL if empty or
+// malformed); *count_out is clamped to max
+static const char *section_at(const void *buf, size_t len, const MetaFileHeader *hdr,
+                              int s, size_t min_record, uint32_t max, uint32_t *count_out) {
+    *count_out = 0;
+    if (s >= hdr->section_count) return NULL;
+    const MetaSectionEntry *sec = &hdr->sections[s];
+    if (sec->count == 0) return NULL;
+    if (sec->record_size < min_record || sec->offset > len ||
+        (uint64_t)sec->count * sec->record_size > len - sec->offset) {
+        return NULL;
+    }
+    *count_out = sec->count > max ? max : sec->count;
+    return (const char *)buf + sec->offset;
+}
+
+int meta_format_decode(const void *buf, size_t len, unsigned sections, FileMetadata *meta) {
+    if (!meta || !meta_format_is_binary(buf, len)) return -1;
+
+    // The header is copied out: an mmap gives no alignment guarantees
+    // beyond the page, and records may be wider than this build's
+    MetaFileHeader hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.version < 1 || hdr.header_size < sizeof(hdr) || hdr.header_size > len) return -1;
+
+    memset(meta, 0, sizeof(*meta));
+    copy_str(meta->owner, sizeof(meta->owner), hdr.owner, sizeof(hdr.owner));
+    copy_str(meta->folder_path, sizeof(meta->folder_path), hdr.folder_path, sizeof(hdr.folder_path));
+    copy_str(meta->acl.owner, sizeof(meta->acl.owner), hdr.acl_owner, sizeof(hdr.acl_owner));
+    meta->created = (time_t)hdr.created;
+    meta->last_modified = (time_t)hdr.last_modified;
+    meta->last_accessed = (time_t)hdr.last_accessed;
+    meta->size_bytes = (size_t)hdr.size_bytes;
+    meta->word_count = hdr.word_count;
+    meta->char_count = hdr.char_count;
+    meta->next_sentence_id = hdr.next_sentence_id > 0 ? hdr.next_sentence_id : 1;
+
+    uint32_t count;
+    const char *p;
+    if (sections & META_SECTION_SENTENCES) {
+        p = section_at(buf, len, &hdr, 0, sizeof(MetaSentenceRecord), MAX_SENTENCE_METADATA, &count);
+        for (uint32_t i = 0; i < count; i++, p += hdr.sections[0].record_size) {
+            MetaSentenceRecord r;
+            memcpy(&r, p, sizeof(r));
+            SentenceMeta *sm = &meta->sentences[i];
+            sm->sentence_id = r.sentence_id;
+            sm->version = r.version;
+            sm->offset = (size_t)r.offset;
+            sm->length = (size_t)r.length;
+            sm->word_count = r.word_count;
+            sm->char_count = r.char_count;
+        }
+        meta->sentence_count = (int)count;
+    }
+    if (sections & META_SECTION_ACL) {
+        p = section_at(buf, len, &hdr, 1, sizeof(MetaAclRecord), MAX_ACL_ENTRIES, &count);
+        for (uint32_t i = 0; i < count; i++, p += hdr.sections[1].record_size) {
+            MetaAclRecord r;
+            memcpy(&r, p, sizeof(r));
+            ACLEntry *e = &meta->acl.entries[i];
+            copy_str(e->username, sizeof(e->username), r.username, sizeof(r.username));
+            e->read_access = r.read_access;
+            e->write_access = r.write_access;
+        }
+        meta->acl.count = (int)count;
+    }
+    if (sections & META_SECTION_PENDING) {
+        p = section_at(buf, len, &hdr, 2, sizeof(MetaPendingRecord), MAX_PENDING_REQUESTS, &count);
+        for (uint32_t i = 0; i < count; i++, p += hdr.sections[2].record_size) {
+            MetaPendingRecord r;
+            memcpy(&r, p, sizeof(r));
+            PendingRequest *req = &meta->pending_requests[i];
+            req->request_id = r.request_id;
+            copy_str(req->requester, sizeof(req->requester), r.requester, sizeof(r.requester));
+            req->access_type = r.access_type;
+            req->timestamp = (time_t)r.timestamp;
+        }
+        meta->pending_request_count = (int)count;
+    }
+    return 0;
+}
+
+static uint64_t fnv_u64(uint64_t h, uint64_t v) {
+    for (int i = 0; i < 8; i++) h = (h ^ ((v >> (8 * i)) & 0xff)) * 1099511628211ull;
+    return h;
+}
+
+static uint64_t fnv_str(uint64_t h, const char *s, size_t max) {
+    size_t n = strnlen(s, max);
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+    return h * 1099511628211ull;    // Terminator
+}
+
+uint64_t meta_format_access_hash(const FileMetadata *meta) {
+    int acl_count = meta->acl.count < 0 ? 0 :
+        meta->acl.count > MAX_ACL_ENTRIES ? MAX_ACL_ENTRIES : meta->acl.count;
+    int pending_count = meta->pending_request_count < 0 ? 0 :
+        meta->pending_request_count > MAX_PENDING_REQUESTS ? MAX_PENDING_REQUESTS : meta->pending_request_count;
+    uint64_t h = 14695981039346656037ull;
+    h = fnv_str(h, meta->owner, sizeof(meta->owner));
+    h = fnv_str(h, meta->acl.owner, sizeof(meta->acl.owner));
+    h = fnv_u64(h, (uint64_t)acl_count);
+    for (int i = 0; i < acl_count; i++) {
+        const ACLEntry *e = &meta->acl.entries[i];
+        h = fnv_str(h, e->username, sizeof(e->username));
+        h = fnv_u64(h, e->read_access ? 1 : 0);
+        h = fnv_u64(h, e->write_access ? 1 : 0);
+    }
+    h = fnv_u64(h, (uint64_t)pending_count);
+    for (int i = 0; i < pending_count; i++) {
+        const PendingRequest *req = &meta->pending_requests[i];
+        h = fnv_u64(h, (uint64_t)req->request_id);
+        h = fnv_str(h, req->requester, sizeof(req->requester));
+        h = fnv_u64(h, (uint64_t)(unsigned char)req->access_type);
+        h = fnv_u64(h, (uint64_t)req->timestamp);
+    }
+    return h;
+}
+
+// Parse legacy text metadata
+// Format: owner=username\ncreated=timestamp\nlast_modified=timestamp\n...
+int meta_format_parse_text(char *text, FileMetadata *metadata) {
+    if (!text || !metadata) return -1;
+
+    memset(metadata, 0, sizeof(FileMetadata));
+    metadata->next_sentence_id = 1;
+
+    // Parse line by line
+    char *saveptr = NULL;
+    char *line = strtok_r(text, "\n", &saveptr);
+    while (line) {
+        // Parse key=value pairs
+        if (strncmp(line, "owner=", 6) == 0) {
+            // Copy owner, truncating if too long (owner field is 64 bytes)
+            const char *owner_val = line + 6;
+            size_t owner_len = strlen(owner_val);
+            if (owner_len >= sizeof(metadata->owner)) {
+                owner_len = sizeof(metadata->owner) - 1;
+            }
+            memcpy(metadata->owner, owner_val, owner_len);
+            metadata->owner[owner_len] = '\0';
+        } else if (strncmp(line, "created=", 8) == 0) {
+            metadata->created = (time_t)atoll(line + 8);
+        } else if (strncmp(line, "last_modified=", 14) == 0) {
+            metadata->last_modified = (time_t)atoll(line + 14);
+        } else if (strncmp(line, "last_accessed=", 14) == 0) {
+            metadata->last_accessed = (time_t)atoll(line + 14);
+        } else if (strncmp(line, "size_bytes=", 11) == 0) {
+            metadata->size_bytes = (size_t)atoll(line + 11);
+        } else if (strncmp(line, "word_count=", 11) == 0) {
+            metadata->word_count = atoi(line + 11);
+        } else if (strncmp(line, "char_count=", 11) == 0) {
+            metadata->char_count = atoi(line + 11);
+        } else if (strncmp(line, "sentence_count=", 15) == 0) {
+            int count = atoi(line + 15);
+            if (count < 0) count = 0;
+            if (count > MAX_SENTENCE_METADATA) count = MAX_SENTENCE_METADATA;
+            metadata->sentence_count = count;
+        } else if (strncmp(line, "next_sentence_id=", 17) == 0) {
+            int next_id = atoi(line + 17);
+            if (next_id <= 0) next_id = 1;
+            metadata->next_sentence_id = next_id;
+        } else if (strncmp(line, "sentence_", 9) == 0) {
+            char *eq = strchr(line, '=');
+            if (!eq) {
+                line = strtok_r(NULL, "\n", &saveptr);
+                continue;
+            }
+            int idx = atoi(line + 9);
+            if (idx < 0 || idx >= MAX_SENTENCE_METADATA) {
+                line = strtok_r(NULL, "\n", &saveptr);
+                continue;
+            }
+            SentenceMeta *sm = &metadata->sentences[idx];
+            int id = 0, version = 0, wcount = 0, ccount = 0;
+            size_t offset = 0, length = 0;
+            int parsed = sscanf(eq + 1, "%d,%d,%zu,%zu,%d,%d",
+                                &id, &version, &offset, &length, &wcount, &ccount);
+            if (parsed == 6) {
+                sm->sentence_id = id;
+                sm->version = version;
+                sm->offset = offset;
+                sm->length = length;
+                sm->word_count = wcount;
+                sm->char_count = ccount;
+                if (idx + 1 > metadata->sentence_count) {
+                    metadata->sentence_count = idx + 1;
+                }
+                if (metadata->next_sentence_id <= sm->sentence_id) {
+                    metadata->next_sentence_id = sm->sentence_id + 1;
+                }
+            }
+        } else if (strncmp(line, "ACL_START", 9) == 0) {
+            // ACL section starts - collect all ACL lines
+            char acl_buf[4096] = {0};
+            size_t acl_pos = 0;
+            
+            // Collect ACL lines until ACL_END
+            while ((line = strtok_r(NULL, "\n", &saveptr))) {
+                if (strncmp(line, "ACL_END", 7) == 0) {
+                    break;
+                }
+                // Append line to ACL buffer
+                size_t line_len = strlen(line);
+                if (acl_pos + line_len + 1 < sizeof(acl_buf)) {
+                    memcpy(acl_buf + acl_pos, line, line_len);
+                    acl_pos += line_len;
+                    acl_buf[acl_pos++] = '\n';
+                }
+            }
+            acl_buf[acl_pos] = '\0';
+            
+            // Deserialize ACL
+            acl_deserialize(&metadata->acl, acl_buf);
+            // Don't break - continue reading pending requests
+        } else if (strncmp(line, "pending_request_count=", 22) == 0) {
+            int count = atoi(line + 22);
+            if (count < 0) count = 0;
+            if (count > MAX_PENDING_REQUESTS) count = MAX_PENDING_REQUESTS;
+            metadata->pending_request_count = count;
+        } else if (strncmp(line, "pending_request_", 16) == 0) {
+            char *eq = strchr(line, '=');
+            if (!eq) {
+                line = strtok_r(NULL, "\n", &saveptr);
+                continue;
+            }
+            int idx = atoi(line + 16);
+            if (idx < 0 || idx >= MAX_PENDING_REQUESTS) {
+                line = strtok_r(NULL, "\n", &saveptr);
+                continue;
+            }
+            PendingRequest *req = &metadata->pending_requests[idx];
+            int request_id = 0;
+            char requester[64] = {0};
+            char access_type = 'R';
+            long timestamp = 0;
+            
+            // Parse: request_id,requester,access_type,timestamp
+            char *field_saveptr = NULL;
+            char *field = strtok_r(eq + 1, ",", &field_saveptr);
+            if (field) request_id = atoi(field);
+            field = strtok_r(NULL, ",", &field_saveptr);
+            if (field) strncpy(requester, field, sizeof(requester) - 1);
+            field = strtok_r(NULL, ",", &field_saveptr);
+            if (field) access_type = field[0];
+            field = strtok_r(NULL, ",", &field_saveptr);
+            if (field) timestamp = atol(field);
+            
+            req->request_id = request_id;
+            size_t req_len = strlen(requester);
+            if (req_len >= sizeof(req->requester)) req_len = sizeof(req->requester) - 1;
+            memcpy(req->requester, requester, req_len);
+            req->requester[req_len] = '\0';
+            req->access_type = access_type;
+            req->timestamp = (time_t)timestamp;
+        }
+        line = strtok_r(NULL, "\n", &saveptr);
+    }
+    
+
+    // If ACL not found, initialize with owner
+    if (metadata->acl.count == 0 && strlen(metadata->owner) > 0) {
+        metadata->acl = acl_init(metadata->owner);
+    }
+
+    return 0;
+}
+
+int meta_format_render_text(const FileMetadata *metadata, char **out, size_t *len_out) {
+    if (!metadata || !out || !len_out) return -1;
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&buf, &len);
+    if (!fp) return -1;
+
+    // Write metadata in key=value format
+    fprintf(fp, "owner=%s\n", metadata->owner);
+    fprintf(fp, "created=%ld\n", (long)metadata->created);
+    fprintf(fp, "last_modified=%ld\n", (long)metadata->last_modified);
+    fprintf(fp, "last_accessed=%ld\n", (long)metadata->last_accessed);
+    fprintf(fp, "size_bytes=%zu\n", metadata->size_bytes);
+    fprintf(fp, "word_count=%d\n", metadata->word_count);
+    fprintf(fp, "char_count=%d\n", metadata->char_count);
+    fprintf(fp, "sentence_count=%d\n", metadata->sentence_count);
+    fprintf(fp, "next_sentence_id=%d\n", metadata->next_sentence_id);
+    for (int i = 0; i < metadata->sentence_count && i < MAX_SENTENCE_METADATA; i++) {
+        const SentenceMeta *sm = &metadata->sentences[i];
+        fprintf(fp, "sentence_%d=%d,%d,%zu,%zu,%d,%d\n",
+                i,
+                sm->sentence_id,
+                sm->version,
+                sm->offset,
+                sm->length,
+                sm->word_count,
+                sm->char_count);
+    }
+    
+    // Write ACL (Step 4)
+    fprintf(fp, "ACL_START\n");
+    char acl_buf[4096];
+    if (acl_serialize(&metadata->acl, acl_buf, sizeof(acl_buf)) == 0) {
+        fprintf(fp, "%s", acl_buf);
+    }
+    fprintf(fp, "ACL_END\n");
+    
+    // Write pending access requests
+    fprintf(fp, "pending_request_count=%d\n", metadata->pending_request_count);
+    for (int i = 0; i < metadata->pending_request_count && i < MAX_PENDING_REQUESTS; i++) {
+        const PendingRequest *req = &metadata->pending_requests[i];
+        fprintf(fp, "pending_request_%d=%d,%s,%c,%ld\n",
+                i, req->request_id, req->requester, req->access_type, (long)req->timestamp);
+    }
+
+    if (fclose(fp) != 0) {
+        free(buf);
+        return -1;
+    }
+    *out = buf;
+    *len_out = len;
+    return 0;
+}
@@ -0,0 +1,108 @@
+#ifndef META_FORMAT_H
+#define META_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "file_storage.h"
+
+// On-disk encoding of metadata/<file>.meta
+//
+// Binary layout (version META_FORMAT_VERSION, host byte order):
+//   MetaFileHeader   magic, version, scalar fields, section table
+//   sentences        sentence_count x MetaSentenceRecord
+//   ACL entries      acl count x MetaAclRecord
+//   pending requests pending_request_count x MetaPendingRecord
+// The section table gives each section's offset, record count and record
+// size, so a reader that mmaps the file touches only the header and the
+// sections it asked for. Sections start 8-byte aligned. A newer writer may
+// grow a record; readers use the prefix they know.
+//
+// Files written by older servers are key=value text ("owner=...",
+// "sentence_N=...", "ACL_START"...). meta_format_parse_text() still reads
+// them; metadata_load() rewrites them in binary on first load.
+
+#define META_FORMAT_MAGIC "SSMB"
+#define META_FORMAT_VERSION 1
+
+typedef struct {
+    uint32_t offset;        // From start of file
+    uint32_t count;         // Records
+    uint32_t record_size;   // Bytes per record
+    uint32_t reserved;
+} MetaSectionEntry;
+
+#define META_FORMAT_SECTIONS 3   // Sentences, ACL, pending requests (in order)
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t section_count;
+    uint32_t header_size;
+    int32_t next_sentence_id;
+    int64_t created;
+    int64_t last_modified;
+    int64_t last_accessed;
+    uint64_t size_bytes;
+    int32_t word_count;
+    int32_t char_count;
+    char owner[64];
+    char folder_path[512];
+    char acl_owner[MAX_USERNAME];
+    MetaSectionEntry sections[META_FORMAT_SECTIONS];
+} MetaFileHeader;
+
+typedef struct {
+    int32_t sentence_id;
+    int32_t version;
+    uint64_t offset;
+    uint64_t length;
+    int32_t word_count;
+    int32_t char_count;
+} MetaSentenceRecord;
+
+typedef struct {
+    char username[MAX_USERNAME];
+    uint8_t read_access;
+    uint8_t write_access;
+    uint8_t pad[2];
+} MetaAclRecord;
+
+typedef struct {
+    int32_t request_id;
+    char requester[64];
+    char access_type;
+    uint8_t pad[3];
+    int64_t timestamp;
+} MetaPendingRecord;
+
+// Returns 1 if buf starts with a binary metadata header
+int meta_format_is_binary(const void *buf, size_t len);
+
+// Encode metadata in the binary format
+// out: Receives a malloc'd buffer (caller frees)
+// Returns: 0 on success, -1 on allocation failure
+int meta_format_encode(const FileMetadata *meta, char **out, size_t *len_out);
+
+// Decode a binary metadata image (e.g. an mmap of the .meta file)
+// sections: META_SECTION_* mask; only those arrays are read, the rest of
+//           meta is left zeroed
+// Returns: 0 on success, -1 if the image is truncated or not version 1+
+int meta_format_decode(const void *buf, size_t len, unsigned sections, FileMetadata *meta);
+
+// Hash of the owner, ACL and pending requests, for comparing the access
+// part of two copies of a file's metadata (replication, anti-entropy);
+// timestamps, counters and sentences are left out
+uint64_t meta_format_access_hash(const FileMetadata *meta);
+
+// Parse a legacy key=value text image (modified in place by strtok)
+// Returns: 0 on success
+int meta_format_parse_text(char *text, FileMetadata *meta);
+
+// Render metadata as legacy text, for peers that cannot take binary
+// content (text-mode replication)
+// out: Receives a malloc'd NUL-terminated buffer (caller frees)
+// Returns: 0 on success, -1 on allocation failure
+int meta_format_render_text(const FileMetadata *meta, char **out, size_t *len_out);
+
+#endif
@@ -0,0 +1,607 @@
+#define _POSIX_C_SOURCE 200809L
+#include "repl_delta.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_storage.h"
+#include "meta_format.h"
+#include "undo_log.h"
+
+#define REPL_DELTA_MAGIC "SSRD"
+#define REPL_DELTA_VERSION 2
+
+// Each edit's texts are padded so the records after them stay 8-byte
+// aligned and can be read in place
+#define TEXT_SPAN(e) ((((e)->new_length + (e)->old_length) + 7) & ~(uint64_t)7)
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t step_count;
+    uint32_t acl_count;         // Access section after the header
+    uint64_t final_size;
+    uint64_t final_hash;
+    int64_t last_accessed;
+    uint32_t pending_count;
+    uint32_t reserved;
+    char owner[64];
+    char acl_owner[MAX_USERNAME];
+} ReplDeltaHeader;
+
+// Access section: pending_count x MetaPendingRecord, acl_count x
+// MetaAclRecord, zero padding to 8 bytes
+#define ACCESS_SPAN(h) \
+    ((((h)->pending_count * sizeof(MetaPendingRecord) + (h)->acl_count * sizeof(MetaAclRecord)) + 7) & \
+     ~(size_t)7)
+
+typedef struct {
+    uint64_t base_size;         // State the step applies to
+    uint64_t base_hash;
+    int32_t base_sentence_count;
+    int32_t sentence_count;     // State after the step
+    uint64_t size;
+    int64_t last_modified;
+    int32_t word_count;
+    int32_t char_count;
+    int32_t next_sentence_id;
+    uint32_t edit_count;
+} ReplDeltaStep;
+
+typedef struct {
+    uint64_t new_offset;        // As in UndoEdit
+    uint64_t new_length;
+    uint64_t old_length;
+    int32_t meta_index;
+    int32_t meta_count;
+} ReplDeltaEdit;
+
+// One step as sent, before encoding
+typedef struct {
+    ReplDeltaStep rec;
+    const UndoDeltaStep *undo;
+    MetaSentenceRecord *records;    // Each edit's new sentences, in edit order
+    size_t record_count;
+} StepOut;
+
+static const char *normalize_filename(const char *filename) {
+    return filename[0] == '/' ? filename + 1 : filename;
+}
+
+static int read_at(int fd, void *buf, size_t len, size_t off) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, (off_t)off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        off += (size_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static uint64_t fnv_mix(uint64_t h, int64_t v) {
+    for (int i = 0; i < 8; i++) {
+        h = (h ^ (uint64_t)((v >> (8 * i)) & 0xff)) * 1099511628211ull;
+    }
+    return h;
+}
+
+static int clamp_count(int count, int max) {
+    return count < 0 ? 0 : count > max ? max : count;
+}
+
+// The version a step is checked against: owner, ACL and pending requests
+// (the journal has no history of them, so every state of a file uses the
+// primary's current ones), file size and sentence table
+static uint64_t state_hash(uint64_t access, const SentenceMeta *table, int count, size_t size) {
+    uint64_t h = 14695981039346656037ull;
+    h = fnv_mix(h, (int64_t)access);
+    h = fnv_mix(h, (int64_t)size);
+    h = fnv_mix(h, count);
+    for (int i = 0; i < count; i++) {
+        h = fnv_mix(h, table[i].sentence_id);
+        h = fnv_mix(h, table[i].version);
+        h = fnv_mix(h, (int64_t)table[i].offset);
+        h = fnv_mix(h, (int64_t)table[i].length);
+        h = fnv_mix(h, table[i].word_count);
+        h = fnv_mix(h, table[i].char_count);
+    }
+    return h;
+}
+
+static void to_record(const SentenceMeta *sm, MetaSentenceRecord *rec) {
+    memset(rec, 0, sizeof(*rec));
+    rec->sentence_id = sm->sentence_id;
+    rec->version = sm->version;
+    rec->offset = sm->offset;
+    rec->length = sm->length;
+    rec->word_count = sm->word_count;
+    rec->char_count = sm->char_count;
+}
+
+static void from_record(const MetaSentenceRecord *rec, SentenceMeta *sm) {
+    sm->sentence_id = rec->sentence_id;
+    sm->version = rec->version;
+    sm->offset = (size_t)rec->offset;
+    sm->length = (size_t)rec->length;
+    sm->word_count = rec->word_count;
+    sm->char_count = rec->char_count;
+}
+
+// The newest step must describe the file as it is now
+static int newest_step_current(int fd, size_t size, const FileMetadata *meta,
+                               const UndoDelta *newest) {
+    if (size != newest->new_size || meta->sentence_count != newest->new_sentence_count) return 0;
+    char *check = NULL;
+    int ok = 1;
+    for (size_t i = 0; ok && i < newest->edit_count; i++) {
+        const UndoEdit *e = &newest->edits[i];
+        char *grown = realloc(check, e->new_length + 1);
+        if (!grown) {
+            ok = 0;
+            break;
+        }
+        check = grown;
+        ok = read_at(fd, check, e->new_length, e->new_offset) == 0 &&
+             memcmp(check, e->new_text, e->new_length) == 0;
+    }
+    free(check);
+    return ok;
+}
+
+static int encode(const StepOut *out, int count, const FileMetadata *meta, uint64_t final_size,
+                  uint64_t final_hash, char **image_out, size_t *len_out) {
+    ReplDeltaHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, REPL_DELTA_MAGIC, 4);
+    hdr.version = REPL_DELTA_VERSION;
+    hdr.step_count = (uint32_t)count;
+    hdr.acl_count = (uint32_t)clamp_count(meta->acl.count, MAX_ACL_ENTRIES);
+    hdr.pending_count = (uint32_t)clamp_count(meta->pending_request_count, MAX_PENDING_REQUESTS);
+    hdr.final_size = final_size;
+    hdr.final_hash = final_hash;
+    hdr.last_accessed = meta->last_accessed;
+    snprintf(hdr.owner, sizeof(hdr.owner), "%.*s", (int)sizeof(meta->owner) - 1, meta->owner);
+    snprintf(hdr.acl_owner, sizeof(hdr.acl_owner), "%.*s", (int)sizeof(meta->acl.owner) - 1,
+             meta->acl.owner);
+
+    size_t len = sizeof(ReplDeltaHeader) + ACCESS_SPAN(&hdr);
+    for (int k = 0; k < count; k++) {
+        const UndoDelta *d = &out[k].undo->delta;
+        len += sizeof(ReplDeltaStep) + d->edit_count * sizeof(ReplDeltaEdit) +
+               out[k].record_count * sizeof(MetaSentenceRecord);
+        for (size_t i = 0; i < d->edit_count; i++) {
+            len += TEXT_SPAN(&d->edits[i]);
+        }
+    }
+    char *image = calloc(1, len);
+    if (!image) return -1;
+    memcpy(image, &hdr, sizeof(hdr));
+    size_t pos = sizeof(hdr);
+    for (uint32_t i = 0; i < hdr.pending_count; i++) {
+        const PendingRequest *req = &meta->pending_requests[i];
+        MetaPendingRecord pr;
+        memset(&pr, 0, sizeof(pr));
+        pr.request_id = req->request_id;
+        snprintf(pr.requester, sizeof(pr.requester), "%.*s", (int)sizeof(req->requester) - 1,
+                 req->requester);
+        pr.access_type = req->access_type;
+        pr.timestamp = req->timestamp;
+        memcpy(image + pos, &pr, sizeof(pr));
+        pos += sizeof(pr);
+    }
+    for (uint32_t i = 0; i < hdr.acl_count; i++) {
+        const ACLEntry *e = &meta->acl.entries[i];
+        MetaAclRecord ar;
+        memset(&ar, 0, sizeof(ar));
+        snprintf(ar.username, sizeof(ar.username), "%.*s", (int)sizeof(e->username) - 1, e->username);
+        ar.read_access = e->read_access ? 1 : 0;
+        ar.write_access = e->write_access ? 1 : 0;
+        memcpy(image + pos, &ar, sizeof(ar));
+        pos += sizeof(ar);
+    }
+    pos = sizeof(hdr) + ACCESS_SPAN(&hdr);
+    // Oldest first: out[] runs newest first
+    for (int k = count - 1; k >= 0; k--) {
+        const UndoDelta *d = &out[k].undo->delta;
+        memcpy(image + pos, &out[k].rec, sizeof(out[k].rec));
+        pos += sizeof(out[k].rec);
+        for (size_t i = 0; i < d->edit_count; i++) {
+            ReplDeltaEdit er;
+            memset(&er, 0, sizeof(er));
+            er.new_offset = d->edits[i].new_offset;
+            er.new_length = d->edits[i].new_length;
+            er.old_length = d->edits[i].old_length;
+            er.meta_index = d->edits[i].meta_index;
+            er.meta_count = d->edits[i].meta_count;
+            memcpy(image + pos, &er, sizeof(er));
+            pos += sizeof(er);
+        }
+        const MetaSentenceRecord *rec = out[k].records;
+        for (size_t i = 0; i < d->edit_count; i++) {
+            const UndoEdit *e = &d->edits[i];
+            memcpy(image + pos, rec, (size_t)e->meta_count * sizeof(*rec));
+            pos += (size_t)e->meta_count * sizeof(*rec);
+            rec += e->meta_count;
+            memcpy(image + pos, e->new_text, e->new_length);
+            pos += e->new_length;
+            memcpy(image + pos, e->old_text, e->old_length);
+            pos += TEXT_SPAN(e) - e->new_length;
+        }
+    }
+    *image_out = image;
+    *len_out = len;
+    return 0;
+}
+
+int repl_delta_build(const char *storage_dir, const char *filename, int max_steps,
+                     char **out, size_t *len_out, int *steps_out) {
+    if (!storage_dir || !filename || !out || !len_out || max_steps < 1) return -1;
+    if (max_steps > REPL_DELTA_MAX_STEPS) max_steps = REPL_DELTA_MAX_STEPS;
+    UndoDeltaStep steps[REPL_DELTA_MAX_STEPS];
+    StepOut step_out[REPL_DELTA_MAX_STEPS];
+    memset(step_out, 0, sizeof(step_out));
+    FileMetadata *meta = malloc(sizeof(FileMetadata));
+    SentenceMeta *after = malloc(sizeof(SentenceMeta) * MAX_SENTENCE_METADATA);
+    SentenceMeta *before = malloc(sizeof(SentenceMeta) * MAX_SENTENCE_METADATA);
+    if (!meta || !after || !before) {
+        free(meta);
+        free(after);
+        free(before);
+        return -1;
+    }
+
+    char data_path[1024];
+    snprintf(data_path, sizeof(data_path), "%s/files/%s", storage_dir, normalize_filename(filename));
+    metadata_lock(storage_dir, filename);
+    int n = undo_log_read_deltas(storage_dir, filename, steps, max_steps);
+    int fd = n > 0 ? open(data_path, O_RDONLY) : -1;
+    struct stat st;
+    int rc = 1;
+    if (fd >= 0 && fstat(fd, &st) == 0 && metadata_load(storage_dir, filename, meta) == 0 &&
+        newest_step_current(fd, (size_t)st.st_size, meta, &steps[0].delta)) {
+        rc = 0;
+    }
+    if (fd >= 0) close(fd);
+    metadata_unlock(storage_dir, filename);
+
+    // Walk back from the current state, one step at a time
+    int used = 0;
+    uint64_t access = 0;
+    if (rc == 0) {
+        memcpy(after, meta->sentences, sizeof(SentenceMeta) * (size_t)meta->sentence_count);
+        access = meta_format_access_hash(meta);
+        ReplDeltaStep cur;
+        memset(&cur, 0, sizeof(cur));
+        cur.sentence_count = meta->sentence_count;
+        cur.size = (uint64_t)st.st_size;
+        cur.last_modified = meta->last_modified;
+        cur.word_count = meta->word_count;
+        cur.char_count = meta->char_count;
+        cur.next_sentence_id = meta->next_sentence_id;
+        for (int k = 0; k < n; k++) {
+            const UndoDelta *d = &steps[k].delta;
+            if (cur.sentence_count != d->new_sentence_count || cur.size != d->new_size ||
+                undo_delta_old_table(d, after, cur.sentence_count, before) < 0) {
+                break;
+            }
+            size_t records = 0;
+            for (size_t i = 0; i < d->edit_count; i++) records += (size_t)d->edits[i].meta_count;
+            step_out[k].records = malloc((records ? records : 1) * sizeof(MetaSentenceRecord));
+            if (!step_out[k].records) {
+                rc = -1;
+                break;
+            }
+            step_out[k].record_count = records;
+            MetaSentenceRecord *rec = step_out[k].records;
+            for (size_t i = 0; i < d->edit_count; i++) {
+                for (int j = 0; j < d->edits[i].meta_count; j++) {
+                    to_record(&after[d->edits[i].meta_index + j], rec++);
+                }
+            }
+            step_out[k].undo = &steps[k];
+            step_out[k].rec = cur;
+            step_out[k].rec.edit_count = (uint32_t)d->edit_count;
+            step_out[k].rec.base_size = d->old_size;
+            step_out[k].rec.base_sentence_count = d->old_sentence_count;
+            step_out[k].rec.base_hash = state_hash(access, before, d->old_sentence_count, d->old_size);
+            used++;
+
+            SentenceMeta *tmp = after;
+            after = before;
+            before = tmp;
+            cur.sentence_count = d->old_sentence_count;
+            cur.size = d->old_size;
+            cur.last_modified = d->old_last_modified;
+            cur.word_count = d->old_word_count;
+            cur.char_count = d->old_char_count;
+            cur.next_sentence_id = d->old_next_sentence_id;
+        }
+        if (rc == 0 && used == 0) rc = 1;
+    }
+    if (rc == 0) {
+        uint64_t final_hash = state_hash(access, meta->sentences, meta->sentence_count,
+                                         (size_t)st.st_size);
+        rc = encode(step_out, used, meta, (uint64_t)st.st_size, final_hash, out, len_out);
+        // Not worth it when the file (and its .meta) would be smaller
+        if (rc == 0 && *len_out >= (size_t)st.st_size) {
+            free(*out);
+            *out = NULL;
+            rc = 1;
+        }
+        if (rc == 0 && steps_out) *steps_out = used;
+    }
+
+    for (int k = 0; k < REPL_DELTA_MAX_STEPS; k++) free(step_out[k].records);
+    if (n > 0) undo_log_free_deltas(steps, n);
+    free(meta);
+    free(after);
+    free(before);
+    return rc;
+}
+
+// A step of a received image, bounds-checked
+typedef struct {
+    const ReplDeltaStep *rec;
+    const ReplDeltaEdit *edits;
+    const char *payload;        // Records and texts, per edit
+} StepIn;
+
+static int parse_image(const char *image, size_t len, ReplDeltaHeader *hdr,
+                       StepIn *steps) {
+    if (len < sizeof(*hdr)) return -1;
+    memcpy(hdr, image, sizeof(*hdr));
+    if (memcmp(hdr->magic, REPL_DELTA_MAGIC, 4) != 0 || hdr->version != REPL_DELTA_VERSION ||
+        hdr->step_count == 0 || hdr->step_count > REPL_DELTA_MAX_STEPS ||
+        hdr->acl_count > MAX_ACL_ENTRIES || hdr->pending_count > MAX_PENDING_REQUESTS ||
+        len - sizeof(*hdr) < ACCESS_SPAN(hdr)) {
+        return -1;
+    }
+    // The image is received into a malloc'd buffer and padded, so records
+    // are aligned
+    size_t pos = sizeof(*hdr) + ACCESS_SPAN(hdr);
+    for (uint32_t k = 0; k < hdr->step_count; k++) {
+        if (len - pos < sizeof(ReplDeltaStep)) return -1;
+        const ReplDeltaStep *rec = (const ReplDeltaStep *)(image + pos);
+        pos += sizeof(*rec);
+        if (rec->edit_count == 0 || rec->edit_count > MAX_SENTENCE_METADATA ||
+            (len - pos) / sizeof(ReplDeltaEdit) < rec->edit_count) {
+            return -1;
+        }
+        steps[k].rec = rec;
+        steps[k].edits = (const ReplDeltaEdit *)(image + pos);
+        pos += rec->edit_count * sizeof(ReplDeltaEdit);
+        steps[k].payload = image + pos;
+        for (uint32_t i = 0; i < rec->edit_count; i++) {
+            const ReplDeltaEdit *e = &steps[k].edits[i];
+            if (e->meta_count < 1 || e->meta_count > MAX_SENTENCE_METADATA) return -1;
+            uint64_t need = (uint64_t)e->meta_count * sizeof(MetaSentenceRecord);
+            if (e->new_length > len || e->old_length > len || len - pos < need + TEXT_SPAN(e)) {
+                return -1;
+            }
+            pos += need + TEXT_SPAN(e);
+        }
+    }
+    return pos == len ? 0 : -1;
+}
+
+// Apply one step to the local file and metadata (metadata lock held)
+// Returns: 0 on success, 1 if the file does not match the step, -1 on error
+static int apply_step(const char *storage_dir, const char *filename, FileMetadata *meta,
+                      const StepIn *step) {
+    const ReplDeltaStep *rec = step->rec;
+    if (rec->sentence_count <= 0 || rec->sentence_count > MAX_SENTENCE_METADATA) return 1;
+    char data_path[1024];
+    char tmp_path[1100];
+    snprintf(data_path, sizeof(data_path), "%s/files/%s", storage_dir, normalize_filename(filename));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.repl.tmp", data_path);
+    int in_fd = open(data_path, O_RDONLY);
+    struct stat st;
+    if (in_fd < 0 || fstat(in_fd, &st) != 0 || (uint64_t)st.st_size != rec->base_size) {
+        if (in_fd >= 0) close(in_fd);
+        return 1;
+    }
+
+    // Where each edit starts in the old file, and the bytes it replaced
+    // must be there
+    int rc = 0;
+    char *check = NULL;
+    const char *p = step->payload;
+    int64_t shift = 0;          // New minus old size of the edits passed so far
+    uint64_t prev_end = 0;
+    for (uint32_t i = 0; rc == 0 && i < rec->edit_count; i++) {
+        const ReplDeltaEdit *e = &step->edits[i];
+        const char *old_text = p + (size_t)e->meta_count * sizeof(MetaSentenceRecord) + e->new_length;
+        uint64_t old_offset = (uint64_t)((int64_t)e->new_offset - shift);
+        if (old_offset < prev_end || old_offset > rec->base_size ||
+            e->old_length > rec->base_size - old_offset) {
+            rc = 1;
+            break;
+        }
+        char *grown = realloc(check, e->old_length + 1);
+        if (!grown) {
+            rc = -1;
+            break;
+        }
+        check = grown;
+        if (read_at(in_fd, check, e->old_length, old_offset) != 0 ||
+            memcmp(check, old_text, e->old_length) != 0) {
+            rc = 1;
+        }
+        prev_end = old_offset + e->old_length;
+        shift += (int64_t)e->new_length - (int64_t)e->old_length;
+        p = old_text - e->new_length + TEXT_SPAN(e);
+    }
+    free(check);
+    if (rc == 0 && (int64_t)rec->base_size + shift != (int64_t)rec->size) rc = 1;
+
+    // New sentence table: each replaced sentence becomes the edit's
+    // records, the ones between move by the size change
+    SentenceMeta *table = NULL;
+    if (rc == 0) {
+        table = malloc(sizeof(SentenceMeta) * (size_t)rec->sentence_count);
+        if (!table) rc = -1;
+    }
+    int out = 0;
+    uint32_t e = 0;
+    int added = 0;              // Sentences gained by the edits passed so far
+    shift = 0;
+    p = step->payload;
+    for (int i = 0; rc == 0 && i < meta->sentence_count;) {
+        const ReplDeltaEdit *ed = e < rec->edit_count ? &step->edits[e] : NULL;
+        if (ed && i == ed->meta_index - added) {
+            if (out + ed->meta_count > rec->sentence_count) {
+                rc = 1;
+                break;
+            }
+            const MetaSentenceRecord *records = (const MetaSentenceRecord *)p;
+            for (int j = 0; j < ed->meta_count; j++) from_record(&records[j], &table[out++]);
+            p += (size_t)ed->meta_count * sizeof(MetaSentenceRecord) + TEXT_SPAN(ed);
+            shift += (int64_t)ed->new_length - (int64_t)ed->old_length;
+            added += ed->meta_count - 1;
+            e++;
+            i++;
+            continue;
+        }
+        if (out >= rec->sentence_count) {
+            rc = 1;
+            break;
+        }
+        table[out] = meta->sentences[i];
+        table[out++].offset = (size_t)((int64_t)meta->sentences[i].offset + shift);
+        i++;
+    }
+    if (rc == 0 && (e != rec->edit_count || out != rec->sentence_count)) rc = 1;
+
+    // New file: gaps from the old one with the new texts spliced in
+    int out_fd = -1;
+    if (rc == 0) {
+        out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (out_fd < 0) rc = -1;
+    }
+    size_t at = 0;
+    shift = 0;
+    p = step->payload;
+    for (uint32_t i = 0; rc == 0 && i < rec->edit_count; i++) {
+        const ReplDeltaEdit *ed = &step->edits[i];
+        const char *new_text = p + (size_t)ed->meta_count * sizeof(MetaSentenceRecord);
+        size_t old_offset = (size_t)((int64_t)ed->new_offset - shift);
+        if (file_copy_range(in_fd, at, out_fd, old_offset - at) != 0 ||
+            file_write_fd(out_fd, new_text, ed->new_length) != 0) {
+            rc = -1;
+        }
+        at = old_offset + ed->old_length;
+        shift += (int64_t)ed->new_length - (int64_t)ed->old_length;
+        p = new_text + TEXT_SPAN(ed);
+    }
+    if (rc == 0 && (file_copy_range(in_fd, at, out_fd, rec->base_size - at) != 0 ||
+                    fsync(out_fd) != 0)) {
+        rc = -1;
+    }
+    close(in_fd);
+    if (out_fd >= 0 && close(out_fd) != 0 && rc == 0) rc = -1;
+    if (rc == 0 && rename(tmp_path, data_path) != 0) rc = -1;
+    if (out_fd >= 0 && rc != 0) unlink(tmp_path);
+    if (rc != 0) {
+        free(table);
+        return rc;
+    }
+
+    memcpy(meta->sentences, table, sizeof(SentenceMeta) * (size_t)out);
+    free(table);
+    meta->sentence_count = out;
+    meta->size_bytes = (size_t)rec->size;
+    meta->last_modified = (time_t)rec->last_modified;
+    meta->word_count = rec->word_count;
+    meta->char_count = rec->char_count;
+    meta->next_sentence_id = rec->next_sentence_id;
+    return metadata_save(storage_dir, filename, meta) == 0 ? 0 : -1;
+}
+
+// Owner, ACL and pending requests from the image's access section
+static void read_access(const char *image, const ReplDeltaHeader *hdr, FileMetadata *meta) {
+    meta->last_accessed = (time_t)hdr->last_accessed;
+    snprintf(meta->owner, sizeof(meta->owner), "%.*s", (int)sizeof(hdr->owner) - 1, hdr->owner);
+    snprintf(meta->acl.owner, sizeof(meta->acl.owner), "%.*s", (int)sizeof(hdr->acl_owner) - 1,
+             hdr->acl_owner);
+    const char *p = image + sizeof(*hdr);
+    for (uint32_t i = 0; i < hdr->pending_count; i++, p += sizeof(MetaPendingRecord)) {
+        MetaPendingRecord pr;
+        memcpy(&pr, p, sizeof(pr));
+        PendingRequest *req = &meta->pending_requests[i];
+        req->request_id = pr.request_id;
+        snprintf(req->requester, sizeof(req->requester), "%.*s", (int)sizeof(pr.requester) - 1,
+                 pr.requester);
+        req->access_type = pr.access_type;
+        req->timestamp = (time_t)pr.timestamp;
+    }
+    meta->pending_request_count = (int)hdr->pending_count;
+    for (uint32_t i = 0; i < hdr->acl_count; i++, p += sizeof(MetaAclRecord)) {
+        MetaAclRecord ar;
+        memcpy(&ar, p, sizeof(ar));
+        ACLEntry *e = &meta->acl.entries[i];
+        snprintf(e->username, sizeof(e->username), "%.*s", (int)sizeof(ar.username) - 1, ar.username);
+        e->read_access = ar.read_access;
+        e->write_access = ar.write_access;
+    }
+    meta->acl.count = (int)hdr->acl_count;
+}
+
+int repl_delta_apply(const char *storage_dir, const char *filename,
+                     const char *image, size_t len) {
+    if (!storage_dir || !filename || !image) return -1;
+    ReplDeltaHeader hdr;
+    StepIn steps[REPL_DELTA_MAX_STEPS];
+    if (parse_image(image, len, &hdr, steps) != 0) return -1;
+    FileMetadata *meta = malloc(sizeof(FileMetadata));
+    if (!meta) return -1;
+
+    char data_path[1024];
+    snprintf(data_path, sizeof(data_path), "%s/files/%s", storage_dir, normalize_filename(filename));
+    metadata_lock(storage_dir, filename);
+    struct stat st;
+    int rc = 1;
+    uint32_t first = 0;
+    if (stat(data_path, &st) == 0 && metadata_load(storage_dir, filename, meta) == 0) {
+        // A replica whose owner, ACL or requests differ matches no state
+        uint64_t hash = state_hash(meta_format_access_hash(meta), meta->sentences,
+                                   meta->sentence_count, (size_t)st.st_size);
+        if (hdr.final_size == (uint64_t)st.st_size && hdr.final_hash == hash) {
+            first = hdr.step_count;     // Already up to date
+            rc = 0;
+        }
+        for (; rc != 0 && first < hdr.step_count; first++) {
+            const ReplDeltaStep *rec = steps[first].rec;
+            if (rec->base_size == (uint64_t)st.st_size && rec->base_hash == hash &&
+                rec->base_sentence_count == meta->sentence_count) {
+                rc = 0;
+                break;
+            }
+        }
+    }
+    // Saved with each step, so the .meta matches the primary's as a whole
+    if (rc == 0 && first < hdr.step_count) read_access(image, &hdr, meta);
+    for (uint32_t k = first; rc == 0 && k < hdr.step_count; k++) {
+        rc = apply_step(storage_dir, filename, meta, &steps[k]);
+    }
+    if (rc == 0 && first < hdr.step_count) {
+        // The local journal no longer matches the file
+        undo_log_discard(storage_dir, filename);
+        if (meta->size_bytes != hdr.final_size ||
+            state_hash(meta_format_access_hash(meta), meta->sentences, meta->sentence_count,
+                       meta->size_bytes) != hdr.final_hash) {
+            rc = 1;
+        }
+    }
+    metadata_unlock(storage_dir, filename);
+    free(meta);
+    return rc;
+}
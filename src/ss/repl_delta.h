@@ -0,0 +1,43 @@
+#ifndef REPL_DELTA_H
+#define REPL_DELTA_H
+
+#include <stddef.h>
+
+// Sentence-level delta replication between storage servers: the primary
+// sends a replica its recent commits from the undo journal (PUT_FILE_DELTA)
+// and the replica applies those whose base state hash matches its own copy.
+// The hashes cover the content, the sentence table and the owner, ACL and
+// pending requests, so any mismatch falls back to a full copy. Both sides
+// take the file's metadata lock themselves.
+//
+// Delta image (host byte order, like the .meta and the undo journal):
+//   ReplDeltaHeader                 magic, step count, state after the last
+//                                   step, last access, owner
+//   access section                  pending_count x MetaPendingRecord,
+//                                   acl_count x MetaAclRecord, zero padding
+//                                   to 8 bytes
+//   per step, oldest first:
+//     ReplDeltaStep                 base state, state after the step
+//     edit_count x ReplDeltaEdit    in file order
+//     per edit: meta_count x MetaSentenceRecord, new text, old text,
+//               zero padding to 8 bytes
+
+#define REPL_DELTA_MAX_STEPS 16     // Commits sent in one delta
+
+// Build a delta bringing a replica of filename up to date from any state
+// in the file's last max_steps commits (1 covers a replica that is one
+// commit behind, the common case)
+// out: Receives a malloc'd image (caller frees)
+// steps_out: Receives the number of commits in the image (may be NULL)
+// Returns: 0 on success, 1 if there is no usable history or the delta
+//          would be no smaller than the file (full copy), -1 on error
+int repl_delta_build(const char *storage_dir, const char *filename, int max_steps,
+                     char **out, size_t *len_out, int *steps_out);
+
+// Apply a delta image to the local copy of filename
+// Returns: 0 if applied, 1 if the local copy matches none of its base
+//          states (the sender falls back to a full copy), -1 on error
+int repl_delta_apply(const char *storage_dir, const char *filename,
+                     const char *image, size_t len);
+
+#endif
@@ -1,62 +1,149 @@
 #include "sentence_parser.h"
 
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static int is_sentence_delim(char c) {
-    return (c == '.' || c == '!' || c == '?');
+#include "text_scan.h"
+
+#define ARENA_FIRST_BLOCK 4096
+#define ARENA_MAX_BLOCK (1024 * 1024)
+
+struct SentenceArenaBlock {
+    SentenceArenaBlock *next;
+    size_t used;
+    size_t size;
+    size_t pad;                 // Keeps data 16-byte aligned
+    char data[];
+};
+
+void *sentence_arena_alloc(SentenceArena *arena, size_t size) {
+    if (!arena) return NULL;
+    size = (size + 7) & ~(size_t)7;
+    SentenceArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = arena->next_block ? arena->next_block : ARENA_FIRST_BLOCK;
+        if (block_size < size) block_size = size;
+        block = malloc(sizeof(*block) + block_size);
+        if (!block) return NULL;
+        block->next = arena->head;
+        block->used = 0;
+        block->size = block_size;
+        arena->head = block;
+        if (block_size < ARENA_MAX_BLOCK) {
+            arena->next_block = block_size * 2 < ARENA_MAX_BLOCK ? block_size * 2 : ARENA_MAX_BLOCK;
+        }
+    }
+    void *p = block->data + block->used;
+    block->used += size;
+    return p;
 }
 
-static void free_sentence(SentenceEntry *entry) {
-    if (!entry || !entry->words) return;
-    for (size_t i = 0; i < entry->word_count; i++) {
-        free(entry->words[i].text);
+char *sentence_arena_strndup(SentenceArena *arena, const char *s, size_t len) {
+    char *copy = sentence_arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void sentence_arena_free(SentenceArena *arena) {
+    if (!arena) return;
+    SentenceArenaBlock *block = arena->head;
+    while (block) {
+        SentenceArenaBlock *next = block->next;
+        free(block);
+        block = next;
     }
-    free(entry->words);
-    entry->words = NULL;
-    entry->word_count = 0;
+    arena->head = NULL;
+    arena->next_block = 0;
 }
 
 void sentence_collection_free(SentenceCollection *collection) {
-    if (!collection || !collection->sentences) return;
-    for (size_t i = 0; i < collection->count; i++) {
-        free_sentence(&collection->sentences[i]);
-    }
+    if (!collection) return;
     free(collection->sentences);
     collection->sentences = NULL;
     collection->count = 0;
+    sentence_arena_free(&collection->arena);
+}
+
+// Parser state: words of the sentence being read collect in a reusable
+// scratch array and are copied into the arena once the sentence ends.
+// The text itself is copied into the arena once; a word followed by
+// whitespace (or the end) is cut out of that copy in place by overwriting
+// the whitespace with a NUL, so most words cost no allocation at all.
+typedef struct {
+    SentenceCollection *collection;
+    size_t sentence_capacity;
+    SentenceWord *scratch;
+    size_t scratch_count;
+    size_t scratch_capacity;
+    const char *text;
+    char *copy;
+} ParseState;
+
+static int is_space_byte(char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
 }
 
-static int append_word(SentenceEntry *entry, const char *start, size_t len) {
+static int append_word(ParseState *st, size_t start, size_t len) {
     if (len == 0) return 0;
-    SentenceWord *new_words = realloc(entry->words, sizeof(SentenceWord) * (entry->word_count + 1));
-    if (!new_words) return -1;
-    entry->words = new_words;
-    char *buffer = (char *)malloc(len + 1);
-    if (!buffer) return -1;
-    memcpy(buffer, start, len);
-    buffer[len] = '\0';
-    entry->words[entry->word_count].text = buffer;
-    entry->word_count += 1;
+    if (st->scratch_count == st->scratch_capacity) {
+        size_t capacity = st->scratch_capacity ? st->scratch_capacity * 2 : 64;
+        SentenceWord *grown = realloc(st->scratch, sizeof(SentenceWord) * capacity);
+        if (!grown) return -1;
+        st->scratch = grown;
+        st->scratch_capacity = capacity;
+    }
+    char *text;
+    char end = st->text[start + len];
+    if (end == '\0' || is_space_byte(end)) {
+        text = st->copy + start;
+        text[len] = '\0';
+    } else {
+        // "a.b": the next word starts right after this one
+        text = sentence_arena_strndup(&st->collection->arena, st->text + start, len);
+        if (!text) return -1;
+    }
+    st->scratch[st->scratch_count++].text = text;
     return 0;
 }
 
-static int finalize_sentence(SentenceCollection *collection, SentenceEntry *current) {
-    if (current->word_count == 0) {
-        free_sentence(current);
-        return 0;
+// Append the delimiter to the last word (delimiter after whitespace)
+static int append_delim(ParseState *st, char delim) {
+    SentenceWord *last = &st->scratch[st->scratch_count - 1];
+    size_t old_len = strlen(last->text);
+    char *text = sentence_arena_alloc(&st->collection->arena, old_len + 2);
+    if (!text) return -1;
+    memcpy(text, last->text, old_len);
+    text[old_len] = delim;
+    text[old_len + 1] = '\0';
+    last->text = text;
+    return 0;
+}
+
+static int push_sentence(ParseState *st, int sentence_id) {
+    SentenceCollection *collection = st->collection;
+    if (collection->count == st->sentence_capacity) {
+        size_t capacity = st->sentence_capacity ? st->sentence_capacity * 2 : 16;
+        SentenceEntry *grown = realloc(collection->sentences, sizeof(SentenceEntry) * capacity);
+        if (!grown) return -1;
+        collection->sentences = grown;
+        st->sentence_capacity = capacity;
     }
-    SentenceEntry *new_array = realloc(collection->sentences, sizeof(SentenceEntry) * (collection->count + 1));
-    if (!new_array) {
-        free_sentence(current);
-        return -1;
+    SentenceEntry *entry = &collection->sentences[collection->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->sentence_id = sentence_id;
+    entry->version = 1;
+    if (st->scratch_count > 0) {
+        entry->words = sentence_arena_alloc(&collection->arena,
+                                            sizeof(SentenceWord) * st->scratch_count);
+        if (!entry->words) return -1;
+        memcpy(entry->words, st->scratch, sizeof(SentenceWord) * st->scratch_count);
+        entry->word_count = st->scratch_count;
     }
-    collection->sentences = new_array;
-    collection->sentences[collection->count] = *current;
     collection->count++;
-    memset(current, 0, sizeof(*current));
+    st->scratch_count = 0;
     return 0;
 }
 
@@ -67,98 +154,93 @@ int sentence_parse_text(const char *text,
     if (!text || !collection || !next_sentence_id_out) return -1;
     memset(collection, 0, sizeof(*collection));
 
+    ParseState st = { collection, 0, NULL, 0, 0, text, NULL };
     int next_id = start_sentence_id;
-    SentenceEntry current = {0};
-    current.sentence_id = next_id++;
-    current.version = 1;
-
-    const char *p = text;
-    const char *token_start = NULL;
-    while (*p) {
-        if (isspace((unsigned char)*p)) {
-            if (token_start) {
-                if (append_word(&current, token_start, (size_t)(p - token_start)) != 0) {
-                    sentence_collection_free(collection);
-                    free_sentence(&current);
-                    return -1;
+    int current_id = next_id++;
+
+    // Only bytes where a word starts, a word ends at whitespace, or a
+    // delimiter sits are visited; the rest is skipped via the masks
+    size_t len = strlen(text);
+    st.copy = sentence_arena_alloc(&collection->arena, len + 1);
+    if (!st.copy) return -1;
+    memcpy(st.copy, text, len + 1);
+    TextScanMasks masks;
+    uint64_t prev_word = 0;     // Last byte of the previous block is in a word
+    size_t token_start = 0;
+    int in_token = 0;
+    for (size_t base = 0; base < len; base += TEXT_SCAN_CHUNK) {
+        size_t n = len - base < TEXT_SCAN_CHUNK ? len - base : TEXT_SCAN_CHUNK;
+        text_scan_classify(text + base, n, &masks);
+        for (size_t b = 0; b * 64 < n; b++) {
+            size_t left = n - b * 64;
+            uint64_t valid = left >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << left) - 1;
+            uint64_t space = masks.space[b];
+            uint64_t delim = masks.delim[b];
+            uint64_t word = ~(space | delim) & valid;
+            uint64_t after_word = (word << 1) | prev_word;
+            uint64_t starts = word & ~after_word;
+            prev_word = word >> 63;
+
+            uint64_t events = starts | delim | (space & after_word);
+            while (events) {
+                int bit = __builtin_ctzll(events);
+                events &= events - 1;
+                uint64_t one = (uint64_t)1 << bit;
+                size_t pos = base + b * 64 + (size_t)bit;
+                if (starts & one) {
+                    token_start = pos;
+                    in_token = 1;
+                    continue;
                 }
-                token_start = NULL;
-            }
-            p++;
-            continue;
-        }
-        if (is_sentence_delim(*p)) {
-            if (token_start) {
-                if (append_word(&current, token_start, (size_t)(p - token_start + 1)) != 0) {
-                    sentence_collection_free(collection);
-                    free_sentence(&current);
-                    return -1;
+                if (space & one) {
+                    if (append_word(&st, token_start, pos - token_start) != 0) goto fail;
+                    in_token = 0;
+                    continue;
                 }
-                token_start = NULL;
-            } else if (current.word_count > 0) {
-                // Append delimiter to last word
-                SentenceWord *last = &current.words[current.word_count - 1];
-                size_t old_len = strlen(last->text);
-                char *resized = realloc(last->text, old_len + 2);
-                if (!resized) {
-                    sentence_collection_free(collection);
-                    free_sentence(&current);
-                    return -1;
+                if (in_token) {
+                    if (append_word(&st, token_start, pos - token_start + 1) != 0) goto fail;
+                    in_token = 0;
+                } else if (st.scratch_count > 0) {
+                    if (append_delim(&st, text[pos]) != 0) goto fail;
                 }
-                resized[old_len] = *p;
-                resized[old_len + 1] = '\0';
-                last->text = resized;
-            }
 
-            if (finalize_sentence(collection, &current) != 0) {
-                sentence_collection_free(collection);
-                return -1;
+                // Sentences without words are dropped; their id is still used
+                if (st.scratch_count > 0 && push_sentence(&st, current_id) != 0) goto fail;
+                current_id = next_id++;
             }
-            current.sentence_id = next_id++;
-            current.version = 1;
-            p++;
-            continue;
-        }
-
-        if (!token_start) {
-            token_start = p;
-        }
-        p++;
-    }
-
-    if (token_start) {
-        if (append_word(&current, token_start, (size_t)(p - token_start)) != 0) {
-            sentence_collection_free(collection);
-            free_sentence(&current);
-            return -1;
         }
     }
 
-        if (finalize_sentence(collection, &current) != 0) {
-        sentence_collection_free(collection);
-        return -1;
+    if (in_token) {
+        if (append_word(&st, token_start, len - token_start) != 0) goto fail;
     }
+    if (st.scratch_count > 0 && push_sentence(&st, current_id) != 0) goto fail;
     if (collection->count == 0) {
-        SentenceEntry *arr = realloc(collection->sentences, sizeof(SentenceEntry));
-        if (!arr) {
-            sentence_collection_free(collection);
-            return -1;
-        }
-        collection->sentences = arr;
-        memset(&collection->sentences[0], 0, sizeof(SentenceEntry));
-        collection->sentences[0].sentence_id = next_id++;
-        collection->sentences[0].version = 1;
-        collection->count = 1;
+        if (push_sentence(&st, next_id++) != 0) goto fail;
     }
+    free(st.scratch);
 
     *next_sentence_id_out = next_id;
     return 0;
+
+fail:
+    free(st.scratch);
+    sentence_collection_free(collection);
+    return -1;
 }
 
 int sentence_render_text(const SentenceCollection *collection, char **out_text, size_t *out_len) {
     if (!collection || !out_text || !out_len) return -1;
-    size_t capacity = 1024;
-    char *buffer = (char *)malloc(capacity);
+    // Size first: one word per space, no reallocation while copying
+    size_t total = 0;
+    for (size_t i = 0; i < collection->count; i++) {
+        const SentenceEntry *entry = &collection->sentences[i];
+        for (size_t w = 0; w < entry->word_count; w++) {
+            total += (entry->words[w].text ? strlen(entry->words[w].text) : 0) + 1;
+        }
+        total++;
+    }
+    char *buffer = (char *)malloc(total + 1);
     if (!buffer) return -1;
     size_t written = 0;
 
@@ -167,25 +249,6 @@ int sentence_render_text(const SentenceCollection *collection, char **out_text,
         for (size_t w = 0; w < entry->word_count; w++) {
             const char *word = entry->words[w].text ? entry->words[w].text : "";
             size_t len = strlen(word);
-            // Add space if needed
-            if (written > 0 && written + len + 1 >= capacity) {
-                capacity *= 2;
-                char *tmp = realloc(buffer, capacity);
-                if (!tmp) {
-                    free(buffer);
-                    return -1;
-                }
-                buffer = tmp;
-            } else if (written + len + 1 >= capacity) {
-                capacity *= 2;
-                char *tmp = realloc(buffer, capacity);
-                if (!tmp) {
-                    free(buffer);
-                    return -1;
-                }
-                buffer = tmp;
-            }
-
             if (written > 0) {
                 buffer[written++] = ' ';
             }
@@ -193,15 +256,6 @@ int sentence_render_text(const SentenceCollection *collection, char **out_text,
             written += len;
         }
         if (i + 1 < collection->count) {
-            if (written + 1 >= capacity) {
-                capacity *= 2;
-                char *tmp = realloc(buffer, capacity);
-                if (!tmp) {
-                    free(buffer);
-                    return -1;
-                }
-                buffer = tmp;
-            }
             buffer[written++] = ' ';
         }
     }
@@ -211,5 +265,3 @@ int sentence_render_text(const SentenceCollection *collection, char **out_text,
     *out_len = written;
     return 0;
 }
-
-
@@ -16,9 +16,33 @@ typedef struct SentenceEntry {
     size_t word_count;
 } SentenceEntry;
 
+// Bump allocator for words and word arrays. Everything allocated from an
+// arena is released at once by sentence_arena_free(); there is no per-item
+// free. Blocks grow geometrically, so parsing a document costs a few dozen
+// mallocs instead of one or two per word.
+typedef struct SentenceArenaBlock SentenceArenaBlock;
+
+typedef struct SentenceArena {
+    SentenceArenaBlock *head;   // Current block; older blocks chained behind
+    size_t next_block;          // Size of the next block to allocate
+} SentenceArena;
+
+// Returns 8-byte aligned memory valid until sentence_arena_free(), or NULL
+void *sentence_arena_alloc(SentenceArena *arena, size_t size);
+
+// Copy len bytes of s plus a terminating NUL into the arena
+char *sentence_arena_strndup(SentenceArena *arena, const char *s, size_t len);
+
+// Release every allocation (the arena can be reused afterwards)
+void sentence_arena_free(SentenceArena *arena);
+
+// Word texts and word arrays live in the collection's arena; the
+// sentences array is malloc'd. Entries may be moved into another
+// collection as long as this one is freed after it.
 typedef struct SentenceCollection {
     SentenceEntry *sentences;
     size_t count;
+    SentenceArena arena;
 } SentenceCollection;
 
 // Parse raw text into a collection of sentences and words.
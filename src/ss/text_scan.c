@@ -0,0 +1,222 @@
+#include "text_scan.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TEXT_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*ClassifyBlockFn)(const unsigned char *p, uint64_t *space, uint64_t *delim);
+
+// ---- Scalar ----
+
+#define CLASS_SPACE 1
+#define CLASS_DELIM 2
+
+static const unsigned char g_class[256] = {
+    ['\t'] = CLASS_SPACE, ['\n'] = CLASS_SPACE, ['\v'] = CLASS_SPACE,
+    ['\f'] = CLASS_SPACE, ['\r'] = CLASS_SPACE, [' '] = CLASS_SPACE,
+    ['.'] = CLASS_DELIM, ['!'] = CLASS_DELIM, ['?'] = CLASS_DELIM,
+};
+
+static void classify_block_scalar(const unsigned char *p, uint64_t *space, uint64_t *delim) {
+    uint64_t s = 0, d = 0;
+    for (int i = 0; i < 64; i++) {
+        unsigned c = g_class[p[i]];
+        s |= (uint64_t)(c & CLASS_SPACE) << i;
+        d |= (uint64_t)(c >> 1) << i;
+    }
+    *space = s;
+    *delim = d;
+}
+
+// ---- SSE2 / AVX2 ----
+// Whitespace is ' ' or 0x09..0x0d: (c - 9) <= 4 unsigned, tested as
+// min_epu8(c - 9, 4) == c - 9 since there is no unsigned byte compare.
+
+#ifdef TEXT_SCAN_X86
+
+#ifdef __SSE2__
+static void classify_block_sse2(const unsigned char *p, uint64_t *space, uint64_t *delim) {
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i four = _mm_set1_epi8(4);
+    const __m128i blank = _mm_set1_epi8(' ');
+    const __m128i dot = _mm_set1_epi8('.');
+    const __m128i bang = _mm_set1_epi8('!');
+    const __m128i ques = _mm_set1_epi8('?');
+    uint64_t s = 0, d = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+        __m128i ctl = _mm_sub_epi8(v, nine);
+        __m128i sp = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(ctl, four), ctl),
+                                  _mm_cmpeq_epi8(v, blank));
+        __m128i de = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, dot), _mm_cmpeq_epi8(v, bang)),
+                                  _mm_cmpeq_epi8(v, ques));
+        s |= (uint64_t)(uint16_t)_mm_movemask_epi8(sp) << (16 * i);
+        d |= (uint64_t)(uint16_t)_mm_movemask_epi8(de) << (16 * i);
+    }
+    *space = s;
+    *delim = d;
+}
+#endif
+
+__attribute__((target("avx2")))
+static void classify_block_avx2(const unsigned char *p, uint64_t *space, uint64_t *delim) {
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i four = _mm256_set1_epi8(4);
+    const __m256i blank = _mm256_set1_epi8(' ');
+    const __m256i dot = _mm256_set1_epi8('.');
+    const __m256i bang = _mm256_set1_epi8('!');
+    const __m256i ques = _mm256_set1_epi8('?');
+    uint64_t s = 0, d = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * i));
+        __m256i ctl = _mm256_sub_epi8(v, nine);
+        __m256i sp = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(ctl, four), ctl),
+                                     _mm256_cmpeq_epi8(v, blank));
+        __m256i de = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, dot),
+                                                     _mm256_cmpeq_epi8(v, bang)),
+                                     _mm256_cmpeq_epi8(v, ques));
+        s |= (uint64_t)(uint32_t)_mm256_movemask_epi8(sp) << (32 * i);
+        d |= (uint64_t)(uint32_t)_mm256_movemask_epi8(de) << (32 * i);
+    }
+    *space = s;
+    *delim = d;
+}
+
+#endif
+
+// ---- Dispatch ----
+
+static ClassifyBlockFn g_classify = NULL;
+static const char *g_impl_name = "scalar";
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+static int impl_supported(TextScanImpl impl) {
+    switch (impl) {
+        case TEXT_SCAN_SCALAR:
+            return 1;
+#ifdef TEXT_SCAN_X86
+#ifdef __SSE2__
+        case TEXT_SCAN_SSE2:
+            return 1;
+#endif
+        case TEXT_SCAN_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return 0;
+    }
+}
+
+static void set_impl(TextScanImpl impl) {
+    switch (impl) {
+#ifdef TEXT_SCAN_X86
+        case TEXT_SCAN_AVX2:
+            g_classify = classify_block_avx2;
+            g_impl_name = "avx2";
+            return;
+#ifdef __SSE2__
+        case TEXT_SCAN_SSE2:
+            g_classify = classify_block_sse2;
+            g_impl_name = "sse2";
+            return;
+#endif
+#endif
+        default:
+            g_classify = classify_block_scalar;
+            g_impl_name = "scalar";
+            return;
+    }
+}
+
+static void select_best(void) {
+    if (impl_supported(TEXT_SCAN_AVX2)) set_impl(TEXT_SCAN_AVX2);
+    else if (impl_supported(TEXT_SCAN_SSE2)) set_impl(TEXT_SCAN_SSE2);
+    else set_impl(TEXT_SCAN_SCALAR);
+}
+
+int text_scan_select(TextScanImpl impl) {
+    pthread_once(&g_once, select_best);
+    if (impl == TEXT_SCAN_AUTO) {
+        select_best();
+        return 0;
+    }
+    if (!impl_supported(impl)) return -1;
+    set_impl(impl);
+    return 0;
+}
+
+const char *text_scan_impl_name(void) {
+    pthread_once(&g_once, select_best);
+    return g_impl_name;
+}
+
+void text_scan_classify(const char *text, size_t len, TextScanMasks *masks) {
+    pthread_once(&g_once, select_best);
+    if (len > TEXT_SCAN_CHUNK) len = TEXT_SCAN_CHUNK;
+    const unsigned char *p = (const unsigned char *)text;
+    size_t full = len / 64;
+    for (size_t b = 0; b < full; b++) {
+        g_classify(p + b * 64, &masks->space[b], &masks->delim[b]);
+    }
+    size_t blocks = full;
+    if (len % 64) {
+        // NUL padding classifies as neither class
+        unsigned char tail[64] = {0};
+        memcpy(tail, p + full * 64, len % 64);
+        g_classify(tail, &masks->space[full], &masks->delim[full]);
+        blocks++;
+    }
+    for (size_t b = blocks; b < TEXT_SCAN_CHUNK / 64; b++) {
+        masks->space[b] = 0;
+        masks->delim[b] = 0;
+    }
+}
+
+size_t text_scan_words(const char *text, size_t len, TextScanWordFn fn, void *ctx) {
+    if (!text) return 0;
+    TextScanMasks masks;
+    size_t words = 0;
+    uint64_t prev_word = 0;     // Last byte of the previous block is in a word
+    size_t start = 0;
+    int in_word = 0;
+    for (size_t base = 0; base < len; base += TEXT_SCAN_CHUNK) {
+        size_t n = len - base < TEXT_SCAN_CHUNK ? len - base : TEXT_SCAN_CHUNK;
+        text_scan_classify(text + base, n, &masks);
+        for (size_t b = 0; b * 64 < n; b++) {
+            size_t left = n - b * 64;
+            uint64_t valid = left >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << left) - 1;
+            uint64_t word = ~masks.space[b] & valid;
+            uint64_t after_word = (word << 1) | prev_word;
+            uint64_t starts = word & ~after_word;
+            prev_word = word >> 63;
+            if (!fn) {
+                words += (size_t)__builtin_popcountll(starts);
+                continue;
+            }
+            uint64_t events = starts | (masks.space[b] & after_word);
+            while (events) {
+                int bit = __builtin_ctzll(events);
+                events &= events - 1;
+                size_t pos = base + b * 64 + (size_t)bit;
+                if (starts & ((uint64_t)1 << bit)) {
+                    start = pos;
+                    in_word = 1;
+                    continue;
+                }
+                in_word = 0;
+                words++;
+                if (fn(ctx, text + start, pos - start) != 0) return words;
+            }
+        }
+    }
+    if (fn && in_word) {
+        words++;
+        fn(ctx, text + start, len - start);
+    }
+    return words;
+}
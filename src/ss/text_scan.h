@@ -0,0 +1,48 @@
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte classification for the sentence parser and word counters: text is
+// classified a block at a time into whitespace and sentence-delimiter
+// bitmasks with the best kernel the CPU supports (AVX2, SSE2 or scalar).
+// Stateless apart from the kernel choice; safe to call from any thread.
+
+#define TEXT_SCAN_CHUNK 4096    // Bytes classified per text_scan_classify()
+
+typedef enum {
+    TEXT_SCAN_AUTO,
+    TEXT_SCAN_SCALAR,
+    TEXT_SCAN_SSE2,
+    TEXT_SCAN_AVX2,
+} TextScanImpl;
+
+// Masks for one chunk: byte i is bit (i % 64) of word i / 64
+typedef struct {
+    uint64_t space[TEXT_SCAN_CHUNK / 64];
+    uint64_t delim[TEXT_SCAN_CHUNK / 64];
+} TextScanMasks;
+
+// Classify text[0, len), len <= TEXT_SCAN_CHUNK (bits past len are clear)
+void text_scan_classify(const char *text, size_t len, TextScanMasks *masks);
+
+// Called for each whitespace-separated word; non-zero stops the walk
+typedef int (*TextScanWordFn)(void *ctx, const char *word, size_t len);
+
+// Walk the whitespace-separated words of text[0, len)
+// fn: NULL to only count
+// Returns: words visited (including the one fn stopped at)
+//
+// Usage:
+//   size_t words = text_scan_words(content, strlen(content), NULL, NULL);
+size_t text_scan_words(const char *text, size_t len, TextScanWordFn fn, void *ctx);
+
+// Force a kernel (benchmarks, testing)
+// Returns: 0 on success, -1 if the CPU or build does not support it
+int text_scan_select(TextScanImpl impl);
+
+// Name of the kernel in use ("avx2", "sse2" or "scalar")
+const char *text_scan_impl_name(void);
+
+#endif
@@ -0,0 +1,706 @@
+#define _POSIX_C_SOURCE 200809L
+#include "undo_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "meta_format.h"
+
+// Journal layout (host byte order):
+//   UndoJournalHeader     magic, version, floor
+//   step*                 UndoStepHeader, body, UndoStepTrailer
+// Steps before floor are cut off by the depth limit. The trailer repeats
+// the step length so the newest step can be found from the end.
+
+#define UNDO_MAGIC "SSUJ"
+#define UNDO_VERSION 1
+
+#define UNDO_STEP_DELTA 1
+#define UNDO_STEP_SNAPSHOT 2
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t floor;             // Offset of the oldest live step
+    uint64_t reserved[2];
+} UndoJournalHeader;
+
+typedef struct {
+    char magic[4];
+    uint32_t kind;
+    uint64_t body_len;
+} UndoStepHeader;
+
+typedef struct {
+    uint64_t step_len;          // Header + body + trailer
+    char magic[4];
+    uint32_t reserved;
+} UndoStepTrailer;
+
+// Delta body: UndoDeltaRecord, edit_count x UndoEditRecord, then each
+// edit's new text followed by its old text
+typedef struct {
+    uint64_t old_size;
+    uint64_t new_size;
+    int64_t old_last_modified;
+    int64_t old_last_accessed;
+    int32_t old_word_count;
+    int32_t old_char_count;
+    int32_t old_next_sentence_id;
+    int32_t old_sentence_count;
+    int32_t new_sentence_count;
+    uint32_t edit_count;
+} UndoDeltaRecord;
+
+typedef struct {
+    uint64_t new_offset;
+    uint64_t new_length;
+    uint64_t old_length;
+    int32_t meta_index;
+    int32_t meta_count;
+    MetaSentenceRecord old_sentence;
+} UndoEditRecord;
+
+// Snapshot body: UndoSnapshotRecord, .meta image, data file
+typedef struct {
+    uint64_t meta_length;
+    uint64_t data_length;
+} UndoSnapshotRecord;
+
+static int g_depth = UNDO_DEFAULT_DEPTH;
+
+void undo_log_set_depth(int depth) {
+    g_depth = depth < 1 ? 1 : depth;
+}
+
+static const char *normalize_filename(const char *filename) {
+    return filename[0] == '/' ? filename + 1 : filename;
+}
+
+static void build_journal_path(const char *storage_dir, const char *filename,
+                               char *path, size_t len) {
+    snprintf(path, len, "%s/metadata/%s.undo", storage_dir, normalize_filename(filename));
+}
+
+// Single-level undo files written by older servers
+static void build_legacy_paths(const char *storage_dir, const char *filename,
+                               char *meta_path, char *data_path, size_t len) {
+    const char *norm = normalize_filename(filename);
+    snprintf(meta_path, len, "%s/metadata/%s.undo.meta", storage_dir, norm);
+    snprintf(data_path, len, "%s/metadata/%s.undo.data", storage_dir, norm);
+}
+
+static void discard_legacy(const char *storage_dir, const char *filename) {
+    char meta_path[1024];
+    char data_path[1024];
+    build_legacy_paths(storage_dir, filename, meta_path, data_path, sizeof(meta_path));
+    unlink(meta_path);
+    unlink(data_path);
+}
+
+static int read_at(int fd, void *buf, size_t len, size_t off) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, (off_t)off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        off += (size_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Open the journal and read its header; create it if asked
+// Returns: fd, or -1 if it does not exist (and create is 0) or is unreadable
+static int journal_open(const char *path, int create, UndoJournalHeader *hdr, size_t *end) {
+    int fd = open(path, create ? O_RDWR | O_CREAT : O_RDWR, 0666);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0 && create) {
+        memset(hdr, 0, sizeof(*hdr));
+        memcpy(hdr->magic, UNDO_MAGIC, 4);
+        hdr->version = UNDO_VERSION;
+        hdr->floor = sizeof(*hdr);
+        if (file_write_fd(fd, hdr, sizeof(*hdr)) != 0) {
+            close(fd);
+            return -1;
+        }
+        *end = sizeof(*hdr);
+        return fd;
+    }
+    if ((size_t)st.st_size < sizeof(*hdr) || read_at(fd, hdr, sizeof(*hdr), 0) != 0 ||
+        memcmp(hdr->magic, UNDO_MAGIC, 4) != 0 || hdr->version != UNDO_VERSION ||
+        hdr->floor < sizeof(*hdr) || hdr->floor > (uint64_t)st.st_size) {
+        close(fd);
+        return -1;
+    }
+    *end = (size_t)st.st_size;
+    return fd;
+}
+
+// Locate the newest live step
+// Returns: 0 with *start / *step filled, 1 if there is none, -1 if the
+//          journal is corrupt
+static int journal_last_step(int fd, const UndoJournalHeader *hdr, size_t end,
+                             size_t *start, UndoStepHeader *step) {
+    if (end <= hdr->floor) return 1;
+    UndoStepTrailer tr;
+    if (end < hdr->floor + sizeof(UndoStepHeader) + sizeof(tr) ||
+        read_at(fd, &tr, sizeof(tr), end - sizeof(tr)) != 0 ||
+        memcmp(tr.magic, UNDO_MAGIC, 4) != 0 || tr.step_len > end - hdr->floor) {
+        return -1;
+    }
+    *start = end - tr.step_len;
+    if (read_at(fd, step, sizeof(*step), *start) != 0 ||
+        memcmp(step->magic, UNDO_MAGIC, 4) != 0 ||
+        step->body_len + sizeof(*step) + sizeof(tr) != tr.step_len) {
+        return -1;
+    }
+    return 0;
+}
+
+// Cut steps beyond the depth limit, compacting when the dead prefix
+// outweighs the live steps
+static void journal_trim(int fd, const char *path, UndoJournalHeader *hdr, size_t end) {
+    size_t count = 0;
+    for (size_t off = hdr->floor; off < end; count++) {
+        UndoStepHeader step;
+        if (read_at(fd, &step, sizeof(step), off) != 0) return;
+        off += sizeof(step) + step.body_len + sizeof(UndoStepTrailer);
+    }
+    if (count > (size_t)g_depth) {
+        for (size_t i = 0; i < count - (size_t)g_depth; i++) {
+            UndoStepHeader step;
+            if (read_at(fd, &step, sizeof(step), hdr->floor) != 0) return;
+            hdr->floor += sizeof(step) + step.body_len + sizeof(UndoStepTrailer);
+        }
+        if (pwrite(fd, hdr, sizeof(*hdr), 0) != (ssize_t)sizeof(*hdr)) return;
+    }
+    if (hdr->floor - sizeof(*hdr) <= end - hdr->floor) return;
+
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int out = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out < 0) return;
+    UndoJournalHeader fresh = *hdr;
+    fresh.floor = sizeof(fresh);
+    if (file_write_fd(out, &fresh, sizeof(fresh)) != 0 ||
+        file_copy_range(fd, hdr->floor, out, end - hdr->floor) != 0 ||
+        fsync(out) != 0) {
+        close(out);
+        unlink(tmp_path);
+        return;
+    }
+    close(out);
+    if (rename(tmp_path, path) != 0) unlink(tmp_path);
+}
+
+// Append count steps of one kind with one fsync: step i is body_lens[i]
+// bytes written by fill(fd, arg, i), which must leave the file position
+// at the end of the body
+static int journal_append(const char *storage_dir, const char *filename, uint32_t kind,
+                          size_t count, const uint64_t *body_lens,
+                          int (*fill)(int fd, const void *arg, size_t i), const void *arg) {
+    char path[1024];
+    build_journal_path(storage_dir, filename, path, sizeof(path));
+    UndoJournalHeader hdr;
+    size_t end = 0;
+    int fd = journal_open(path, 1, &hdr, &end);
+    if (fd < 0) {
+        // Unreadable journal: start over rather than refuse commits
+        unlink(path);
+        fd = journal_open(path, 1, &hdr, &end);
+        if (fd < 0) return -1;
+    }
+    int ok = lseek(fd, (off_t)end, SEEK_SET) >= 0;
+    size_t new_end = end;
+    for (size_t i = 0; ok && i < count; i++) {
+        UndoStepHeader step;
+        memcpy(step.magic, UNDO_MAGIC, 4);
+        step.kind = kind;
+        step.body_len = body_lens[i];
+        UndoStepTrailer tr;
+        tr.step_len = sizeof(step) + body_lens[i] + sizeof(tr);
+        memcpy(tr.magic, UNDO_MAGIC, 4);
+        tr.reserved = 0;
+        ok = file_write_fd(fd, &step, sizeof(step)) == 0 &&
+             fill(fd, arg, i) == 0 &&
+             file_write_fd(fd, &tr, sizeof(tr)) == 0;
+        new_end += (size_t)tr.step_len;
+    }
+    if (!ok || fsync(fd) != 0) {
+        if (ftruncate(fd, (off_t)end) != 0) unlink(path);
+        close(fd);
+        return -1;
+    }
+    journal_trim(fd, path, &hdr, new_end);
+    close(fd);
+    discard_legacy(storage_dir, filename);
+    return 0;
+}
+
+static int fill_delta(int fd, const void *arg, size_t i) {
+    const UndoDelta *delta = (const UndoDelta *)arg + i;
+    UndoDeltaRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.old_size = delta->old_size;
+    rec.new_size = delta->new_size;
+    rec.old_last_modified = delta->old_last_modified;
+    rec.old_last_accessed = delta->old_last_accessed;
+    rec.old_word_count = delta->old_word_count;
+    rec.old_char_count = delta->old_char_count;
+    rec.old_next_sentence_id = delta->old_next_sentence_id;
+    rec.old_sentence_count = delta->old_sentence_count;
+    rec.new_sentence_count = delta->new_sentence_count;
+    rec.edit_count = (uint32_t)delta->edit_count;
+    if (file_write_fd(fd, &rec, sizeof(rec)) != 0) return -1;
+    for (size_t k = 0; k < delta->edit_count; k++) {
+        const UndoEdit *e = &delta->edits[k];
+        UndoEditRecord er;
+        memset(&er, 0, sizeof(er));
+        er.new_offset = e->new_offset;
+        er.new_length = e->new_length;
+        er.old_length = e->old_length;
+        er.meta_index = e->meta_index;
+        er.meta_count = e->meta_count;
+        er.old_sentence.sentence_id = e->old_sentence.sentence_id;
+        er.old_sentence.version = e->old_sentence.version;
+        er.old_sentence.offset = e->old_sentence.offset;
+        er.old_sentence.length = e->old_sentence.length;
+        er.old_sentence.word_count = e->old_sentence.word_count;
+        er.old_sentence.char_count = e->old_sentence.char_count;
+        if (file_write_fd(fd, &er, sizeof(er)) != 0) return -1;
+    }
+    for (size_t k = 0; k < delta->edit_count; k++) {
+        const UndoEdit *e = &delta->edits[k];
+        if (file_write_fd(fd, e->new_text, e->new_length) != 0 ||
+            file_write_fd(fd, e->old_text, e->old_length) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int undo_log_record_deltas(const char *storage_dir, const char *filename,
+                           const UndoDelta *deltas, size_t count) {
+    if (!storage_dir || !filename || !deltas || count == 0) return -1;
+    uint64_t *body_lens = malloc(sizeof(uint64_t) * count);
+    int rc = body_lens ? 0 : -1;
+    for (size_t i = 0; rc == 0 && i < count; i++) {
+        const UndoDelta *delta = &deltas[i];
+        body_lens[i] = sizeof(UndoDeltaRecord) + delta->edit_count * sizeof(UndoEditRecord);
+        for (size_t k = 0; k < delta->edit_count; k++) {
+            body_lens[i] += delta->edits[k].new_length + delta->edits[k].old_length;
+        }
+    }
+    if (rc == 0) {
+        rc = journal_append(storage_dir, filename, UNDO_STEP_DELTA, count, body_lens,
+                            fill_delta, deltas);
+    }
+    free(body_lens);
+    if (rc != 0) {
+        undo_log_discard(storage_dir, filename);
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    int meta_fd;
+    int data_fd;
+    UndoSnapshotRecord rec;
+} SnapshotSource;
+
+static int fill_snapshot(int fd, const void *arg, size_t i) {
+    (void)i;
+    const SnapshotSource *src = arg;
+    if (file_write_fd(fd, &src->rec, sizeof(src->rec)) != 0 ||
+        file_copy_range(src->meta_fd, 0, fd, src->rec.meta_length) != 0 ||
+        file_copy_range(src->data_fd, 0, fd, src->rec.data_length) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int undo_log_record_snapshot(const char *storage_dir, const char *filename) {
+    if (!storage_dir || !filename) return -1;
+    const char *norm = normalize_filename(filename);
+    char meta_path[1024];
+    char data_path[1024];
+    snprintf(meta_path, sizeof(meta_path), "%s/metadata/%s.meta", storage_dir, norm);
+    snprintf(data_path, sizeof(data_path), "%s/files/%s", storage_dir, norm);
+    SnapshotSource src;
+    src.meta_fd = open(meta_path, O_RDONLY);
+    src.data_fd = open(data_path, O_RDONLY);
+    struct stat mst, dst;
+    int rc = -1;
+    if (src.meta_fd >= 0 && src.data_fd >= 0 &&
+        fstat(src.meta_fd, &mst) == 0 && fstat(src.data_fd, &dst) == 0) {
+        src.rec.meta_length = (uint64_t)mst.st_size;
+        src.rec.data_length = (uint64_t)dst.st_size;
+        uint64_t body_len = sizeof(src.rec) + src.rec.meta_length + src.rec.data_length;
+        rc = journal_append(storage_dir, filename, UNDO_STEP_SNAPSHOT, 1, &body_len,
+                            fill_snapshot, &src);
+    }
+    if (src.meta_fd >= 0) close(src.meta_fd);
+    if (src.data_fd >= 0) close(src.data_fd);
+    return rc;
+}
+
+int undo_log_exists(const char *storage_dir, const char *filename) {
+    if (!storage_dir || !filename) return 0;
+    char path[1024];
+    build_journal_path(storage_dir, filename, path, sizeof(path));
+    UndoJournalHeader hdr;
+    size_t end = 0;
+    int fd = journal_open(path, 0, &hdr, &end);
+    if (fd < 0) {
+        char meta_path[1024];
+        char data_path[1024];
+        build_legacy_paths(storage_dir, filename, meta_path, data_path, sizeof(meta_path));
+        return access(meta_path, F_OK) == 0 && access(data_path, F_OK) == 0;
+    }
+    size_t start;
+    UndoStepHeader step;
+    int rc = journal_last_step(fd, &hdr, end, &start, &step);
+    close(fd);
+    return rc == 0;
+}
+
+// Parse a delta step body into step (edits and texts point into body)
+// Returns: 0 on success, 1 if the body is malformed, -1 on allocation failure
+static int parse_delta(const char *body, size_t body_len, UndoDeltaStep *step) {
+    memset(step, 0, sizeof(*step));
+    UndoDeltaRecord rec;
+    if (body_len < sizeof(rec)) return 1;
+    memcpy(&rec, body, sizeof(rec));
+    size_t table_len = rec.edit_count * sizeof(UndoEditRecord);
+    if (body_len - sizeof(rec) < table_len ||
+        rec.old_sentence_count <= 0 || rec.old_sentence_count > MAX_SENTENCE_METADATA ||
+        rec.new_sentence_count <= 0 || rec.new_sentence_count > MAX_SENTENCE_METADATA) {
+        return 1;
+    }
+    step->edits = calloc(rec.edit_count ? rec.edit_count : 1, sizeof(UndoEdit));
+    if (!step->edits) return -1;
+    size_t pos = sizeof(rec) + table_len;
+    for (uint32_t i = 0; i < rec.edit_count; i++) {
+        UndoEditRecord er;
+        memcpy(&er, body + sizeof(rec) + i * sizeof(er), sizeof(er));
+        if (body_len - pos < er.new_length + er.old_length ||
+            (i > 0 && er.new_offset < step->edits[i - 1].new_offset + step->edits[i - 1].new_length) ||
+            er.new_offset + er.new_length > rec.new_size ||
+            er.meta_index < 0 || er.meta_count < 1 ||
+            er.meta_index + er.meta_count > rec.new_sentence_count) {
+            free(step->edits);
+            step->edits = NULL;
+            return 1;
+        }
+        UndoEdit *e = &step->edits[i];
+        e->new_offset = (size_t)er.new_offset;
+        e->new_length = (size_t)er.new_length;
+        e->new_text = body + pos;
+        e->old_length = (size_t)er.old_length;
+        e->old_text = body + pos + er.new_length;
+        e->meta_index = er.meta_index;
+        e->meta_count = er.meta_count;
+        e->old_sentence.sentence_id = er.old_sentence.sentence_id;
+        e->old_sentence.version = er.old_sentence.version;
+        e->old_sentence.offset = (size_t)er.old_sentence.offset;
+        e->old_sentence.length = (size_t)er.old_sentence.length;
+        e->old_sentence.word_count = er.old_sentence.word_count;
+        e->old_sentence.char_count = er.old_sentence.char_count;
+        pos += er.new_length + er.old_length;
+    }
+    UndoDelta *d = &step->delta;
+    d->old_size = (size_t)rec.old_size;
+    d->new_size = (size_t)rec.new_size;
+    d->old_word_count = rec.old_word_count;
+    d->old_char_count = rec.old_char_count;
+    d->old_next_sentence_id = rec.old_next_sentence_id;
+    d->old_sentence_count = rec.old_sentence_count;
+    d->new_sentence_count = rec.new_sentence_count;
+    d->old_last_modified = (time_t)rec.old_last_modified;
+    d->old_last_accessed = (time_t)rec.old_last_accessed;
+    d->edits = step->edits;
+    d->edit_count = rec.edit_count;
+    return 0;
+}
+
+// Each edit's sentences collapse back into the one it replaced; the
+// sentences between move back by the size change
+int undo_delta_old_table(const UndoDelta *delta, const SentenceMeta *after, int after_count,
+                         SentenceMeta *before) {
+    if (!delta || !after || !before || after_count != delta->new_sentence_count) return -1;
+    int out = 0;
+    size_t e = 0;
+    size_t grown = 0;           // Bytes added by the edits passed so far
+    size_t shrunk = 0;          // Bytes they removed
+    for (int i = 0; i < after_count && out < delta->old_sentence_count;) {
+        if (e < delta->edit_count && i == delta->edits[e].meta_index) {
+            before[out++] = delta->edits[e].old_sentence;
+            grown += delta->edits[e].new_length;
+            shrunk += delta->edits[e].old_length;
+            i += delta->edits[e].meta_count;
+            e++;
+            continue;
+        }
+        before[out] = after[i];
+        before[out++].offset = after[i].offset - grown + shrunk;
+        i++;
+    }
+    return (e == delta->edit_count && out == delta->old_sentence_count) ? out : -1;
+}
+
+// Write the file as it was before a delta step
+// Returns: 0 on success, 1 if the file no longer matches the step, -1 on error
+static int undo_delta(const char *storage_dir, const char *filename,
+                      const char *body, size_t body_len) {
+    UndoDeltaStep step;
+    int rc = parse_delta(body, body_len, &step);
+    if (rc != 0) return rc;
+    const UndoDelta *delta = &step.delta;
+
+    const char *norm = normalize_filename(filename);
+    char data_path[1024];
+    char tmp_path[1100];
+    snprintf(data_path, sizeof(data_path), "%s/files/%s", storage_dir, norm);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.undo.tmp", data_path);
+    int in_fd = open(data_path, O_RDONLY);
+    struct stat st;
+    if (in_fd < 0 || fstat(in_fd, &st) != 0 || (size_t)st.st_size != delta->new_size) {
+        rc = 1;
+    }
+    // The bytes the step wrote must still be there
+    char *check = NULL;
+    for (size_t i = 0; rc == 0 && i < delta->edit_count; i++) {
+        const UndoEdit *e = &delta->edits[i];
+        char *grown = realloc(check, e->new_length + 1);
+        if (!grown) {
+            rc = -1;
+            break;
+        }
+        check = grown;
+        if (read_at(in_fd, check, e->new_length, e->new_offset) != 0 ||
+            memcmp(check, e->new_text, e->new_length) != 0) {
+            rc = 1;
+        }
+    }
+    free(check);
+    FileMetadata meta;
+    if (rc == 0 && metadata_load(storage_dir, filename, &meta) != 0) rc = -1;
+    if (rc == 0 && meta.sentence_count != delta->new_sentence_count) rc = 1;
+    SentenceMeta *table = NULL;
+    if (rc == 0) {
+        table = calloc((size_t)delta->old_sentence_count, sizeof(SentenceMeta));
+        if (!table) rc = -1;
+        else if (undo_delta_old_table(delta, meta.sentences, meta.sentence_count, table) < 0) rc = 1;
+    }
+
+    // Old file: gaps from the current file with the old texts spliced back
+    int out_fd = -1;
+    if (rc == 0) {
+        out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (out_fd < 0) rc = -1;
+    }
+    size_t at = 0;
+    for (size_t i = 0; rc == 0 && i < delta->edit_count; i++) {
+        const UndoEdit *e = &delta->edits[i];
+        if (file_copy_range(in_fd, at, out_fd, e->new_offset - at) != 0 ||
+            file_write_fd(out_fd, e->old_text, e->old_length) != 0) {
+            rc = -1;
+        }
+        at = e->new_offset + e->new_length;
+    }
+    if (rc == 0 && (file_copy_range(in_fd, at, out_fd, delta->new_size - at) != 0 ||
+                    fsync(out_fd) != 0)) {
+        rc = -1;
+    }
+    if (in_fd >= 0) close(in_fd);
+    if (out_fd >= 0 && close(out_fd) != 0 && rc == 0) rc = -1;
+    if (rc == 0 && rename(tmp_path, data_path) != 0) rc = -1;
+    if (out_fd >= 0 && rc != 0) unlink(tmp_path);
+    if (rc != 0) {
+        free(table);
+        free(step.edits);
+        return rc;
+    }
+
+    memcpy(meta.sentences, table, sizeof(SentenceMeta) * (size_t)delta->old_sentence_count);
+    free(table);
+    meta.sentence_count = delta->old_sentence_count;
+    meta.size_bytes = delta->old_size;
+    meta.word_count = delta->old_word_count;
+    meta.char_count = delta->old_char_count;
+    meta.next_sentence_id = delta->old_next_sentence_id;
+    meta.last_modified = delta->old_last_modified;
+    meta.last_accessed = delta->old_last_accessed;
+    free(step.edits);
+    return metadata_save(storage_dir, filename, &meta) == 0 ? 0 : -1;
+}
+
+// Replace dst with len bytes of fd at off (tmp file + rename)
+static int restore_range(int fd, size_t off, size_t len, const char *dst) {
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.undo.tmp", dst);
+    int out = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out < 0) return -1;
+    int rc = (file_copy_range(fd, off, out, len) == 0 && fsync(out) == 0) ? 0 : -1;
+    if (close(out) != 0) rc = -1;
+    if (rc == 0 && rename(tmp_path, dst) != 0) rc = -1;
+    if (rc != 0) unlink(tmp_path);
+    return rc;
+}
+
+static int undo_snapshot(const char *storage_dir, const char *filename,
+                         int fd, size_t body_off, size_t body_len) {
+    UndoSnapshotRecord rec;
+    if (body_len < sizeof(rec) || read_at(fd, &rec, sizeof(rec), body_off) != 0 ||
+        rec.meta_length + rec.data_length != body_len - sizeof(rec)) {
+        return 1;
+    }
+    const char *norm = normalize_filename(filename);
+    char meta_path[1024];
+    char data_path[1024];
+    snprintf(meta_path, sizeof(meta_path), "%s/metadata/%s.meta", storage_dir, norm);
+    snprintf(data_path, sizeof(data_path), "%s/files/%s", storage_dir, norm);
+    size_t meta_off = body_off + sizeof(rec);
+    if (restore_range(fd, meta_off + rec.meta_length, rec.data_length, data_path) != 0) {
+        return -1;
+    }
+    int rc = restore_range(fd, meta_off, rec.meta_length, meta_path);
+    metadata_invalidate(storage_dir, filename);
+    return rc;
+}
+
+// Restore the single-level .undo.meta / .undo.data pair of older servers
+static int undo_legacy(const char *storage_dir, const char *filename) {
+    char undo_meta[1024];
+    char undo_data[1024];
+    build_legacy_paths(storage_dir, filename, undo_meta, undo_data, sizeof(undo_meta));
+    int meta_fd = open(undo_meta, O_RDONLY);
+    int data_fd = open(undo_data, O_RDONLY);
+    int rc = 1;
+    struct stat mst, dst;
+    if (meta_fd >= 0 && data_fd >= 0 &&
+        fstat(meta_fd, &mst) == 0 && fstat(data_fd, &dst) == 0) {
+        const char *norm = normalize_filename(filename);
+        char meta_path[1024];
+        char data_path[1024];
+        snprintf(meta_path, sizeof(meta_path), "%s/metadata/%s.meta", storage_dir, norm);
+        snprintf(data_path, sizeof(data_path), "%s/files/%s", storage_dir, norm);
+        rc = restore_range(meta_fd, 0, (size_t)mst.st_size, meta_path);
+        metadata_invalidate(storage_dir, filename);
+        if (rc == 0) rc = restore_range(data_fd, 0, (size_t)dst.st_size, data_path);
+        if (rc == 0) discard_legacy(storage_dir, filename);
+    }
+    if (meta_fd >= 0) close(meta_fd);
+    if (data_fd >= 0) close(data_fd);
+    return rc;
+}
+
+int undo_log_undo(const char *storage_dir, const char *filename) {
+    if (!storage_dir || !filename) return -1;
+    char path[1024];
+    build_journal_path(storage_dir, filename, path, sizeof(path));
+    UndoJournalHeader hdr;
+    size_t end = 0;
+    int fd = journal_open(path, 0, &hdr, &end);
+    if (fd < 0) return undo_legacy(storage_dir, filename);
+    size_t start;
+    UndoStepHeader step;
+    int rc = journal_last_step(fd, &hdr, end, &start, &step);
+    if (rc != 0) {
+        close(fd);
+        if (rc < 0) unlink(path);
+        return rc < 0 ? -1 : 1;
+    }
+    size_t body_off = start + sizeof(step);
+    if (step.kind == UNDO_STEP_DELTA) {
+        char *body = malloc(step.body_len ? step.body_len : 1);
+        if (!body) {
+            close(fd);
+            return -1;
+        }
+        rc = read_at(fd, body, step.body_len, body_off) == 0
+                 ? undo_delta(storage_dir, filename, body, step.body_len)
+                 : -1;
+        free(body);
+    } else if (step.kind == UNDO_STEP_SNAPSHOT) {
+        rc = undo_snapshot(storage_dir, filename, fd, body_off, step.body_len);
+    } else {
+        rc = 1;
+    }
+    if (rc == 1) {
+        // The file moved on without the journal: nothing in it applies
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    if (rc == 0) {
+        if (start <= hdr.floor) {
+            unlink(path);
+        } else if (ftruncate(fd, (off_t)start) != 0) {
+            unlink(path);
+        }
+    }
+    close(fd);
+    return rc;
+}
+
+int undo_log_read_deltas(const char *storage_dir, const char *filename,
+                         UndoDeltaStep *steps, int max) {
+    if (!storage_dir || !filename || !steps || max <= 0) return -1;
+    char path[1024];
+    build_journal_path(storage_dir, filename, path, sizeof(path));
+    UndoJournalHeader hdr;
+    size_t end = 0;
+    int fd = journal_open(path, 0, &hdr, &end);
+    if (fd < 0) return 0;
+    int count = 0;
+    while (count < max) {
+        size_t start;
+        UndoStepHeader step;
+        if (journal_last_step(fd, &hdr, end, &start, &step) != 0 ||
+            step.kind != UNDO_STEP_DELTA) {
+            break;
+        }
+        char *body = malloc(step.body_len ? step.body_len : 1);
+        if (!body) break;
+        if (read_at(fd, body, step.body_len, start + sizeof(step)) != 0 ||
+            parse_delta(body, step.body_len, &steps[count]) != 0) {
+            free(body);
+            break;
+        }
+        steps[count++].body = body;
+        end = start;
+    }
+    close(fd);
+    return count;
+}
+
+void undo_log_free_deltas(UndoDeltaStep *steps, int count) {
+    for (int i = 0; steps && i < count; i++) {
+        free(steps[i].edits);
+        free(steps[i].body);
+        steps[i].edits = NULL;
+        steps[i].body = NULL;
+    }
+}
+
+void undo_log_discard(const char *storage_dir, const char *filename) {
+    if (!storage_dir || !filename) return;
+    char path[1024];
+    build_journal_path(storage_dir, filename, path, sizeof(path));
+    unlink(path);
+}
@@ -0,0 +1,91 @@
+#ifndef UNDO_LOG_H
+#define UNDO_LOG_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "file_storage.h"
+
+// Per-file undo journal for the Storage Server (metadata/<file>.undo):
+// commits append a delta step (the bytes and sentence metadata each edit
+// replaced) or a whole-file snapshot, and UNDO pops the newest one. At most
+// the newest depth steps are kept.
+//
+// Callers hold the file's metadata lock (metadata_lock()).
+
+#define UNDO_DEFAULT_DEPTH 8
+
+// Number of undo levels kept per file (call once at startup; < 1 is 1)
+void undo_log_set_depth(int depth);
+
+// One sentence replaced by a commit
+typedef struct {
+    size_t new_offset;          // Where the new text starts in the new file
+    size_t new_length;
+    const char *new_text;
+    size_t old_length;          // The old text started at the same place
+    const char *old_text;
+    int meta_index;             // First sentence it became in the new table
+    int meta_count;             // Sentences it became
+    SentenceMeta old_sentence;  // Its metadata before the commit
+} UndoEdit;
+
+// A commit, as seen by the undo journal
+typedef struct {
+    size_t old_size;
+    size_t new_size;
+    int old_word_count;
+    int old_char_count;
+    int old_next_sentence_id;
+    int old_sentence_count;
+    int new_sentence_count;
+    time_t old_last_modified;
+    time_t old_last_accessed;
+    const UndoEdit *edits;      // In file order
+    size_t edit_count;
+} UndoDelta;
+
+// Append delta steps for a commit that has just been written, oldest
+// first, with one fsync (a group commit records one step per session)
+// Returns: 0 on success, -1 on error (the journal is then dropped, since
+//          its older steps no longer match the file)
+int undo_log_record_deltas(const char *storage_dir, const char *filename,
+                           const UndoDelta *deltas, size_t count);
+
+// Append a snapshot of the file's current data and metadata
+// Returns: 0 on success, -1 on error
+int undo_log_record_snapshot(const char *storage_dir, const char *filename);
+
+// Returns 1 if the file has a step to undo
+int undo_log_exists(const char *storage_dir, const char *filename);
+
+// Undo the newest step
+// Returns: 0 on success, 1 if there is nothing to undo, -1 on error
+int undo_log_undo(const char *storage_dir, const char *filename);
+
+// A delta step read back from the journal; edits and their texts point
+// into body
+typedef struct {
+    UndoDelta delta;
+    UndoEdit *edits;
+    char *body;
+} UndoDeltaStep;
+
+// Read the newest delta steps, newest first, stopping at a snapshot step,
+// the oldest live step or max (replication sends them as a delta)
+// Returns: steps read (0 if there are none); free with undo_log_free_deltas()
+int undo_log_read_deltas(const char *storage_dir, const char *filename,
+                         UndoDeltaStep *steps, int max);
+void undo_log_free_deltas(UndoDeltaStep *steps, int count);
+
+// Rebuild the sentence table from before a delta step
+// after: The table right after the step (delta->new_sentence_count entries)
+// before: Room for delta->old_sentence_count entries
+// Returns: entries written, or -1 if the table does not fit the step
+int undo_delta_old_table(const UndoDelta *delta, const SentenceMeta *after, int after_count,
+                         SentenceMeta *before);
+
+// Drop the file's journal (file deleted or replaced outside the journal)
+void undo_log_discard(const char *storage_dir, const char *filename);
+
+#endif
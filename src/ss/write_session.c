@@ -1,110 +1,97 @@
 #define _POSIX_C_SOURCE 200809L
 #include "write_session.h"
 
-#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "../common/log.h"
 #include "file_storage.h"
 #include "runtime_state.h"
+#include "text_scan.h"
+#include "undo_log.h"
 
 typedef struct {
     char **items;
     size_t count;
 } TokenList;
 
-static void sentence_entry_clear(SentenceEntry *entry) {
-    if (!entry || !entry->words) return;
-    for (size_t i = 0; i < entry->word_count; i++) {
-        free(entry->words[i].text);
-    }
-    free(entry->words);
-    entry->words = NULL;
-    entry->word_count = 0;
-}
-
-static int sentence_entry_clone(const SentenceEntry *src, SentenceEntry *dst) {
+// Copy src into dst with its words in arena
+static int sentence_entry_clone(const SentenceEntry *src, SentenceEntry *dst,
+                                SentenceArena *arena) {
     if (!src || !dst) return -1;
     memset(dst, 0, sizeof(*dst));
-    if (src->word_count == 0) {
-        dst->sentence_id = src->sentence_id;
-        dst->version = src->version;
-        return 0;
-    }
-    SentenceWord *words = calloc(src->word_count, sizeof(SentenceWord));
+    dst->sentence_id = src->sentence_id;
+    dst->version = src->version;
+    if (src->word_count == 0) return 0;
+    SentenceWord *words = sentence_arena_alloc(arena, sizeof(SentenceWord) * src->word_count);
     if (!words) return -1;
     for (size_t i = 0; i < src->word_count; i++) {
+        words[i].text = NULL;
         if (!src->words[i].text) continue;
-        words[i].text = strdup(src->words[i].text);
-        if (!words[i].text) {
-            for (size_t j = 0; j < i; j++) {
-                free(words[j].text);
-            }
-            free(words);
-            return -1;
-        }
+        words[i].text = sentence_arena_strndup(arena, src->words[i].text,
+                                               strlen(src->words[i].text));
+        if (!words[i].text) return -1;
     }
     dst->words = words;
     dst->word_count = src->word_count;
-    dst->sentence_id = src->sentence_id;
-    dst->version = src->version;
     return 0;
 }
 
-static void free_tokens(TokenList *list) {
-    if (!list || !list->items) return;
-    for (size_t i = 0; i < list->count; i++) {
-        free(list->items[i]);
-    }
-    free(list->items);
-    list->items = NULL;
-    list->count = 0;
+typedef struct {
+    TokenList *out;
+    SentenceArena *arena;
+} TokenSink;
+
+static int store_token(void *ctx, const char *word, size_t len) {
+    TokenSink *sink = ctx;
+    TokenList *out = sink->out;
+    out->items[out->count] = sentence_arena_strndup(sink->arena, word, len);
+    if (!out->items[out->count]) return -1;
+    out->count++;
+    return 0;
 }
 
-static int split_content_into_tokens(const char *content, TokenList *out) {
+// Split content on whitespace; the tokens and their array live in arena
+static int split_content_into_tokens(const char *content, SentenceArena *arena,
+                                     TokenList *out) {
     if (!content || !out) return -1;
     memset(out, 0, sizeof(*out));
-    const char *p = content;
-    while (*p) {
-        while (*p && isspace((unsigned char)*p)) p++;
-        if (!*p) break;
-        const char *start = p;
-        while (*p && !isspace((unsigned char)*p)) p++;
-        size_t len = (size_t)(p - start);
-        if (len == 0) continue;
-        char *token = strndup(start, len);
-        if (!token) {
-            free_tokens(out);
-            return -1;
-        }
-        char **new_items = realloc(out->items, sizeof(char*) * (out->count + 1));
-        if (!new_items) {
-            free(token);
-            free_tokens(out);
-            return -1;
-        }
-        out->items = new_items;
-        out->items[out->count++] = token;
-    }
-    if (out->count == 0) {
-        free_tokens(out);
-        return -1;
-    }
-    return 0;
+    size_t len = strlen(content);
+    size_t count = text_scan_words(content, len, NULL, NULL);
+    if (count == 0) return -1;
+    out->items = sentence_arena_alloc(arena, sizeof(char *) * count);
+    if (!out->items) return -1;
+    TokenSink sink = { out, arena };
+    text_scan_words(content, len, store_token, &sink);
+    return out->count == count ? 0 : -1;
 }
 
-static int sentence_entry_insert_tokens(SentenceEntry *entry, size_t index,
-                                        TokenList *tokens) {
-    if (!entry || !tokens || index > entry->word_count) return -1;
+// Insert tokens before word index of the session's sentence, growing the
+// word array geometrically (the old array stays in the arena until the
+// session ends)
+static int sentence_entry_insert_tokens(WriteSession *session, size_t index,
+                                        const TokenList *tokens) {
+    SentenceEntry *entry = &session->sentence_entry;
+    if (!tokens || index > entry->word_count) return -1;
     size_t new_count = entry->word_count + tokens->count;
-    SentenceWord *words = realloc(entry->words, sizeof(SentenceWord) * new_count);
-    if (!words) return -1;
-    entry->words = words;
+    if (new_count > session->word_capacity) {
+        size_t capacity = session->word_capacity ? session->word_capacity * 2 : 16;
+        if (capacity < new_count) capacity = new_count;
+        SentenceWord *words = sentence_arena_alloc(&session->arena, sizeof(SentenceWord) * capacity);
+        if (!words) return -1;
+        if (entry->word_count > 0) {
+            memcpy(words, entry->words, sizeof(SentenceWord) * entry->word_count);
+        }
+        entry->words = words;
+        session->word_capacity = capacity;
+    }
     if (index < entry->word_count) {
         memmove(&entry->words[index + tokens->count],
                 &entry->words[index],
@@ -112,10 +99,8 @@ static int sentence_entry_insert_tokens(SentenceEntry *entry, size_t index,
     }
     for (size_t i = 0; i < tokens->count; i++) {
         entry->words[index + i].text = tokens->items[i];
-        tokens->items[i] = NULL;
     }
     entry->word_count = new_count;
-    tokens->count = 0;
     return 0;
 }
 
@@ -251,6 +236,87 @@ static int find_metadata_index_by_id(const FileMetadata *meta, int sentence_id)
     return -1;
 }
 
+static int is_sentence_delim(char c) {
+    return (c == '.' || c == '!' || c == '?');
+}
+
+// Sentence offsets in the metadata are only trusted when they describe
+// exactly what render_collection() would have written: sentences back to
+// back, one space apart, ending at size_bytes
+static int sentence_layout_is_contiguous(const FileMetadata *meta) {
+    if (meta->sentence_count <= 0) return 0;
+    size_t expect = 0;
+    for (int i = 0; i < meta->sentence_count; i++) {
+        const SentenceMeta *sm = &meta->sentences[i];
+        if (sm->offset != expect) return 0;
+        if (sm->length == 0 && meta->sentence_count > 1) return 0;
+        expect = sm->offset + sm->length + 1;
+    }
+    return expect - 1 == meta->size_bytes;
+}
+
+// Read sentence idx straight from its recorded byte range and check the
+// range really holds that sentence: its bytes must parse to one sentence
+// that renders back unchanged, and its neighbours must be separated from it
+// by a space after a sentence delimiter. fd is the open file, size its length.
+// Returns: 0 with *parsed holding the sentence, 1 if the range cannot be
+//          trusted (caller re-parses the whole file), -1 on I/O error
+static int sentence_range_read(int fd, size_t size, const FileMetadata *meta, int idx,
+                               SentenceCollection *parsed) {
+    memset(parsed, 0, sizeof(*parsed));
+    if (meta->size_bytes != size || !sentence_layout_is_contiguous(meta)) return 1;
+    const SentenceMeta *sm = &meta->sentences[idx];
+    int last = (idx == meta->sentence_count - 1);
+    size_t lo = sm->offset >= 2 ? sm->offset - 2 : 0;
+    size_t hi = last ? sm->offset + sm->length : sm->offset + sm->length + 1;
+    char *window = malloc(hi - lo + 1);
+    if (!window) return -1;
+    size_t got = 0;
+    while (got < hi - lo) {
+        ssize_t n = pread(fd, window + got, hi - lo - got, (off_t)(lo + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            free(window);
+            return -1;
+        }
+        got += (size_t)n;
+    }
+    window[got] = '\0';
+
+    char *text = window + (sm->offset - lo);
+    int trusted = 1;
+    if (sm->offset > 0 &&
+        (sm->offset < 2 || text[-1] != ' ' || !is_sentence_delim(text[-2]))) {
+        trusted = 0;
+    }
+    if (trusted && !last &&
+        (sm->length == 0 || text[sm->length] != ' ' ||
+         !is_sentence_delim(text[sm->length - 1]))) {
+        trusted = 0;
+    }
+    if (!trusted) {
+        free(window);
+        return 1;
+    }
+    text[sm->length] = '\0';
+    int next_id = sm->sentence_id;
+    if (sentence_parse_text(text, next_id, parsed, &next_id) != 0) {
+        free(window);
+        return -1;
+    }
+    char *rendered = parsed->count == 1 ? sentence_entry_to_string(&parsed->sentences[0]) : NULL;
+    trusted = rendered && strcmp(rendered, text) == 0;
+    free(rendered);
+    free(window);
+    if (!trusted) {
+        sentence_collection_free(parsed);
+        return 1;
+    }
+    parsed->sentences[0].sentence_id = sm->sentence_id;
+    parsed->sentences[0].version = sm->version;
+    return 0;
+}
+
 static void format_error(char *buf, size_t len, const char *msg) {
     if (!buf || len == 0) return;
     snprintf(buf, len, "%s", msg ? msg : "unknown error");
@@ -274,15 +340,19 @@ int write_session_begin(WriteSession *session,
     session->sentence_index = sentence_index;
 
     FileMetadata meta;
+    metadata_lock(storage_dir, filename);
     if (metadata_load(storage_dir, filename, &meta) != 0) {
+        metadata_unlock(storage_dir, filename);
         format_error(error_buf, error_buf_len, "Failed to load metadata");
         return -1;
     }
     if (metadata_ensure_sentences(storage_dir, filename, &meta) != 0) {
+        metadata_unlock(storage_dir, filename);
         format_error(error_buf, error_buf_len, "Failed to prepare sentence metadata");
         return -1;
     }
     if (sentence_index < 0 || sentence_index >= meta.sentence_count) {
+        metadata_unlock(storage_dir, filename);
         format_error(error_buf, error_buf_len, "Sentence index out of range");
         return -1;
     }
@@ -292,6 +362,7 @@ int write_session_begin(WriteSession *session,
         meta.sentences[sentence_index].sentence_id = sentence_id;
         metadata_save(storage_dir, filename, &meta);
     }
+    metadata_unlock(storage_dir, filename);
     int session_id;
     if (sentence_lock_acquire(filename, sentence_id, username, &session_id) < 0) {
         format_error(error_buf, error_buf_len, "Sentence is locked by another writer");
@@ -301,6 +372,29 @@ int write_session_begin(WriteSession *session,
     session->sentence_id = sentence_id;
     session->active = 1;
 
+    // Only the edited sentence is needed: read it from its recorded range
+    // when the layout checks out, otherwise parse the whole file
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/files/%s", storage_dir, filename);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+        SentenceCollection single;
+        int rc = sentence_range_read(fd, (size_t)st.st_size, &meta, sentence_index, &single);
+        if (rc == 0) {
+            close(fd);
+            session->sentence_entry = single.sentences[0];
+            session->word_capacity = single.sentences[0].word_count;
+            session->arena = single.arena;  // The session now owns the words
+            free(single.sentences);
+            if (current_text_out) {
+                *current_text_out = sentence_entry_to_string(&session->sentence_entry);
+            }
+            return 0;
+        }
+    }
+    if (fd >= 0) close(fd);
+
     char *file_text = NULL;
     size_t file_len = 0;
     if (file_read_all(storage_dir, filename, &file_text, &file_len) != 0) {
@@ -325,13 +419,14 @@ int write_session_begin(WriteSession *session,
         return -1;
     }
     if (sentence_entry_clone(&collection.sentences[sentence_index],
-                             &session->sentence_entry) != 0) {
+                             &session->sentence_entry, &session->arena) != 0) {
         sentence_collection_free(&collection);
         free(file_text);
         format_error(error_buf, error_buf_len, "Failed to prepare sentence copy");
         write_session_abort(session);
         return -1;
     }
+    session->word_capacity = session->sentence_entry.word_count;
     if (current_text_out) {
         *current_text_out = sentence_entry_to_string(&session->sentence_entry);
     }
@@ -353,17 +448,14 @@ int write_session_apply_edit(WriteSession *session,
         return -1;
     }
     TokenList tokens = {0};
-    if (split_content_into_tokens(content, &tokens) != 0) {
+    if (split_content_into_tokens(content, &session->arena, &tokens) != 0) {
         format_error(error_buf, error_buf_len, "Content must contain at least one word");
         return -1;
     }
-    if (sentence_entry_insert_tokens(&session->sentence_entry,
-                                     (size_t)word_index, &tokens) != 0) {
-        free_tokens(&tokens);
+    if (sentence_entry_insert_tokens(session, (size_t)word_index, &tokens) != 0) {
         format_error(error_buf, error_buf_len, "Failed to apply edit");
         return -1;
     }
-    free_tokens(&tokens);
     return 0;
 }
 
@@ -426,124 +518,373 @@ static int write_updated_file(WriteSession *session,
     return 0;
 }
 
-int write_session_commit(WriteSession *session,
-                         char *error_buf, size_t error_buf_len) {
-    if (!session || !session->active) {
-        format_error(error_buf, error_buf_len, "No active write session");
-        return -1;
+// One session's commit inside a group (see write_session_commit)
+typedef struct CommitRequest {
+    WriteSession *session;
+    SentenceCollection fragment;
+    int meta_idx;               // Edited sentence in the group's metadata
+    size_t order;               // Position in the group; undo steps follow it
+    int result;                 // 0 ok, -1 failed (error holds why)
+    char error[256];
+    int lead;                   // This request's thread runs the next group
+    int done;
+    struct CommitRequest *next;
+} CommitRequest;
+
+static int compare_by_meta_idx(const void *a, const void *b) {
+    const CommitRequest *ra = *(CommitRequest *const *)a;
+    const CommitRequest *rb = *(CommitRequest *const *)b;
+    return ra->meta_idx - rb->meta_idx;
+}
+
+static int compare_by_order(const void *a, const void *b) {
+    const CommitRequest *ra = *(CommitRequest *const *)a;
+    const CommitRequest *rb = *(CommitRequest *const *)b;
+    return ra->order < rb->order ? -1 : ra->order > rb->order;
+}
+
+static void fail_request(CommitRequest *req, const char *msg) {
+    req->result = -1;
+    format_error(req->error, sizeof(req->error), msg);
+    sentence_collection_free(&req->fragment);
+}
+
+// Undo steps for a spliced group: one per session, in group order, each
+// against the file as the sessions before it left it, so UNDO reverts only
+// the newest session's edit
+// reqs: the group's requests sorted by meta_idx; texts, text_lens and
+//       old_texts are indexed the same way
+// meta: the metadata from before the group
+static void record_session_steps(CommitRequest **reqs, size_t n, const FileMetadata *meta,
+                                int old_next_id, char **texts, const size_t *text_lens,
+                                char **old_texts, time_t now) {
+    WriteSession *session = reqs[0]->session;
+    size_t *seq = malloc(n * sizeof(size_t));
+    int *applied = calloc(n, sizeof(int));
+    UndoEdit *edits = calloc(n, sizeof(UndoEdit));
+    UndoDelta *steps = calloc(n, sizeof(UndoDelta));
+    if (!seq || !applied || !edits || !steps) {
+        free(seq);
+        free(applied);
+        free(edits);
+        free(steps);
+        undo_log_discard(session->storage_dir, session->filename);
+        return;
     }
-    if (undo_save_state(session->storage_dir, session->filename) != 0) {
-        format_error(error_buf, error_buf_len, "Failed to snapshot undo state");
-        return -1;
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i;
+        for (; j > 0 && reqs[seq[j - 1]]->order > reqs[i]->order; j--) seq[j] = seq[j - 1];
+        seq[j] = i;
     }
-    char *sentence_text = sentence_entry_to_string(&session->sentence_entry);
-    if (!sentence_text) {
-        format_error(error_buf, error_buf_len, "Failed to build sentence");
-        return -1;
+
+    size_t size = meta->size_bytes;
+    int count = meta->sentence_count;
+    int words = meta->word_count;
+    int chars = meta->char_count;
+    int next_id = old_next_id;
+    for (size_t k = 0; k < n; k++) {
+        size_t r = seq[k];
+        const SentenceMeta *old = &meta->sentences[reqs[r]->meta_idx];
+        const SentenceCollection *fragment = &reqs[r]->fragment;
+        // Edits already applied in front of this one moved it
+        int64_t shift = 0;
+        int index = reqs[r]->meta_idx;
+        for (size_t j = 0; j < r; j++) {
+            if (!applied[j]) continue;
+            const SentenceMeta *before = &meta->sentences[reqs[j]->meta_idx];
+            shift += (int64_t)text_lens[j] - (int64_t)before->length;
+            index += (int)reqs[j]->fragment.count - 1;
+        }
+        UndoEdit *e = &edits[k];
+        e->new_offset = (size_t)((int64_t)old->offset + shift);
+        e->new_length = text_lens[r];
+        e->new_text = texts[r];
+        e->old_length = old->length;
+        e->old_text = old_texts[r];
+        e->meta_index = index;
+        e->meta_count = (int)fragment->count;
+        e->old_sentence = *old;
+        e->old_sentence.offset = e->new_offset;
+        int fragment_words = 0;
+        for (size_t i = 0; i < fragment->count; i++) {
+            fragment_words += (int)fragment->sentences[i].word_count;
+        }
+
+        size_t new_size = size - old->length + text_lens[r];
+        steps[k] = (UndoDelta){
+            .old_size = size,
+            .new_size = new_size,
+            .old_word_count = words,
+            .old_char_count = chars,
+            .old_next_sentence_id = next_id,
+            .old_sentence_count = count,
+            .new_sentence_count = count + (int)fragment->count - 1,
+            .old_last_modified = k == 0 ? meta->last_modified : now,
+            .old_last_accessed = k == 0 ? meta->last_accessed : now,
+            .edits = e,
+            .edit_count = 1,
+        };
+        size = new_size;
+        count += (int)fragment->count - 1;
+        words += fragment_words - old->word_count;
+        chars = (int)new_size;
+        next_id += (int)fragment->count - 1;
+        applied[r] = 1;
     }
-    SentenceCollection fragment = {0};
-    int next_id = session->sentence_id;
-    if (sentence_parse_text(sentence_text, next_id, &fragment, &next_id) != 0) {
-        free(sentence_text);
-        format_error(error_buf, error_buf_len, "Failed to parse updated sentence");
-        return -1;
+    // On failure the journal is dropped; the commit itself stands
+    undo_log_record_deltas(session->storage_dir, session->filename, steps, n);
+    free(seq);
+    free(applied);
+    free(edits);
+    free(steps);
+}
+
+// Byte-range commit: splice each rendered fragment over its sentence's
+// recorded range and shift the offsets behind it, without reading,
+// parsing or rendering the rest of the file. The new file is still built
+// in a temp file and renamed into place; the unchanged ranges between
+// edits are copied with copy_file_range(), which stays in the kernel (and
+// is a reflink on filesystems that support it).
+// reqs: live requests sorted by meta_idx
+// old_next_id: next_sentence_id before the fragments took their ids
+// Returns: 0 on success, 1 if the recorded layout cannot be trusted (the
+//          caller falls back to the full re-parse), -1 on error
+static int commit_splice(CommitRequest **reqs, size_t n, FileMetadata *meta,
+                         int old_next_id, char *error_buf, size_t error_buf_len) {
+    WriteSession *session = reqs[0]->session;
+    int new_count = meta->sentence_count;
+    for (size_t r = 0; r < n; r++) new_count += (int)reqs[r]->fragment.count - 1;
+    if (new_count > MAX_SENTENCE_METADATA) return 1;
+
+    char final_path[1024];
+    snprintf(final_path, sizeof(final_path), "%s/files/%s",
+             session->storage_dir, session->filename);
+    int in_fd = open(final_path, O_RDONLY);
+    if (in_fd < 0) return 1;
+    struct stat st;
+    if (fstat(in_fd, &st) != 0) {
+        close(in_fd);
+        return 1;
     }
-    if (fragment.count == 0) {
-        sentence_collection_free(&fragment);
-        free(sentence_text);
-        format_error(error_buf, error_buf_len, "Sentence must contain words");
-        return -1;
+    // The verified old sentences double as the undo steps' old texts
+    char **old_texts = calloc(n, sizeof(char *));
+    int rc = old_texts ? 0 : 1;
+    for (size_t r = 0; rc == 0 && r < n; r++) {
+        SentenceCollection old_sentence;
+        if (sentence_range_read(in_fd, (size_t)st.st_size, meta, reqs[r]->meta_idx,
+                                &old_sentence) != 0) {
+            rc = 1;
+            break;
+        }
+        old_texts[r] = sentence_entry_to_string(&old_sentence.sentences[0]);
+        sentence_collection_free(&old_sentence);
+        if (!old_texts[r]) rc = 1;
     }
-    FileMetadata meta;
-    if (metadata_load(session->storage_dir, session->filename, &meta) != 0) {
-        sentence_collection_free(&fragment);
-        free(sentence_text);
-        format_error(error_buf, error_buf_len, "Failed to reload metadata");
-        return -1;
+    if (rc != 0) {
+        for (size_t r = 0; old_texts && r < n; r++) free(old_texts[r]);
+        free(old_texts);
+        close(in_fd);
+        return 1;
     }
-    if (metadata_ensure_sentences(session->storage_dir, session->filename, &meta) != 0) {
-        sentence_collection_free(&fragment);
-        free(sentence_text);
-        format_error(error_buf, error_buf_len, "Failed to prepare metadata");
-        return -1;
+
+    char **texts = calloc(n, sizeof(char *));
+    size_t *text_lens = calloc(n, sizeof(size_t));
+    size_t **offsets = calloc(n, sizeof(size_t *));
+    size_t **lengths = calloc(n, sizeof(size_t *));
+    SentenceMeta *sentences = calloc((size_t)new_count, sizeof(SentenceMeta));
+    rc = (texts && text_lens && offsets && lengths && sentences) ? 0 : -1;
+    for (size_t r = 0; rc == 0 && r < n; r++) {
+        const SentenceCollection *fragment = &reqs[r]->fragment;
+        offsets[r] = calloc(fragment->count, sizeof(size_t));
+        lengths[r] = calloc(fragment->count, sizeof(size_t));
+        if (!offsets[r] || !lengths[r] ||
+            render_collection(fragment, &texts[r], &text_lens[r], offsets[r], lengths[r]) != 0) {
+            rc = -1;
+            break;
+        }
+        for (size_t i = 0; i < fragment->count; i++) {
+            if (lengths[r][i] == 0 && new_count > 1) rc = 1;
+        }
     }
-    int meta_idx = find_metadata_index_by_id(&meta, session->sentence_id);
-    if (meta_idx < 0) {
-        sentence_collection_free(&fragment);
-        free(sentence_text);
-        format_error(error_buf, error_buf_len, "Sentence metadata missing");
-        return -1;
+    if (rc == -1) format_error(error_buf, error_buf_len, "Failed to render sentence");
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/files/%s.%d.tmp",
+             session->storage_dir, session->filename, session->session_id);
+    int out_fd = -1;
+    if (rc == 0) {
+        out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (out_fd < 0) {
+            format_error(error_buf, error_buf_len, "Failed to open temp file");
+            rc = -1;
+        }
+    }
+
+    // Write unchanged gaps and fragments in file order while building the
+    // new sentence table
+    size_t pos = 0;             // Next unwritten byte of the old file
+    size_t written = 0;         // Bytes in the new file so far
+    int out_idx = 0;
+    int old_idx = 0;
+    for (size_t r = 0; rc == 0 && r < n; r++) {
+        const SentenceMeta *old = &meta->sentences[reqs[r]->meta_idx];
+        for (; old_idx < reqs[r]->meta_idx; old_idx++) {
+            sentences[out_idx] = meta->sentences[old_idx];
+            sentences[out_idx++].offset = meta->sentences[old_idx].offset - pos + written;
+        }
+        size_t gap = old->offset - pos;
+        if (file_copy_range(in_fd, pos, out_fd, gap) != 0 ||
+            file_write_fd(out_fd, texts[r], text_lens[r]) != 0) {
+            format_error(error_buf, error_buf_len, "Failed to write temp file");
+            rc = -1;
+            break;
+        }
+        written += gap;
+        const SentenceCollection *fragment = &reqs[r]->fragment;
+        for (size_t i = 0; i < fragment->count; i++) {
+            SentenceMeta *sm = &sentences[out_idx++];
+            sm->sentence_id = fragment->sentences[i].sentence_id;
+            sm->version = fragment->sentences[i].version;
+            sm->offset = written + offsets[r][i];
+            sm->length = lengths[r][i];
+            sm->word_count = (int)fragment->sentences[i].word_count;
+            sm->char_count = (int)lengths[r][i];
+        }
+        written += text_lens[r];
+        pos = old->offset + old->length;
+        old_idx++;
+    }
+    if (rc == 0) {
+        for (; old_idx < meta->sentence_count; old_idx++) {
+            sentences[out_idx] = meta->sentences[old_idx];
+            sentences[out_idx++].offset = meta->sentences[old_idx].offset - pos + written;
+        }
+        if (file_copy_range(in_fd, pos, out_fd, meta->size_bytes - pos) != 0 ||
+            fsync(out_fd) != 0) {
+            format_error(error_buf, error_buf_len, "Failed to write temp file");
+            rc = -1;
+        }
+        written += meta->size_bytes - pos;
+    }
+    close(in_fd);
+    if (out_fd >= 0 && close(out_fd) != 0 && rc == 0) {
+        format_error(error_buf, error_buf_len, "Failed to write temp file");
+        rc = -1;
+    }
+    if (rc == 0 && rename(tmp_path, final_path) != 0) {
+        format_error(error_buf, error_buf_len, "Failed to commit file");
+        rc = -1;
+    }
+    if (out_fd >= 0 && rc != 0) unlink(tmp_path);
+    time_t now = time(NULL);
+    if (rc == 0) record_session_steps(reqs, n, meta, old_next_id, texts, text_lens, old_texts, now);
+    for (size_t r = 0; r < n; r++) {
+        if (texts) free(texts[r]);
+        if (offsets) free(offsets[r]);
+        if (lengths) free(lengths[r]);
+        free(old_texts[r]);
+    }
+    free(old_texts);
+    free(texts);
+    free(text_lens);
+    free(offsets);
+    free(lengths);
+    if (rc != 0) {
+        free(sentences);
+        return rc;
+    }
+
+    int total_words = 0;
+    int max_id = 0;
+    for (int i = 0; i < new_count; i++) {
+        meta->sentences[i] = sentences[i];
+        total_words += sentences[i].word_count;
+        if (sentences[i].sentence_id > max_id) max_id = sentences[i].sentence_id;
     }
-    fragment.sentences[0].sentence_id = session->sentence_id;
-    fragment.sentences[0].version = meta.sentences[meta_idx].version + 1;
-    for (size_t i = 1; i < fragment.count; i++) {
-        fragment.sentences[i].sentence_id = meta.next_sentence_id++;
-        fragment.sentences[i].version = 1;
+    free(sentences);
+    meta->sentence_count = new_count;
+    if (max_id >= meta->next_sentence_id) meta->next_sentence_id = max_id + 1;
+    meta->word_count = total_words;
+    meta->char_count = (int)written;
+    meta->size_bytes = written;
+    meta->last_modified = now;
+    meta->last_accessed = meta->last_modified;
+    if (metadata_save(session->storage_dir, session->filename, meta) != 0) {
+        format_error(error_buf, error_buf_len, "Failed to save metadata");
+        return -1;
     }
+    return 0;
+}
 
+// Full commit: re-parse the file, replace each edited sentence with its
+// fragment and render everything again. Used when the recorded layout
+// cannot be trusted. A request whose sentence is no longer in the file
+// fails on its own; the others are still written.
+// Returns: 0 if the file was written (or nothing was left to write), -1 on error
+static int commit_reparse(CommitRequest **reqs, size_t n, FileMetadata *meta,
+                          char *error_buf, size_t error_buf_len) {
+    WriteSession *session = reqs[0]->session;
+    if (undo_save_state(session->storage_dir, session->filename) != 0) {
+        format_error(error_buf, error_buf_len, "Failed to snapshot undo state");
+        return -1;
+    }
     char *file_text = NULL;
     size_t file_len = 0;
     if (file_read_all(session->storage_dir, session->filename, &file_text, &file_len) != 0) {
-        sentence_collection_free(&fragment);
-        free(sentence_text);
         format_error(error_buf, error_buf_len, "Failed to read file");
         return -1;
     }
     SentenceCollection file_col = {0};
     int parse_next = 1;
     if (sentence_parse_text(file_text, parse_next, &file_col, &parse_next) != 0) {
-        sentence_collection_free(&fragment);
-        free(sentence_text);
         free(file_text);
         format_error(error_buf, error_buf_len, "Failed to parse file");
         return -1;
     }
-    assign_sentence_ids(&file_col, &meta);
-    int file_idx = find_sentence_index_by_id(&file_col, session->sentence_id);
-    if (file_idx < 0) {
-        sentence_collection_free(&fragment);
-        sentence_collection_free(&file_col);
-        free(sentence_text);
-        free(file_text);
-        format_error(error_buf, error_buf_len, "Sentence not found in file");
-        return -1;
+    free(file_text);
+    assign_sentence_ids(&file_col, meta);
+
+    size_t applied = 0;
+    for (size_t r = 0; r < n; r++) {
+        CommitRequest *req = reqs[r];
+        int file_idx = find_sentence_index_by_id(&file_col, req->session->sentence_id);
+        if (file_idx < 0) {
+            fail_request(req, "Sentence not found in file");
+            continue;
+        }
+        SentenceCollection *fragment = &req->fragment;
+        size_t old_count = file_col.count;
+        size_t new_count = old_count - 1 + fragment->count;
+        SentenceEntry *new_entries = calloc(new_count, sizeof(SentenceEntry));
+        if (!new_entries) {
+            sentence_collection_free(&file_col);
+            format_error(error_buf, error_buf_len, "Out of memory");
+            return -1;
+        }
+        size_t pos = 0;
+        for (size_t i = 0; i < (size_t)file_idx; i++) {
+            new_entries[pos++] = file_col.sentences[i];
+        }
+        for (size_t i = 0; i < fragment->count; i++) {
+            new_entries[pos++] = fragment->sentences[i];
+            fragment->sentences[i].words = NULL;
+            fragment->sentences[i].word_count = 0;
+        }
+        for (size_t i = file_idx + 1; i < old_count; i++) {
+            new_entries[pos++] = file_col.sentences[i];
+        }
+        free(file_col.sentences);
+        file_col.sentences = new_entries;
+        file_col.count = new_count;
+        applied++;
     }
-    SentenceEntry *old_entries = file_col.sentences;
-    size_t old_count = file_col.count;
-    size_t new_count = old_count - 1 + fragment.count;
-    SentenceEntry *new_entries = calloc(new_count, sizeof(SentenceEntry));
-    if (!new_entries) {
-        sentence_collection_free(&fragment);
+    if (applied == 0) {
         sentence_collection_free(&file_col);
-        free(sentence_text);
-        free(file_text);
-        format_error(error_buf, error_buf_len, "Out of memory");
-        return -1;
-    }
-    size_t pos = 0;
-    for (size_t i = 0; i < (size_t)file_idx; i++) {
-        new_entries[pos++] = old_entries[i];
-    }
-    sentence_entry_clear(&old_entries[file_idx]);
-    for (size_t i = 0; i < fragment.count; i++) {
-        new_entries[pos++] = fragment.sentences[i];
-        fragment.sentences[i].words = NULL;
-        fragment.sentences[i].word_count = 0;
-    }
-    for (size_t i = file_idx + 1; i < old_count; i++) {
-        new_entries[pos++] = old_entries[i];
+        return 0;
     }
-    free(old_entries);
-    free(file_text);
-    free(sentence_text);
-    free(fragment.sentences);
-    fragment.sentences = NULL;
-    fragment.count = 0;
-    file_col.sentences = new_entries;
-    file_col.count = new_count;
-
-    size_t *offsets = calloc(new_count, sizeof(size_t));
-    size_t *lengths = calloc(new_count, sizeof(size_t));
+
+    size_t *offsets = calloc(file_col.count, sizeof(size_t));
+    size_t *lengths = calloc(file_col.count, sizeof(size_t));
     if (!offsets || !lengths) {
         free(offsets);
         free(lengths);
@@ -557,30 +898,230 @@ int write_session_commit(WriteSession *session,
     for (size_t i = 0; i < file_col.count; i++) {
         total_words += file_col.sentences[i].word_count;
     }
-    if (write_updated_file(session, &file_col, &meta, offsets, lengths,
-                           total_words,
-                           &rendered, &rendered_len,
-                           error_buf, error_buf_len) != 0) {
-        free(offsets);
-        free(lengths);
-        free(rendered);
-        sentence_collection_free(&file_col);
-        return -1;
-    }
+    int rc = write_updated_file(session, &file_col, meta, offsets, lengths,
+                                total_words, &rendered, &rendered_len,
+                                error_buf, error_buf_len);
     free(rendered);
     free(offsets);
     free(lengths);
     sentence_collection_free(&file_col);
+    return rc;
+}
+
+// Commit one group of sessions editing the same file: one rewrite, one
+// fsync, and one undo step per session so UNDO still reverts a single
+// session's edit. Runs under the file's metadata lock so the metadata it
+// loads is still current when it saves. Sets every request's result; a
+// failure of the shared write fails the whole group. When the layout
+// cannot be trusted, each session is re-parsed and written on its own, in
+// group order, each behind its own undo snapshot.
+static void commit_group(CommitRequest *group) {
+    size_t n = 0;
+    for (CommitRequest *req = group; req; req = req->next) n++;
+    CommitRequest **reqs = calloc(n, sizeof(*reqs));
+    char error[256] = {0};
+    const char *group_error = NULL;
+    FileMetadata meta;
+    WriteSession *first = group->session;
+    if (!reqs) {
+        group_error = "Out of memory";
+    } else if (metadata_load(first->storage_dir, first->filename, &meta) != 0) {
+        group_error = "Failed to reload metadata";
+    } else if (metadata_ensure_sentences(first->storage_dir, first->filename, &meta) != 0) {
+        group_error = "Failed to prepare metadata";
+    }
+    if (group_error) {
+        for (CommitRequest *req = group; req; req = req->next) fail_request(req, group_error);
+        free(reqs);
+        return;
+    }
+
+    size_t live = 0;
+    size_t order = 0;
+    int old_next_id = meta.next_sentence_id;
+    for (CommitRequest *req = group; req; req = req->next) {
+        WriteSession *session = req->session;
+        req->order = order++;
+        req->result = 0;
+        char *sentence_text = sentence_entry_to_string(&session->sentence_entry);
+        if (!sentence_text) {
+            fail_request(req, "Failed to build sentence");
+            continue;
+        }
+        int next_id = session->sentence_id;
+        int parse_rc = sentence_parse_text(sentence_text, next_id, &req->fragment, &next_id);
+        free(sentence_text);
+        if (parse_rc != 0) {
+            fail_request(req, "Failed to parse updated sentence");
+            continue;
+        }
+        if (req->fragment.count == 0) {
+            fail_request(req, "Sentence must contain words");
+            continue;
+        }
+        req->meta_idx = find_metadata_index_by_id(&meta, session->sentence_id);
+        if (req->meta_idx < 0) {
+            fail_request(req, "Sentence metadata missing");
+            continue;
+        }
+        SentenceCollection *fragment = &req->fragment;
+        fragment->sentences[0].sentence_id = session->sentence_id;
+        fragment->sentences[0].version = meta.sentences[req->meta_idx].version + 1;
+        for (size_t i = 1; i < fragment->count; i++) {
+            fragment->sentences[i].sentence_id = meta.next_sentence_id++;
+            fragment->sentences[i].version = 1;
+        }
+        reqs[live++] = req;
+    }
+    if (live > 0) {
+        qsort(reqs, live, sizeof(*reqs), compare_by_meta_idx);
+        int rc = commit_splice(reqs, live, &meta, old_next_id, error, sizeof(error));
+        if (rc > 0) {
+            qsort(reqs, live, sizeof(*reqs), compare_by_order);
+            for (size_t r = 0; r < live; r++) {
+                char req_error[256] = {0};
+                if (commit_reparse(&reqs[r], 1, &meta, req_error, sizeof(req_error)) != 0) {
+                    fail_request(reqs[r], req_error);
+                }
+            }
+            rc = 0;
+        }
+        for (size_t r = 0; r < live; r++) {
+            if (reqs[r]->result != 0) continue;
+            if (rc != 0) {
+                fail_request(reqs[r], error);
+            } else {
+                sentence_collection_free(&reqs[r]->fragment);
+            }
+        }
+    }
+    free(reqs);
+}
+
+// Per-file commit queue. Sessions that commit while a group for the same
+// file is being written queue up here and go out together as the next
+// group, so N concurrent writers cost one rewrite instead of N.
+typedef struct CommitQueue {
+    char storage_dir[WRITE_SESSION_MAX_PATH];
+    char filename[WRITE_SESSION_MAX_FILENAME];
+    int leader_active;          // Some thread owns the queue's next group
+    size_t refs;                // Requests queued or running
+    CommitRequest *head;
+    CommitRequest *tail;
+    struct CommitQueue *next;
+} CommitQueue;
+
+static pthread_mutex_t g_commit_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_commit_cond = PTHREAD_COND_INITIALIZER;
+static CommitQueue *g_commit_queues;
+static WriteCommitStats g_commit_stats;
+
+// Caller holds g_commit_mu
+static CommitQueue *commit_queue_get(const char *storage_dir, const char *filename) {
+    for (CommitQueue *q = g_commit_queues; q; q = q->next) {
+        if (strcmp(q->filename, filename) == 0 && strcmp(q->storage_dir, storage_dir) == 0) {
+            return q;
+        }
+    }
+    CommitQueue *q = calloc(1, sizeof(*q));
+    if (!q) return NULL;
+    snprintf(q->storage_dir, sizeof(q->storage_dir), "%s", storage_dir);
+    snprintf(q->filename, sizeof(q->filename), "%s", filename);
+    q->next = g_commit_queues;
+    g_commit_queues = q;
+    return q;
+}
+
+// Caller holds g_commit_mu
+static void commit_queue_release(CommitQueue *q) {
+    if (--q->refs > 0) return;
+    for (CommitQueue **pp = &g_commit_queues; *pp; pp = &(*pp)->next) {
+        if (*pp == q) {
+            *pp = q->next;
+            break;
+        }
+    }
+    free(q);
+}
+
+int write_session_commit(WriteSession *session,
+                         char *error_buf, size_t error_buf_len) {
+    if (!session || !session->active) {
+        format_error(error_buf, error_buf_len, "No active write session");
+        return -1;
+    }
+    CommitRequest req;
+    memset(&req, 0, sizeof(req));
+    req.session = session;
+
+    pthread_mutex_lock(&g_commit_mu);
+    CommitQueue *q = commit_queue_get(session->storage_dir, session->filename);
+    if (!q) {
+        pthread_mutex_unlock(&g_commit_mu);
+        format_error(error_buf, error_buf_len, "Out of memory");
+        return -1;
+    }
+    q->refs++;
+    if (q->tail) q->tail->next = &req;
+    else q->head = &req;
+    q->tail = &req;
+    if (!q->leader_active) {
+        q->leader_active = 1;
+        req.lead = 1;
+    }
+    while (!req.done && !req.lead) {
+        pthread_cond_wait(&g_commit_cond, &g_commit_mu);
+    }
+    if (!req.done) {
+        // Leader: take everything queued so far as one group
+        CommitRequest *group = q->head;
+        size_t n = 0;
+        for (CommitRequest *r = group; r; r = r->next) n++;
+        q->head = q->tail = NULL;
+        pthread_mutex_unlock(&g_commit_mu);
+
+        metadata_lock(session->storage_dir, session->filename);
+        commit_group(group);
+        metadata_unlock(session->storage_dir, session->filename);
+
+        pthread_mutex_lock(&g_commit_mu);
+        g_commit_stats.groups++;
+        g_commit_stats.commits += n;
+        if (n > g_commit_stats.largest_group) g_commit_stats.largest_group = n;
+        for (CommitRequest *r = group; r;) {
+            CommitRequest *next = r->next;
+            r->done = 1;
+            r = next;
+        }
+        // Hand the queue to the oldest waiter, if any
+        if (q->head) q->head->lead = 1;
+        else q->leader_active = 0;
+        pthread_cond_broadcast(&g_commit_cond);
+    }
+    commit_queue_release(q);
+    pthread_mutex_unlock(&g_commit_mu);
+
+    if (req.result != 0) {
+        format_error(error_buf, error_buf_len, req.error);
+        return -1;
+    }
     write_session_abort(session);
     return 0;
 }
 
+void write_session_get_commit_stats(WriteCommitStats *out) {
+    if (!out) return;
+    pthread_mutex_lock(&g_commit_mu);
+    *out = g_commit_stats;
+    pthread_mutex_unlock(&g_commit_mu);
+}
+
 void write_session_abort(WriteSession *session) {
     if (!session) return;
     if (session->active) {
         sentence_lock_release(session->filename, session->sentence_id, session->session_id);
     }
-    sentence_entry_clear(&session->sentence_entry);
+    sentence_arena_free(&session->arena);
     memset(session, 0, sizeof(*session));
 }
 
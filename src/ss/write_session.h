@@ -16,6 +16,8 @@ typedef struct {
     int session_id;
     int active;
     SentenceEntry sentence_entry;
+    SentenceArena arena;        // Owns sentence_entry's words
+    size_t word_capacity;       // Slots in sentence_entry.words
 } WriteSession;
 
 int write_session_begin(WriteSession *session,
@@ -33,11 +35,27 @@ int write_session_apply_edit(WriteSession *session,
 
 char *write_session_get_current_text(const WriteSession *session);
 
+// Write the session's sentence into the file and end the session
+// Sessions committing the same file concurrently are group-committed:
+// whoever arrives while a commit for that file is running waits, and all
+// waiters are then written together with one rewrite and one fsync.
+// Each session still gets its own result and its own undo step, in the
+// order the sessions arrived, so UNDO reverts the newest session only.
+// Returns: 0 on success, -1 on error (error_buf says why; the session
+//          stays active and must be aborted)
 int write_session_commit(WriteSession *session,
                          char *error_buf, size_t error_buf_len);
 
 void write_session_abort(WriteSession *session);
 
+typedef struct {
+    unsigned long commits;      // Sessions committed (including failed ones)
+    unsigned long groups;       // File rewrites those commits took
+    size_t largest_group;
+} WriteCommitStats;
+
+void write_session_get_commit_stats(WriteCommitStats *out);
+
 #endif
 
 
@@ -1,5 +1,5 @@
 #!/bin/bash
-# Test script for failover functionality
+# Test script for failover functionality and recovery sync
 
 echo "=== Failover Test Script ==="
 echo ""
@@ -64,3 +64,121 @@ echo ""
 
 echo "=== Test Complete ==="
 echo "Check nm.log for detailed failover logs"
+
+echo ""
+echo "=== Recovery sync check ==="
+# Runs its own NM and primary/backup pair in a scratch directory: edits
+# made while the backup is down must be the only files copied when it
+# comes back
+REPO_DIR="$(cd "$(dirname "$0")" && pwd)"
+RECOVERY_DIR="$(mktemp -d /tmp/failover_sync.XXXXXX)"
+RECOVERY_NM_PORT=5720
+RECOVERY_PRIMARY_PORT=6820
+RECOVERY_BACKUP_PORT=6821
+RECOVERY_FILES=6
+FAILED=0
+
+start_backup() {
+    (cd "$RECOVERY_DIR" && exec "$REPO_DIR/bin_ss" --nm-port $RECOVERY_NM_PORT \
+        --client-port $RECOVERY_BACKUP_PORT --storage "$RECOVERY_DIR/backup" \
+        --username ss1_backup >> backup.log 2>&1) &
+    BACKUP_PID=$!
+}
+
+recovery_client() {
+    "$REPO_DIR/bin_client" --nm-port $RECOVERY_NM_PORT --username alice > /dev/null
+}
+
+all_on_backup() {
+    for i in $(seq 1 $RECOVERY_FILES); do
+        cmp -s "$RECOVERY_DIR/primary/files/sync_$i.txt" "$RECOVERY_DIR/backup/files/sync_$i.txt" || return 1
+    done
+    return 0
+}
+
+wait_all_on_backup() {
+    for i in $(seq 1 100); do
+        all_on_backup && return 0
+        sleep 0.2
+    done
+    return 1
+}
+
+check() {
+    if [ "$1" -eq 0 ]; then
+        echo "PASS: $2"
+    else
+        echo "FAIL: $2"
+        FAILED=1
+    fi
+}
+
+mkdir -p "$RECOVERY_DIR/nm"
+(cd "$RECOVERY_DIR" && exec "$REPO_DIR/bin_nm" --port $RECOVERY_NM_PORT \
+    --state-dir "$RECOVERY_DIR/nm" > nm.log 2>&1) &
+NM_PID=$!
+sleep 1
+start_backup
+sleep 1
+(cd "$RECOVERY_DIR" && exec "$REPO_DIR/bin_ss" --nm-port $RECOVERY_NM_PORT \
+    --client-port $RECOVERY_PRIMARY_PORT --storage "$RECOVERY_DIR/primary" \
+    --username ss1 > primary.log 2>&1) &
+PRIMARY_PID=$!
+sleep 1
+
+echo "Step 11: Create $RECOVERY_FILES files and wait for the backup"
+for i in $(seq 1 $RECOVERY_FILES); do
+    recovery_client << EOF
+CREATE sync_$i.txt
+WRITE sync_$i.txt 0
+0 File $i for the recovery sync check. It has two sentences.
+ETIRW
+EXIT
+EOF
+done
+wait_all_on_backup
+check $? "All files replicated"
+
+echo "Step 12: Kill the backup and wait until the NM marks it failed"
+kill -9 $BACKUP_PID
+wait $BACKUP_PID 2>/dev/null
+for i in $(seq 1 60); do
+    grep -q '"event":"heartbeat_monitor_failure"' "$RECOVERY_DIR/nm.log" && break
+    sleep 1
+done
+grep -q '"event":"heartbeat_monitor_failure"' "$RECOVERY_DIR/nm.log"
+check $? "Backup marked failed"
+
+echo "Step 13: Edit 3 files while the backup is down"
+for i in 2 4 5; do
+    recovery_client << EOF
+WRITE sync_$i.txt 1
+0 Changed
+ETIRW
+EXIT
+EOF
+done
+sleep 1
+NM_MARK=$(wc -l < "$RECOVERY_DIR/nm.log")
+SS_MARK=$(wc -l < "$RECOVERY_DIR/ss_ss1.log")
+
+echo "Step 14: Restart the backup"
+start_backup
+wait_all_on_backup
+check $? "Backup caught up with every file"
+sleep 1
+tail -n +$((NM_MARK + 1)) "$RECOVERY_DIR/nm.log" | grep '"event":"anti_entropy_sync"' |
+    grep -q "3 differing files, 3 queued"
+check $? "Anti-entropy found exactly the 3 edited files"
+COPIED=$(tail -n +$((SS_MARK + 1)) "$RECOVERY_DIR/ss_ss1.log" | grep -c '"event":"ss_replicate_to_success"')
+[ "$COPIED" -eq 3 ]
+check $? "Primary sent exactly 3 files to the backup (sent $COPIED)"
+
+kill $PRIMARY_PID $BACKUP_PID $NM_PID 2>/dev/null
+wait $PRIMARY_PID $BACKUP_PID $NM_PID 2>/dev/null
+if [ "$FAILED" -ne 0 ]; then
+    echo "Recovery sync check failed; logs in $RECOVERY_DIR"
+    exit 1
+fi
+rm -rf "$RECOVERY_DIR"
+echo "=== Recovery Sync Check Complete ==="
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 # Test script for replication system
-# Tests: CREATE replication and DELETE replication
+# Tests: CREATE replication, DELETE replication, delta replication and UNDO
 
 echo "=== Replication Test Script ==="
 
@@ -109,6 +109,153 @@ else
     grep "Replication job failed" logs/nm.log | tail -5
 fi
 
+echo -e "\n${YELLOW}=== Delta replication checks ===${NC}"
+# Runs its own NM and primary/backup pair in a scratch directory, so it
+# does not depend on the servers checked above
+REPO_DIR="$(cd "$(dirname "$0")" && pwd)"
+DELTA_DIR="$(mktemp -d /tmp/repl_delta.XXXXXX)"
+DELTA_NM_PORT=5710
+DELTA_PRIMARY_PORT=6810
+DELTA_BACKUP_PORT=6811
+FAILED=0
+
+start_delta_servers() {
+    mkdir -p "$DELTA_DIR/nm"
+    (cd "$DELTA_DIR" && exec "$REPO_DIR/bin_nm" --port $DELTA_NM_PORT --state-dir "$DELTA_DIR/nm" > nm.log 2>&1) &
+    DELTA_NM_PID=$!
+    sleep 1
+    (cd "$DELTA_DIR" && exec "$REPO_DIR/bin_ss" --nm-port $DELTA_NM_PORT --client-port $DELTA_BACKUP_PORT \
+        --storage "$DELTA_DIR/backup" --username ss1_backup > backup.log 2>&1) &
+    DELTA_BACKUP_PID=$!
+    sleep 1
+    (cd "$DELTA_DIR" && exec "$REPO_DIR/bin_ss" --nm-port $DELTA_NM_PORT --client-port $DELTA_PRIMARY_PORT \
+        --storage "$DELTA_DIR/primary" --username ss1 > primary.log 2>&1) &
+    DELTA_PRIMARY_PID=$!
+    sleep 1
+}
+
+stop_delta_servers() {
+    kill $DELTA_PRIMARY_PID $DELTA_BACKUP_PID $DELTA_NM_PID 2>/dev/null
+    wait $DELTA_PRIMARY_PID $DELTA_BACKUP_PID $DELTA_NM_PID 2>/dev/null
+}
+
+delta_client() {
+    "$REPO_DIR/bin_client" --nm-port $DELTA_NM_PORT --username "${1:-alice}" > /dev/null
+}
+
+# Wait until the backup's copy of a file and its .meta match the primary's
+same_on_backup() {
+    for i in $(seq 1 50); do
+        if cmp -s "$DELTA_DIR/primary/files/$1" "$DELTA_DIR/backup/files/$1" &&
+           cmp -s "$DELTA_DIR/primary/metadata/$1.meta" "$DELTA_DIR/backup/metadata/$1.meta"; then
+            return 0
+        fi
+        sleep 0.2
+    done
+    return 1
+}
+
+replications() {
+    grep '"event":"ss_replicate_to_success"' "$DELTA_DIR/ss_ss1.log" | grep "file=$1 " | grep -c "mode=$2"
+}
+
+check() {
+    if [ "$1" -eq 0 ]; then
+        echo -e "${GREEN}✓ $2${NC}"
+    else
+        echo -e "${RED}✗ $2${NC}"
+        FAILED=1
+    fi
+}
+
+start_delta_servers
+echo "bob" | delta_client bob   # Registers bob for the ACL checks
+DELTA_FILE="delta_test.txt"
+# Large enough that a one-sentence delta is smaller than the file
+DELTA_TEXT=""
+for i in $(seq 1 40); do
+    DELTA_TEXT="$DELTA_TEXT Sentence number $i of the delta replication test file."
+done
+delta_client << EOF
+CREATE $DELTA_FILE
+WRITE $DELTA_FILE 0
+0$DELTA_TEXT
+ETIRW
+EXIT
+EOF
+same_on_backup $DELTA_FILE
+check $? "Initial copy replicated"
+
+echo -e "\n${YELLOW}Step 10: A one-sentence edit is replicated as a delta${NC}"
+BEFORE=$(replications $DELTA_FILE delta)
+delta_client << EOF
+WRITE $DELTA_FILE 1
+0 Changed
+ETIRW
+EXIT
+EOF
+same_on_backup $DELTA_FILE
+check $? "Backup file and .meta are byte-identical to the primary's"
+sleep 0.5
+[ "$(replications $DELTA_FILE delta)" -gt "$BEFORE" ]
+check $? "Edit was sent as a delta"
+
+echo -e "\n${YELLOW}Step 11: A backup that matches no delta base gets a full copy${NC}"
+# ACL changes only reach the primary, so the backup's .meta no longer
+# matches any base the next delta is built for
+delta_client << EOF
+ADDACCESS -R $DELTA_FILE bob
+WRITE $DELTA_FILE 2
+0 Again
+ETIRW
+EXIT
+EOF
+same_on_backup $DELTA_FILE
+check $? "Backup file and .meta (with bob's access) match the primary's"
+grep '"event":"ss_put_file_delta"' "$DELTA_DIR/ss_ss1_backup.log" | grep "file=$DELTA_FILE " | grep -q "result=CONFLICT"
+check $? "Backup answered the delta with CONFLICT"
+BEFORE=$(replications $DELTA_FILE full)
+delta_client << EOF
+REMACCESS $DELTA_FILE bob
+WRITE $DELTA_FILE 0
+0 Last
+ETIRW
+EXIT
+EOF
+same_on_backup $DELTA_FILE
+check $? "Removed access is gone from the backup's .meta too"
+sleep 0.5
+[ "$(replications $DELTA_FILE full)" -gt "$BEFORE" ]
+check $? "Fell back to a full copy"
+
+echo -e "\n${YELLOW}Step 12: UNDO after a spliced commit restores the previous bytes${NC}"
+cp "$DELTA_DIR/primary/files/$DELTA_FILE" "$DELTA_DIR/before_undo.txt"
+cp "$DELTA_DIR/primary/metadata/$DELTA_FILE.meta" "$DELTA_DIR/before_undo.meta"
+# Replacing one sentence with two goes through the byte-range splice
+delta_client << EOF
+WRITE $DELTA_FILE 5
+3 spliced. And a new sentence
+ETIRW
+EXIT
+EOF
+! cmp -s "$DELTA_DIR/primary/files/$DELTA_FILE" "$DELTA_DIR/before_undo.txt"
+check $? "Edit was committed"
+delta_client << EOF
+UNDO $DELTA_FILE
+EXIT
+EOF
+cmp -s "$DELTA_DIR/primary/files/$DELTA_FILE" "$DELTA_DIR/before_undo.txt"
+check $? "File is byte-identical to before the edit"
+cmp -s "$DELTA_DIR/primary/metadata/$DELTA_FILE.meta" "$DELTA_DIR/before_undo.meta"
+check $? ".meta is byte-identical to before the edit"
+
+stop_delta_servers
+if [ "$FAILED" -ne 0 ]; then
+    echo -e "${RED}Delta replication checks failed; logs in $DELTA_DIR${NC}"
+    exit 1
+fi
+rm -rf "$DELTA_DIR"
+
 echo -e "\n${YELLOW}=== Test Summary ===${NC}"
 echo "Total replication jobs processed:"
 grep -c "Processing replication job" logs/nm.log 2>/dev/null || echo "0"